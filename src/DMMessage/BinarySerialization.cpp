@@ -0,0 +1,155 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include "BinarySerialization.h"
+#include "SerializationHelper.h"
+#include "Blob.h"
+#include "CurrentVersion.h"
+
+using namespace Microsoft::Devices::Management::Message;
+using namespace Platform;
+
+static constexpr size_t FieldHeaderSize = sizeof(uint16_t) + sizeof(uint8_t) + sizeof(uint32_t);
+
+size_t BinaryWriter::WriteHeader(uint16_t id, BinaryFieldType type, uint32_t size)
+{
+    size_t start = _buffer.size();
+    _buffer.resize(start + FieldHeaderSize);
+
+    uint8_t* header = _buffer.data() + start;
+    memcpy(header, &id, sizeof(id));
+    header[sizeof(id)] = static_cast<uint8_t>(type);
+    memcpy(header + sizeof(id) + sizeof(uint8_t), &size, sizeof(size));
+    return start;
+}
+
+void BinaryWriter::WriteUInt32(uint16_t id, uint32_t value)
+{
+    WriteHeader(id, BinaryFieldType::UInt32, sizeof(value));
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    _buffer.insert(_buffer.end(), bytes, bytes + sizeof(value));
+}
+
+void BinaryWriter::WriteString(uint16_t id, String^ value)
+{
+    int wideLength = value == nullptr ? 0 : static_cast<int>(value->Length());
+    int utf8Length = wideLength == 0 ? 0 : WideCharToMultiByte(CP_UTF8, 0, value->Data(), wideLength, nullptr, 0, nullptr, nullptr);
+    if (wideLength != 0 && utf8Length == 0)
+    {
+        throw ref new Exception(HRESULT_FROM_WIN32(GetLastError()), "WideCharToMultiByte() failed to encode field.");
+    }
+
+    WriteHeader(id, BinaryFieldType::String, utf8Length);
+    if (utf8Length != 0)
+    {
+        size_t start = _buffer.size();
+        _buffer.resize(start + utf8Length);
+        WideCharToMultiByte(CP_UTF8, 0, value->Data(), wideLength, reinterpret_cast<char*>(_buffer.data() + start), utf8Length, nullptr, nullptr);
+    }
+}
+
+size_t BinaryWriter::BeginObject(uint16_t id)
+{
+    // The length is patched in by EndObject.
+    return WriteHeader(id, BinaryFieldType::Object, 0);
+}
+
+void BinaryWriter::EndObject(size_t start)
+{
+    uint32_t size = static_cast<uint32_t>(_buffer.size() - start - FieldHeaderSize);
+    memcpy(_buffer.data() + start + sizeof(uint16_t) + sizeof(uint8_t), &size, sizeof(size));
+}
+
+Blob^ BinaryWriter::ToBlob(uint32_t tag) const
+{
+    return SerializationHelper::CreateBlobFromPtrSize(tag, _buffer.data(), _buffer.size(), BlobPayloadBinary);
+}
+
+BinaryReader BinaryReader::FromBlob(Blob^ blob)
+{
+    size_t size = 0;
+    const uint8_t* data = SerializationHelper::GetPayload(blob, &size);
+    return BinaryReader(data, size);
+}
+
+bool BinaryReader::Next(BinaryField& field)
+{
+    if (_data == _end)
+    {
+        return false;
+    }
+    if (static_cast<size_t>(_end - _data) < FieldHeaderSize)
+    {
+        throw ref new Exception(E_INVALIDARG, "Binary payload is truncated.");
+    }
+
+    memcpy(&field.id, _data, sizeof(field.id));
+    field.type = static_cast<BinaryFieldType>(_data[sizeof(field.id)]);
+    memcpy(&field.size, _data + sizeof(field.id) + sizeof(uint8_t), sizeof(field.size));
+    _data += FieldHeaderSize;
+
+    if (static_cast<size_t>(_end - _data) < field.size)
+    {
+        throw ref new Exception(E_INVALIDARG, "Binary payload field overruns the payload.");
+    }
+
+    field.data = _data;
+    _data += field.size;
+    return true;
+}
+
+uint32_t BinaryReader::ToUInt32(const BinaryField& field)
+{
+    if (field.type != BinaryFieldType::UInt32 || field.size != sizeof(uint32_t))
+    {
+        throw ref new Exception(E_INVALIDARG, "Binary payload field is not a UInt32.");
+    }
+
+    uint32_t value;
+    memcpy(&value, field.data, sizeof(value));
+    return value;
+}
+
+String^ BinaryReader::ToString(const BinaryField& field)
+{
+    if (field.type != BinaryFieldType::String)
+    {
+        throw ref new Exception(E_INVALIDARG, "Binary payload field is not a String.");
+    }
+    if (field.size == 0)
+    {
+        return ref new String();
+    }
+
+    const char* utf8 = reinterpret_cast<const char*>(field.data);
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, utf8, field.size, nullptr, 0);
+    if (wideLength == 0)
+    {
+        throw ref new Exception(HRESULT_FROM_WIN32(GetLastError()), "MultiByteToWideChar() failed to decode field.");
+    }
+
+    std::vector<wchar_t> buffer(wideLength);
+    MultiByteToWideChar(CP_UTF8, 0, utf8, field.size, buffer.data(), wideLength);
+    return ref new String(buffer.data(), wideLength);
+}
+
+BinaryReader BinaryReader::ToObject(const BinaryField& field)
+{
+    if (field.type != BinaryFieldType::Object)
+    {
+        throw ref new Exception(E_INVALIDARG, "Binary payload field is not an Object.");
+    }
+    return BinaryReader(field.data, field.size);
+}
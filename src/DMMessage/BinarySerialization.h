@@ -0,0 +1,85 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+using namespace Platform;
+
+namespace Microsoft { namespace Devices { namespace Management { namespace Message
+{
+    ref class Blob;
+
+    //
+    // Compact tag-length-value payload encoding, used instead of JSON when the peer advertises
+    // BlobAcceptsBinary. Each field is a 16-bit field id, an 8-bit type and a 32-bit length,
+    // followed by the value. Strings are UTF-8, objects are a nested field list, and lists are
+    // repeated fields with the same id. Readers skip ids they do not know, so fields can be
+    // added to a model without breaking older peers.
+    //
+    enum class BinaryFieldType : uint8_t
+    {
+        UInt32 = 1,
+        String = 2,
+        Object = 3,
+    };
+
+    struct BinaryField
+    {
+        uint16_t id;
+        BinaryFieldType type;
+        const uint8_t* data;
+        uint32_t size;
+    };
+
+    class BinaryWriter
+    {
+    public:
+        void WriteUInt32(uint16_t id, uint32_t value);
+        void WriteString(uint16_t id, String^ value);
+
+        // Returns the offset to hand to EndObject once the nested fields are written.
+        size_t BeginObject(uint16_t id);
+        void EndObject(size_t start);
+
+        Blob^ ToBlob(uint32_t tag) const;
+
+    private:
+        size_t WriteHeader(uint16_t id, BinaryFieldType type, uint32_t size);
+
+        std::vector<uint8_t> _buffer;
+    };
+
+    class BinaryReader
+    {
+    public:
+        BinaryReader(const uint8_t* data, size_t size) : _data(data), _end(data + size) {}
+
+        static BinaryReader FromBlob(Blob^ blob);
+
+        // Returns false at the end of the field list; throws if the encoding is malformed.
+        bool Next(BinaryField& field);
+
+        static uint32_t ToUInt32(const BinaryField& field);
+        static String^ ToString(const BinaryField& field);
+        static BinaryReader ToObject(const BinaryField& field);
+
+    private:
+        const uint8_t* _data;
+        const uint8_t* _end;
+    };
+
+}}}}
@@ -18,6 +18,8 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Blob.h"
 #include "DMMessageSerialization.h"
 #include "../SharedUtilities/Logger.h"
+#include "../SharedUtilities/BufferPool.h"
+#include "../SharedUtilities/MessageFraming.h"
 
 using namespace Platform;
 using namespace concurrency;
@@ -33,19 +35,18 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
     {
         auto tag = this->Tag;
 
-        DMMessageDeserializer helper;
-        auto serialization = helper.Deserializer.find(tag);
-        if (serialization == helper.Deserializer.end())
+        auto serialization = DMMessageDeserializer::Find(tag);
+        if (serialization == nullptr)
         {
             throw ref new Platform::Exception(S_OK, "Unknown type, deserialization failed");
         }
 
         if (messageType == MessageType::Request) {
-            return (*serialization->second.first)(this);
+            return (*serialization->request)(this);
         }
         else
         {
-            return (*serialization->second.second)(this);
+            return (*serialization->response)(this);
         }
     }
 
@@ -59,33 +60,103 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         return ref new Blob(bytes);
     }
 
-    Blob^ Blob::ReadFromNativeHandle(uint64_t handle)
+    Blob^ Blob::CreateView(const uint8_t* data, uint32_t size, std::shared_ptr<const void> owner)
     {
-        TRACE(__FUNCTION__);
+        if (size < PrefixSize)
+        {
+            throw ref new Exception(E_INVALIDARG, "Blob is too short.");
+        }
+        return ref new Blob(data, size, owner);
+    }
 
-        HANDLE pipeHandle = (HANDLE)handle;
-        DWORD readByteCount = 0;
-        uint32_t totalSizInBytes = 0;
-        if (!ReadFile(pipeHandle, &totalSizInBytes, sizeof(uint32_t), &readByteCount, NULL))
+    Array<uint8_t>^ Blob::GetByteArrayForSerialization()
+    {
+        if (this->bytes == nullptr)
         {
-            throw ref new Exception(GetLastError(), "ReadFile() failed to read payload size from pipe.");
+            auto copy = ref new Array<uint8_t>(const_cast<uint8_t*>(this->data), this->size);
+            SerializationHelper::RecordCopy(this->size, 1);
+            this->bytes = copy;
+            this->data = copy->Data;
+            this->owner = nullptr;
         }
+        return (Array<uint8_t>^)this->bytes;
+    }
+
+    IRequest^ Blob::ParseRequest(const Array<uint8_t>^ bytes)
+    {
+        auto blob = CreateView(bytes->Data, bytes->Length, nullptr);
+        blob->ValidateVersion();
+        return blob->MakeIRequest();
+    }
 
-        if (readByteCount != sizeof(uint32_t))
+    IResponse^ Blob::ParseResponse(const Array<uint8_t>^ bytes)
+    {
+        auto blob = CreateView(bytes->Data, bytes->Length, nullptr);
+        blob->ValidateVersion();
+        return blob->MakeIResponse();
+    }
+
+#ifdef DMMESSAGE_COPY_STATISTICS
+    uint64_t BlobStatistics::AllocationCount::get()
+    {
+        return SerializationHelper::AllocationCount();
+    }
+
+    uint64_t BlobStatistics::BytesCopied::get()
+    {
+        return SerializationHelper::BytesCopied();
+    }
+
+    void BlobStatistics::Reset()
+    {
+        SerializationHelper::ResetStatistics();
+    }
+#endif
+
+    // Receive buffers are recycled across messages; a Blob read from a pipe
+    // or stream is a view that returns its buffer when it is released.
+    static std::shared_ptr<Utils::BufferPool> ReceivePool()
+    {
+        static auto pool = Utils::BufferPool::Create();
+        return pool;
+    }
+
+    static void ReadExactFromHandle(HANDLE pipeHandle, uint8_t* buffer, uint32_t size)
+    {
+        uint32_t done = 0;
+        while (done < size)
         {
-            throw ref new Exception(E_FAIL, "Payload size could not be read.");
+            DWORD readByteCount = 0;
+            if (!ReadFile(pipeHandle, buffer + done, size - done, &readByteCount, NULL))
+            {
+                throw ref new Exception(GetLastError(), "ReadFile() failed to read from pipe.");
+            }
+            if (readByteCount == 0)
+            {
+                throw ref new Exception(E_FAIL, "Pipe closed in the middle of a message.");
+            }
+            done += readByteCount;
         }
+    }
 
-        auto bytes = ref new Array<uint8_t>(totalSizInBytes);
+    Blob^ Blob::ReadFromNativeHandle(uint64_t handle)
+    {
+        TRACE(__FUNCTION__);
 
-        if (!ReadFile(pipeHandle, bytes->Data, totalSizInBytes, &readByteCount, NULL))
+        // Each call reads exactly one frame; reading ahead would strand the
+        // next message's bytes in a buffer that does not outlive this call.
+        HANDLE pipeHandle = (HANDLE)handle;
+        uint32_t totalSizInBytes = 0;
+        ReadExactFromHandle(pipeHandle, reinterpret_cast<uint8_t*>(&totalSizInBytes), sizeof(uint32_t));
+        if (totalSizInBytes > Utils::MessageFraming::MaxFrameSize)
         {
-            throw ref new Exception(GetLastError(), "ReadFile() failed to read payload from pipe");
+            throw ref new Exception(E_FAIL, "Payload size is out of range.");
         }
 
-        FlushFileBuffers(pipeHandle);
+        auto buffer = ReceivePool()->Acquire(totalSizInBytes);
+        ReadExactFromHandle(pipeHandle, buffer->data, totalSizInBytes);
 
-        return CreateFromByteArray(bytes);
+        return CreateView(buffer->data, totalSizInBytes, buffer);
     }
 
     void ValidateDataSize(uint32_t minexpected, uint32_t actual)
@@ -109,9 +180,10 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
                 memcpy_s(&dataSize, sizeof(uint32_t), dataSizeArry->Data, sizeof(uint32_t));
                 return create_task(reader->LoadAsync(dataSize)).then([=](uint32_t bytesLoaded) {
                     ValidateDataSize(dataSize, bytesLoaded);
-                    Array<byte>^ data = ref new Array<byte>(dataSize);
-                    reader->ReadBytes(data);
-                    auto blob = Blob::CreateFromByteArray(data);
+                    auto buffer = ReceivePool()->Acquire(dataSize);
+                    reader->ReadBytes(ArrayReference<uint8_t>(buffer->data, dataSize));
+                    SerializationHelper::RecordCopy(dataSize, 0);
+                    auto blob = Blob::CreateView(buffer->data, dataSize, buffer);
                     blob->ValidateVersion();
                     return blob;
                 });
@@ -125,21 +197,45 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
 
         HANDLE pipeHandle = (HANDLE)handle;
 
-        DWORD byteWrittenCount = 0;
-        uint32_t totalSizInBytes = this->bytes->Length;
-
-        if (!WriteFile(pipeHandle, &totalSizInBytes, sizeof(uint32_t), &byteWrittenCount, NULL) || byteWrittenCount != sizeof(uint32_t))
+        // Pipes have no gathered write, so the size and payload are coalesced
+        // into one pooled buffer and sent with a single WriteFile().
+        auto pool = ReceivePool();
+        Utils::MessageFraming framing(nullptr, [pipeHandle, pool](const Utils::MessageFraming::Chunk* chunks, size_t count)
         {
-            throw ref new Exception(GetLastError(), "WriteFile() failed to write payload size to pipe.");
-        }
+            size_t total = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                total += chunks[i].size;
+            }
+
+            auto buffer = pool->Acquire(total);
+            uint8_t* next = buffer->data;
+            for (size_t i = 0; i < count; ++i)
+            {
+                memcpy(next, chunks[i].data, chunks[i].size);
+                next += chunks[i].size;
+            }
+
+            DWORD byteWrittenCount = 0;
+            if (!WriteFile(pipeHandle, buffer->data, static_cast<DWORD>(total), &byteWrittenCount, NULL) || byteWrittenCount != total)
+            {
+                throw ref new Exception(GetLastError(), "WriteFile() failed to write payload to pipe.");
+            }
+        }, pool);
+
+        framing.WriteFrame(this->data, this->size);
+    }
 
-        byteWrittenCount = 0;
-        if (!WriteFile(pipeHandle, this->bytes->Data, totalSizInBytes, &byteWrittenCount, NULL))
+    void Blob::FlushNativeHandle(uint64_t handle)
+    {
+        TRACE(__FUNCTION__);
+
+        // Blocks until the reader has drained the pipe; callers that need
+        // that guarantee ask for it explicitly instead of paying on every write.
+        if (!FlushFileBuffers((HANDLE)handle))
         {
-            throw ref new Exception(GetLastError(), "WriteFile() failed to write payload to pipe.");
+            throw ref new Exception(GetLastError(), "FlushFileBuffers() failed.");
         }
-
-        FlushFileBuffers(pipeHandle);
     }
 
     IAsyncAction^ Blob::WriteToIOutputStreamAsync(IOutputStream^ iostream)
@@ -149,14 +245,13 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         DataWriter^ writer = ref new DataWriter(iostream);
         return create_async([=]() {
             auto dataSizeArry = ref new Array<byte>(sizeof(uint32_t));
-            uint32 size = this->bytes->Length;
+            uint32 size = this->size;
             memcpy_s(dataSizeArry->Data, sizeof(uint32_t), &size, sizeof(uint32_t));
+            // Size and payload go out in a single store.
             writer->WriteBytes(dataSizeArry);
+            writer->WriteBytes(this->GetByteArrayForSerialization());
             return create_task(writer->StoreAsync()).then([=](auto) {
-                writer->WriteBytes(this->bytes);
-                return create_task(writer->StoreAsync()).then([=](auto) {
-                    writer->FlushAsync();
-                });
+                writer->FlushAsync();
             });
         });
     }
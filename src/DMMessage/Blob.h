@@ -16,8 +16,10 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdint.h>
 #include <assert.h>
+#include <memory>
 #include "IRequestIResponse.h"
 #include "CurrentVersion.h"
+#include "SerializationHelper.h"
 
 using namespace Platform;
 using namespace Platform::Metadata;
@@ -34,21 +36,42 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
     };
 
     //
-    // Blob is a thin wrapper around a byte array with an 8-byte prefix (version + kind)
+    // Blob is a thin wrapper around a byte array with an 8-byte prefix (version + kind).
+    // It either owns that array or is a view over a received buffer it does not own.
     //
     public ref class Blob sealed {
+        // Owned storage; nullptr while the blob is a view.
         const Array<uint8_t>^ bytes;
-        Blob(const Array<uint8_t>^ bytes) : bytes(bytes)
+        // Keeps a pooled buffer alive for as long as a view uses it.
+        std::shared_ptr<const void> owner;
+        const uint8_t* data;
+        uint32_t size;
+
+        Blob(const Array<uint8_t>^ bytes) : bytes(bytes), data(bytes->Data), size(bytes->Length)
         {
             assert(bytes->Length >= 8);
         }
 
+        Blob(const uint8_t* data, uint32_t size, std::shared_ptr<const void> owner) : bytes(nullptr), owner(owner), data(data), size(size)
+        {
+            assert(size >= 8);
+        }
+
         friend class SerializationHelper;
         // The prefix has to 32-bit integers: the version and the command
         static constexpr int      PrefixSize = 2 * sizeof(uint32_t);
 
         IDataPayload^ MakeMessage(MessageType);
 
+        property uint32_t VersionWord
+        {
+            uint32_t get()
+            {
+                // Return the first uint32:
+                return *(reinterpret_cast<const uint32_t*>(data));
+            }
+        }
+
     public:
 
         // Only used for testing, clients should not use
@@ -61,6 +84,7 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         static IAsyncOperation<Blob^>^ ReadFromIInputStreamAsync(IInputStream^ iistream);
 
         void WriteToNativeHandle(uint64_t handle);
+        static void FlushNativeHandle(uint64_t handle);
         IAsyncAction^ WriteToIOutputStreamAsync(IOutputStream^ iostream);
 
         // Parsing
@@ -74,14 +98,41 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
             {
                 throw ref new Exception(E_FAIL, "Version mispatch. Check your installation");
             }
+            if ((this->VersionWord & ~BlobVersionMask & ~BlobKnownFlags) != 0)
+            {
+                throw ref new Exception(E_FAIL, "Unknown payload encoding. Check your installation");
+            }
         }
 
         property uint32_t Version
         {
             uint32_t get()
             {
-                // Return the first uint32:
-                return *(reinterpret_cast<uint32_t*>(bytes->Data));
+                return this->VersionWord & BlobVersionMask;
+            }
+        }
+
+        property bool IsUtf8Payload
+        {
+            bool get()
+            {
+                return (this->VersionWord & BlobPayloadUtf8) != 0;
+            }
+        }
+
+        property bool IsBinaryPayload
+        {
+            bool get()
+            {
+                return (this->VersionWord & BlobPayloadBinary) != 0;
+            }
+        }
+
+        property bool AcceptsBinaryPayload
+        {
+            bool get()
+            {
+                return (this->VersionWord & BlobAcceptsBinary) != 0;
             }
         }
 
@@ -92,10 +143,35 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
             DMMessageKind get()
             {
                 // Return the second uint32:
-                return static_cast<DMMessageKind>(*(reinterpret_cast<uint32_t*>(bytes->Data) + 1));
+                return static_cast<DMMessageKind>(*(reinterpret_cast<const uint32_t*>(data) + 1));
             }
         }
 
-        Array<uint8_t>^ GetByteArrayForSerialization() { return (Array<uint8_t>^)this->bytes; }
+        // Views are copied into an owned array the first time this is called.
+        Array<uint8_t>^ GetByteArrayForSerialization();
+
+        // Parse straight from a caller's buffer. The buffer is not copied or retained.
+        static IRequest^ ParseRequest(const Array<uint8_t>^ bytes);
+        static IResponse^ ParseResponse(const Array<uint8_t>^ bytes);
+
+    internal:
+        // Wraps a received buffer without copying it. Without an owner the caller must keep the
+        // buffer alive for as long as the blob is used; pooled buffers pass their lease as owner.
+        static Blob^ CreateView(const uint8_t* data, uint32_t size, std::shared_ptr<const void> owner);
+
+        const uint8_t* PayloadData() { return data + PrefixSize; }
+        uint32_t PayloadSize() { return size - PrefixSize; }
+    };
+
+#ifdef DMMESSAGE_COPY_STATISTICS
+    // Debug builds only, for tests: buffers allocated and bytes copied by
+    // blob storage and payload decoding, across all blobs.
+    public ref class BlobStatistics sealed
+    {
+    public:
+        static property uint64_t AllocationCount { uint64_t get(); }
+        static property uint64_t BytesCopied { uint64_t get(); }
+        static void Reset();
     };
+#endif
 }}}}
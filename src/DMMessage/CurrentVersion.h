@@ -19,4 +19,18 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 namespace Microsoft { namespace Devices { namespace Management { namespace Message
 {
     static constexpr uint32_t CurrentVersion = 1;
+
+    // The first word of the Blob prefix carries the version in its low 16 bits and payload
+    // flags in the high 16 bits. Version 1 peers that predate the flags only ever write zero
+    // there, so their blobs are read as UTF-16 as before.
+    static constexpr uint32_t BlobVersionMask = 0x0000FFFF;
+    static constexpr uint32_t BlobPayloadUtf8 = 0x00010000;
+
+    // The payload uses the tag-length-value encoding in BinarySerialization.h instead of JSON.
+    static constexpr uint32_t BlobPayloadBinary = 0x00020000;
+
+    // The writer can read binary payloads, so a response to this blob may use them.
+    static constexpr uint32_t BlobAcceptsBinary = 0x00040000;
+
+    static constexpr uint32_t BlobKnownFlags = BlobPayloadUtf8 | BlobPayloadBinary | BlobAcceptsBinary;
 }}}}
@@ -14,6 +14,8 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #pragma once
 
+#include <array>
+#include <utility>
 #include "DMMessageKind.h"
 #include "Models\AllModels.h"
 
@@ -24,16 +26,54 @@ using namespace Microsoft::Devices::Management::Message;
 
 namespace Microsoft { namespace Devices { namespace Management { namespace Message
 {
+    constexpr uint32_t MaxTagOf(uint32_t tag)
+    {
+        return tag;
+    }
+
+    template<typename... Rest>
+    constexpr uint32_t MaxTagOf(uint32_t first, uint32_t second, Rest... rest)
+    {
+        return MaxTagOf(first > second ? first : second, rest...);
+    }
+
+    //
+    // The deserializer registry is a dense table indexed by tag value. It is generated from
+    // ModelsInfo.dat at compile time, so looking up a message kind is a bounds check and an
+    // array load, and nothing is built or allocated per parsed message.
+    //
     private class DMMessageDeserializer
     {
     public:
-        typedef IDataPayload^ (DMRequestDeserialize)(Blob^ bytes);
-        typedef IDataPayload^ (DMResponseDeserialize)(Blob^ bytes);
-        typedef std::pair<DMRequestDeserialize*, DMResponseDeserialize*> DMSerializationPair;
-        typedef std::map<DMMessageKind, DMSerializationPair> DMDeserializer;
+        typedef IDataPayload^ (DMDeserialize)(Blob^ bytes);
+
+        struct DMSerializationPair
+        {
+            DMDeserialize* request;
+            DMDeserialize* response;
+        };
+
+        // Returns nullptr if the tag does not name a known model.
+        static const DMSerializationPair* Find(DMMessageKind tag);
 
-        DMDeserializer Deserializer = {
-#define MODEL_NODEF(A, B, C, D) { DMMessageKind::##A, { (DMRequestDeserialize*)##C##::Deserialize, (DMResponseDeserialize*)##D##::Deserialize } },
+    private:
+        // Adapts each model's Deserialize (some return the concrete type) to the common signature.
+        template<class T>
+        static IDataPayload^ DeserializeAs(Blob^ bytes)
+        {
+            return T::Deserialize(bytes);
+        }
+
+        // Tag values without a model map to an empty entry.
+        template<uint32_t Tag>
+        struct Model
+        {
+            static constexpr DMDeserialize* Request = nullptr;
+            static constexpr DMDeserialize* Response = nullptr;
+        };
+
+        static constexpr uint32_t MaxTag = MaxTagOf(0
+#define MODEL_NODEF(A, B, C, D) , static_cast<uint32_t>(DMMessageKind::A)
 #define MODEL_REQDEF(A, B, C, D) MODEL_NODEF(A, B, C, D)
 #define MODEL_ALLDEF(A, B, C, D) MODEL_NODEF(A, B, C, D)
 #define MODEL_TAGONLY(A, B, C, D) MODEL_NODEF(A, B, C, D)
@@ -42,6 +82,44 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
 #undef MODEL_REQDEF
 #undef MODEL_ALLDEF
 #undef MODEL_TAGONLY
-        };
+            );
+
+        // Tags are small and clustered; a sparse numbering would need a different lookup.
+        static_assert(MaxTag < 1024, "DMMessageKind values are too sparse for a dense dispatch table");
+
+        template<size_t... Index>
+        static constexpr std::array<DMSerializationPair, sizeof...(Index)> MakeTable(std::index_sequence<Index...>)
+        {
+            return {{ { Model<Index>::Request, Model<Index>::Response }... }};
+        }
     };
+
+    // A tag listed twice in ModelsInfo.dat fails here as a redefinition.
+#define MODEL_NODEF(A, B, C, D) \
+    template<> struct DMMessageDeserializer::Model<static_cast<uint32_t>(DMMessageKind::A)> \
+    { \
+        static constexpr DMMessageDeserializer::DMDeserialize* Request = &DMMessageDeserializer::DeserializeAs<C>; \
+        static constexpr DMMessageDeserializer::DMDeserialize* Response = &DMMessageDeserializer::DeserializeAs<D>; \
+    };
+#define MODEL_REQDEF(A, B, C, D) MODEL_NODEF(A, B, C, D)
+#define MODEL_ALLDEF(A, B, C, D) MODEL_NODEF(A, B, C, D)
+#define MODEL_TAGONLY(A, B, C, D) MODEL_NODEF(A, B, C, D)
+#include "Models\ModelsInfo.dat"
+#undef MODEL_NODEF
+#undef MODEL_REQDEF
+#undef MODEL_ALLDEF
+#undef MODEL_TAGONLY
+
+    // Defined after the specializations above so the table sees every model.
+    inline const DMMessageDeserializer::DMSerializationPair* DMMessageDeserializer::Find(DMMessageKind tag)
+    {
+        static constexpr auto table = MakeTable(std::make_index_sequence<MaxTag + 1>());
+
+        uint32_t index = static_cast<uint32_t>(tag);
+        if (index > MaxTag || table[index].request == nullptr)
+        {
+            return nullptr;
+        }
+        return &table[index];
+    }
 }}}}
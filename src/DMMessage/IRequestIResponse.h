@@ -39,4 +39,11 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         property ResponseStatus Status { ResponseStatus get(); }
     };
 
+    // Implemented by models that also have a compact binary encoding (see BinarySerialization.h).
+    // Use it only when the peer's blob says AcceptsBinaryPayload.
+    public interface class IBinaryDataPayload
+    {
+        Blob^ SerializeBinary();
+    };
+
 }}}}
@@ -18,11 +18,24 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DMMessageKind.h"
 #include "StatusCodeResponse.h"
 #include "Blob.h"
+#include "BinarySerialization.h"
 
 using namespace Platform;
 using namespace Platform::Metadata;
 using namespace Windows::Data::Json;
 
+//
+// GetCertificateDetailsResponse schema: binary field id, JSON name and property. Both encodings
+// are generated from this list. Ids are the binary wire identity; never reuse or renumber one.
+//
+#define CERTIFICATEDETAILS_FIELDS(FIELD) \
+    FIELD(1, "Base64Encoding", base64Encoding) \
+    FIELD(2, "TemplateName", templateName) \
+    FIELD(3, "IssuedBy", issuedBy) \
+    FIELD(4, "IssuedTo", issuedTo) \
+    FIELD(5, "ValidFrom", validFrom) \
+    FIELD(6, "ValidTo", validTo)
+
 namespace Microsoft { namespace Devices { namespace Management { namespace Message
 {
     public ref class GetCertificateDetailsRequest sealed : public IRequest
@@ -59,7 +72,7 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         }
     };
 
-    public ref class GetCertificateDetailsResponse sealed : public IResponse
+    public ref class GetCertificateDetailsResponse sealed : public IResponse, public IBinaryDataPayload
     {
         StatusCodeResponse statusCodeResponse;
     public:
@@ -75,28 +88,47 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         virtual Blob^ Serialize() {
 
             JsonObject^ jsonObject = ref new JsonObject();
-            jsonObject->Insert("Base64Encoding", JsonValue::CreateStringValue(base64Encoding));
-            jsonObject->Insert("TemplateName", JsonValue::CreateStringValue(templateName));
-            jsonObject->Insert("IssuedBy", JsonValue::CreateStringValue(issuedBy));
-            jsonObject->Insert("IssuedTo", JsonValue::CreateStringValue(issuedTo));
-            jsonObject->Insert("ValidFrom", JsonValue::CreateStringValue(validFrom));
-            jsonObject->Insert("ValidTo", JsonValue::CreateStringValue(validTo));
+#define FIELD(id, jsonName, propName) jsonObject->Insert(jsonName, JsonValue::CreateStringValue(propName));
+            CERTIFICATEDETAILS_FIELDS(FIELD)
+#undef FIELD
 
             return SerializationHelper::CreateBlobFromJson((uint32_t)Tag, jsonObject);
         }
 
+        virtual Blob^ SerializeBinary() {
+            BinaryWriter writer;
+#define FIELD(id, jsonName, propName) writer.WriteString(id, propName);
+            CERTIFICATEDETAILS_FIELDS(FIELD)
+#undef FIELD
+            return writer.ToBlob((uint32_t)Tag);
+        }
+
         static IDataPayload^ Deserialize(Blob^ blob) {
 
+            auto getCertificateDetailsResponse = ref new GetCertificateDetailsResponse(ResponseStatus::Success);
+
+            if (blob->IsBinaryPayload)
+            {
+                auto reader = BinaryReader::FromBlob(blob);
+                BinaryField field;
+                while (reader.Next(field))
+                {
+                    switch (field.id)
+                    {
+#define FIELD(id, jsonName, propName) case id: getCertificateDetailsResponse->propName = BinaryReader::ToString(field); break;
+                    CERTIFICATEDETAILS_FIELDS(FIELD)
+#undef FIELD
+                    }
+                }
+                return getCertificateDetailsResponse;
+            }
+
             String^ str = SerializationHelper::GetStringFromBlob(blob);
 
             JsonObject^ jsonObject = JsonObject::Parse(str);
-            auto getCertificateDetailsResponse = ref new GetCertificateDetailsResponse(ResponseStatus::Success);
-            getCertificateDetailsResponse->base64Encoding = jsonObject->Lookup("Base64Encoding")->GetString();
-            getCertificateDetailsResponse->templateName = jsonObject->Lookup("TemplateName")->GetString();
-            getCertificateDetailsResponse->issuedBy = jsonObject->Lookup("IssuedBy")->GetString();
-            getCertificateDetailsResponse->issuedTo = jsonObject->Lookup("IssuedTo")->GetString();
-            getCertificateDetailsResponse->validFrom = jsonObject->Lookup("ValidFrom")->GetString();
-            getCertificateDetailsResponse->validTo = jsonObject->Lookup("ValidTo")->GetString();
+#define FIELD(id, jsonName, propName) getCertificateDetailsResponse->propName = jsonObject->Lookup(jsonName)->GetString();
+            CERTIFICATEDETAILS_FIELDS(FIELD)
+#undef FIELD
 
             return getCertificateDetailsResponse;
         }
@@ -18,6 +18,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DMMessageKind.h"
 #include "StatusCodeResponse.h"
 #include "Blob.h"
+#include "BinarySerialization.h"
 
 #include <collection.h>
 
@@ -30,6 +31,28 @@ using namespace Windows::Foundation::Collections;
 #define INSERT_STRING_PROPERTY_INTO_JSON(json, info, propName) json->Insert(#propName, JsonValue::CreateStringValue(info->##propName))
 #define SET_STRING_PROPERTY_FROM_JSON(json, info, propName) info->##propName = json->GetNamedString(#propName)
 
+//
+// AppInfo schema: binary field id and property name. Both the JSON and the binary encodings
+// are generated from this list. Ids are the binary wire identity; never reuse or renumber one.
+//
+#define APPINFO_STRING_FIELDS(FIELD) \
+    FIELD(1, AppSource) \
+    FIELD(2, Architecture) \
+    FIELD(3, InstallDate) \
+    FIELD(4, InstallLocation) \
+    FIELD(5, IsBundle) \
+    FIELD(6, IsFramework) \
+    FIELD(7, IsProvisioned) \
+    FIELD(8, Name) \
+    FIELD(9, PackageFamilyName) \
+    FIELD(10, PackageStatus) \
+    FIELD(11, Publisher) \
+    FIELD(12, RequiresReinstall) \
+    FIELD(13, ResourceID) \
+    FIELD(14, Users) \
+    FIELD(15, Version)
+#define APPINFO_STARTUP_FIELD 16
+
 namespace Microsoft { namespace Devices { namespace Management { namespace Message
 {
     public ref class AppInfo sealed
@@ -40,21 +63,9 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
     internal:
         AppInfo(JsonObject^ jsonApp)
         {
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, AppSource);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, Architecture);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, InstallDate);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, InstallLocation);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, IsBundle);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, IsFramework);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, IsProvisioned);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, Name);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, PackageFamilyName);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, PackageStatus);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, Publisher);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, RequiresReinstall);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, ResourceID);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, Users);
-            SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, Version);
+#define FIELD(id, propName) SET_STRING_PROPERTY_FROM_JSON(jsonApp, this, propName);
+            APPINFO_STRING_FIELDS(FIELD)
+#undef FIELD
 
             // Macros cannot be used with the casting easily.
             StartUp = static_cast<StartUpType>(static_cast<int>(jsonApp->Lookup("StartUp")->GetNumber()));
@@ -62,21 +73,9 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         JsonObject^ ToJson()
         {
             auto jsonApp = ref new JsonObject();
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, AppSource);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, Architecture);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, InstallDate);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, InstallLocation);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, IsBundle);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, IsFramework);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, IsProvisioned);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, Name);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, PackageFamilyName);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, PackageStatus);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, Publisher);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, RequiresReinstall);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, ResourceID);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, Users);
-            INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, Version);
+#define FIELD(id, propName) INSERT_STRING_PROPERTY_INTO_JSON(jsonApp, this, propName);
+            APPINFO_STRING_FIELDS(FIELD)
+#undef FIELD
 
             // Macros cannot be used with the casting easily.
             jsonApp->Insert("StartUp", JsonValue::CreateNumberValue(static_cast<int>(StartUp)));
@@ -84,6 +83,30 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
             return jsonApp;
         }
 
+        AppInfo(BinaryReader reader)
+        {
+            BinaryField field;
+            while (reader.Next(field))
+            {
+                switch (field.id)
+                {
+#define FIELD(id, propName) case id: propName = BinaryReader::ToString(field); break;
+                APPINFO_STRING_FIELDS(FIELD)
+#undef FIELD
+                case APPINFO_STARTUP_FIELD:
+                    StartUp = static_cast<StartUpType>(BinaryReader::ToUInt32(field));
+                    break;
+                }
+            }
+        }
+        void ToBinary(BinaryWriter& writer)
+        {
+#define FIELD(id, propName) writer.WriteString(id, propName);
+            APPINFO_STRING_FIELDS(FIELD)
+#undef FIELD
+            writer.WriteUInt32(APPINFO_STARTUP_FIELD, static_cast<uint32_t>(StartUp));
+        }
+
     public:
         property String^ AppSource;
         property String^ Architecture;
@@ -103,9 +126,13 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         property StartUpType StartUp;
     };
 
-    public ref class ListAppsResponse sealed : public IResponse
+    public ref class ListAppsResponse sealed : public IResponse, public IBinaryDataPayload
     {
     private:
+        // Binary field ids, top level and within each AppField object
+        enum : uint16_t { StatusField = 1, AppField = 2 };
+        enum : uint16_t { AppKeyField = 1, AppInfoField = 2 };
+
         ResponseStatus status;
         IMap<String^, AppInfo^>^ apps;
 
@@ -139,7 +166,27 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
             return SerializationHelper::CreateBlobFromJson((uint32_t)Tag, jsonObject);
         }
 
+        virtual Blob^ SerializeBinary() {
+            BinaryWriter writer;
+            writer.WriteUInt32(StatusField, (uint32_t)status);
+            for each (auto app in apps)
+            {
+                auto appStart = writer.BeginObject(AppField);
+                writer.WriteString(AppKeyField, app->Key);
+                auto infoStart = writer.BeginObject(AppInfoField);
+                app->Value->ToBinary(writer);
+                writer.EndObject(infoStart);
+                writer.EndObject(appStart);
+            }
+            return writer.ToBlob((uint32_t)Tag);
+        }
+
         static IDataPayload^ Deserialize(Blob^ bytes) {
+            if (bytes->IsBinaryPayload)
+            {
+                return DeserializeBinary(bytes);
+            }
+
             auto str = SerializationHelper::GetStringFromBlob(bytes);
             auto jsonObject = JsonObject::Parse(str);
             auto status = (ResponseStatus)(uint32_t)jsonObject->GetNamedNumber("Status");
@@ -147,6 +194,47 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
             return ref new ListAppsResponse(status, appDictionary);
         }
 
+    private:
+        static IDataPayload^ DeserializeBinary(Blob^ bytes) {
+            auto status = ResponseStatus::Success;
+            auto apps = ref new Map<String^, AppInfo^>();
+
+            auto reader = BinaryReader::FromBlob(bytes);
+            BinaryField field;
+            while (reader.Next(field))
+            {
+                if (field.id == StatusField)
+                {
+                    status = (ResponseStatus)BinaryReader::ToUInt32(field);
+                }
+                else if (field.id == AppField)
+                {
+                    String^ pfn = nullptr;
+                    AppInfo^ info = nullptr;
+                    auto appReader = BinaryReader::ToObject(field);
+                    BinaryField appField;
+                    while (appReader.Next(appField))
+                    {
+                        if (appField.id == AppKeyField)
+                        {
+                            pfn = BinaryReader::ToString(appField);
+                        }
+                        else if (appField.id == AppInfoField)
+                        {
+                            info = ref new AppInfo(BinaryReader::ToObject(appField));
+                        }
+                    }
+                    if (pfn != nullptr && info != nullptr)
+                    {
+                        apps->Insert(pfn, info);
+                    }
+                }
+            }
+            return ref new ListAppsResponse(status, apps);
+        }
+
+    public:
+
         virtual property DMMessageKind Tag {
             DMMessageKind get();
         }
@@ -19,6 +19,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "DMMessageKind.h"
 #include "StatusCodeResponse.h"
 #include "Blob.h"
+#include "BinarySerialization.h"
 
 using namespace Platform;
 using namespace Platform::Metadata;
@@ -26,8 +27,11 @@ using namespace Windows::Data::Json;
 
 namespace Microsoft { namespace Devices { namespace Management { namespace Message
 {
-    public ref class StringListResponse sealed : public IResponse
+    public ref class StringListResponse sealed : public IResponse, public IBinaryDataPayload
     {
+        // Binary field ids
+        enum : uint16_t { ItemField = 1 };
+
         StatusCodeResponse statusCodeResponse;
     public:
         property IVector<String^>^ List;
@@ -50,8 +54,33 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
             return SerializationHelper::CreateBlobFromJson((uint32_t)Tag, jsonObject);
         }
 
+        virtual Blob^ SerializeBinary()
+        {
+            BinaryWriter writer;
+            for each (String^ item in List)
+            {
+                writer.WriteString(ItemField, item);
+            }
+            return writer.ToBlob((uint32_t)Tag);
+        }
+
         static IDataPayload^ Deserialize(Blob^ blob)
         {
+            if (blob->IsBinaryPayload)
+            {
+                auto result = ref new StringListResponse(ResponseStatus::Success);
+                auto reader = BinaryReader::FromBlob(blob);
+                BinaryField field;
+                while (reader.Next(field))
+                {
+                    if (field.id == ItemField)
+                    {
+                        result->List->Append(BinaryReader::ToString(field));
+                    }
+                }
+                return result;
+            }
+
             String^ str = SerializationHelper::GetStringFromBlob(blob);
             JsonObject^ jsonObject = JsonObject::Parse(str);
             auto result = ref new StringListResponse(ResponseStatus::Success);
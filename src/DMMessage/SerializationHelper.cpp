@@ -13,6 +13,8 @@ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "stdafx.h"
+#include <atomic>
+#include <vector>
 #include "SerializationHelper.h"
 #include "Blob.h"
 #include "CurrentVersion.h"
@@ -20,26 +22,63 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 using namespace Microsoft::Devices::Management::Message;
 using namespace Platform;
 
+#ifdef DMMESSAGE_COPY_STATISTICS
+static std::atomic<uint64_t> s_allocationCount { 0 };
+static std::atomic<uint64_t> s_bytesCopied { 0 };
+
+void SerializationHelper::RecordCopy(size_t bytesCopied, uint32_t allocations)
+{
+    s_allocationCount += allocations;
+    s_bytesCopied += bytesCopied;
+}
+
+uint64_t SerializationHelper::AllocationCount()
+{
+    return s_allocationCount;
+}
+
+uint64_t SerializationHelper::BytesCopied()
+{
+    return s_bytesCopied;
+}
+
+void SerializationHelper::ResetStatistics()
+{
+    s_allocationCount = 0;
+    s_bytesCopied = 0;
+}
+#endif
+
 Blob^ SerializationHelper::CreateEmptyBlob(uint32_t tag)
 {
     return CreateBlobFromPtrSize(tag, nullptr, 0);
 }
 
-Blob^ SerializationHelper::CreateBlobFromPtrSize(uint32_t tag, const byte* byteptr, size_t size)
+Array<byte>^ SerializationHelper::AllocateBlobBytes(uint32_t tag, size_t size, uint32_t flags)
 {
     size_t byteCount = PrefixSize + size;
 
     auto byteArray = ref new Array<byte>(static_cast<unsigned int>(byteCount));
+    RecordCopy(PrefixSize, 1);
 
-    // First, put out the version (32 bits)
-    uint32_t version = CurrentVersion;
+    // First, put out the version and payload flags (32 bits). Every blob this build writes
+    // advertises that binary payloads can be read back.
+    uint32_t version = CurrentVersion | flags | BlobAcceptsBinary;
     memcpy_s(byteArray->Data, byteCount, &version, sizeof(version));
 
     // Second, put out the 32-bit tag
     memcpy_s(byteArray->Data + sizeof(version), byteCount, &tag, sizeof(tag));
 
+    return byteArray;
+}
+
+Blob^ SerializationHelper::CreateBlobFromPtrSize(uint32_t tag, const byte* byteptr, size_t size, uint32_t flags)
+{
+    auto byteArray = AllocateBlobBytes(tag, size, flags);
+
     // Followed by the serialized object:
-    memcpy_s(byteArray->Data + PrefixSize, byteCount, byteptr, size);
+    memcpy_s(byteArray->Data + PrefixSize, size, byteptr, size);
+    RecordCopy(size, 0);
 
     return Blob::CreateFromByteArray(byteArray);
 }
@@ -52,7 +91,22 @@ Blob^ SerializationHelper::CreateBlobFromJson(uint32_t tag, JsonObject^ jsonObje
 
 Blob^ SerializationHelper::CreateBlobFromString(uint32_t tag, String ^str)
 {
-    return CreateBlobFromPtrSize(tag, (const byte*)str->Data(), str->Length() * sizeof(wchar_t));
+    // Payloads are JSON and mostly ASCII, so UTF-8 halves them compared to the in-memory UTF-16.
+    // Encode straight into the blob to avoid an intermediate buffer.
+    int wideLength = static_cast<int>(str->Length());
+    int utf8Length = wideLength == 0 ? 0 : WideCharToMultiByte(CP_UTF8, 0, str->Data(), wideLength, nullptr, 0, nullptr, nullptr);
+    if (wideLength != 0 && utf8Length == 0)
+    {
+        throw ref new Exception(HRESULT_FROM_WIN32(GetLastError()), "WideCharToMultiByte() failed to encode payload.");
+    }
+
+    auto byteArray = AllocateBlobBytes(tag, utf8Length, BlobPayloadUtf8);
+    if (utf8Length != 0)
+    {
+        WideCharToMultiByte(CP_UTF8, 0, str->Data(), wideLength, reinterpret_cast<char*>(byteArray->Data + PrefixSize), utf8Length, nullptr, nullptr);
+        RecordCopy(utf8Length, 0);
+    }
+    return Blob::CreateFromByteArray(byteArray);
 }
 
 Blob^ SerializationHelper::CreateBlobFromByteArray(uint32_t tag, const Array<byte>^ bytes)
@@ -63,10 +117,57 @@ Blob^ SerializationHelper::CreateBlobFromByteArray(uint32_t tag, const Array<byt
 
 String^ SerializationHelper::GetStringFromBlob(const Blob^ blob)
 {
-    return ref new String(reinterpret_cast<wchar_t*>(blob->bytes->Data + PrefixSize), (blob->bytes->Length - PrefixSize) / sizeof(wchar_t));
+    const byte* payload = blob->data + PrefixSize;
+    unsigned int payloadSize = blob->size - PrefixSize;
+
+    uint32_t versionWord = *reinterpret_cast<const uint32_t*>(blob->data);
+    if ((versionWord & BlobPayloadBinary) != 0)
+    {
+        throw ref new Exception(E_INVALIDARG, "Payload is binary encoded and has no string form.");
+    }
+
+    if ((versionWord & BlobPayloadUtf8) == 0)
+    {
+        // Blobs from peers that predate the encoding flag carry UTF-16.
+        RecordCopy(payloadSize, 1);
+        return ref new String(reinterpret_cast<const wchar_t*>(payload), payloadSize / sizeof(wchar_t));
+    }
+
+    if (payloadSize == 0)
+    {
+        return ref new String();
+    }
+
+    int wideLength = MultiByteToWideChar(CP_UTF8, 0, reinterpret_cast<const char*>(payload), payloadSize, nullptr, 0);
+    if (wideLength == 0)
+    {
+        throw ref new Exception(HRESULT_FROM_WIN32(GetLastError()), "MultiByteToWideChar() failed to decode payload.");
+    }
+
+    // Payloads up to MaxRetainedDecodeLength characters are decoded into a buffer reused
+    // per thread. Larger ones, such as a full app inventory, get a buffer of their own that
+    // is freed on return, so no thread keeps more than that after one large response.
+    static const size_t MaxRetainedDecodeLength = 64 * 1024;
+    static thread_local std::vector<wchar_t> retained;
+    std::vector<wchar_t> oversized;
+    std::vector<wchar_t>& buffer = static_cast<size_t>(wideLength) <= MaxRetainedDecodeLength ? retained : oversized;
+    if (buffer.size() < static_cast<size_t>(wideLength))
+    {
+        buffer.resize(wideLength);
+        RecordCopy(0, 1);
+    }
+    MultiByteToWideChar(CP_UTF8, 0, reinterpret_cast<const char*>(payload), payloadSize, buffer.data(), wideLength);
+    RecordCopy(2 * wideLength * sizeof(wchar_t), 1);
+    return ref new String(buffer.data(), wideLength);
+}
+
+const byte* SerializationHelper::GetPayload(const Blob^ blob, size_t* size)
+{
+    *size = blob->size - PrefixSize;
+    return blob->data + PrefixSize;
 }
 
 void SerializationHelper::ReadDataFromBlob(const Blob^ blob, byte* buffer, size_t size)
 {
-    memcpy_s(buffer, size, blob->bytes->Data + PrefixSize, size);
+    memcpy_s(buffer, size, blob->data + PrefixSize, size);
 }
@@ -16,6 +16,11 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <stdint.h>
 
+// Debug builds count the buffers and bytes that blobs copy, for the tests.
+#ifdef _DEBUG
+#define DMMESSAGE_COPY_STATISTICS
+#endif
+
 using namespace Platform;
 using namespace Windows::Data::Json;
 
@@ -28,15 +33,29 @@ namespace Microsoft { namespace Devices { namespace Management { namespace Messa
         // The Prefix has to 32-bit integers: the version and the tag
         static constexpr int      PrefixSize = 2 * sizeof(uint32_t);
 
+        static Array<uint8_t>^ AllocateBlobBytes(uint32_t tag, size_t size, uint32_t flags);
+
     public:
 
         static Blob^ CreateEmptyBlob(uint32_t tag);
-        static Blob^ CreateBlobFromPtrSize(uint32_t tag, const uint8_t* byteptr, size_t size);
+        static Blob^ CreateBlobFromPtrSize(uint32_t tag, const uint8_t* byteptr, size_t size, uint32_t flags = 0);
         static Blob^ CreateBlobFromJson(uint32_t tag, JsonObject^ jsonObject);
         static Blob^ CreateBlobFromString(uint32_t tag, String^ str);
         static Blob^ CreateBlobFromByteArray(uint32_t tag, const Array<uint8_t>^ bytes);
 
         static String^ GetStringFromBlob(const Blob^ blob);
+        static const uint8_t* GetPayload(const Blob^ blob, size_t* size);
+
+        // Allocation and copy counters behind BlobStatistics. Release builds
+        // compile the calls away.
+#ifdef DMMESSAGE_COPY_STATISTICS
+        static void RecordCopy(size_t bytesCopied, uint32_t allocations);
+        static uint64_t AllocationCount();
+        static uint64_t BytesCopied();
+        static void ResetStatistics();
+#else
+        static void RecordCopy(size_t, uint32_t) {}
+#endif
         static void ReadDataFromBlob(const Blob^ blob, uint8_t* buffer, size_t size);
     };
 
@@ -16,6 +16,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "..\SharedUtilities\Utils.h"
 #include "..\SharedUtilities\Logger.h"
 #include "TpmSupport.h"
+#include "TpmTokenCache.h"
 #include "DMException.h"
 
 using namespace std;
@@ -52,13 +53,29 @@ std::string Tpm::RunLimpet(const std::wstring& params)
     return output;
 }
 
+TpmTokenCache& Tpm::TokenCache()
+{
+    static TpmTokenCache cache(FetchServiceUrl, FetchSASToken);
+    return cache;
+}
+
 std::string Tpm::GetServiceUrl(int logicalId)
+{
+    return TokenCache().GetServiceUrl(logicalId);
+}
+
+std::string Tpm::GetSASToken(int logicalId, unsigned int durationInSeconds)
+{
+    return TokenCache().GetSASToken(logicalId, durationInSeconds);
+}
+
+std::string Tpm::FetchServiceUrl(int logicalId)
 {
     TRACE(__FUNCTION__);
 
     const std::string response = RunLimpet(to_wstring(logicalId) + L" -rur");
 
-    std::regex rgx(".*<ServiceURI>\\s*(\\S+)\\s*</ServiceURI>.*");
+    static const std::regex rgx(".*<ServiceURI>\\s*(\\S+)\\s*</ServiceURI>.*");
     std::smatch match;
 
     if (std::regex_search(response.begin(), response.end(), match, rgx))
@@ -71,7 +88,7 @@ std::string Tpm::GetServiceUrl(int logicalId)
     throw DMException("cannot parse Limpet response. Is TPM supported?");
 }
 
-std::string Tpm::GetSASToken(int logicalId, unsigned int durationInSeconds)
+std::string Tpm::FetchSASToken(int logicalId, unsigned int durationInSeconds)
 {
     TRACE(__FUNCTION__);
 
@@ -81,7 +98,7 @@ std::string Tpm::GetSASToken(int logicalId, unsigned int durationInSeconds)
     // Work around by extracting the actual connection string
     // The workaround will continue to work (but will be unnecessary) once the bug in Limpet is fixed
 
-    std::regex rgx(".*(SharedAccessSignature sr.*)");
+    static const std::regex rgx(".*(SharedAccessSignature sr.*)");
     std::smatch match;
 
     if (std::regex_search(response.begin(), response.end(), match, rgx))
@@ -99,8 +116,9 @@ void Tpm::ClearTPM()
     TRACE(__FUNCTION__);
 
     const std::string response = RunLimpet(L"-fct");
+    TokenCache().InvalidateAll();
 
-    std::regex rgx(".*<TpmClear>\\s*(\\S+)\\s*</TpmClear>.*");
+    static const std::regex rgx(".*<TpmClear>\\s*(\\S+)\\s*</TpmClear>.*");
     std::smatch match;
 
     if (std::regex_search(response.begin(), response.end(), match, rgx))
@@ -123,7 +141,7 @@ std::string Tpm::GetEndorsementKey()
 	TRACE(__FUNCTION__);
 
 	const std::string response = RunLimpet(L"-erk");
-	std::regex rgx(".*<ERKPub>\\s*(\\S+)\\s*</ERKPub>.*");
+	static const std::regex rgx(".*<ERKPub>\\s*(\\S+)\\s*</ERKPub>.*");
 	std::smatch match;
 
 	if (std::regex_search(response.begin(), response.end(), match, rgx))
@@ -141,7 +159,7 @@ std::string Tpm::GetSRootKey()
 	TRACE(__FUNCTION__);
 
 	const std::string response = RunLimpet(L"-srk");
-	std::regex rgx(".*<SRKPub>\\s*(\\S+)\\s*</SRKPub>.*");
+	static const std::regex rgx(".*<SRKPub>\\s*(\\S+)\\s*</SRKPub>.*");
 	std::smatch match;
 
 	if (std::regex_search(response.begin(), response.end(), match, rgx))
@@ -159,6 +177,7 @@ void Tpm::DestroyServiceUrl(int logicalId)
 	TRACE(__FUNCTION__);
 
 	RunLimpet(to_wstring(logicalId) + L" -dur");
+	TokenCache().Invalidate(logicalId);
 }
 
 void Tpm::StoreServiceUrl(int logicalId, const std::string& url)
@@ -166,6 +185,7 @@ void Tpm::StoreServiceUrl(int logicalId, const std::string& url)
 	TRACE(__FUNCTION__);
 
 	RunLimpet(to_wstring(logicalId) + (std::wstring)L" -sur " + Utils::MultibyteToWide(url.c_str()));
+	TokenCache().Invalidate(logicalId);
 }
 
 void Tpm::ImportSymetricIdentity(int logicalId, const std::string& hostageFile)
@@ -173,6 +193,7 @@ void Tpm::ImportSymetricIdentity(int logicalId, const std::string& hostageFile)
 	TRACE(__FUNCTION__);
 
 	RunLimpet(to_wstring(logicalId) + L" -isi " + Utils::MultibyteToWide(hostageFile.c_str()));
+	TokenCache().Invalidate(logicalId);
 }
 
 void Tpm::EvictHmacKey(int logicalId)
@@ -180,5 +201,6 @@ void Tpm::EvictHmacKey(int logicalId)
 	TRACE(__FUNCTION__);
 
 	RunLimpet(to_wstring(logicalId) + L" -ehk");
+	TokenCache().Invalidate(logicalId);
 }
 
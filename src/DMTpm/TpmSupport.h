@@ -16,6 +16,8 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <string>
 
+class TpmTokenCache;
+
 class Tpm
 {
 public:
@@ -25,9 +27,13 @@ public:
     static void StoreServiceUrl(int logicalId, const std::string& url);
     static void ImportSymetricIdentity(int logicalId, const std::string& hostageFile);
     static void EvictHmacKey(int logicalId);
+    // Cached; see TpmTokenCache.
     static std::string GetServiceUrl(int logicalId);
     static std::string GetSASToken(int logicalId, unsigned int durationInSeconds);
     static void ClearTPM();
 private:
     static std::string Tpm::RunLimpet(const std::wstring& params);
+    static std::string FetchServiceUrl(int logicalId);
+    static std::string FetchSASToken(int logicalId, unsigned int durationInSeconds);
+    static TpmTokenCache& TokenCache();
 };
@@ -0,0 +1,152 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include "TpmTokenCache.h"
+
+using namespace std;
+
+const unsigned int TpmTokenCache::MaxReuseSeconds;
+
+TpmTokenCache::TpmTokenCache(UrlSource urlSource, TokenSource tokenSource, TimeSource timeSource) :
+    _urlSource(urlSource),
+    _tokenSource(tokenSource),
+    _timeSource(timeSource),
+    _generation(0)
+{
+}
+
+string TpmTokenCache::GetServiceUrl(int logicalId)
+{
+    return GetOrFetch(Key(logicalId, ServiceUrl, 0), [this, logicalId]()
+    {
+        return make_pair(_urlSource(logicalId), Clock::time_point::max());
+    });
+}
+
+string TpmTokenCache::GetSASToken(int logicalId, unsigned int durationInSeconds)
+{
+    return GetOrFetch(Key(logicalId, SASToken, durationInSeconds), [this, logicalId, durationInSeconds]()
+    {
+        Clock::time_point requested = _timeSource();
+        string token = _tokenSource(logicalId, durationInSeconds);
+
+        // Callers assume the token lasts about as long as they asked for.
+        Clock::time_point refreshAt = requested + chrono::seconds((min)(MaxReuseSeconds, durationInSeconds / 10));
+        Clock::time_point expiry;
+        if (TryGetTokenExpiry(token, expiry))
+        {
+            refreshAt = (min)(refreshAt, expiry);
+        }
+        return make_pair(token, refreshAt);
+    });
+}
+
+void TpmTokenCache::Invalidate(int logicalId)
+{
+    lock_guard<mutex> lock(_mutex);
+    auto it = _entries.lower_bound(Key(logicalId, 0, 0));
+    while (it != _entries.end() && get<0>(it->first) == logicalId)
+    {
+        it = _entries.erase(it);
+    }
+}
+
+void TpmTokenCache::InvalidateAll()
+{
+    lock_guard<mutex> lock(_mutex);
+    _entries.clear();
+}
+
+bool TpmTokenCache::TryGetTokenExpiry(const string& sasToken, Clock::time_point& expiry)
+{
+    size_t position = sasToken.find("&se=");
+    if (position == string::npos)
+    {
+        return false;
+    }
+
+    const char* begin = sasToken.c_str() + position + 4;
+    char* end = nullptr;
+    unsigned long long seconds = strtoull(begin, &end, 10);
+    if (end == begin)
+    {
+        return false;
+    }
+
+    expiry = Clock::from_time_t(static_cast<time_t>(seconds));
+    return true;
+}
+
+string TpmTokenCache::GetOrFetch(const Key& key, const Fetch& fetch)
+{
+    unique_lock<mutex> lock(_mutex);
+
+    auto it = _entries.find(key);
+    if (it != _entries.end())
+    {
+        if (!it->second.ready)
+        {
+            // Another thread is running limpet for this value.
+            shared_future<string> value = it->second.value;
+            lock.unlock();
+            return value.get();
+        }
+        if (_timeSource() < it->second.refreshAt)
+        {
+            return it->second.value.get();
+        }
+    }
+
+    promise<string> fetched;
+    Entry& entry = _entries[key];
+    entry.value = fetched.get_future().share();
+    entry.ready = false;
+    entry.generation = ++_generation;
+    uint64_t generation = entry.generation;
+    lock.unlock();
+
+    try
+    {
+        pair<string, Clock::time_point> result = fetch();
+
+        lock.lock();
+        it = _entries.find(key);
+        if (it != _entries.end() && it->second.generation == generation)
+        {
+            it->second.ready = true;
+            it->second.refreshAt = result.second;
+        }
+        lock.unlock();
+
+        fetched.set_value(result.first);
+        return result.first;
+    }
+    catch (...)
+    {
+        lock.lock();
+        it = _entries.find(key);
+        if (it != _entries.end() && it->second.generation == generation)
+        {
+            _entries.erase(it);
+        }
+        lock.unlock();
+
+        fetched.set_exception(current_exception());
+        throw;
+    }
+}
@@ -0,0 +1,90 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+// Keeps what limpet reports for each logical slot, so that repeated requests
+// do not each start a process.
+//
+// A service URL is kept until the slot is changed. A SAS token is only
+// reused for a short window after it was issued, so that a burst of
+// reconnects shares one token while every caller still gets close to the
+// lifetime it asked for. Concurrent requests for the same value share one
+// fetch; if that fetch fails, every waiter gets its exception and nothing is
+// cached.
+class TpmTokenCache
+{
+public:
+    typedef std::chrono::system_clock Clock;
+    typedef std::function<std::string(int logicalId)> UrlSource;
+    typedef std::function<std::string(int logicalId, unsigned int durationInSeconds)> TokenSource;
+    typedef std::function<Clock::time_point()> TimeSource;
+
+    // A token is handed out for this long after it was issued, or for a
+    // tenth of its lifetime if that is shorter.
+    static const unsigned int MaxReuseSeconds = 60;
+
+    TpmTokenCache(UrlSource urlSource, TokenSource tokenSource, TimeSource timeSource = Clock::now);
+
+    std::string GetServiceUrl(int logicalId);
+    std::string GetSASToken(int logicalId, unsigned int durationInSeconds);
+
+    // Forgets what is cached for a slot, or for every slot. A fetch already
+    // in flight still completes for its waiters but is not cached.
+    void Invalidate(int logicalId);
+    void InvalidateAll();
+
+    // Reads the se= field (seconds since 1970) of a SAS token.
+    static bool TryGetTokenExpiry(const std::string& sasToken, Clock::time_point& expiry);
+
+private:
+    enum Kind
+    {
+        ServiceUrl,
+        SASToken
+    };
+
+    // Slot, kind, token duration.
+    typedef std::tuple<int, int, unsigned int> Key;
+
+    struct Entry
+    {
+        std::shared_future<std::string> value;
+        bool ready;
+        Clock::time_point refreshAt;
+        uint64_t generation;
+    };
+
+    // Returns the value and the time to fetch it again.
+    typedef std::function<std::pair<std::string, Clock::time_point>()> Fetch;
+
+    std::string GetOrFetch(const Key& key, const Fetch& fetch);
+
+    UrlSource _urlSource;
+    TokenSource _tokenSource;
+    TimeSource _timeSource;
+
+    std::mutex _mutex;
+    std::map<Key, Entry> _entries;
+    uint64_t _generation;
+};
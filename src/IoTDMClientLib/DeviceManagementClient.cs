@@ -426,42 +426,58 @@ namespace Microsoft.Devices.Management
             }
         }
 
-        private async Task ReportAllDeviceProperties()
+        // Returns null if the handler failed; the failure is reported in its status section.
+        private async Task<JObject> GetReportedPropertyWithStatusAsync(IClientPropertyHandler handler)
         {
-            Logger.Log("Reporting all device properties to device twin...", LoggingLevel.Information);
+            StatusSection statusSection = new StatusSection(StatusSection.StateType.Pending);
+            await ReportStatusAsync(handler.PropertySectionName, statusSection);
 
-            Logger.Log("Querying device state...", LoggingLevel.Information);
+            // TODO: how do we ensure that only Reported=yes sections report results?
+            try
+            {
+                JObject reportedProperty = await handler.GetReportedPropertyAsync();
 
-            JObject windowsObj = new JObject();
-            foreach (var handler in this._desiredPropertyMap.Values)
+                statusSection.State = StatusSection.StateType.Completed;
+                Logger.Log(statusSection.ToString(), LoggingLevel.Information);
+                await ReportStatusAsync(handler.PropertySectionName, statusSection);
+                return reportedProperty;
+            }
+            catch (Error e)
             {
-                StatusSection statusSection = new StatusSection(StatusSection.StateType.Pending);
+                statusSection.State = StatusSection.StateType.Failed;
+                statusSection.TheError = e;
+
+                Logger.Log(statusSection.ToString(), LoggingLevel.Error);
                 await ReportStatusAsync(handler.PropertySectionName, statusSection);
+            }
+            catch (Exception e)
+            {
+                statusSection.State = StatusSection.StateType.Failed;
+                statusSection.TheError = new Error(ErrorSubSystem.Unknown, e.HResult, e.Message);
 
-                // TODO: how do we ensure that only Reported=yes sections report results?
-                try
-                {
-                    windowsObj[handler.PropertySectionName] = await handler.GetReportedPropertyAsync();
+                Logger.Log(statusSection.ToString(), LoggingLevel.Error);
+                await ReportStatusAsync(handler.PropertySectionName, statusSection);
+            }
+            return null;
+        }
 
-                    statusSection.State = StatusSection.StateType.Completed;
-                    Logger.Log(statusSection.ToString(), LoggingLevel.Information);
-                    await ReportStatusAsync(handler.PropertySectionName, statusSection);
-                }
-                catch (Error e)
-                {
-                    statusSection.State = StatusSection.StateType.Failed;
-                    statusSection.TheError = e;
+        private async Task ReportAllDeviceProperties()
+        {
+            Logger.Log("Reporting all device properties to device twin...", LoggingLevel.Information);
 
-                    Logger.Log(statusSection.ToString(), LoggingLevel.Error);
-                    await ReportStatusAsync(handler.PropertySectionName, statusSection);
-                }
-                catch (Exception e)
-                {
-                    statusSection.State = StatusSection.StateType.Failed;
-                    statusSection.TheError = new Error(ErrorSubSystem.Unknown, e.HResult, e.Message);
+            Logger.Log("Querying device state...", LoggingLevel.Information);
+
+            // The handlers are queried concurrently; with a pipelining SystemConfigurator their
+            // requests are all in flight at once rather than one round trip after another.
+            var handlers = this._desiredPropertyMap.Values.ToList();
+            JObject[] reportedProperties = await Task.WhenAll(handlers.Select(handler => GetReportedPropertyWithStatusAsync(handler)));
 
-                    Logger.Log(statusSection.ToString(), LoggingLevel.Error);
-                    await ReportStatusAsync(handler.PropertySectionName, statusSection);
+            JObject windowsObj = new JObject();
+            for (int i = 0; i < handlers.Count; ++i)
+            {
+                if (reportedProperties[i] != null)
+                {
+                    windowsObj[handlers[i].PropertySectionName] = reportedProperties[i];
                 }
             }
 
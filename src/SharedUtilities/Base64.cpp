@@ -0,0 +1,505 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <algorithm>
+#include <cstring>
+#include "DMException.h"
+#include "Base64.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BASE64_SSSE3
+#include <tmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define SSSE3_FUNCTION
+#else
+#define SSSE3_FUNCTION __attribute__((target("ssse3")))
+#endif
+#endif
+
+using namespace std;
+
+namespace Utils
+{
+    static const char EncodeTable[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    // Decode table entries other than sextets (0-63). All have the top two
+    // bits set, so four entries can be checked with one mask.
+    static const uint8_t Invalid = 0xFF;
+    static const uint8_t Whitespace = 0xFE;
+    static const uint8_t Padding = 0xFD;
+
+    struct DecodeTable
+    {
+        uint8_t values[256];
+
+        DecodeTable()
+        {
+            memset(values, Invalid, sizeof(values));
+            for (uint8_t i = 0; i < 64; ++i)
+            {
+                values[static_cast<uint8_t>(EncodeTable[i])] = i;
+            }
+            values[' '] = values['\t'] = values['\r'] = values['\n'] = Whitespace;
+            values['='] = Padding;
+        }
+    };
+
+    static const DecodeTable Decoding;
+
+    // Wide text is converted through a narrow buffer of this many characters.
+    static const size_t ChunkSize = 4096;
+
+    // The SSSE3 decoder stores 16 bytes for every 12 it decodes.
+    static const size_t DecodeSlack = 4;
+
+    static bool HasSsse3()
+    {
+#if defined(BASE64_SSSE3) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 9)) != 0;
+#elif defined(BASE64_SSSE3)
+        return __builtin_cpu_supports("ssse3") != 0;
+#else
+        return false;
+#endif
+    }
+
+    static const bool UseSsse3 = HasSsse3();
+
+#if defined(BASE64_SSSE3)
+    // Encodes 12 bytes into 16 characters per step while 16 bytes can be
+    // loaded. Returns the number of bytes consumed.
+    // See Wojciech Mula, "Base64 encoding with SIMD instructions".
+    SSSE3_FUNCTION static size_t EncodeSsse3(const uint8_t* in, size_t size, char* out)
+    {
+        const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+        const __m128i shiftLut = _mm_setr_epi8(
+            'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+            '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+        size_t done = 0;
+        for (; size - done >= 16; done += 12, out += 16)
+        {
+            __m128i input = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done)), spread);
+
+            // Move each 6-bit field into its own byte.
+            __m128i high = _mm_mulhi_epu16(_mm_and_si128(input, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+            __m128i low = _mm_mullo_epi16(_mm_and_si128(input, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+            __m128i indices = _mm_or_si128(high, low);
+
+            // Map each sextet range to the offset of its first character.
+            __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+            __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+            range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+            __m128i text = _mm_add_epi8(_mm_shuffle_epi8(shiftLut, range), indices);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), text);
+        }
+        return done;
+    }
+
+    // Decodes 16 characters into 12 bytes per step, stopping at the first
+    // block holding anything but the 64 alphabet characters. Returns the
+    // number of characters consumed.
+    SSSE3_FUNCTION static size_t DecodeSsse3(const char* in, size_t size, uint8_t* out)
+    {
+        const __m128i shiftLut = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i maskLut = _mm_setr_epi8(
+            static_cast<char>(0xa8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+            static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf8),
+            static_cast<char>(0xf8), static_cast<char>(0xf8), static_cast<char>(0xf0), 0x54,
+            0x50, 0x50, 0x50, 0x54);
+        const __m128i bitLut = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, static_cast<char>(0x80), 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i gather = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+        size_t done = 0;
+        for (; size - done >= 16; done += 16, out += 12)
+        {
+            __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+            __m128i highNibble = _mm_and_si128(_mm_srli_epi32(input, 4), _mm_set1_epi8(0x0f));
+            __m128i lowNibble = _mm_and_si128(input, _mm_set1_epi8(0x0f));
+
+            // A character is in the alphabet if its low nibble's mask has its high nibble's bit set.
+            __m128i valid = _mm_and_si128(_mm_shuffle_epi8(maskLut, lowNibble), _mm_shuffle_epi8(bitLut, highNibble));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(valid, _mm_setzero_si128())) != 0)
+            {
+                break;
+            }
+
+            // '/' shares its high nibble with '+' but needs its own offset.
+            __m128i isSlash = _mm_cmpeq_epi8(input, _mm_set1_epi8('/'));
+            __m128i shift = _mm_or_si128(
+                _mm_andnot_si128(isSlash, _mm_shuffle_epi8(shiftLut, highNibble)),
+                _mm_and_si128(isSlash, _mm_set1_epi8(16)));
+            __m128i sextets = _mm_add_epi8(input, shift);
+
+            // Pack four sextets into three bytes, then put the bytes in order.
+            __m128i pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+            __m128i groups = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(groups, gather));
+        }
+        return done;
+    }
+#endif
+
+    static void EncodeGroups(const uint8_t* in, size_t groups, char* out)
+    {
+        size_t done = 0;
+#if defined(BASE64_SSSE3)
+        if (UseSsse3)
+        {
+            done = EncodeSsse3(in, groups * 3, out);
+            out += done / 3 * 4;
+        }
+#endif
+        for (const uint8_t* end = in + groups * 3, *group = in + done; group != end; group += 3, out += 4)
+        {
+            uint32_t bits = (group[0] << 16) | (group[1] << 8) | group[2];
+            out[0] = EncodeTable[bits >> 18];
+            out[1] = EncodeTable[(bits >> 12) & 0x3f];
+            out[2] = EncodeTable[(bits >> 6) & 0x3f];
+            out[3] = EncodeTable[bits & 0x3f];
+        }
+    }
+
+    static void EncodeGroups(const uint8_t* in, size_t groups, wchar_t* out)
+    {
+        char chunk[ChunkSize];
+        const size_t chunkGroups = ChunkSize / 4;
+        while (groups != 0)
+        {
+            size_t count = (min)(groups, chunkGroups);
+            EncodeGroups(in, count, chunk);
+            copy(chunk, chunk + count * 4, out);
+            in += count * 3;
+            out += count * 4;
+            groups -= count;
+        }
+    }
+
+    // Writes the 1 or 2 bytes left at the end as a padded group.
+    static void EncodeLastGroup(const uint8_t* in, size_t size, char* out)
+    {
+        uint32_t bits = (in[0] << 16) | (size == 2 ? in[1] << 8 : 0);
+        out[0] = EncodeTable[bits >> 18];
+        out[1] = EncodeTable[(bits >> 12) & 0x3f];
+        out[2] = size == 2 ? EncodeTable[(bits >> 6) & 0x3f] : '=';
+        out[3] = '=';
+    }
+
+    const size_t Base64Encoder::StreamChunkSize;
+
+    Base64Encoder::Base64Encoder() :
+        _carrySize(0)
+    {
+    }
+
+    size_t Base64Encoder::EncodedSize(size_t size)
+    {
+        return (size + 2) / 3 * 4;
+    }
+
+    template<class Text>
+    void Base64Encoder::AppendText(const uint8_t* data, size_t size, Text& out)
+    {
+        if (_carrySize != 0)
+        {
+            // Complete the group held back from the last call.
+            size_t needed = 3 - _carrySize;
+            if (size < needed)
+            {
+                copy(data, data + size, _carry + _carrySize);
+                _carrySize += size;
+                return;
+            }
+
+            uint8_t group[3];
+            memcpy(group, _carry, _carrySize);
+            memcpy(group + _carrySize, data, needed);
+            data += needed;
+            size -= needed;
+            _carrySize = 0;
+
+            char text[4];
+            EncodeGroups(group, 1, text);
+            out.append(text, text + 4);
+        }
+
+        size_t groups = size / 3;
+        if (groups != 0)
+        {
+            size_t start = out.size();
+            out.resize(start + groups * 4);
+            EncodeGroups(data, groups, &out[start]);
+        }
+
+        _carrySize = size - groups * 3;
+        copy(data + groups * 3, data + size, _carry);
+    }
+
+    template<class Text>
+    void Base64Encoder::FinishText(Text& out)
+    {
+        if (_carrySize != 0)
+        {
+            char text[4];
+            EncodeLastGroup(_carry, _carrySize, text);
+            out.append(text, text + 4);
+        }
+        _carrySize = 0;
+    }
+
+    void Base64Encoder::Append(const void* data, size_t size, string& out)
+    {
+        AppendText(static_cast<const uint8_t*>(data), size, out);
+    }
+
+    void Base64Encoder::Append(const void* data, size_t size, wstring& out)
+    {
+        AppendText(static_cast<const uint8_t*>(data), size, out);
+    }
+
+    void Base64Encoder::Finish(string& out)
+    {
+        FinishText(out);
+    }
+
+    void Base64Encoder::Finish(wstring& out)
+    {
+        FinishText(out);
+    }
+
+    void Base64Encoder::Encode(const void* data, size_t size, string& out)
+    {
+        out.reserve(out.size() + EncodedSize(size));
+        Base64Encoder encoder;
+        encoder.Append(data, size, out);
+        encoder.Finish(out);
+    }
+
+    void Base64Encoder::Encode(const void* data, size_t size, wstring& out)
+    {
+        out.reserve(out.size() + EncodedSize(size));
+        Base64Encoder encoder;
+        encoder.Append(data, size, out);
+        encoder.Finish(out);
+    }
+
+    void Base64Encoder::EncodeStream(const ReadFunction& read, wstring& out)
+    {
+        vector<uint8_t> chunk(StreamChunkSize);
+        Base64Encoder encoder;
+        for (;;)
+        {
+            size_t size = read(chunk.data(), chunk.size());
+            if (size == 0)
+            {
+                break;
+            }
+            encoder.Append(chunk.data(), size, out);
+        }
+        encoder.Finish(out);
+    }
+
+    // Writes the bytes of a group of 2 or 3 sextets cut short by padding or the end of the text.
+    static uint8_t* DecodeLastGroup(uint32_t bits, unsigned int count, uint8_t* out)
+    {
+        if (count == 2)
+        {
+            *out++ = static_cast<uint8_t>(bits >> 4);
+        }
+        else
+        {
+            *out++ = static_cast<uint8_t>(bits >> 10);
+            *out++ = static_cast<uint8_t>(bits >> 2);
+        }
+        return out;
+    }
+
+    Base64Decoder::Base64Decoder() :
+        _bits(0),
+        _count(0),
+        _padding(0)
+    {
+    }
+
+    size_t Base64Decoder::MaxDecodedSize(size_t size)
+    {
+        // Up to three sextets may be carried in from an earlier call.
+        return (size + 3) / 4 * 3;
+    }
+
+    size_t Base64Decoder::DecodeInto(const char* text, size_t size, uint8_t* out)
+    {
+        uint8_t* start = out;
+        size_t i = 0;
+        while (i < size)
+        {
+            if (_count == 0 && _padding == 0)
+            {
+                // On a group boundary: take whole groups while the text is clean.
+#if defined(BASE64_SSSE3)
+                if (UseSsse3)
+                {
+                    size_t done = DecodeSsse3(text + i, size - i, out);
+                    i += done;
+                    out += done / 4 * 3;
+                }
+#endif
+                while (size - i >= 4)
+                {
+                    uint8_t a = Decoding.values[static_cast<uint8_t>(text[i])];
+                    uint8_t b = Decoding.values[static_cast<uint8_t>(text[i + 1])];
+                    uint8_t c = Decoding.values[static_cast<uint8_t>(text[i + 2])];
+                    uint8_t d = Decoding.values[static_cast<uint8_t>(text[i + 3])];
+                    if (((a | b | c | d) & 0xc0) != 0)
+                    {
+                        break;
+                    }
+
+                    uint32_t bits = (a << 18) | (b << 12) | (c << 6) | d;
+                    out[0] = static_cast<uint8_t>(bits >> 16);
+                    out[1] = static_cast<uint8_t>(bits >> 8);
+                    out[2] = static_cast<uint8_t>(bits);
+                    out += 3;
+                    i += 4;
+                }
+                if (i == size)
+                {
+                    break;
+                }
+            }
+
+            // Whitespace, padding, or a group split across calls: one character at a time.
+            uint8_t value = Decoding.values[static_cast<uint8_t>(text[i++])];
+            if (value < 64)
+            {
+                if (_padding != 0)
+                {
+                    throw DMException("Base64 text continues after its padding.");
+                }
+
+                _bits = (_bits << 6) | value;
+                if (++_count == 4)
+                {
+                    out[0] = static_cast<uint8_t>(_bits >> 16);
+                    out[1] = static_cast<uint8_t>(_bits >> 8);
+                    out[2] = static_cast<uint8_t>(_bits);
+                    out += 3;
+                    _bits = 0;
+                    _count = 0;
+                }
+            }
+            else if (value == Padding)
+            {
+                if (_count < 2 || _count + _padding >= 4)
+                {
+                    throw DMException("Base64 padding is misplaced.");
+                }
+
+                if (_count + ++_padding == 4)
+                {
+                    out = DecodeLastGroup(_bits, _count, out);
+                    _bits = 0;
+                    _count = 0;
+                }
+            }
+            else if (value != Whitespace)
+            {
+                throw DMException("Invalid character in base64 text.");
+            }
+        }
+        return out - start;
+    }
+
+    void Base64Decoder::Append(const char* text, size_t size, vector<char>& out)
+    {
+        size_t start = out.size();
+        out.resize(start + MaxDecodedSize(size) + DecodeSlack);
+        try
+        {
+            out.resize(start + DecodeInto(text, size, reinterpret_cast<uint8_t*>(out.data() + start)));
+        }
+        catch (...)
+        {
+            out.resize(start);
+            throw;
+        }
+    }
+
+    void Base64Decoder::Append(const wchar_t* text, size_t size, vector<char>& out)
+    {
+        size_t start = out.size();
+        out.reserve(start + MaxDecodedSize(size) + DecodeSlack);
+
+        char chunk[ChunkSize];
+        try
+        {
+            while (size != 0)
+            {
+                size_t count = (min)(size, ChunkSize);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    // Anything outside ASCII is invalid; 0x80 keeps it that way.
+                    chunk[i] = static_cast<uint32_t>(text[i]) < 0x80 ? static_cast<char>(text[i]) : static_cast<char>(0x80);
+                }
+                Append(chunk, count, out);
+                text += count;
+                size -= count;
+            }
+        }
+        catch (...)
+        {
+            out.resize(start);
+            throw;
+        }
+    }
+
+    void Base64Decoder::Finish(vector<char>& out)
+    {
+        unsigned int count = _count;
+        uint32_t bits = _bits;
+        _bits = 0;
+        _count = 0;
+        _padding = 0;
+
+        if (count == 1)
+        {
+            throw DMException("Base64 text ends in the middle of a group.");
+        }
+        if (count != 0)
+        {
+            uint8_t bytes[2];
+            uint8_t* end = DecodeLastGroup(bits, count, bytes);
+            out.insert(out.end(), bytes, end);
+        }
+    }
+
+    void Base64Decoder::Decode(const char* text, size_t size, vector<char>& out)
+    {
+        Base64Decoder decoder;
+        decoder.Append(text, size, out);
+        decoder.Finish(out);
+    }
+
+    void Base64Decoder::Decode(const wchar_t* text, size_t size, vector<char>& out)
+    {
+        Base64Decoder decoder;
+        decoder.Append(text, size, out);
+        decoder.Finish(out);
+    }
+}
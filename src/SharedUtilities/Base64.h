@@ -0,0 +1,103 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Utils
+{
+    // Base64 (RFC 4648, standard alphabet, '=' padding) for narrow and wide
+    // text.
+    //
+    // Output is sized once up front and written in place. Full 12-byte groups
+    // go through SSSE3 when the CPU has it and through a table otherwise.
+    // Both classes also work incrementally, so a large payload can be
+    // converted piece by piece with only a few bytes carried between calls.
+
+    class Base64Encoder
+    {
+    public:
+        // Reads up to 'size' bytes into 'buffer'; returns 0 at the end of the input.
+        typedef std::function<size_t(void* buffer, size_t size)> ReadFunction;
+
+        // A multiple of 3, so whole chunks encode without a carry.
+        static const size_t StreamChunkSize = 48 * 1024;
+
+        Base64Encoder();
+
+        // Appends the encoding of 'data' to 'out'. Up to two trailing bytes
+        // are held back until the next call or Finish().
+        void Append(const void* data, size_t size, std::string& out);
+        void Append(const void* data, size_t size, std::wstring& out);
+
+        // Appends the last group, padded, and resets the encoder.
+        void Finish(std::string& out);
+        void Finish(std::wstring& out);
+
+        static size_t EncodedSize(size_t size);
+
+        // One-shot; appends to 'out'.
+        static void Encode(const void* data, size_t size, std::string& out);
+        static void Encode(const void* data, size_t size, std::wstring& out);
+
+        // Appends the encoding of everything 'read' returns to 'out', reading
+        // through one StreamChunkSize buffer; the input is never held whole.
+        static void EncodeStream(const ReadFunction& read, std::wstring& out);
+
+    private:
+        template<class Text>
+        void AppendText(const uint8_t* data, size_t size, Text& out);
+
+        template<class Text>
+        void FinishText(Text& out);
+
+        uint8_t _carry[2];
+        size_t _carrySize;
+    };
+
+    class Base64Decoder
+    {
+    public:
+        Base64Decoder();
+
+        // Appends the bytes decoded from 'text' to 'out'. Whitespace is
+        // skipped, so line-wrapped input is fine. Throws DMException on a
+        // character outside the alphabet or anything but whitespace after
+        // the padding.
+        void Append(const char* text, size_t size, std::vector<char>& out);
+        void Append(const wchar_t* text, size_t size, std::vector<char>& out);
+
+        // Flushes a final unpadded group and resets the decoder. Throws if
+        // the text ended with a single character of a group.
+        void Finish(std::vector<char>& out);
+
+        static size_t MaxDecodedSize(size_t size);
+
+        // One-shot; appends to 'out'.
+        static void Decode(const char* text, size_t size, std::vector<char>& out);
+        static void Decode(const wchar_t* text, size_t size, std::vector<char>& out);
+
+    private:
+        // Returns the number of bytes written to 'out'.
+        size_t DecodeInto(const char* text, size_t size, uint8_t* out);
+
+        uint32_t _bits;
+        unsigned int _count;    // sextets in _bits
+        unsigned int _padding;  // '=' seen
+    };
+}
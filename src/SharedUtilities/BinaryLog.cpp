@@ -0,0 +1,369 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <cstring>
+#include "DMException.h"
+#include "BinaryLog.h"
+
+using namespace std;
+
+namespace Utils
+{
+    static void PutVarint(vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static void PutUtf8(vector<uint8_t>& out, const wchar_t* text, size_t length)
+    {
+        // The length prefix needs the byte count, so encode first.
+        vector<uint8_t> bytes;
+        bytes.reserve(length);
+        for (size_t i = 0; i < length; ++i)
+        {
+            uint32_t c = static_cast<uint32_t>(text[i]);
+            if (sizeof(wchar_t) == 2 && c >= 0xD800 && c < 0xDC00 && i + 1 < length)
+            {
+                uint32_t low = static_cast<uint32_t>(text[i + 1]);
+                if (low >= 0xDC00 && low < 0xE000)
+                {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+                    ++i;
+                }
+            }
+
+            if (c < 0x80)
+            {
+                bytes.push_back(static_cast<uint8_t>(c));
+            }
+            else if (c < 0x800)
+            {
+                bytes.push_back(static_cast<uint8_t>(0xC0 | (c >> 6)));
+                bytes.push_back(static_cast<uint8_t>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000)
+            {
+                bytes.push_back(static_cast<uint8_t>(0xE0 | (c >> 12)));
+                bytes.push_back(static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3F)));
+                bytes.push_back(static_cast<uint8_t>(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                bytes.push_back(static_cast<uint8_t>(0xF0 | (c >> 18)));
+                bytes.push_back(static_cast<uint8_t>(0x80 | ((c >> 12) & 0x3F)));
+                bytes.push_back(static_cast<uint8_t>(0x80 | ((c >> 6) & 0x3F)));
+                bytes.push_back(static_cast<uint8_t>(0x80 | (c & 0x3F)));
+            }
+        }
+
+        PutVarint(out, bytes.size());
+        out.insert(out.end(), bytes.begin(), bytes.end());
+    }
+
+    static uint64_t ZigZag(int64_t value)
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    static int64_t UnZigZag(uint64_t value)
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    BinaryLogEncoder::BinaryLogEncoder() :
+        _buffer(nullptr),
+        _capacity(0),
+        _size(0),
+        _lastTime(0)
+    {}
+
+    bool BinaryLogEncoder::Begin(uint8_t* buffer, size_t capacity, uint64_t startTime)
+    {
+        _buffer = buffer;
+        _capacity = capacity;
+        _size = 0;
+        _lastTime = startTime;
+        _strings.clear();
+
+        if (capacity < HeaderSize)
+        {
+            return false;
+        }
+
+        uint32_t magic = Magic;
+        uint32_t version = Version;
+        memcpy(buffer, &magic, sizeof(magic));
+        memcpy(buffer + 4, &version, sizeof(version));
+        memcpy(buffer + 8, &startTime, sizeof(startTime));
+        _size = HeaderSize;
+        return true;
+    }
+
+    bool BinaryLogEncoder::Append(const LogEntry& entry)
+    {
+        if (_buffer == nullptr)
+        {
+            return false;
+        }
+
+        _scratch.clear();
+
+        // Intern the format the first time it is seen in this file.
+        uint32_t formatId = 0;
+        bool newString = false;
+        wstring format(entry.text, 0, entry.formatLength);
+        auto it = _strings.find(format);
+        if (it != _strings.end())
+        {
+            formatId = it->second;
+        }
+        else if (format.size() <= MaxInternedLength && _strings.size() < MaxInternedCount)
+        {
+            formatId = static_cast<uint32_t>(_strings.size() + 1);
+            newString = true;
+
+            _scratch.push_back(StringDef);
+            PutVarint(_scratch, formatId);
+            PutUtf8(_scratch, format.c_str(), format.size());
+        }
+
+        _scratch.push_back(Event);
+        PutVarint(_scratch, ZigZag(static_cast<int64_t>(entry.time - _lastTime)));
+        PutVarint(_scratch, entry.threadId);
+        _scratch.push_back(static_cast<uint8_t>(entry.level));
+        PutVarint(_scratch, formatId);
+        if (formatId == 0)
+        {
+            PutUtf8(_scratch, format.c_str(), format.size());
+        }
+
+        _scratch.push_back(static_cast<uint8_t>(entry.argType));
+        switch (entry.argType)
+        {
+        case LogArgType::Int:
+            PutVarint(_scratch, ZigZag(static_cast<int64_t>(entry.argValue)));
+            break;
+        case LogArgType::UInt:
+            PutVarint(_scratch, entry.argValue);
+            break;
+        case LogArgType::String:
+            PutUtf8(_scratch, entry.text.c_str() + entry.formatLength, entry.text.size() - entry.formatLength);
+            break;
+        default:
+            break;
+        }
+
+        if (_scratch.size() > _capacity - _size)
+        {
+            return false;
+        }
+
+        memcpy(_buffer + _size, _scratch.data(), _scratch.size());
+        _size += _scratch.size();
+        _lastTime = entry.time;
+        if (newString)
+        {
+            _strings.emplace(move(format), formatId);
+        }
+        return true;
+    }
+
+    // Bounds-checked reader over one file; any overrun marks it truncated.
+    class BinaryLogCursor
+    {
+    public:
+        BinaryLogCursor(const uint8_t* data, size_t size) :
+            _data(data),
+            _size(size),
+            _offset(0),
+            _truncated(false)
+        {}
+
+        bool Truncated() const { return _truncated; }
+        bool AtEnd() const { return _offset >= _size; }
+
+        uint8_t Byte()
+        {
+            if (_offset >= _size)
+            {
+                _truncated = true;
+                return 0;
+            }
+            return _data[_offset++];
+        }
+
+        uint64_t Varint()
+        {
+            uint64_t value = 0;
+            for (unsigned int shift = 0; shift < 64; shift += 7)
+            {
+                uint8_t b = Byte();
+                value |= static_cast<uint64_t>(b & 0x7F) << shift;
+                if ((b & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+            _truncated = true;
+            return 0;
+        }
+
+        wstring Utf8()
+        {
+            uint64_t length = Varint();
+            if (_truncated || length > _size - _offset)
+            {
+                _truncated = true;
+                return wstring();
+            }
+
+            wstring text;
+            text.reserve(static_cast<size_t>(length));
+            const uint8_t* p = _data + _offset;
+            const uint8_t* end = p + length;
+            while (p < end)
+            {
+                uint32_t c = *p++;
+                int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+                c &= extra == 3 ? 0x07 : extra == 2 ? 0x0F : extra == 1 ? 0x1F : 0x7F;
+                for (; extra > 0 && p < end; --extra)
+                {
+                    c = (c << 6) | (*p++ & 0x3F);
+                }
+
+                if (sizeof(wchar_t) == 2 && c >= 0x10000)
+                {
+                    c -= 0x10000;
+                    text.push_back(static_cast<wchar_t>(0xD800 + (c >> 10)));
+                    text.push_back(static_cast<wchar_t>(0xDC00 + (c & 0x3FF)));
+                }
+                else
+                {
+                    text.push_back(static_cast<wchar_t>(c));
+                }
+            }
+            _offset += static_cast<size_t>(length);
+            return text;
+        }
+
+    private:
+        const uint8_t* _data;
+        size_t _size;
+        size_t _offset;
+        bool _truncated;
+    };
+
+    uint64_t BinaryLogDecoder::StartTime(const uint8_t* data, size_t size)
+    {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        if (size < BinaryLogEncoder::HeaderSize)
+        {
+            throw DMException("Binary log is too short.");
+        }
+
+        memcpy(&magic, data, sizeof(magic));
+        memcpy(&version, data + 4, sizeof(version));
+        if (magic != BinaryLogEncoder::Magic || version != BinaryLogEncoder::Version)
+        {
+            throw DMException("Not a binary log, or an unsupported version.");
+        }
+
+        uint64_t startTime = 0;
+        memcpy(&startTime, data + 8, sizeof(startTime));
+        return startTime;
+    }
+
+    void BinaryLogDecoder::Decode(const uint8_t* data, size_t size, const function<void(const LogEntry&)>& handler)
+    {
+        uint64_t time = StartTime(data, size);
+        unordered_map<uint64_t, wstring> strings;
+        BinaryLogCursor cursor(data + BinaryLogEncoder::HeaderSize, size - BinaryLogEncoder::HeaderSize);
+
+        while (!cursor.AtEnd())
+        {
+            uint8_t kind = cursor.Byte();
+            if (kind == BinaryLogEncoder::StringDef)
+            {
+                uint64_t id = cursor.Varint();
+                wstring text = cursor.Utf8();
+                if (cursor.Truncated())
+                {
+                    return;
+                }
+                strings[id] = move(text);
+            }
+            else if (kind == BinaryLogEncoder::Event)
+            {
+                LogEntry entry;
+                time += static_cast<uint64_t>(UnZigZag(cursor.Varint()));
+                entry.time = time;
+                entry.threadId = static_cast<uint32_t>(cursor.Varint());
+                entry.level = static_cast<ETWLogger::LoggingLevel>(cursor.Byte());
+
+                uint64_t formatId = cursor.Varint();
+                if (formatId == 0)
+                {
+                    entry.text = cursor.Utf8();
+                }
+                else
+                {
+                    auto it = strings.find(formatId);
+                    if (it == strings.end())
+                    {
+                        return;
+                    }
+                    entry.text = it->second;
+                }
+                entry.formatLength = entry.text.size();
+
+                entry.argType = static_cast<LogArgType>(cursor.Byte());
+                entry.argValue = 0;
+                switch (entry.argType)
+                {
+                case LogArgType::None:
+                    break;
+                case LogArgType::Int:
+                    entry.argValue = static_cast<uint64_t>(UnZigZag(cursor.Varint()));
+                    break;
+                case LogArgType::UInt:
+                    entry.argValue = cursor.Varint();
+                    break;
+                case LogArgType::String:
+                    entry.text += cursor.Utf8();
+                    break;
+                default:
+                    return;
+                }
+
+                if (cursor.Truncated())
+                {
+                    return;
+                }
+                handler(entry);
+            }
+            else
+            {
+                // End, or a record that was cut short.
+                return;
+            }
+        }
+    }
+}
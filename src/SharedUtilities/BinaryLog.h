@@ -0,0 +1,88 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "LogRing.h"
+
+namespace Utils
+{
+    // Compact binary encoding of log records.
+    //
+    // A file starts with a fixed header (magic, version, start time) and is
+    // followed by records. Each record starts with a kind byte. Integers are
+    // LEB128 varints. Strings are UTF-8 with a varint length.
+    //
+    //   StringDef: id, string
+    //       Adds a format string to the file's string table.
+    //   Event: time delta, thread id, level byte, format id, arg type byte, arg
+    //       The time delta is zigzag-encoded and relative to the previous
+    //       event, or to the header for the first one. A format id of 0 means
+    //       the format string follows inline. The arg is a zigzag varint, a
+    //       plain varint or a string, depending on its type.
+    //
+    // Unused space is zero-filled and reads as an End record. Each file has
+    // its own string table and time base, so it can be decoded on its own.
+    class BinaryLogEncoder
+    {
+    public:
+        static const uint32_t Magic = 0x474C4D44;   // "DMLG"
+        static const uint32_t Version = 1;
+        static const size_t HeaderSize = 16;
+
+        // Longer or later format strings are written inline instead of interned.
+        static const size_t MaxInternedLength = 256;
+        static const size_t MaxInternedCount = 4096;
+
+        enum RecordKind : uint8_t
+        {
+            End = 0,
+            StringDef = 1,
+            Event = 2
+        };
+
+        BinaryLogEncoder();
+
+        // Starts a new file in 'buffer'. Returns false if the header does not fit.
+        bool Begin(uint8_t* buffer, size_t capacity, uint64_t startTime);
+
+        // Appends the entry. Returns false, without writing anything, if it does not fit.
+        bool Append(const LogEntry& entry);
+
+        size_t Size() const { return _size; }
+
+    private:
+        uint8_t* _buffer;
+        size_t _capacity;
+        size_t _size;
+        uint64_t _lastTime;
+        std::unordered_map<std::wstring, uint32_t> _strings;
+        std::vector<uint8_t> _scratch;
+    };
+
+    class BinaryLogDecoder
+    {
+    public:
+        // Calls 'handler' for every event in a file. Decoding stops quietly at
+        // the first End or truncated record. Throws if the header is not valid.
+        static void Decode(const uint8_t* data, size_t size, const std::function<void(const LogEntry&)>& handler);
+
+        static uint64_t StartTime(const uint8_t* data, size_t size);
+    };
+}
@@ -0,0 +1,200 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include "DMException.h"
+#include "BinaryLogWriter.h"
+
+using namespace std;
+
+namespace Utils
+{
+    const wchar_t* const BinaryLogWriter::FileExtension = L".dmlog";
+
+    static uint64_t FileTimeToTicks(const FILETIME& fileTime)
+    {
+        ULARGE_INTEGER ticks = { fileTime.dwLowDateTime, fileTime.dwHighDateTime };
+        return ticks.QuadPart;
+    }
+
+    BinaryLogWriter::BinaryLogWriter(const wstring& folder, const wstring& baseName, size_t fileSize, unsigned int fileCount) :
+        _folder(folder),
+        _baseName(baseName),
+        _fileSize(fileSize),
+        _fileCount((max)(fileCount, 1u)),
+        _index(0),
+        _view(nullptr)
+    {
+        // Resume in a missing file or the one written longest ago.
+        uint64_t oldest = UINT64_MAX;
+        for (unsigned int i = 0; i < _fileCount; ++i)
+        {
+            WIN32_FILE_ATTRIBUTE_DATA attributes;
+            if (!GetFileAttributesEx(FileName(i).c_str(), GetFileExInfoStandard, &attributes))
+            {
+                _index = i;
+                break;
+            }
+
+            uint64_t lastWrite = FileTimeToTicks(attributes.ftLastWriteTime);
+            if (lastWrite < oldest)
+            {
+                oldest = lastWrite;
+                _index = i;
+            }
+        }
+
+        Open(_index);
+    }
+
+    BinaryLogWriter::~BinaryLogWriter()
+    {
+        Close();
+    }
+
+    wstring BinaryLogWriter::FileName(unsigned int index) const
+    {
+        return _folder + L"\\" + _baseName + L"." + to_wstring(index) + FileExtension;
+    }
+
+    void BinaryLogWriter::Open(unsigned int index)
+    {
+        Close();
+
+        HANDLE file = CreateFile(FileName(index).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            throw DMExceptionWithErrorCode("CreateFile failed for the binary log.", GetLastError());
+        }
+        _file.SetHandle(move(file));
+
+        // Mapping a new file at full size extends it with zeros, which read back as End records.
+        ULARGE_INTEGER size;
+        size.QuadPart = _fileSize;
+        HANDLE mapping = CreateFileMapping(_file.Get(), NULL, PAGE_READWRITE, size.HighPart, size.LowPart, NULL);
+        if (mapping == NULL)
+        {
+            throw DMExceptionWithErrorCode("CreateFileMapping failed for the binary log.", GetLastError());
+        }
+        _mapping.SetHandle(move(mapping));
+
+        _view = static_cast<uint8_t*>(MapViewOfFile(_mapping.Get(), FILE_MAP_WRITE, 0, 0, _fileSize));
+        if (_view == nullptr)
+        {
+            throw DMExceptionWithErrorCode("MapViewOfFile failed for the binary log.", GetLastError());
+        }
+
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        _encoder.Begin(_view, _fileSize, FileTimeToTicks(now));
+        _index = index;
+    }
+
+    void BinaryLogWriter::Close()
+    {
+        if (_view != nullptr)
+        {
+            UnmapViewOfFile(_view);
+            _view = nullptr;
+        }
+        _mapping.Close();
+        _file.Close();
+    }
+
+    void BinaryLogWriter::Write(const LogEntry& entry)
+    {
+        if (_view == nullptr || _encoder.Append(entry))
+        {
+            return;
+        }
+
+        // An entry that does not fit in an empty file is dropped.
+        Open((_index + 1) % _fileCount);
+        _encoder.Append(entry);
+    }
+
+    void BinaryLogWriter::Flush()
+    {
+        if (_view != nullptr)
+        {
+            FlushViewOfFile(_view, _encoder.Size());
+        }
+    }
+
+    static void AppendDecodedLine(wstring& output, const LogEntry& entry)
+    {
+        static const wchar_t* const levelNames[] = { L"VERB", L"INFO", L"WARN", L"ERR ", L"CRIT" };
+
+        FILETIME utcTime = { static_cast<DWORD>(entry.time), static_cast<DWORD>(entry.time >> 32) };
+        FILETIME localTime;
+        SYSTEMTIME systemTime;
+        FileTimeToLocalFileTime(&utcTime, &localTime);
+        FileTimeToSystemTime(&localTime, &systemTime);
+
+        wchar_t prefix[64];
+        swprintf_s(prefix, L"%04u-%02u-%02u %02u:%02u:%02u.%03u [%08u] %ls ",
+            systemTime.wYear, systemTime.wMonth, systemTime.wDay,
+            systemTime.wHour, systemTime.wMinute, systemTime.wSecond, systemTime.wMilliseconds,
+            entry.threadId,
+            static_cast<unsigned int>(entry.level) < _countof(levelNames) ? levelNames[entry.level] : L"?   ");
+
+        output += prefix;
+        entry.AppendText(output);
+        output += L"\n";
+    }
+
+    void DecodeBinaryLogFiles(const vector<wstring>& paths, wostream& output)
+    {
+        struct LogFile
+        {
+            wstring path;
+            vector<uint8_t> data;
+            uint64_t startTime;
+        };
+
+        vector<LogFile> files;
+        for (const auto& path : paths)
+        {
+            ifstream stream(path, ios::binary);
+            if (!stream)
+            {
+                throw DMException("Cannot open binary log file.");
+            }
+
+            LogFile file;
+            file.path = path;
+            file.data.assign(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+            file.startTime = BinaryLogDecoder::StartTime(file.data.data(), file.data.size());
+            files.push_back(move(file));
+        }
+
+        sort(files.begin(), files.end(), [](const LogFile& a, const LogFile& b)
+        {
+            return a.startTime < b.startTime;
+        });
+
+        for (const auto& file : files)
+        {
+            wstring text = L"---- " + file.path + L"\n";
+            BinaryLogDecoder::Decode(file.data.data(), file.data.size(), [&text](const LogEntry& entry)
+            {
+                AppendDecodedLine(text, entry);
+            });
+            output << text;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <windows.h>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "AutoCloseHandle.h"
+#include "BinaryLog.h"
+#include "LogSink.h"
+
+namespace Utils
+{
+    // Writes log entries to memory-mapped files named <baseName>.<n>.dmlog in
+    // 'folder', rotating through 'fileCount' files of 'fileSize' bytes each.
+    // Writing resumes in the oldest file, so a restart never overwrites the
+    // newest one. Pages are written back by the system; Flush() forces it.
+    class BinaryLogWriter : public ILogSink
+    {
+    public:
+        static const wchar_t* const FileExtension;
+
+        BinaryLogWriter(const std::wstring& folder, const std::wstring& baseName, size_t fileSize, unsigned int fileCount);
+        ~BinaryLogWriter();
+
+        void Write(const LogEntry& entry) override;
+        void Flush() override;
+
+    private:
+        BinaryLogWriter(const BinaryLogWriter&);
+        BinaryLogWriter& operator=(const BinaryLogWriter&);
+
+        std::wstring FileName(unsigned int index) const;
+        void Open(unsigned int index);
+        void Close();
+
+        std::wstring _folder;
+        std::wstring _baseName;
+        size_t _fileSize;
+        unsigned int _fileCount;
+        unsigned int _index;
+
+        AutoCloseHandle _file;
+        AutoCloseHandle _mapping;
+        uint8_t* _view;
+        BinaryLogEncoder _encoder;
+    };
+
+    // Decodes binary log files, oldest first, into text lines on 'output'.
+    void DecodeBinaryLogFiles(const std::vector<std::wstring>& paths, std::wostream& output);
+}
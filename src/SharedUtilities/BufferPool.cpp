@@ -0,0 +1,129 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include "BufferPool.h"
+
+using namespace std;
+
+namespace Utils
+{
+    shared_ptr<BufferPool> BufferPool::Create(size_t maxPerClass)
+    {
+        return shared_ptr<BufferPool>(new BufferPool(maxPerClass));
+    }
+
+    BufferPool::BufferPool(size_t maxPerClass) :
+        _maxPerClass(maxPerClass),
+        _allocationCount(0),
+        _reuseCount(0)
+    {}
+
+    size_t BufferPool::ClassIndex(size_t size)
+    {
+        size_t index = 0;
+        size_t capacity = MinClassSize;
+        while (capacity < size)
+        {
+            capacity <<= 1;
+            ++index;
+        }
+        return index;
+    }
+
+    BufferPool::Lease BufferPool::Acquire(size_t size)
+    {
+        unique_ptr<uint8_t[]> storage;
+        size_t capacity = size;
+
+        if (size <= MaxClassSize)
+        {
+            size_t index = ClassIndex(size);
+            capacity = MinClassSize << index;
+
+            lock_guard<mutex> lock(_mutex);
+            if (!_free[index].empty())
+            {
+                storage = move(_free[index].back());
+                _free[index].pop_back();
+                ++_reuseCount;
+            }
+        }
+
+        if (!storage)
+        {
+            storage.reset(new uint8_t[capacity]);
+            lock_guard<mutex> lock(_mutex);
+            ++_allocationCount;
+        }
+
+        unique_ptr<Buffer> buffer(new Buffer{ nullptr, size, capacity });
+        buffer->data = storage.release();
+
+        // If creating the lease throws, shared_ptr runs the deleter and the storage is recycled.
+        weak_ptr<BufferPool> pool = shared_from_this();
+        return Lease(buffer.release(), [pool](Buffer* buffer)
+        {
+            auto owner = pool.lock();
+            if (owner)
+            {
+                owner->Release(buffer->data, buffer->capacity);
+            }
+            else
+            {
+                delete[] buffer->data;
+            }
+            delete buffer;
+        });
+    }
+
+    void BufferPool::Release(uint8_t* data, size_t capacity)
+    {
+        unique_ptr<uint8_t[]> storage(data);
+        if (capacity > MaxClassSize)
+        {
+            return;
+        }
+
+        size_t index = ClassIndex(capacity);
+        lock_guard<mutex> lock(_mutex);
+        if (_free[index].size() < _maxPerClass)
+        {
+            _free[index].push_back(move(storage));
+        }
+    }
+
+    uint64_t BufferPool::AllocationCount() const
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _allocationCount;
+    }
+
+    uint64_t BufferPool::ReuseCount() const
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _reuseCount;
+    }
+
+    size_t BufferPool::FreeCount() const
+    {
+        lock_guard<mutex> lock(_mutex);
+        size_t count = 0;
+        for (const auto& list : _free)
+        {
+            count += list.size();
+        }
+        return count;
+    }
+}
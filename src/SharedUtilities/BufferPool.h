@@ -0,0 +1,70 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Utils
+{
+    // Size-classed pool of reusable byte buffers for receiving messages.
+    //
+    // Requests are rounded up to a power of two between MinClassSize and
+    // MaxClassSize. Each class keeps up to maxPerClass free buffers; larger
+    // requests are allocated and freed directly. A buffer goes back to its
+    // class when the last reference to its lease is released, even if the
+    // pool itself is gone by then.
+    class BufferPool : public std::enable_shared_from_this<BufferPool>
+    {
+    public:
+        static const size_t MinClassSize = 256;
+        static const size_t MaxClassSize = 1024 * 1024;
+
+        struct Buffer
+        {
+            uint8_t* data;
+            // The size that was asked for; capacity can be larger.
+            size_t size;
+            size_t capacity;
+        };
+
+        typedef std::shared_ptr<Buffer> Lease;
+
+        static std::shared_ptr<BufferPool> Create(size_t maxPerClass = 8);
+
+        Lease Acquire(size_t size);
+
+        // Buffers allocated from the heap, and requests served from the pool instead.
+        uint64_t AllocationCount() const;
+        uint64_t ReuseCount() const;
+        size_t FreeCount() const;
+
+    private:
+        explicit BufferPool(size_t maxPerClass);
+
+        static size_t ClassIndex(size_t size);
+        void Release(uint8_t* data, size_t capacity);
+
+        static const size_t ClassCount = 13;    // 256 B .. 1 MB
+
+        const size_t _maxPerClass;
+        mutable std::mutex _mutex;
+        std::vector<std::unique_ptr<uint8_t[]>> _free[ClassCount];
+        uint64_t _allocationCount;
+        uint64_t _reuseCount;
+    };
+}
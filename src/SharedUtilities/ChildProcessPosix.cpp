@@ -0,0 +1,242 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <cerrno>
+#include <codecvt>
+#include <csignal>
+#include <locale>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "DMException.h"
+#include "ProcessRunner.h"
+
+extern char** environ;
+
+using namespace std;
+
+namespace Utils
+{
+    ProcessCancellation::ProcessCancellation()
+    {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0)
+        {
+            throw DMExceptionWithErrorCode("Error: pipe2 failed.", errno);
+        }
+        _waitHandle = fds[0];
+        _signalHandle = fds[1];
+    }
+
+    ProcessCancellation::~ProcessCancellation()
+    {
+        close(static_cast<int>(_waitHandle));
+        close(static_cast<int>(_signalHandle));
+    }
+
+    void ProcessCancellation::Cancel()
+    {
+        // The pipe is non-blocking; once it holds a byte, further writes are not needed.
+        char signal = 1;
+        ssize_t written = write(static_cast<int>(_signalHandle), &signal, 1);
+        (void)written;
+    }
+
+    bool ProcessCancellation::IsCancelled() const
+    {
+        pollfd fd = { static_cast<int>(_waitHandle), POLLIN, 0 };
+        return poll(&fd, 1, 0) == 1;
+    }
+
+    // The child's output pipe, the cancellation pipe and, where the kernel
+    // supports it, a pidfd for the child's exit are polled together.
+    // Without a pidfd, exit is checked every ExitPollMs while output is idle.
+    class PosixChildProcess : public IChildProcess
+    {
+    public:
+        static const int ExitPollMs = 10;
+
+        PosixChildProcess(const wstring& commandLine, const ProcessCancellation* cancellation) :
+            _cancelFd(cancellation == nullptr ? -1 : static_cast<int>(cancellation->WaitHandle())),
+            _outputFd(-1),
+            _exitFd(-1),
+            _pid(0),
+            _ended(false),
+            _exited(false),
+            _exitCode(0)
+        {
+            int fds[2];
+            if (pipe2(fds, O_CLOEXEC) != 0)
+            {
+                throw DMExceptionWithErrorCode("Error: pipe2 failed.", errno);
+            }
+            _outputFd = fds[0];
+
+            posix_spawn_file_actions_t actions;
+            posix_spawn_file_actions_init(&actions);
+            posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+            posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+            string command = wstring_convert<codecvt_utf8<wchar_t>>().to_bytes(commandLine);
+            char* argv[] = { const_cast<char*>("sh"), const_cast<char*>("-c"), const_cast<char*>(command.c_str()), nullptr };
+            int error = posix_spawn(&_pid, "/bin/sh", &actions, nullptr, argv, environ);
+            posix_spawn_file_actions_destroy(&actions);
+
+            // Only the child holds the write end now.
+            close(fds[1]);
+            if (error != 0)
+            {
+                close(_outputFd);
+                throw DMExceptionWithErrorCode("Error: posix_spawn failed.", error);
+            }
+
+#ifdef SYS_pidfd_open
+            _exitFd = static_cast<int>(syscall(SYS_pidfd_open, _pid, 0));
+#endif
+        }
+
+        ~PosixChildProcess()
+        {
+            close(_outputFd);
+            if (_exitFd >= 0)
+            {
+                close(_exitFd);
+            }
+            if (!_exited)
+            {
+                CheckExited();
+            }
+        }
+
+        unsigned int Wait(unsigned int timeoutMs) override
+        {
+            pollfd fds[3];
+            nfds_t count = 0;
+            int cancelIndex = -1;
+            int outputIndex = -1;
+            if (_cancelFd >= 0)
+            {
+                cancelIndex = static_cast<int>(count);
+                fds[count++] = { _cancelFd, POLLIN, 0 };
+            }
+            if (!_ended)
+            {
+                outputIndex = static_cast<int>(count);
+                fds[count++] = { _outputFd, POLLIN, 0 };
+            }
+            if (!_exited && _exitFd >= 0)
+            {
+                fds[count++] = { _exitFd, POLLIN, 0 };
+            }
+
+            int timeout = timeoutMs == ProcessRunner::NoTimeout ? -1 : static_cast<int>(timeoutMs);
+            if (!_exited && _exitFd < 0 && (timeout < 0 || timeout > ExitPollMs))
+            {
+                timeout = ExitPollMs;
+            }
+
+            int ready = poll(fds, count, timeout);
+            if (ready < 0 && errno != EINTR)
+            {
+                throw DMExceptionWithErrorCode("Error: poll failed.", errno);
+            }
+
+            unsigned int events = 0;
+            if (ready > 0 && cancelIndex >= 0 && fds[cancelIndex].revents != 0)
+            {
+                events |= Cancelled;
+            }
+            if (ready > 0 && outputIndex >= 0 && fds[outputIndex].revents != 0)
+            {
+                events |= OutputReady;
+            }
+            if (!_exited && CheckExited())
+            {
+                events |= Exited;
+            }
+            return events;
+        }
+
+        size_t Read(char* buffer, size_t size) override
+        {
+            for (;;)
+            {
+                ssize_t count = read(_outputFd, buffer, size);
+                if (count > 0)
+                {
+                    return static_cast<size_t>(count);
+                }
+                if (count < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                _ended = true;
+                return 0;
+            }
+        }
+
+        unsigned long ExitCode() override
+        {
+            return _exitCode;
+        }
+
+        void Terminate() override
+        {
+            if (!_exited)
+            {
+                kill(_pid, SIGKILL);
+                int status = 0;
+                while (waitpid(_pid, &status, 0) < 0 && errno == EINTR)
+                {
+                }
+                SetExitCode(status);
+            }
+        }
+
+    private:
+        bool CheckExited()
+        {
+            int status = 0;
+            if (waitpid(_pid, &status, WNOHANG) != _pid)
+            {
+                return false;
+            }
+            SetExitCode(status);
+            return true;
+        }
+
+        void SetExitCode(int status)
+        {
+            _exited = true;
+            _exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+
+        int _cancelFd;
+        int _outputFd;
+        int _exitFd;
+        pid_t _pid;
+        bool _ended;
+        bool _exited;
+        unsigned long _exitCode;
+    };
+
+    unique_ptr<IChildProcess> StartChildProcess(const wstring& commandLine, const ProcessCancellation* cancellation)
+    {
+        return unique_ptr<IChildProcess>(new PosixChildProcess(commandLine, cancellation));
+    }
+}
@@ -0,0 +1,276 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <windows.h>
+#include <atomic>
+#include "AutoCloseHandle.h"
+#include "DMException.h"
+#include "ProcessRunner.h"
+
+using namespace std;
+
+namespace Utils
+{
+    ProcessCancellation::ProcessCancellation()
+    {
+        HANDLE event = CreateEvent(NULL, TRUE /*manual reset*/, FALSE /*initial state*/, NULL);
+        if (event == NULL)
+        {
+            throw DMExceptionWithErrorCode("Error: CreateEvent failed.", GetLastError());
+        }
+        _waitHandle = reinterpret_cast<intptr_t>(event);
+        _signalHandle = _waitHandle;
+    }
+
+    ProcessCancellation::~ProcessCancellation()
+    {
+        CloseHandle(reinterpret_cast<HANDLE>(_waitHandle));
+    }
+
+    void ProcessCancellation::Cancel()
+    {
+        SetEvent(reinterpret_cast<HANDLE>(_signalHandle));
+    }
+
+    bool ProcessCancellation::IsCancelled() const
+    {
+        return WaitForSingleObject(reinterpret_cast<HANDLE>(_waitHandle), 0) == WAIT_OBJECT_0;
+    }
+
+    // Anonymous pipes cannot be read asynchronously, so the child writes to
+    // a uniquely named pipe whose read end is overlapped. The read event, the
+    // process handle and the cancellation event are waited on together.
+    class Win32ChildProcess : public IChildProcess
+    {
+    public:
+        Win32ChildProcess(const wstring& commandLine, const ProcessCancellation* cancellation) :
+            _cancelEvent(cancellation == nullptr ? NULL : reinterpret_cast<HANDLE>(cancellation->WaitHandle())),
+            _reading(false),
+            _ended(false),
+            _exited(false)
+        {
+            static atomic<unsigned int> pipeIndex(0);
+            wstring pipeName = L"\\\\.\\pipe\\IoTDM.ChildProcess." + to_wstring(GetCurrentProcessId()) + L"." + to_wstring(++pipeIndex);
+
+            HANDLE readPipe = CreateNamedPipe(pipeName.c_str(),
+                PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                1,                          // max instances
+                0,                          // out buffer size
+                ProcessRunner::ReadSize,    // in buffer size
+                0,                          // default timeout
+                NULL);
+            if (readPipe == INVALID_HANDLE_VALUE)
+            {
+                throw DMExceptionWithErrorCode("Error: CreateNamedPipe failed.", GetLastError());
+            }
+            _readPipe.SetHandle(move(readPipe));
+
+            SECURITY_ATTRIBUTES securityAttributes;
+            securityAttributes.nLength = sizeof(SECURITY_ATTRIBUTES);
+            securityAttributes.bInheritHandle = TRUE;
+            securityAttributes.lpSecurityDescriptor = NULL;
+
+            AutoCloseHandle writePipe(CreateFile(pipeName.c_str(), GENERIC_WRITE, 0, &securityAttributes, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+            if (writePipe.Get() == INVALID_HANDLE_VALUE)
+            {
+                writePipe.SetHandle(NULL);
+                throw DMExceptionWithErrorCode("Error: CreateFile failed for the child's output pipe.", GetLastError());
+            }
+
+            HANDLE readEvent = CreateEvent(NULL, TRUE /*manual reset*/, FALSE /*initial state*/, NULL);
+            if (readEvent == NULL)
+            {
+                throw DMExceptionWithErrorCode("Error: CreateEvent failed.", GetLastError());
+            }
+            _readEvent.SetHandle(move(readEvent));
+
+            PROCESS_INFORMATION processInfo;
+            ZeroMemory(&processInfo, sizeof(PROCESS_INFORMATION));
+
+            STARTUPINFO startupInfo;
+            ZeroMemory(&startupInfo, sizeof(STARTUPINFO));
+            startupInfo.cb = sizeof(STARTUPINFO);
+            startupInfo.hStdError = writePipe.Get();
+            startupInfo.hStdOutput = writePipe.Get();
+            startupInfo.hStdInput = NULL;
+            startupInfo.dwFlags |= STARTF_USESTDHANDLES;
+
+            vector<wchar_t> commandBuffer(commandLine.begin(), commandLine.end());
+            commandBuffer.push_back(L'\0');
+            if (!CreateProcess(NULL,
+                commandBuffer.data(),   // command line
+                NULL,                   // process security attributes
+                NULL,                   // primary thread security attributes
+                TRUE,                   // handles are inherited
+                0,                      // creation flags
+                NULL,                   // use parent's environment
+                NULL,                   // use parent's current directory
+                &startupInfo,
+                &processInfo))
+            {
+                throw DMExceptionWithErrorCode("Error: CreateProcess failed.", GetLastError());
+            }
+            CloseHandle(processInfo.hThread);
+            _process.SetHandle(move(processInfo.hProcess));
+
+            // Only the child holds the write end now, so the read ends when the child (and anything it spawned) exits.
+            writePipe.Close();
+
+            StartRead();
+        }
+
+        ~Win32ChildProcess()
+        {
+            if (_reading)
+            {
+                // The buffer must outlive the read.
+                CancelIoEx(_readPipe.Get(), &_overlapped);
+                DWORD bytesRead = 0;
+                GetOverlappedResult(_readPipe.Get(), &_overlapped, &bytesRead, TRUE /*wait*/);
+            }
+        }
+
+        unsigned int Wait(unsigned int timeoutMs) override
+        {
+            HANDLE handles[3];
+            DWORD count = 0;
+            if (_cancelEvent != NULL)
+            {
+                handles[count++] = _cancelEvent;
+            }
+            if (!_exited)
+            {
+                handles[count++] = _process.Get();
+            }
+            if (!_ended)
+            {
+                handles[count++] = _readEvent.Get();
+            }
+
+            if (count == 0)
+            {
+                return 0;
+            }
+
+            DWORD waitResult = WaitForMultipleObjects(count, handles, FALSE /*wait all*/, timeoutMs == ProcessRunner::NoTimeout ? INFINITE : timeoutMs);
+            if (waitResult == WAIT_FAILED)
+            {
+                throw DMExceptionWithErrorCode("Error: WaitForMultipleObjects failed.", GetLastError());
+            }
+            if (waitResult == WAIT_TIMEOUT)
+            {
+                return 0;
+            }
+
+            // More than one may be signaled; report all of them.
+            unsigned int events = 0;
+            if (_cancelEvent != NULL && WaitForSingleObject(_cancelEvent, 0) == WAIT_OBJECT_0)
+            {
+                events |= Cancelled;
+            }
+            if (!_exited && WaitForSingleObject(_process.Get(), 0) == WAIT_OBJECT_0)
+            {
+                _exited = true;
+                events |= Exited;
+            }
+            if (!_ended && WaitForSingleObject(_readEvent.Get(), 0) == WAIT_OBJECT_0)
+            {
+                events |= OutputReady;
+            }
+            return events;
+        }
+
+        size_t Read(char* buffer, size_t size) override
+        {
+            if (_ended)
+            {
+                return 0;
+            }
+
+            // Only called once the read event is set, so this does not block.
+            DWORD bytesRead = 0;
+            if (!_reading || !GetOverlappedResult(_readPipe.Get(), &_overlapped, &bytesRead, FALSE /*wait*/))
+            {
+                // ERROR_BROKEN_PIPE: every writer has closed its end.
+                _reading = false;
+                _ended = true;
+                return 0;
+            }
+            _reading = false;
+
+            size_t count = (min)(size, static_cast<size_t>(bytesRead));
+            memcpy(buffer, _buffer, count);
+
+            StartRead();
+            return count;
+        }
+
+        unsigned long ExitCode() override
+        {
+            DWORD exitCode = 0;
+            if (!GetExitCodeProcess(_process.Get(), &exitCode))
+            {
+                TRACEP("Warning: Failed to get process exit code. GetLastError() = ", GetLastError());
+            }
+            return exitCode;
+        }
+
+        void Terminate() override
+        {
+            if (!_exited)
+            {
+                TerminateProcess(_process.Get(), ERROR_CANCELLED);
+                WaitForSingleObject(_process.Get(), INFINITE);
+                _exited = true;
+            }
+        }
+
+    private:
+        // Issues the next read. If it fails at once (the pipe is already
+        // broken), the event is set so that the next Read() reports the end.
+        void StartRead()
+        {
+            ZeroMemory(&_overlapped, sizeof(_overlapped));
+            _overlapped.hEvent = _readEvent.Get();
+            ResetEvent(_readEvent.Get());
+
+            if (ReadFile(_readPipe.Get(), _buffer, sizeof(_buffer), NULL, &_overlapped) || GetLastError() == ERROR_IO_PENDING)
+            {
+                _reading = true;
+            }
+            else
+            {
+                _reading = false;
+                SetEvent(_readEvent.Get());
+            }
+        }
+
+        HANDLE _cancelEvent;
+        AutoCloseHandle _process;
+        AutoCloseHandle _readPipe;
+        AutoCloseHandle _readEvent;
+        OVERLAPPED _overlapped;
+        char _buffer[ProcessRunner::ReadSize];
+        bool _reading;
+        bool _ended;
+        bool _exited;
+    };
+
+    unique_ptr<IChildProcess> StartChildProcess(const wstring& commandLine, const ProcessCancellation* cancellation)
+    {
+        return unique_ptr<IChildProcess>(new Win32ChildProcess(commandLine, cancellation));
+    }
+}
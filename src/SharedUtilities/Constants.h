@@ -34,6 +34,11 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define RegEventTracingLogFileFolder L"LogFileFolder"
 #define RegEventTracingLogFileName L"LogFileName"
 
+#define RegBinaryLog IoTDMRegistryRoot L"\\BinaryLog"
+#define RegBinaryLogFolder L"LogFileFolder"
+
+#define RegSyncMLWorkerCount L"SyncMLWorkerCount"
+
 #define RegTimeService IoTDMRegistryRoot L"\\TimeService"
 #define RegRemoteTimeService RegTimeService L"\\Remote"
 #define RegLocalTimeService RegTimeService L"\\Local"
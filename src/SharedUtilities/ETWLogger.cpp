@@ -72,43 +72,61 @@ namespace Utils
         return retValue;
     }
 
-    void ETWLogger::Log(const std::wstring& msg, LoggingLevel level)
+    bool ETWLogger::IsEnabled(LoggingLevel level) const
+    {
+        static const UCHAR eventLevels[] =
+        {
+            WINEVENT_LEVEL_VERBOSE,
+            WINEVENT_LEVEL_INFORMATION,
+            WINEVENT_LEVEL_WARNING,
+            WINEVENT_LEVEL_ERROR,
+            WINEVENT_LEVEL_CRITICAL
+        };
+        return TraceLoggingProviderEnabled(gLogProvider, eventLevels[level], 0) != FALSE;
+    }
+
+    void ETWLogger::Log(const wchar_t* msg, LoggingLevel level)
     {
         switch (level)
         {
         case Verbose:
             TraceLoggingWrite(gLogProvider, "LogMsgVerbose",
                 TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE), 
-                TraceLoggingWideString(msg.c_str(), "msg"),
+                TraceLoggingWideString(msg, "msg"),
                 TraceLoggingWideString(_exeFileName.c_str(), "exeName"));
             break;
         case Information:
             TraceLoggingWrite(gLogProvider, "LogMsgInformation",
                 TraceLoggingLevel(WINEVENT_LEVEL_INFORMATION),
-                TraceLoggingWideString(msg.c_str(), "msg"),
+                TraceLoggingWideString(msg, "msg"),
                 TraceLoggingWideString(_exeFileName.c_str(), "exeName"));
             break;
         case Warning:
             TraceLoggingWrite(gLogProvider, "LogMsgWarning",
                 TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
-                TraceLoggingWideString(msg.c_str(), "msg"),
+                TraceLoggingWideString(msg, "msg"),
                 TraceLoggingWideString(_exeFileName.c_str(), "exeName"));
             break;
         case Error:
             TraceLoggingWrite(gLogProvider, "LogMsgError",
                 TraceLoggingLevel(WINEVENT_LEVEL_ERROR),
-                TraceLoggingWideString(msg.c_str(), "msg"),
+                TraceLoggingWideString(msg, "msg"),
                 TraceLoggingWideString(_exeFileName.c_str(), "exeName"));
             break;
         case Critical:
             TraceLoggingWrite(gLogProvider, "LogMsgCritical",
                 TraceLoggingLevel(WINEVENT_LEVEL_CRITICAL),
-                TraceLoggingWideString(msg.c_str(), "msg"),
+                TraceLoggingWideString(msg, "msg"),
                 TraceLoggingWideString(_exeFileName.c_str(), "exeName"));
             break;
         }
     }
 
+    void ETWLogger::Log(const std::wstring& msg, LoggingLevel level)
+    {
+        Log(msg.c_str(), level);
+    }
+
     void ETWLogger::Log(const std::string& msg, LoggingLevel level)
     {
         switch (level)
@@ -33,6 +33,10 @@ namespace Utils
 
         ETWLogger();
         ~ETWLogger();
+        // True if an ETW session is listening at this level.
+        bool IsEnabled(LoggingLevel level) const;
+
+        void Log(const wchar_t* msg, LoggingLevel level);
         void Log(const std::wstring& msg, LoggingLevel level);
         void Log(const std::string& msg, LoggingLevel level);
 
@@ -0,0 +1,130 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <cstring>
+#include "LogRing.h"
+
+using namespace std;
+
+namespace Utils
+{
+    LogRing::LogRing() :
+        _head(0),
+        _tail(0),
+        _dropped(0),
+        _claimed(false)
+    {}
+
+    LogRing::~LogRing()
+    {
+        for (uint64_t i = _tail.load(); i != _head.load(); ++i)
+        {
+            delete[] _records[i % Capacity].heapText;
+        }
+    }
+
+    void LogRing::Push(ETWLogger::LoggingLevel level, const wchar_t* format, size_t formatLength, const LogArg& arg, uint64_t time, uint32_t threadId)
+    {
+        uint64_t head = _head.load(memory_order_relaxed);
+
+        // Make room by dropping the oldest record. If the reader takes it
+        // first, its compare-exchange wins and this one retries.
+        uint64_t tail = _tail.load(memory_order_acquire);
+        while (head - tail >= Capacity)
+        {
+            if (_tail.compare_exchange_weak(tail, tail + 1, memory_order_acq_rel))
+            {
+                Record& dropped = _records[tail % Capacity];
+                delete[] dropped.heapText;
+                dropped.heapText = nullptr;
+                _dropped.fetch_add(1, memory_order_relaxed);
+                break;
+            }
+        }
+
+        Record& record = _records[head % Capacity];
+        record.time = time;
+        record.threadId = threadId;
+        record.level = level;
+        record.argType = arg.type;
+        record.argValue = arg.value;
+        record.formatLength = formatLength;
+
+        size_t textLength = arg.type == LogArgType::String ? arg.length : 0;
+        record.length = formatLength + textLength;
+        wchar_t* destination = record.inlineText;
+        record.heapText = nullptr;
+        if (record.length >= InlineChars)
+        {
+            record.heapText = new wchar_t[record.length];
+            destination = record.heapText;
+        }
+        memcpy(destination, format, formatLength * sizeof(wchar_t));
+        if (textLength != 0)
+        {
+            memcpy(destination + formatLength, arg.text, textLength * sizeof(wchar_t));
+        }
+
+        _head.store(head + 1, memory_order_release);
+    }
+
+    bool LogRing::Pop(LogEntry& entry)
+    {
+        uint64_t tail = _tail.load(memory_order_acquire);
+        for (;;)
+        {
+            if (tail == _head.load(memory_order_acquire))
+            {
+                return false;
+            }
+
+            // Copy first, then claim. If the writer dropped this record in
+            // the meantime, the claim fails and the copy is discarded
+            // without being looked at.
+            Record record;
+            memcpy(&record, &_records[tail % Capacity], sizeof(record));
+            if (_tail.compare_exchange_strong(tail, tail + 1, memory_order_acq_rel))
+            {
+                entry.time = record.time;
+                entry.threadId = record.threadId;
+                entry.level = record.level;
+                entry.formatLength = record.formatLength;
+                entry.argType = record.argType;
+                entry.argValue = record.argValue;
+                if (record.heapText != nullptr)
+                {
+                    entry.text.assign(record.heapText, record.length);
+                    delete[] record.heapText;
+                }
+                else
+                {
+                    entry.text.assign(record.inlineText, record.length);
+                }
+                return true;
+            }
+        }
+    }
+
+    bool LogRing::TryClaim()
+    {
+        bool expected = false;
+        return _claimed.compare_exchange_strong(expected, true);
+    }
+
+    void LogRing::Unclaim()
+    {
+        _claimed.store(false);
+    }
+}
@@ -0,0 +1,127 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "ETWLogger.h"
+
+namespace Utils
+{
+    enum class LogArgType : uint8_t
+    {
+        None = 0,
+        Int = 1,
+        UInt = 2,
+        String = 3
+    };
+
+    // The parameter of a TRACEP record. Integers are kept as values and
+    // only formatted by the sink that writes them.
+    struct LogArg
+    {
+        LogArgType type;
+        uint64_t value;         // Int (two's complement) or UInt
+        const wchar_t* text;    // String
+        size_t length;
+    };
+
+    struct LogEntry
+    {
+        uint64_t time;          // FILETIME ticks (UTC)
+        uint32_t threadId;
+        ETWLogger::LoggingLevel level;
+        // The format, followed by the parameter if it is a string.
+        std::wstring text;
+        size_t formatLength;
+        LogArgType argType;
+        uint64_t argValue;
+
+        void AppendText(std::wstring& output) const
+        {
+            output += text;
+            if (argType == LogArgType::Int)
+            {
+                output += std::to_wstring(static_cast<int64_t>(argValue));
+            }
+            else if (argType == LogArgType::UInt)
+            {
+                output += std::to_wstring(argValue);
+            }
+        }
+    };
+
+    // Bounded ring of log records written by one thread and drained by one
+    // other thread, without locks.
+    //
+    // When the ring is full, the writer discards the oldest record and
+    // counts it as dropped; logging never waits for the reader. Short
+    // messages are stored inline; longer ones are copied to the heap.
+    class LogRing
+    {
+    public:
+        static const size_t Capacity = 256;
+        static const size_t InlineChars = 120;
+
+        LogRing();
+        ~LogRing();
+
+        // Writer side.
+        void Push(ETWLogger::LoggingLevel level, const wchar_t* text, size_t length, uint64_t time, uint32_t threadId)
+        {
+            LogArg none = { LogArgType::None, 0, nullptr, 0 };
+            Push(level, text, length, none, time, threadId);
+        }
+
+        void Push(ETWLogger::LoggingLevel level, const wchar_t* format, size_t formatLength, const LogArg& arg, uint64_t time, uint32_t threadId);
+
+        // Reader side. Returns false when the ring is empty.
+        bool Pop(LogEntry& entry);
+        bool Empty() const { return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire); }
+
+        uint64_t DroppedCount() const { return _dropped.load(std::memory_order_relaxed); }
+
+        // A ring outlives the thread that wrote to it and is handed to the next new thread.
+        bool TryClaim();
+        void Unclaim();
+
+    private:
+        struct Record
+        {
+            uint64_t time;
+            uint32_t threadId;
+            ETWLogger::LoggingLevel level;
+            LogArgType argType;
+            uint64_t argValue;
+            size_t formatLength;
+            size_t length;
+            wchar_t* heapText;
+            wchar_t inlineText[InlineChars];
+        };
+
+        LogRing(const LogRing&);
+        LogRing& operator=(const LogRing&);
+
+        Record _records[Capacity];
+
+        // Records in [_tail, _head) are readable. Only the writer moves _head;
+        // both sides move _tail, the writer only to drop the oldest record.
+        std::atomic<uint64_t> _head;
+        std::atomic<uint64_t> _tail;
+        std::atomic<uint64_t> _dropped;
+        std::atomic<bool> _claimed;
+    };
+}
@@ -18,6 +18,8 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <fstream>
 #include <iostream> 
 #include <iomanip>
+#include <algorithm>
+#include <list>
 #include "StringUtils.h"
 #include "Logger.h"
 #include "ETWLogger.h"
@@ -26,53 +28,421 @@ using namespace std;
 
 Utils::ETWLogger gETWLogger;
 
+const unsigned int Logger::DrainIntervalMs;
+
+static atomic<uint64_t> gNextLoggerId(1);
+
 Logger::Logger(bool console) :
+    _id(gNextLoggerId++),
+    _cachedSecond(0),
+    _reportedDrops(0),
+    _drainIdle(false),
+    _drainDone(false),
+    _stop(false),
+#ifdef _DEBUG
+    _level(Utils::ETWLogger::LoggingLevel::Verbose),
+#else
+    _level(Utils::ETWLogger::LoggingLevel::Information),
+#endif
+    _binaryLevel(Disabled),
     _console(console)
 {
     Log("----New Session----------------------------------------------------------------");
 }
 
-void Logger::Log(const char* msg)
+Logger::~Logger()
 {
-    wstring s = Utils::MultibyteToWide(msg);
-    Log(Utils::ETWLogger::LoggingLevel::Information, s.c_str());
+    if (!_drainThread.joinable())
+    {
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(_wakeMutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+
+    // Not join(): when a DLL is unloaded the loader lock is held and the thread
+    // could never finish exiting. At process exit the thread is already gone.
+    HANDLE thread = _drainThread.native_handle();
+    while (!_drainDone && WaitForSingleObject(thread, 10) == WAIT_TIMEOUT)
+    {
+    }
+    _drainThread.detach();
 }
 
-void Logger::Log(const wchar_t* msg)
+Utils::LogRing* Logger::ThreadRing()
 {
-    Log(Utils::ETWLogger::LoggingLevel::Information, msg);
+    struct ThreadSlot
+    {
+        uint64_t loggerId;
+        shared_ptr<Utils::LogRing> ring;
+
+        ThreadSlot(uint64_t id, const shared_ptr<Utils::LogRing>& claimed) :
+            loggerId(id),
+            ring(claimed)
+        {
+        }
+
+        ~ThreadSlot()
+        {
+            ring->Unclaim();
+        }
+
+    private:
+        ThreadSlot(const ThreadSlot&);
+        ThreadSlot& operator=(const ThreadSlot&);
+    };
+
+    // One slot per logger this thread has written to; there is normally
+    // only gLogger. A list, so slots are never copied.
+    static thread_local list<ThreadSlot> slots;
+
+    for (const auto& slot : slots)
+    {
+        if (slot.loggerId == _id)
+        {
+            return slot.ring.get();
+        }
+    }
+
+    // Release the rings of loggers that have since been destroyed.
+    slots.remove_if([](const ThreadSlot& slot) { return slot.ring.use_count() == 1; });
+
+    lock_guard<mutex> guard(_mutex);
+    shared_ptr<Utils::LogRing> claimed;
+    for (const auto& ring : _rings)
+    {
+        if (ring->TryClaim())
+        {
+            claimed = ring;
+            break;
+        }
+    }
+
+    if (!claimed)
+    {
+        claimed = make_shared<Utils::LogRing>();
+        claimed->TryClaim();
+        _rings.push_back(claimed);
+    }
+
+    slots.emplace_back(_id, claimed);
+
+    if (!_drainThread.joinable())
+    {
+        // ~Logger stops waiting once _drainDone is set, but the thread still
+        // has code in this module to run. It holds its own reference on the
+        // module and drops it on the way out, so FreeLibrary cannot unmap
+        // the code under it; the module stays loaded while the thread lives.
+        HMODULE module = nullptr;
+        GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, reinterpret_cast<LPCWSTR>(&gETWLogger), &module);
+        _drainThread = thread([this, module]()
+        {
+            DrainLoop();
+            if (module != nullptr)
+            {
+                FreeLibraryAndExitThread(module, 0);
+            }
+        });
+    }
+    return claimed.get();
 }
 
-void Logger::Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg)
+void Logger::DrainLoop()
 {
-    SYSTEMTIME systemTime;
-    GetLocalTime(&systemTime);
+    for (;;)
+    {
+        bool stop = _stop;
+        Drain();
+        if (stop)
+        {
+            break;
+        }
 
-    // format time
-    basic_ostringstream<wchar_t> formattedTime;
-    formattedTime << setw(2) << setfill(L'0') << (systemTime.wHour > 12 ? (systemTime.wHour - 12) : systemTime.wHour)
-        << L'-' << setw(2) << setfill(L'0') << systemTime.wMinute
-        << L'-' << setw(2) << setfill(L'0') << systemTime.wSecond;
+        // Records that arrived during Drain() are batched for one interval;
+        // with nothing queued the thread sleeps until Write() wakes it.
+        unique_lock<mutex> lock(_wakeMutex);
+        _drainIdle = true;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (!_stop)
+        {
+            if (IsPending())
+            {
+                _wake.wait_for(lock, chrono::milliseconds(DrainIntervalMs));
+            }
+            else
+            {
+                _wake.wait(lock);
+            }
+        }
+        _drainIdle = false;
+    }
+    _drainDone = true;
+}
 
-    // format thread id
-    basic_ostringstream<wchar_t> formattedThreadId;
-    formattedThreadId << setw(8) << setfill(L'0') << GetThreadId(GetCurrentThread());
+bool Logger::IsPending()
+{
+    lock_guard<mutex> guard(_mutex);
+    for (const auto& ring : _rings)
+    {
+        if (!ring->Empty())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::AppendLine(wstring& output, const Utils::LogEntry& entry)
+{
+    uint64_t time = entry.time;
 
-    // build message
-    wstring messageWithTime = formattedTime.str() + L" "
-        + (systemTime.wHour >= 12 ? L"PM " : L"AM ")
-        + L"[" + formattedThreadId.str() + L"] "
-        + msg
-        + L"\r\n";
+    // Timestamps only have one-second resolution, so the formatted form is
+    // reused until the second changes.
+    const uint64_t ticksPerSecond = 10000000;
+    uint64_t second = time / ticksPerSecond;
+    if (second != _cachedSecond || _cachedTime.empty())
+    {
+        ULARGE_INTEGER utc;
+        utc.QuadPart = time;
+        FILETIME utcTime = { utc.LowPart, utc.HighPart };
+        FILETIME localTime;
+        SYSTEMTIME systemTime;
+        FileTimeToLocalFileTime(&utcTime, &localTime);
+        FileTimeToSystemTime(&localTime, &systemTime);
+
+        wchar_t formattedTime[32];
+        swprintf_s(formattedTime, L"%02u-%02u-%02u %ls ",
+            systemTime.wHour > 12 ? (systemTime.wHour - 12) : systemTime.wHour,
+            systemTime.wMinute,
+            systemTime.wSecond,
+            systemTime.wHour >= 12 ? L"PM" : L"AM");
+
+        _cachedTime = formattedTime;
+        _cachedSecond = second;
+    }
+
+    wchar_t formattedThreadId[16];
+    swprintf_s(formattedThreadId, L"[%08u] ", entry.threadId);
+
+    output += _cachedTime;
+    output += formattedThreadId;
+    entry.AppendText(output);
+    output += L"\r\n";
+}
+
+void Logger::Drain()
+{
+    lock_guard<mutex> drainGuard(_drainMutex);
 
-    // share...
-    if (_console)
+    vector<Utils::LogRing*> rings;
     {
         lock_guard<mutex> guard(_mutex);
-        wcout << messageWithTime;
+        for (const auto& ring : _rings)
+        {
+            rings.push_back(ring.get());
+        }
+    }
+
+    vector<Utils::LogEntry> entries;
+    uint64_t dropped = 0;
+    for (Utils::LogRing* ring : rings)
+    {
+        Utils::LogEntry entry;
+        while (ring->Pop(entry))
+        {
+            entries.push_back(move(entry));
+        }
+        dropped += ring->DroppedCount();
+    }
+
+    if (entries.empty() && dropped == _reportedDrops)
+    {
+        return;
+    }
+
+    // Interleave the threads' records in the order they were logged.
+    stable_sort(entries.begin(), entries.end(), [](const Utils::LogEntry& a, const Utils::LogEntry& b)
+    {
+        return a.time < b.time;
+    });
+
+    if (dropped != _reportedDrops)
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        ULARGE_INTEGER time = { now.dwLowDateTime, now.dwHighDateTime };
+
+        Utils::LogEntry entry;
+        entry.time = time.QuadPart;
+        entry.threadId = GetCurrentThreadId();
+        entry.level = Utils::ETWLogger::LoggingLevel::Warning;
+        entry.text = L"Logger: " + to_wstring(dropped - _reportedDrops) + L" message(s) dropped.";
+        entry.formatLength = entry.text.size();
+        entry.argType = Utils::LogArgType::None;
+        entry.argValue = 0;
+        entries.insert(entries.begin(), move(entry));
+        _reportedDrops = dropped;
+    }
+
+    wstring output;
+    int consoleLevel = _console ? _level.load() : Disabled;
+    int binaryLevel = _binaryLog ? _binaryLevel.load() : Disabled;
+    for (const auto& entry : entries)
+    {
+        if (entry.level >= consoleLevel)
+        {
+            AppendLine(output, entry);
+        }
+
+        if (entry.level >= binaryLevel)
+        {
+            try
+            {
+                _binaryLog->Write(entry);
+            }
+            catch (...)
+            {
+                // Keep the console going if the log files become unwritable.
+                _binaryLevel = Disabled;
+                binaryLevel = Disabled;
+                _binaryLog.reset();
+            }
+        }
     }
 
-    gETWLogger.Log(msg, level);
+    if (!output.empty())
+    {
+        wcout << output;
+    }
+}
+
+void Logger::Flush()
+{
+    Drain();
+    wcout.flush();
+
+    lock_guard<mutex> drainGuard(_drainMutex);
+    if (_binaryLog)
+    {
+        _binaryLog->Flush();
+    }
+}
+
+void Logger::EnableBinaryLog(unique_ptr<Utils::ILogSink> binaryLog, Utils::ETWLogger::LoggingLevel level)
+{
+    lock_guard<mutex> drainGuard(_drainMutex);
+    _binaryLog = move(binaryLog);
+    _binaryLevel = level;
+}
+
+uint64_t Logger::DroppedCount()
+{
+    lock_guard<mutex> guard(_mutex);
+    uint64_t dropped = 0;
+    for (const auto& ring : _rings)
+    {
+        dropped += ring->DroppedCount();
+    }
+    return dropped;
+}
+
+bool Logger::IsQueued(Utils::ETWLogger::LoggingLevel level) const
+{
+    return (_console && level >= _level.load(memory_order_relaxed)) || level >= _binaryLevel.load(memory_order_relaxed);
+}
+
+bool Logger::IsEnabled(Utils::ETWLogger::LoggingLevel level)
+{
+    return IsQueued(level) || gETWLogger.IsEnabled(level);
+}
+
+void Logger::SetLevel(Utils::ETWLogger::LoggingLevel level)
+{
+    _level = level;
+}
+
+void Logger::Write(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, size_t length, const Utils::LogArg& arg)
+{
+    if (IsQueued(level))
+    {
+        FILETIME now;
+        GetSystemTimeAsFileTime(&now);
+        ULARGE_INTEGER time = { now.dwLowDateTime, now.dwHighDateTime };
+
+        ThreadRing()->Push(level, msg, length, arg, time.QuadPart, GetCurrentThreadId());
+
+        // Pairs with the fence in DrainLoop(): either the drain thread sees
+        // this record before it sleeps, or this thread sees it idle. The
+        // lock keeps the notification from landing before it waits.
+        atomic_thread_fence(memory_order_seq_cst);
+        if (_drainIdle.load(memory_order_relaxed))
+        {
+            lock_guard<mutex> lock(_wakeMutex);
+            _wake.notify_one();
+        }
+    }
+
+    if (gETWLogger.IsEnabled(level))
+    {
+        if (arg.type == Utils::LogArgType::None)
+        {
+            gETWLogger.Log(msg, level);
+        }
+        else
+        {
+            wstring message(msg, length);
+            if (arg.type == Utils::LogArgType::String)
+            {
+                message.append(arg.text, arg.length);
+            }
+            else
+            {
+                message += arg.type == Utils::LogArgType::Int ? to_wstring(static_cast<int64_t>(arg.value)) : to_wstring(arg.value);
+            }
+            gETWLogger.Log(message, level);
+        }
+    }
+}
+
+void Logger::Log(const char* msg)
+{
+    Log(Utils::ETWLogger::LoggingLevel::Information, msg);
+}
+
+void Logger::Log(const wchar_t* msg)
+{
+    Log(Utils::ETWLogger::LoggingLevel::Information, msg);
+}
+
+void Logger::Log(Utils::ETWLogger::LoggingLevel level, const char* msg)
+{
+    if (IsEnabled(level))
+    {
+        wstring s = Utils::MultibyteToWide(msg);
+        Utils::LogArg none = { Utils::LogArgType::None, 0, nullptr, 0 };
+        Write(level, s.c_str(), s.size(), none);
+    }
+}
+
+void Logger::Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg)
+{
+    Utils::LogArg none = { Utils::LogArgType::None, 0, nullptr, 0 };
+    Write(level, msg, wcslen(msg), none);
+}
+
+void Logger::Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, const wchar_t* param)
+{
+    Utils::LogArg arg = { Utils::LogArgType::String, 0, param, param == nullptr ? 0 : wcslen(param) };
+    Write(level, msg, wcslen(msg), arg);
+}
+
+void Logger::Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, const wstring& param)
+{
+    Utils::LogArg arg = { Utils::LogArgType::String, 0, param.c_str(), param.size() };
+    Write(level, msg, wcslen(msg), arg);
 }
 
 void Logger::Log(const char* msg, const char* param)
@@ -82,20 +452,26 @@ void Logger::Log(const char* msg, const char* param)
 
 void Logger::Log(Utils::ETWLogger::LoggingLevel level, const char*  msg, const char* param)
 {
-    wstring m = Utils::MultibyteToWide(msg);
-    wstring p = Utils::MultibyteToWide(param);
-    Log<const wchar_t*>(level, m.c_str(), p.c_str());
-
+    if (IsEnabled(level))
+    {
+        wstring m = Utils::MultibyteToWide(msg);
+        wstring p = Utils::MultibyteToWide(param);
+        Utils::LogArg arg = { Utils::LogArgType::String, 0, p.c_str(), p.size() };
+        Write(level, m.c_str(), m.size(), arg);
+    }
 }
 
 void Logger::Log(const char*  msg, int param)
 {
-    wstring s = Utils::MultibyteToWide(msg);
-    Log<int>(Utils::ETWLogger::LoggingLevel::Information, s.c_str(), param);
+    Log(Utils::ETWLogger::LoggingLevel::Information, msg, param);
 }
 
 void Logger::Log(Utils::ETWLogger::LoggingLevel level, const char*  msg, int param)
 {
-    wstring s = Utils::MultibyteToWide(msg);
-    Log<int>(level, s.c_str(), param);
+    if (IsEnabled(level))
+    {
+        wstring s = Utils::MultibyteToWide(msg);
+        Utils::LogArg arg = { Utils::LogArgType::Int, static_cast<uint64_t>(static_cast<int64_t>(param)), nullptr, 0 };
+        Write(level, s.c_str(), s.size(), arg);
+    }
 }
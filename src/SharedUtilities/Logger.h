@@ -14,17 +14,29 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <type_traits>
+#include <vector>
 #include "ETWLogger.h"
+#include "LogRing.h"
+#include "LogSink.h"
 
 #include "..\DMMessage\DMGarbageCollectorTempFolder.h"
 
+// Console and binary file output is asynchronous: each thread appends to
+// its own lock-free ring and a background thread formats and writes the
+// records. ETW events are still written on the calling thread.
 class Logger
 {
 public:
     Logger(bool console);
+    ~Logger();
 
     // Legacy (no logging level; defaults to information)
     void Log(const char*  message);
@@ -33,9 +45,7 @@ public:
     template<class T>
     void Log(const wchar_t* msg, T param)
     {
-        std::basic_ostringstream<wchar_t> message;
-        message << msg << param;
-        Log(message.str().c_str());
+        Log(Utils::ETWLogger::LoggingLevel::Information, msg, param);
     }
 
     void Log(const char* msg, const char* param);
@@ -45,24 +55,114 @@ public:
     void Log(Utils::ETWLogger::LoggingLevel level, const char*  msg);
     void Log(Utils::ETWLogger::LoggingLevel level, const wchar_t*  msg);
 
+    // Integer parameters are passed to the sinks as values; other types are
+    // formatted here. The message and parameter are joined by the sink.
     template<class T>
     void Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, T param)
     {
-        std::basic_ostringstream<wchar_t> message;
-        message << msg << param;
-        Log(level, message.str().c_str());
+        if (!IsEnabled(level))
+        {
+            return;
+        }
+
+        LogParam(level, msg, param, std::integral_constant<bool,
+            std::is_integral<T>::value && !std::is_same<T, wchar_t>::value && !std::is_same<T, char>::value>());
     }
 
+    void Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, const wchar_t* param);
+    void Log(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, const std::wstring& param);
     void Log(Utils::ETWLogger::LoggingLevel level, const char* msg, const char* param);
     void Log(Utils::ETWLogger::LoggingLevel level, const char* msg, int param);
 
+    // True if the console, the binary log or an ETW session wants records at this level.
+    bool IsEnabled(Utils::ETWLogger::LoggingLevel level);
+
+    // Console threshold; ETW sessions choose their own level.
+    void SetLevel(Utils::ETWLogger::LoggingLevel level);
+
+    // Also hands records at 'level' and above to 'binaryLog', replacing any
+    // earlier one. The sink is supplied by the host so that only processes
+    // that keep log files link the file writer (see Utils::BinaryLogWriter).
+    void EnableBinaryLog(std::unique_ptr<Utils::ILogSink> binaryLog, Utils::ETWLogger::LoggingLevel level);
+
+    // Writes everything logged so far to the console and binary log before returning.
+    void Flush();
+
+    // Console records discarded because a thread's ring was full.
+    uint64_t DroppedCount();
+
 private:
+    static const unsigned int DrainIntervalMs = 50;
+
+    static const int Disabled = Utils::ETWLogger::LoggingLevel::Critical + 1;
+
+    template<class T>
+    void LogParam(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, T param, std::true_type /*integral*/)
+    {
+        Utils::LogArg arg = { std::is_signed<T>::value ? Utils::LogArgType::Int : Utils::LogArgType::UInt, static_cast<uint64_t>(param), nullptr, 0 };
+        Write(level, msg, wcslen(msg), arg);
+    }
+
+    template<class T>
+    void LogParam(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, T param, std::false_type /*integral*/)
+    {
+        std::basic_ostringstream<wchar_t> formattedParam;
+        formattedParam << param;
+        Log(level, msg, formattedParam.str());
+    }
+
+    bool IsQueued(Utils::ETWLogger::LoggingLevel level) const;
+    Utils::LogRing* ThreadRing();
+    void Write(Utils::ETWLogger::LoggingLevel level, const wchar_t* msg, size_t length, const Utils::LogArg& arg);
+    void DrainLoop();
+    bool IsPending();
+    void Drain();
+    void AppendLine(std::wstring& output, const Utils::LogEntry& entry);
+
+    // Distinguishes this logger's rings in the per-thread slots, even if
+    // another logger later reuses its address.
+    const uint64_t _id;
+
+    // Guards _rings and the start of the drain thread. A thread's slot
+    // shares ownership of its ring, so it may outlive the logger.
     std::mutex _mutex;
+    std::vector<std::shared_ptr<Utils::LogRing>> _rings;
 
+    // Serializes readers of the rings and the formatting state below.
+    std::mutex _drainMutex;
+    uint64_t _cachedSecond;
+    std::wstring _cachedTime;
+    uint64_t _reportedDrops;
+    std::unique_ptr<Utils::ILogSink> _binaryLog;
+
+    std::thread _drainThread;
+    std::mutex _wakeMutex;
+    std::condition_variable _wake;
+    std::atomic<bool> _drainIdle;
+    std::atomic<bool> _drainDone;
+    std::atomic<bool> _stop;
+
+    std::atomic<int> _level;
+    std::atomic<int> _binaryLevel;
     bool _console;
 };
 
 Logger __declspec(selectany) gLogger(true /*console output*/);
 
-#define TRACE(msg) gLogger.Log(msg)
-#define TRACEP(format, param) gLogger.Log(format, param)
+// TRACE levels below LOGGER_MIN_LEVEL are compiled out. Enabled levels are
+// checked at run time before the arguments are evaluated.
+#ifndef LOGGER_MIN_LEVEL
+#define LOGGER_MIN_LEVEL Utils::ETWLogger::LoggingLevel::Verbose
+#endif
+
+#define TRACE_ENABLED(level) ((level) >= LOGGER_MIN_LEVEL && gLogger.IsEnabled(level))
+
+#define TRACEL(level, msg) do { if (TRACE_ENABLED(level)) { gLogger.Log(level, msg); } } while (0)
+#define TRACEPL(level, format, param) do { if (TRACE_ENABLED(level)) { gLogger.Log(level, format, param); } } while (0)
+
+#define TRACE(msg) TRACEL(Utils::ETWLogger::LoggingLevel::Information, msg)
+#define TRACEP(format, param) TRACEPL(Utils::ETWLogger::LoggingLevel::Information, format, param)
+
+// For request and response dumps and other bulky diagnostics.
+#define TRACEV(msg) TRACEL(Utils::ETWLogger::LoggingLevel::Verbose, msg)
+#define TRACEPV(format, param) TRACEPL(Utils::ETWLogger::LoggingLevel::Verbose, format, param)
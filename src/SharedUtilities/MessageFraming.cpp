@@ -0,0 +1,122 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <cstring>
+#include "DMException.h"
+#include "MessageFraming.h"
+
+using namespace std;
+
+namespace Utils
+{
+    MessageFraming::MessageFraming(ReadFunction read, WriteFunction write, shared_ptr<BufferPool> pool, FlushFunction flush) :
+        _read(read),
+        _write(write),
+        _flush(flush),
+        _pool(pool),
+        _readAheadBegin(0),
+        _readAheadEnd(0),
+        _readCalls(0),
+        _writeCalls(0)
+    {}
+
+    size_t MessageFraming::Fill()
+    {
+        if (!_readAhead)
+        {
+            _readAhead = _pool->Acquire(ReadAheadSize);
+        }
+
+        ++_readCalls;
+        _readAheadBegin = 0;
+        _readAheadEnd = _read(_readAhead->data, _readAhead->size);
+        return _readAheadEnd;
+    }
+
+    void MessageFraming::ReadExact(uint8_t* buffer, size_t size)
+    {
+        size_t buffered = (min)(size, _readAheadEnd - _readAheadBegin);
+        if (buffered != 0)
+        {
+            memcpy(buffer, _readAhead->data + _readAheadBegin, buffered);
+            _readAheadBegin += buffered;
+        }
+
+        size_t done = buffered;
+        while (done < size)
+        {
+            size_t remaining = size - done;
+            if (remaining < ReadAheadSize)
+            {
+                // Small remainder: read ahead so the next frame's header comes along.
+                if (Fill() == 0)
+                {
+                    throw DMException("Stream ended in the middle of a frame.");
+                }
+                size_t chunk = (min)(remaining, _readAheadEnd);
+                memcpy(buffer + done, _readAhead->data, chunk);
+                _readAheadBegin = chunk;
+                done += chunk;
+            }
+            else
+            {
+                // Large remainder: read straight into the destination.
+                ++_readCalls;
+                size_t count = _read(buffer + done, remaining);
+                if (count == 0)
+                {
+                    throw DMException("Stream ended in the middle of a frame.");
+                }
+                done += count;
+            }
+        }
+    }
+
+    BufferPool::Lease MessageFraming::ReadFrame()
+    {
+        uint32_t frameSize = 0;
+        ReadExact(reinterpret_cast<uint8_t*>(&frameSize), sizeof(frameSize));
+        if (frameSize > MaxFrameSize)
+        {
+            throw DMException("Frame size is out of range.", frameSize);
+        }
+
+        auto frame = _pool->Acquire(frameSize);
+        ReadExact(frame->data, frameSize);
+        return frame;
+    }
+
+    void MessageFraming::WriteFrame(const void* data, size_t size)
+    {
+        if (size > MaxFrameSize)
+        {
+            throw DMException("Frame size is out of range.", size);
+        }
+
+        uint32_t frameSize = static_cast<uint32_t>(size);
+        Chunk chunks[] = { { &frameSize, sizeof(frameSize) }, { data, size } };
+
+        ++_writeCalls;
+        _write(chunks, size == 0 ? 1 : 2);
+    }
+
+    void MessageFraming::Flush()
+    {
+        if (_flush)
+        {
+            _flush();
+        }
+    }
+}
@@ -0,0 +1,84 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include "BufferPool.h"
+
+namespace Utils
+{
+    // Length-prefixed message framing over a byte stream.
+    //
+    // A frame is a 32-bit length followed by that many bytes. The transport
+    // is a set of injected primitives so the same framing runs over a named
+    // pipe, a socket, or an in-memory stand-in in tests.
+    //
+    // Reads go through a small read-ahead buffer, so a short frame usually
+    // costs one read call; the payload lands in a pooled buffer. A frame is
+    // written with one gathered write of header plus payload. Nothing is
+    // flushed unless Flush() is called.
+    class MessageFraming
+    {
+    public:
+        struct Chunk
+        {
+            const void* data;
+            size_t size;
+        };
+
+        // Reads up to 'size' bytes and returns the number read; 0 means the stream ended.
+        typedef std::function<size_t(void* buffer, size_t size)> ReadFunction;
+        // Writes every chunk, in order, as a single operation.
+        typedef std::function<void(const Chunk* chunks, size_t count)> WriteFunction;
+        typedef std::function<void()> FlushFunction;
+
+        static const size_t ReadAheadSize = 4096;
+        static const uint32_t MaxFrameSize = 64 * 1024 * 1024;
+
+        MessageFraming(ReadFunction read, WriteFunction write, std::shared_ptr<BufferPool> pool, FlushFunction flush = nullptr);
+
+        // Returns the next frame's payload, sized to the frame.
+        // Throws if the stream ends mid-frame or the length is out of range.
+        BufferPool::Lease ReadFrame();
+
+        void WriteFrame(const void* data, size_t size);
+
+        // Blocks until the peer has drained what was written, if the transport supports it.
+        void Flush();
+
+        // Number of calls made to the read and write primitives.
+        uint64_t ReadCallCount() const { return _readCalls; }
+        uint64_t WriteCallCount() const { return _writeCalls; }
+
+    private:
+        // Copies buffered bytes first, then reads the rest straight into 'buffer'.
+        void ReadExact(uint8_t* buffer, size_t size);
+        size_t Fill();
+
+        ReadFunction _read;
+        WriteFunction _write;
+        FlushFunction _flush;
+        std::shared_ptr<BufferPool> _pool;
+
+        BufferPool::Lease _readAhead;
+        size_t _readAheadBegin;
+        size_t _readAheadEnd;
+
+        uint64_t _readCalls;
+        uint64_t _writeCalls;
+    };
+}
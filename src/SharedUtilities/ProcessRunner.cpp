@@ -0,0 +1,91 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <chrono>
+#include "ProcessRunner.h"
+
+using namespace std;
+
+namespace Utils
+{
+    const unsigned int ProcessRunner::NoTimeout;
+    const size_t ProcessRunner::ReadSize;
+
+    ProcessRunner::Result ProcessRunner::Run(IChildProcess& child, const OutputHandler& onOutput, unsigned int timeoutMs)
+    {
+        typedef chrono::steady_clock Clock;
+        const Clock::time_point deadline = Clock::now() + chrono::milliseconds(timeoutMs);
+
+        char buffer[ReadSize];
+        bool exited = false;
+        bool outputEnded = false;
+        for (;;)
+        {
+            // Once the child has exited, only what it left in the pipe is
+            // read: a grandchild may hold the pipe open indefinitely.
+            unsigned int waitMs = 0;
+            if (!exited)
+            {
+                waitMs = NoTimeout;
+                if (timeoutMs != NoTimeout)
+                {
+                    Clock::time_point now = Clock::now();
+                    if (now >= deadline)
+                    {
+                        child.Terminate();
+                        Result result = { TimedOut, child.ExitCode() };
+                        return result;
+                    }
+                    auto remaining = chrono::duration_cast<chrono::milliseconds>(deadline - now).count() + 1;
+                    waitMs = static_cast<unsigned int>(remaining);
+                }
+            }
+
+            unsigned int events = child.Wait(waitMs);
+            if (events & IChildProcess::Cancelled)
+            {
+                child.Terminate();
+                Result result = { Cancelled, child.ExitCode() };
+                return result;
+            }
+
+            if (events & IChildProcess::OutputReady)
+            {
+                size_t count = child.Read(buffer, sizeof(buffer));
+                if (count == 0)
+                {
+                    outputEnded = true;
+                }
+                else if (onOutput)
+                {
+                    onOutput(buffer, count);
+                }
+            }
+
+            if (events & IChildProcess::Exited)
+            {
+                exited = true;
+            }
+
+            if (exited && (outputEnded || !(events & IChildProcess::OutputReady)))
+            {
+                break;
+            }
+        }
+
+        Result result = { Completed, child.ExitCode() };
+        return result;
+    }
+}
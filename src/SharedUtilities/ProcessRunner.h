@@ -0,0 +1,107 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace Utils
+{
+    // Lets another thread stop a running child process. The wait primitive is
+    // platform specific, so a cancellation wakes a blocked runner immediately.
+    class ProcessCancellation
+    {
+    public:
+        ProcessCancellation();
+        ~ProcessCancellation();
+
+        void Cancel();
+        bool IsCancelled() const;
+
+        // An event handle on Windows, the read end of a pipe elsewhere.
+        intptr_t WaitHandle() const { return _waitHandle; }
+
+    private:
+        ProcessCancellation(const ProcessCancellation&);
+        ProcessCancellation& operator=(const ProcessCancellation&);
+
+        intptr_t _waitHandle;
+        intptr_t _signalHandle;
+    };
+
+    // The platform half of the runner: a started child whose stdout and
+    // stderr share one stream, which can be waited on together with the
+    // child's exit.
+    class IChildProcess
+    {
+    public:
+        enum Event
+        {
+            OutputReady = 1,
+            Exited = 2,
+            Cancelled = 4
+        };
+
+        virtual ~IChildProcess() {}
+
+        // Blocks until output can be read, the child exits or the
+        // cancellation fires, or 'timeoutMs' passes. Returns a mask of
+        // Event values, 0 on timeout.
+        virtual unsigned int Wait(unsigned int timeoutMs) = 0;
+
+        // Returns output that is ready without blocking; 0 means the stream
+        // has ended and OutputReady will not be reported again. Called only
+        // after Wait() reports OutputReady, with room for ReadSize bytes.
+        virtual size_t Read(char* buffer, size_t size) = 0;
+
+        virtual unsigned long ExitCode() = 0;
+        virtual void Terminate() = 0;
+    };
+
+    // Starts 'commandLine' with the current platform's implementation:
+    // ChildProcessWin32.cpp, or ChildProcessPosix.cpp where the command line
+    // is run by /bin/sh. 'cancellation' may be null and must outlive the child.
+    std::unique_ptr<IChildProcess> StartChildProcess(const std::wstring& commandLine, const ProcessCancellation* cancellation);
+
+    // Runs a child process to completion without polling: output is passed
+    // to the handler as soon as it is written and the run ends as soon as
+    // the child exits.
+    class ProcessRunner
+    {
+    public:
+        enum Status
+        {
+            Completed,
+            TimedOut,
+            Cancelled
+        };
+
+        struct Result
+        {
+            Status status;
+            unsigned long exitCode;
+        };
+
+        typedef std::function<void(const char* data, size_t size)> OutputHandler;
+
+        static const unsigned int NoTimeout = 0xFFFFFFFF;
+        static const size_t ReadSize = 4096;
+
+        // Terminates the child if it times out or is cancelled.
+        static Result Run(IChildProcess& child, const OutputHandler& onOutput, unsigned int timeoutMs = NoTimeout);
+    };
+}
@@ -0,0 +1,297 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <cstring>
+#include <stdexcept>
+#include "RequestPipeline.h"
+
+using namespace std;
+
+namespace Utils
+{
+    static void AppendUInt32(PipelineBatch::Bytes& batch, uint32_t value)
+    {
+        uint8_t bytes[sizeof(uint32_t)];
+        memcpy(bytes, &value, sizeof(value));
+        batch.insert(batch.end(), bytes, bytes + sizeof(bytes));
+    }
+
+    void PipelineBatch::Append(Bytes& batch, uint32_t requestId, const uint8_t* data, uint32_t size)
+    {
+        batch.reserve(batch.size() + 2 * sizeof(uint32_t) + size);
+        AppendUInt32(batch, requestId);
+        AppendUInt32(batch, size);
+        batch.insert(batch.end(), data, data + size);
+    }
+
+    void PipelineBatch::Parse(const uint8_t* batch, size_t size, const ResponseHandler& onResponse)
+    {
+        size_t offset = 0;
+        while (offset < size)
+        {
+            if (size - offset < 2 * sizeof(uint32_t))
+            {
+                throw runtime_error("Pipeline batch ends inside a record header.");
+            }
+
+            uint32_t requestId;
+            uint32_t payloadSize;
+            memcpy(&requestId, batch + offset, sizeof(uint32_t));
+            memcpy(&payloadSize, batch + offset + sizeof(uint32_t), sizeof(uint32_t));
+            offset += 2 * sizeof(uint32_t);
+
+            if (size - offset < payloadSize)
+            {
+                throw runtime_error("Pipeline batch ends inside a payload.");
+            }
+            onResponse(requestId, batch + offset, payloadSize);
+            offset += payloadSize;
+        }
+    }
+
+    const uint32_t PipelineClient::ReceiveTimeoutMs;
+
+    PipelineClient::PipelineClient(SubmitFunction submit, ReceiveFunction receive) :
+        _submit(submit),
+        _receive(receive),
+        _nextRequestId(1),
+        _stopping(false)
+    {
+        _receiver = thread([this]() { ReceiveLoop(); });
+    }
+
+    PipelineClient::~PipelineClient()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _cv.notify_all();
+        _receiver.join();
+
+        FailAll(make_exception_ptr(runtime_error("The request pipeline was closed.")));
+    }
+
+    void PipelineClient::Send(const uint8_t* data, uint32_t size, Completion completion)
+    {
+        uint32_t requestId;
+        {
+            unique_lock<mutex> lock(_mutex);
+            if (_broken)
+            {
+                exception_ptr error = _broken;
+                lock.unlock();
+                completion(error, Bytes());
+                return;
+            }
+
+            requestId = _nextRequestId++;
+            _pending[requestId] = completion;
+        }
+        _cv.notify_all();
+
+        try
+        {
+            _submit(requestId, data, size);
+        }
+        catch (...)
+        {
+            bool pending;
+            {
+                lock_guard<mutex> lock(_mutex);
+                pending = _pending.erase(requestId) != 0;
+            }
+
+            // The receiver may have failed it already.
+            if (pending)
+            {
+                completion(current_exception(), Bytes());
+            }
+        }
+    }
+
+    size_t PipelineClient::InFlight() const
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _pending.size();
+    }
+
+    bool PipelineClient::IsBroken() const
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _broken != nullptr;
+    }
+
+    void PipelineClient::ReceiveLoop()
+    {
+        for (;;)
+        {
+            {
+                // Nothing is asked of the server while nothing is in flight.
+                unique_lock<mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return _stopping || !_pending.empty(); });
+                if (_stopping)
+                {
+                    return;
+                }
+            }
+
+            try
+            {
+                Bytes batch = _receive(ReceiveTimeoutMs);
+                PipelineBatch::Parse(batch.data(), batch.size(), [this](uint32_t requestId, const uint8_t* data, uint32_t size)
+                {
+                    Completion completion;
+                    {
+                        lock_guard<mutex> lock(_mutex);
+                        auto it = _pending.find(requestId);
+                        if (it == _pending.end())
+                        {
+                            return;
+                        }
+                        completion = move(it->second);
+                        _pending.erase(it);
+                    }
+                    completion(nullptr, Bytes(data, data + size));
+                });
+            }
+            catch (...)
+            {
+                exception_ptr error = current_exception();
+                {
+                    lock_guard<mutex> lock(_mutex);
+                    _broken = error;
+                }
+                FailAll(error);
+                return;
+            }
+        }
+    }
+
+    void PipelineClient::FailAll(exception_ptr error)
+    {
+        map<uint32_t, Completion> pending;
+        {
+            lock_guard<mutex> lock(_mutex);
+            pending.swap(_pending);
+        }
+        for (auto& request : pending)
+        {
+            request.second(error, Bytes());
+        }
+    }
+
+    PipelineServer::PipelineServer(Handler handler, Dispatch dispatch) :
+        _handler(handler),
+        _dispatch(dispatch),
+        _nextSessionId(1)
+    {
+    }
+
+    uint32_t PipelineServer::Open()
+    {
+        lock_guard<mutex> lock(_mutex);
+
+        shared_ptr<Session> session = make_shared<Session>();
+        session->closed = false;
+
+        uint32_t sessionId = _nextSessionId++;
+        _sessions[sessionId] = session;
+        return sessionId;
+    }
+
+    void PipelineServer::Close(uint32_t sessionId)
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _sessions.find(sessionId);
+        if (it != _sessions.end())
+        {
+            it->second->closed = true;
+            it->second->cv.notify_all();
+            _sessions.erase(it);
+        }
+    }
+
+    bool PipelineServer::Submit(uint32_t sessionId, uint32_t requestId, const uint8_t* data, uint32_t size)
+    {
+        shared_ptr<Session> session;
+        {
+            lock_guard<mutex> lock(_mutex);
+            session = Find(sessionId);
+        }
+        if (!session)
+        {
+            return false;
+        }
+
+        // The request buffer belongs to the transport; the work gets a copy.
+        shared_ptr<Bytes> request = make_shared<Bytes>(data, data + size);
+        _dispatch([this, session, requestId, request]()
+        {
+            Bytes response;
+            try
+            {
+                response = _handler(request->data(), static_cast<uint32_t>(request->size()));
+            }
+            catch (...)
+            {
+                response.clear();
+            }
+
+            lock_guard<mutex> lock(_mutex);
+            if (!session->closed)
+            {
+                PipelineBatch::Append(session->batch, requestId, response.data(), static_cast<uint32_t>(response.size()));
+                session->cv.notify_all();
+            }
+        });
+        return true;
+    }
+
+    bool PipelineServer::Receive(uint32_t sessionId, uint32_t timeoutMs, Bytes& batch)
+    {
+        unique_lock<mutex> lock(_mutex);
+        shared_ptr<Session> session = Find(sessionId);
+        if (!session)
+        {
+            return false;
+        }
+
+        session->cv.wait_for(lock, chrono::milliseconds(timeoutMs), [&session]()
+        {
+            return session->closed || !session->batch.empty();
+        });
+
+        batch.clear();
+        batch.swap(session->batch);
+        return true;
+    }
+
+    size_t PipelineServer::SessionCount() const
+    {
+        lock_guard<mutex> lock(_mutex);
+        return _sessions.size();
+    }
+
+    shared_ptr<PipelineServer::Session> PipelineServer::Find(uint32_t sessionId)
+    {
+        auto it = _sessions.find(sessionId);
+        if (it == _sessions.end())
+        {
+            return nullptr;
+        }
+        return it->second;
+    }
+}
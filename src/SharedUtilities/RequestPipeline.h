@@ -0,0 +1,155 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Utils
+{
+    // Many requests in flight over one connection, matched by request ID.
+    //
+    // The client submits each request under a new ID and returns at once.
+    // The server runs requests concurrently and queues each response as it
+    // completes. One receiver thread on the client collects the queued
+    // responses in batches and completes each request by its ID, in whatever
+    // order the server finished them.
+    //
+    // The transport is injected: RPC calls in the product, direct calls in tests.
+    // Only standard C++ is used, so no exception type is assumed beyond std.
+
+    // A batch is a sequence of records: 32-bit request ID, 32-bit payload
+    // size, payload.
+    class PipelineBatch
+    {
+    public:
+        typedef std::vector<uint8_t> Bytes;
+        typedef std::function<void(uint32_t requestId, const uint8_t* data, uint32_t size)> ResponseHandler;
+
+        static void Append(Bytes& batch, uint32_t requestId, const uint8_t* data, uint32_t size);
+
+        // Throws std::runtime_error if the batch is truncated.
+        static void Parse(const uint8_t* batch, size_t size, const ResponseHandler& onResponse);
+    };
+
+    class PipelineClient
+    {
+    public:
+        typedef PipelineBatch::Bytes Bytes;
+
+        // Hands a request to the server. Throws if it could not be sent.
+        typedef std::function<void(uint32_t requestId, const uint8_t* data, uint32_t size)> SubmitFunction;
+
+        // Returns the responses completed so far, waiting up to timeoutMs for
+        // at least one. Throws if the connection is broken.
+        typedef std::function<Bytes(uint32_t timeoutMs)> ReceiveFunction;
+
+        // Called once per request with either an error or the response.
+        typedef std::function<void(std::exception_ptr error, Bytes response)> Completion;
+
+        static const uint32_t ReceiveTimeoutMs = 1000;
+
+        PipelineClient(SubmitFunction submit, ReceiveFunction receive);
+
+        // Requests still in flight complete with an error.
+        ~PipelineClient();
+
+        // The completion runs on the receiver thread, or on this thread if
+        // the request could not be submitted.
+        void Send(const uint8_t* data, uint32_t size, Completion completion);
+
+        size_t InFlight() const;
+
+        // True once the connection has failed. Every later Send fails at
+        // once; the owner should open a new pipeline.
+        bool IsBroken() const;
+
+    private:
+        PipelineClient(const PipelineClient&);
+        PipelineClient& operator=(const PipelineClient&);
+
+        void ReceiveLoop();
+        void FailAll(std::exception_ptr error);
+
+        SubmitFunction _submit;
+        ReceiveFunction _receive;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _cv;
+        std::map<uint32_t, Completion> _pending;
+        uint32_t _nextRequestId;
+        bool _stopping;
+        std::exception_ptr _broken;
+
+        std::thread _receiver;
+    };
+
+    class PipelineServer
+    {
+    public:
+        typedef PipelineBatch::Bytes Bytes;
+
+        // Runs one request and returns its response. A handler that throws
+        // produces an empty response.
+        typedef std::function<Bytes(const uint8_t* data, uint32_t size)> Handler;
+
+        // Runs work on some other thread.
+        typedef std::function<void(std::function<void()> work)> Dispatch;
+
+        PipelineServer(Handler handler, Dispatch dispatch);
+
+        // The transport ties the session to the client's connection and
+        // closes it if the client goes away without closing it.
+        uint32_t Open();
+
+        // Responses still owed to the session are discarded.
+        void Close(uint32_t sessionId);
+
+        // All return false if there is no such session.
+        bool Submit(uint32_t sessionId, uint32_t requestId, const uint8_t* data, uint32_t size);
+        bool Receive(uint32_t sessionId, uint32_t timeoutMs, Bytes& batch);
+
+        size_t SessionCount() const;
+
+    private:
+        struct Session
+        {
+            Bytes batch;
+            bool closed;
+            std::condition_variable cv;
+        };
+
+        PipelineServer(const PipelineServer&);
+        PipelineServer& operator=(const PipelineServer&);
+
+        // Must be called with _mutex held.
+        std::shared_ptr<Session> Find(uint32_t sessionId);
+
+        Handler _handler;
+        Dispatch _dispatch;
+
+        mutable std::mutex _mutex;
+        std::map<uint32_t, std::shared_ptr<Session>> _sessions;
+        uint32_t _nextSessionId;
+    };
+}
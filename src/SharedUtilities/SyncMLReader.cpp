@@ -0,0 +1,228 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <cwchar>
+#include <cwctype>
+#include "DMException.h"
+#include "SyncMLReader.h"
+
+using namespace std;
+
+namespace Utils
+{
+    // '#' followed by 1-6 decimal digits, or '#x' followed by 1-6 hex digits.
+    static bool IsCharacterReference(const wstring& entity)
+    {
+        if (entity.size() < 2 || entity[0] != L'#')
+        {
+            return false;
+        }
+        bool hex = entity[1] == L'x' || entity[1] == L'X';
+        size_t first = hex ? 2 : 1;
+        if (entity.size() == first || entity.size() - first > 6)
+        {
+            return false;
+        }
+        for (size_t i = first; i < entity.size(); ++i)
+        {
+            if (!(hex ? iswxdigit(entity[i]) : iswdigit(entity[i])))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static wstring LocalName(const wchar_t* begin, const wchar_t* end)
+    {
+        const wchar_t* nameEnd = begin;
+        while (nameEnd < end && *nameEnd != L' ' && *nameEnd != L'\t' && *nameEnd != L'\r' && *nameEnd != L'\n' && *nameEnd != L'/')
+        {
+            ++nameEnd;
+        }
+        const wchar_t* nameStart = begin;
+        for (const wchar_t* p = begin; p < nameEnd; ++p)
+        {
+            if (*p == L':')
+            {
+                nameStart = p + 1;
+            }
+        }
+        return wstring(nameStart, nameEnd);
+    }
+
+    void SyncMLReader::Read(const wstring& syncML, StartHandler onStart, EndHandler onEnd)
+    {
+        ElementStack elementStack;
+        wstring text;
+
+        const wchar_t* begin = syncML.c_str();
+        const wchar_t* end = begin + syncML.size();
+        const wchar_t* p = begin;
+        while (p < end)
+        {
+            if (*p != L'<')
+            {
+                const wchar_t* textStart = p;
+                while (p < end && *p != L'<')
+                {
+                    ++p;
+                }
+                AppendUnescaped(textStart, p, text);
+                continue;
+            }
+
+            if (syncML.compare(p - begin, 9, L"<![CDATA[") == 0)
+            {
+                size_t close = syncML.find(L"]]>", p - begin);
+                if (close == wstring::npos)
+                {
+                    throw DMException("SyncMLReader: unterminated CDATA section.");
+                }
+                text.append(p + 9, begin + close);
+                p = begin + close + 3;
+                continue;
+            }
+
+            if (syncML.compare(p - begin, 4, L"<!--") == 0)
+            {
+                size_t close = syncML.find(L"-->", p - begin);
+                p = close == wstring::npos ? end : begin + close + 3;
+                continue;
+            }
+
+            // Find the end of the tag, skipping over quoted attribute values.
+            const wchar_t* tagStart = p + 1;
+            const wchar_t* tagEnd = tagStart;
+            wchar_t quote = 0;
+            while (tagEnd < end && (quote || *tagEnd != L'>'))
+            {
+                if (quote && *tagEnd == quote)
+                {
+                    quote = 0;
+                }
+                else if (!quote && (*tagEnd == L'"' || *tagEnd == L'\''))
+                {
+                    quote = *tagEnd;
+                }
+                ++tagEnd;
+            }
+            if (tagEnd == end)
+            {
+                throw DMException("SyncMLReader: unterminated tag.");
+            }
+            p = tagEnd + 1;
+
+            if (*tagStart == L'?' || *tagStart == L'!')
+            {
+                continue;
+            }
+
+            if (*tagStart == L'/')
+            {
+                if (elementStack.empty())
+                {
+                    throw DMException("SyncMLReader: unbalanced closing tag.");
+                }
+                if (onEnd)
+                {
+                    onEnd(elementStack, text);
+                }
+                elementStack.pop_back();
+                text.clear();
+                continue;
+            }
+
+            elementStack.push_back(LocalName(tagStart, tagEnd));
+            text.clear();
+            if (onStart)
+            {
+                onStart(elementStack);
+            }
+            if (*(tagEnd - 1) == L'/')
+            {
+                if (onEnd)
+                {
+                    onEnd(elementStack, text);
+                }
+                elementStack.pop_back();
+            }
+        }
+
+        if (!elementStack.empty())
+        {
+            throw DMException("SyncMLReader: unexpected end of document.");
+        }
+    }
+
+    wstring SyncMLReader::Escape(const wstring& text)
+    {
+        wstring escaped;
+        escaped.reserve(text.size());
+        for (wchar_t c : text)
+        {
+            switch (c)
+            {
+            case L'<': escaped += L"&lt;"; break;
+            case L'>': escaped += L"&gt;"; break;
+            case L'&': escaped += L"&amp;"; break;
+            default: escaped += c; break;
+            }
+        }
+        return escaped;
+    }
+
+    void SyncMLReader::AppendUnescaped(const wchar_t* begin, const wchar_t* end, wstring& text)
+    {
+        for (const wchar_t* p = begin; p < end; ++p)
+        {
+            if (*p != L'&')
+            {
+                text += *p;
+                continue;
+            }
+
+            const wchar_t* semicolon = p;
+            while (semicolon < end && *semicolon != L';')
+            {
+                ++semicolon;
+            }
+            if (semicolon == end)
+            {
+                text += *p;
+                continue;
+            }
+
+            wstring entity(p + 1, semicolon);
+            if (entity == L"lt") text += L'<';
+            else if (entity == L"gt") text += L'>';
+            else if (entity == L"amp") text += L'&';
+            else if (entity == L"quot") text += L'"';
+            else if (entity == L"apos") text += L'\'';
+            else if (IsCharacterReference(entity))
+            {
+                bool hex = entity[1] == L'x' || entity[1] == L'X';
+                text += static_cast<wchar_t>(wcstoul(entity.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10));
+            }
+            else
+            {
+                text.append(p, semicolon + 1);
+            }
+            p = semicolon;
+        }
+    }
+}
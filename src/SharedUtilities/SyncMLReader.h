@@ -0,0 +1,46 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace Utils
+{
+    // A minimal, forward-only reader for the SyncML documents exchanged with
+    // the local management stack. It does not depend on XmlLite so that the
+    // code building and consuming SyncML can be exercised off-device.
+    //
+    // - Element names are reported without their namespace prefix.
+    // - Text is entity-decoded and reported once, when its element closes.
+    // - Attributes, comments and processing instructions are skipped.
+    class SyncMLReader
+    {
+    public:
+        typedef std::vector<std::wstring> ElementStack;
+        typedef std::function<void(const ElementStack& elementStack)> StartHandler;
+        typedef std::function<void(const ElementStack& elementStack, const std::wstring& text)> EndHandler;
+
+        // elementStack includes the element being started/ended as its last entry.
+        static void Read(const std::wstring& syncML, StartHandler onStart, EndHandler onEnd);
+
+        // Escapes the characters that cannot appear as-is in element text.
+        static std::wstring Escape(const std::wstring& text);
+
+        // Decodes the entities in [begin, end) and appends the result to 'text'.
+        static void AppendUnescaped(const wchar_t* begin, const wchar_t* end, std::wstring& text);
+    };
+}
@@ -0,0 +1,419 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <cwchar>
+#include <cwctype>
+#include "DMException.h"
+#include "SyncMLReader.h"
+#include "SyncMLResponse.h"
+
+using namespace std;
+
+namespace Utils
+{
+    enum ElementId : unsigned char
+    {
+        OtherElement,
+        SyncBodyElement,
+        StatusElement,
+        ResultsElement,
+        ItemElement,
+        SourceElement,
+        LocURIElement,
+        DataElement,
+        CmdRefElement,
+        CmdElement,
+    };
+
+    struct ElementName
+    {
+        const wchar_t* name;
+        size_t length;
+        ElementId id;
+    };
+
+    static const ElementName ElementNames[] =
+    {
+        { L"SyncBody", 8, SyncBodyElement },
+        { L"Status", 6, StatusElement },
+        { L"Results", 7, ResultsElement },
+        { L"Item", 4, ItemElement },
+        { L"Source", 6, SourceElement },
+        { L"LocURI", 6, LocURIElement },
+        { L"Data", 4, DataElement },
+        { L"CmdRef", 6, CmdRefElement },
+        { L"Cmd", 3, CmdElement },
+    };
+
+    // Maps a (prefixed or not) element name to its id without allocating.
+    static ElementId InternElementName(const wchar_t* begin, const wchar_t* end)
+    {
+        for (const wchar_t* p = begin; p < end; ++p)
+        {
+            if (*p == L':')
+            {
+                begin = p + 1;
+            }
+        }
+
+        size_t length = end - begin;
+        for (const ElementName& elementName : ElementNames)
+        {
+            if (elementName.length == length && wmemcmp(elementName.name, begin, length) == 0)
+            {
+                return elementName.id;
+            }
+        }
+        return OtherElement;
+    }
+
+    static bool StartsWith(const wchar_t* p, const wchar_t* end, const wchar_t* prefix)
+    {
+        size_t length = wcslen(prefix);
+        return static_cast<size_t>(end - p) >= length && wmemcmp(p, prefix, length) == 0;
+    }
+
+    // Returns a pointer past 'terminator', or nullptr if it is not found.
+    static const wchar_t* SkipPast(const wchar_t* p, const wchar_t* end, const wchar_t* terminator)
+    {
+        size_t length = wcslen(terminator);
+        for (; static_cast<size_t>(end - p) >= length; ++p)
+        {
+            if (wmemcmp(p, terminator, length) == 0)
+            {
+                return p + length;
+            }
+        }
+        return nullptr;
+    }
+
+    // Returns a pointer to the '>' closing the tag, skipping quoted attribute values.
+    static const wchar_t* FindTagEnd(const wchar_t* p, const wchar_t* end)
+    {
+        wchar_t quote = 0;
+        for (; p < end; ++p)
+        {
+            if (quote)
+            {
+                if (*p == quote)
+                {
+                    quote = 0;
+                }
+            }
+            else if (*p == L'"' || *p == L'\'')
+            {
+                quote = *p;
+            }
+            else if (*p == L'>')
+            {
+                return p;
+            }
+        }
+        return nullptr;
+    }
+
+    static unsigned int ParseStatusCode(const SyncMLResponse::View& data)
+    {
+        const wchar_t* p = data.data;
+        const wchar_t* end = p + data.size;
+        while (p < end && iswspace(*p))
+        {
+            ++p;
+        }
+        while (end > p && iswspace(*(end - 1)))
+        {
+            --end;
+        }
+        if (p == end || end - p > 9)
+        {
+            return 0;
+        }
+
+        unsigned int code = 0;
+        for (; p < end; ++p)
+        {
+            if (*p < L'0' || *p > L'9')
+            {
+                return 0;
+            }
+            code = code * 10 + (*p - L'0');
+        }
+        return code;
+    }
+
+    bool SyncMLResponse::View::equals(const wchar_t* s) const
+    {
+        return data && wcslen(s) == size && wmemcmp(data, s, size) == 0;
+    }
+
+    SyncMLResponse::SyncMLResponse()
+    {
+    }
+
+    SyncMLResponse::SyncMLResponse(const wstring& responseSyncML)
+    {
+        Parse(responseSyncML);
+    }
+
+    void SyncMLResponse::Parse(const wstring& responseSyncML)
+    {
+        Parse(responseSyncML.c_str(), responseSyncML.size());
+    }
+
+    SyncMLResponse::View SyncMLResponse::MakeView(const wchar_t* begin, const wchar_t* end)
+    {
+        View view;
+
+        // Most values need no decoding and are returned in place.
+        const wchar_t* p = begin;
+        while (p < end && *p != L'&' && *p != L'<')
+        {
+            ++p;
+        }
+        if (p == end)
+        {
+            view.data = begin;
+            view.size = end - begin;
+            return view;
+        }
+
+        _decoded.emplace_back();
+        wstring& text = _decoded.back();
+        text.reserve(end - begin);
+
+        p = begin;
+        while (p < end)
+        {
+            if (*p != L'<')
+            {
+                const wchar_t* textEnd = p;
+                while (textEnd < end && *textEnd != L'<')
+                {
+                    ++textEnd;
+                }
+                SyncMLReader::AppendUnescaped(p, textEnd, text);
+                p = textEnd;
+            }
+            else if (StartsWith(p, end, L"<![CDATA["))
+            {
+                const wchar_t* cdataEnd = SkipPast(p, end, L"]]>");
+                text.append(p + 9, cdataEnd - 3);
+                p = cdataEnd;
+            }
+            else
+            {
+                // Comments and nested elements contribute no text of their own.
+                const wchar_t* tagEnd = StartsWith(p, end, L"<!--") ? SkipPast(p, end, L"-->") : FindTagEnd(p, end) + 1;
+                p = tagEnd;
+            }
+        }
+
+        view.data = text.c_str();
+        view.size = text.size();
+        return view;
+    }
+
+    void SyncMLResponse::Parse(const wchar_t* responseSyncML, size_t length)
+    {
+        _statuses.clear();
+        _items.clear();
+        _decoded.clear();
+
+        vector<ElementId> elementStack;
+        elementStack.reserve(16);
+
+        // The value being captured. Elements nested in it are not interpreted.
+        View* capture = nullptr;
+        size_t captureDepth = 0;
+        const wchar_t* captureStart = nullptr;
+
+        View resultsCmdRef;
+        size_t resultsFirstItem = 0;
+
+        const wchar_t* end = responseSyncML + length;
+        const wchar_t* p = responseSyncML;
+        while (p < end)
+        {
+            p = wmemchr(p, L'<', end - p);
+            if (!p)
+            {
+                break;
+            }
+
+            if (StartsWith(p, end, L"<!--"))
+            {
+                p = SkipPast(p, end, L"-->");
+                if (!p)
+                {
+                    throw DMException("SyncMLResponse: unterminated comment.");
+                }
+                continue;
+            }
+
+            if (StartsWith(p, end, L"<![CDATA["))
+            {
+                p = SkipPast(p, end, L"]]>");
+                if (!p)
+                {
+                    throw DMException("SyncMLResponse: unterminated CDATA section.");
+                }
+                continue;
+            }
+
+            const wchar_t* tagEnd = FindTagEnd(p + 1, end);
+            if (!tagEnd)
+            {
+                throw DMException("SyncMLResponse: unterminated tag.");
+            }
+            const wchar_t* tagStart = p;
+            p = tagEnd + 1;
+
+            // Declarations and processing instructions
+            if (tagStart[1] == L'?' || tagStart[1] == L'!')
+            {
+                continue;
+            }
+
+            bool closing = tagStart[1] == L'/';
+            const wchar_t* nameBegin = tagStart + (closing ? 2 : 1);
+            const wchar_t* nameEnd = nameBegin;
+            while (nameEnd < tagEnd && !iswspace(*nameEnd) && *nameEnd != L'/')
+            {
+                ++nameEnd;
+            }
+            ElementId id = InternElementName(nameBegin, nameEnd);
+
+            if (closing)
+            {
+                if (elementStack.empty() || elementStack.back() != id)
+                {
+                    throw DMException("SyncMLResponse: unbalanced closing tag.");
+                }
+
+                if (capture && elementStack.size() == captureDepth)
+                {
+                    *capture = MakeView(captureStart, tagStart);
+                    capture = nullptr;
+                }
+                else if (!capture && elementStack.size() >= 2 && elementStack[elementStack.size() - 2] == SyncBodyElement)
+                {
+                    if (id == StatusElement)
+                    {
+                        _statuses.back().code = ParseStatusCode(_statuses.back().data);
+                    }
+                    else if (id == ResultsElement)
+                    {
+                        for (size_t i = resultsFirstItem; i < _items.size(); ++i)
+                        {
+                            _items[i].cmdRef = resultsCmdRef;
+                        }
+                    }
+                }
+
+                elementStack.pop_back();
+                continue;
+            }
+
+            bool selfClosing = *(tagEnd - 1) == L'/';
+            size_t depth = elementStack.size();
+            ElementId parent = depth >= 1 ? elementStack[depth - 1] : OtherElement;
+            ElementId grandParent = depth >= 2 ? elementStack[depth - 2] : OtherElement;
+            ElementId greatGrandParent = depth >= 3 ? elementStack[depth - 3] : OtherElement;
+
+            View* target = nullptr;
+            if (!capture)
+            {
+                switch (id)
+                {
+                case StatusElement:
+                    if (parent == SyncBodyElement)
+                    {
+                        _statuses.emplace_back();
+                    }
+                    break;
+                case ResultsElement:
+                    if (parent == SyncBodyElement)
+                    {
+                        resultsCmdRef = View();
+                        resultsFirstItem = _items.size();
+                    }
+                    break;
+                case ItemElement:
+                    if (parent == ResultsElement && grandParent == SyncBodyElement)
+                    {
+                        _items.emplace_back();
+                    }
+                    break;
+                case CmdRefElement:
+                    if (parent == StatusElement && grandParent == SyncBodyElement)
+                    {
+                        target = &_statuses.back().cmdRef;
+                    }
+                    else if (parent == ResultsElement && grandParent == SyncBodyElement)
+                    {
+                        target = &resultsCmdRef;
+                    }
+                    break;
+                case CmdElement:
+                    if (parent == StatusElement && grandParent == SyncBodyElement)
+                    {
+                        target = &_statuses.back().cmd;
+                    }
+                    break;
+                case DataElement:
+                    if (parent == StatusElement && grandParent == SyncBodyElement)
+                    {
+                        target = &_statuses.back().data;
+                    }
+                    else if (parent == ItemElement && grandParent == ResultsElement && greatGrandParent == SyncBodyElement)
+                    {
+                        target = &_items.back().data;
+                    }
+                    break;
+                case LocURIElement:
+                    if (parent == SourceElement && grandParent == ItemElement && greatGrandParent == ResultsElement &&
+                        depth >= 4 && elementStack[depth - 4] == SyncBodyElement)
+                    {
+                        target = &_items.back().locUri;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (selfClosing)
+            {
+                // An empty element has no value; 'target' stays not present.
+                continue;
+            }
+
+            elementStack.push_back(id);
+            if (target)
+            {
+                capture = target;
+                captureDepth = elementStack.size();
+                captureStart = p;
+            }
+        }
+
+        if (!elementStack.empty())
+        {
+            throw DMException("SyncMLResponse: unexpected end of document.");
+        }
+    }
+}
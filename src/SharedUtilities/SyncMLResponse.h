@@ -0,0 +1,103 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace Utils
+{
+    // Single-pass reader for the responses of the local management stack.
+    //
+    // The response is scanned once, in place. Element nesting is tracked
+    // with a stack of interned element ids, and the statuses and result items
+    // are collected in the same pass.
+    //
+    // Values are returned as views. A view points into the response buffer
+    // unless the value had to be decoded (entities, CDATA mixed with text),
+    // in which case it points to a copy owned by the SyncMLResponse. Either
+    // way, the response buffer and the SyncMLResponse must outlive the views.
+    //
+    // The reader has no platform dependencies so it can be fuzzed and
+    // benchmarked off-device.
+    class SyncMLResponse
+    {
+    public:
+        struct View
+        {
+            View() :
+                data(nullptr),
+                size(0)
+            {}
+
+            // nullptr if the element was not present.
+            const wchar_t* data;
+            size_t size;
+
+            bool present() const { return data != nullptr; }
+            std::wstring str() const { return data ? std::wstring(data, size) : std::wstring(); }
+            bool equals(const wchar_t* s) const;
+        };
+
+        struct Status
+        {
+            Status() :
+                code(0)
+            {}
+
+            View cmdRef;
+            View cmd;
+            View data;
+
+            // The numeric value of 'data'. 0 if it is missing or not a number.
+            unsigned int code;
+        };
+
+        struct Item
+        {
+            // CmdRef of the enclosing <Results>.
+            View cmdRef;
+            View locUri;
+            View data;
+        };
+
+        SyncMLResponse();
+        explicit SyncMLResponse(const std::wstring& responseSyncML);
+
+        // The views would point into a string that is gone by the next statement.
+        SyncMLResponse(std::wstring&&) = delete;
+
+        // Replaces any previous content.
+        void Parse(const wchar_t* responseSyncML, size_t length);
+        void Parse(const std::wstring& responseSyncML);
+        void Parse(std::wstring&&) = delete;
+
+        const std::vector<Status>& Statuses() const { return _statuses; }
+        const std::vector<Item>& Items() const { return _items; }
+
+    private:
+        SyncMLResponse(const SyncMLResponse&) = delete;
+        SyncMLResponse& operator=(const SyncMLResponse&) = delete;
+
+        View MakeView(const wchar_t* begin, const wchar_t* end);
+
+        std::vector<Status> _statuses;
+        std::vector<Item> _items;
+
+        // Decoded values. A deque so that existing strings never move.
+        std::deque<std::wstring> _decoded;
+    };
+}
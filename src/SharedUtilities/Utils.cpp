@@ -22,10 +22,11 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <iomanip>
 #include <iostream>
 #include <algorithm> 
-#include <xmllite.h>
 #include <fstream>
 #include <Sddl.h>
 #include "Utils.h"
+#include "Base64.h"
+#include "SyncMLResponse.h"
 #include "DMException.h"
 #include "Logger.h"
 
@@ -220,325 +221,19 @@ namespace Utils
         return formattedTime.str();
     }
 
-    void ReadXmlStructData(IStream* resultSyncML, ELEMENT_HANDLER handler)
-    {
-        wstring uriPath = L"SyncML\\SyncBody\\Results\\Item\\Source\\LocURI\\";
-        wstring dataPath = L"SyncML\\SyncBody\\Results\\Item\\Data\\";
-        wstring itemPath = L"SyncML\\SyncBody\\Results\\Item\\";
-
-        wstring emptyString = L"";
-        auto value = emptyString;
-        auto uri = emptyString;
-
-        ComPtr<IXmlReader> xmlReader;
-
-        HRESULT hr = CreateXmlReader(__uuidof(IXmlReader), (void**)xmlReader.GetAddressOf(), NULL);
-        if (FAILED(hr))
-        {
-            throw DMExceptionWithErrorCode("Error: Failed to create xml reader.", hr);
-        }
-
-        hr = xmlReader->SetProperty(XmlReaderProperty_DtdProcessing, DtdProcessing_Prohibit);
-        if (FAILED(hr))
-        {
-            throw DMExceptionWithErrorCode("Error: XmlReaderProperty_DtdProcessing() failed.", hr);
-        }
-
-        hr = xmlReader->SetInput(resultSyncML);
-        if (FAILED(hr))
-        {
-            throw DMExceptionWithErrorCode("Error: SetInput() failed.", hr);
-        }
-
-        deque<wstring> pathStack;
-        wstring currentPath;
-
-        // Read until there are no more nodes
-        XmlNodeType nodeType;
-        while (S_OK == (hr = xmlReader->Read(&nodeType)))
-        {
-            switch (nodeType)
-            {
-            case XmlNodeType_Element:
-            {
-                const wchar_t* prefix = NULL;
-                UINT prefixSize = 0;
-
-                hr = xmlReader->GetPrefix(&prefix, &prefixSize);
-                if (FAILED(hr))
-                {
-                    throw DMExceptionWithErrorCode("Error: GetPrefix() failed.", hr);
-                }
-
-                const wchar_t* localName;
-                hr = xmlReader->GetLocalName(&localName, NULL);
-                if (FAILED(hr))
-                {
-                    throw DMExceptionWithErrorCode("Error: GetLocalName() failed.", hr);
-                }
-
-                wstring elementName;
-                if (prefixSize > 0)
-                {
-                    elementName = prefix;
-                    elementName += L":";
-                }
-                elementName += localName;
-
-                if (!xmlReader->IsEmptyElement())
-                {
-                    pathStack.push_back(elementName);
-
-                    // rebuild the current path.
-                    currentPath = L"";
-                    for (auto& it : pathStack)
-                    {
-                        currentPath += it + L"\\";
-                    }
-                    if (itemPath == currentPath)
-                    {
-                        value = emptyString;
-                        uri = emptyString;
-                    }
-                }
-            }
-            break;
-            case XmlNodeType_EndElement:
-            {
-                const wchar_t* prefix = NULL;
-                UINT prefixSize = 0;
-
-                hr = xmlReader->GetPrefix(&prefix, &prefixSize);
-                if (FAILED(hr))
-                {
-                    throw DMExceptionWithErrorCode("Error: GetPrefix() failed.", hr);
-                }
-
-                const wchar_t* localName = NULL;
-                hr = xmlReader->GetLocalName(&localName, NULL);
-                if (FAILED(hr))
-                {
-                    throw DMExceptionWithErrorCode("Error: GetLocalName() failed.", hr);
-                }
-
-                if (itemPath == currentPath)
-                {
-                    vector<wstring> uriTokens;
-                    wstringstream ss(uri);
-                    wstring s;
-
-                    while (getline(ss, s, L'/')) 
-                    {
-                        uriTokens.push_back(s);
-                    }
-
-                    handler(uriTokens, value);
-
-                    value = emptyString;
-                    uri = emptyString;
-                }
-                pathStack.pop_back();
-                // rebuild the current path.
-                currentPath = L"";
-                for (auto& it : pathStack)
-                {
-                    currentPath += it + L"\\";
-                }
-
-            }
-            break;
-            case XmlNodeType_Text:
-            case XmlNodeType_Whitespace:
-            {
-                const wchar_t* valueText = NULL;
-                hr = xmlReader->GetValue(&valueText, NULL);
-                if (FAILED(hr))
-                {
-                    throw DMExceptionWithErrorCode("Error: GetValue() failed.", hr);
-                }
-
-                if (uriPath == currentPath)
-                {
-                    uri = valueText;
-                }
-                else if (dataPath == currentPath)
-                {
-                    value = valueText;
-                }
-            }
-            break;
-            }
-        }
-    }
-    
-    void ReadXmlValue(IStream* resultSyncML, const wstring& targetXmlPath, wstring& value)
-    {
-        ComPtr<IXmlReader> xmlReader;
-
-        HRESULT hr = CreateXmlReader(__uuidof(IXmlReader), (void**)xmlReader.GetAddressOf(), NULL);
-        if (FAILED(hr))
-        {
-            TRACEP(L"Error: Failed to create xml reader. Code :", hr);
-            throw DMExceptionWithErrorCode(hr);
-        }
-
-        hr = xmlReader->SetProperty(XmlReaderProperty_DtdProcessing, DtdProcessing_Prohibit);
-        if (FAILED(hr))
-        {
-            TRACEP(L"Error: XmlReaderProperty_DtdProcessing() failed. Code :\n", hr);
-            throw DMExceptionWithErrorCode(hr);
-        }
-
-        hr = xmlReader->SetInput(resultSyncML);
-        if (FAILED(hr))
-        {
-            TRACEP(L"Error: SetInput() failed. Code :\n", hr);
-            throw DMExceptionWithErrorCode(hr);
-        }
-
-        deque<wstring> pathStack;
-        wstring currentPath;
-
-        // Read until there are no more nodes
-        bool valueFound = false;
-        bool pathFound = false;
-        XmlNodeType nodeType;
-        while (S_OK == (hr = xmlReader->Read(&nodeType)) && !valueFound)
-        {
-            switch (nodeType)
-            {
-            case XmlNodeType_Element:
-            {
-                const wchar_t* prefix = NULL;
-                UINT prefixSize = 0;
-
-                hr = xmlReader->GetPrefix(&prefix, &prefixSize);
-                if (FAILED(hr))
-                {
-                    TRACEP(L"Error: GetPrefix() failed. Code :\n", hr);
-                    throw DMExceptionWithErrorCode(hr);
-                }
-
-                const wchar_t* localName;
-                hr = xmlReader->GetLocalName(&localName, NULL);
-                if (FAILED(hr))
-                {
-                    TRACEP(L"Error: GetLocalName() failed. Code :\n", hr);
-                    throw DMExceptionWithErrorCode(hr);
-                }
-
-                wstring elementName;
-                if (prefixSize > 0)
-                {
-                    elementName = prefix;
-                    elementName += L":";
-                }
-                elementName += localName;
-
-                if (!xmlReader->IsEmptyElement())
-                {
-                    pathStack.push_back(elementName);
-
-                    // rebuild the current path.
-                    currentPath = L"";
-                    for (auto& it : pathStack)
-                    {
-                        currentPath += it + L"\\";
-                    }
-                    if (targetXmlPath == currentPath)
-                    {
-                        pathFound = true;
-                    }
-                }
-            }
-            break;
-            case XmlNodeType_EndElement:
-            {
-                const wchar_t* prefix = NULL;
-                UINT prefixSize = 0;
-
-                hr = xmlReader->GetPrefix(&prefix, &prefixSize);
-                if (FAILED(hr))
-                {
-                    TRACEP(L"Error: GetPrefix() failed. Code :", hr);
-                    throw DMExceptionWithErrorCode(hr);
-                }
-
-                const wchar_t* localName = NULL;
-                hr = xmlReader->GetLocalName(&localName, NULL);
-                if (FAILED(hr))
-                {
-                    TRACEP(L"Error: GetLocalName() failed. Code :", hr);
-                    throw DMExceptionWithErrorCode(hr);
-                }
-
-                pathStack.pop_back();
-            }
-            break;
-            case XmlNodeType_Text:
-            case XmlNodeType_Whitespace:
-            {
-                const wchar_t* valueText = NULL;
-                hr = xmlReader->GetValue(&valueText, NULL);
-                if (FAILED(hr))
-                {
-                    TRACEP(L"Error: GetValue() failed. Code :", hr);
-                    throw DMExceptionWithErrorCode(hr);
-                }
-
-                if (targetXmlPath == currentPath)
-                {
-                    value = valueText;
-                    valueFound = true;
-                }
-            }
-            break;
-            }
-        }
-
-        if (!pathFound)
-        {
-            TRACEP(L"Error: Failed to read: ", targetXmlPath.c_str());
-            throw DMException("ReadXmlValue: path not found");
-        }
-    }
-
     void ReadXmlStructData(const wstring& resultSyncML, Utils::ELEMENT_HANDLER handler)
     {
-        DWORD bufferSize = static_cast<DWORD>(resultSyncML.size() * sizeof(resultSyncML[0]));
-        char* buffer = (char*)GlobalAlloc(GMEM_FIXED, bufferSize);
-        memcpy(buffer, resultSyncML.c_str(), bufferSize);
-
-        ComPtr<IStream> dataStream;
-        HRESULT hr = ::CreateStreamOnHGlobal(buffer, TRUE /*delete on release*/, dataStream.GetAddressOf());
-        if (FAILED(hr))
+        // Calls the handler for each <Results>/<Item> with the tokens of its
+        // <Source>/<LocURI> and its <Data>.
+        SyncMLResponse response(resultSyncML);
+        for (const SyncMLResponse::Item& item : response.Items())
         {
-            GlobalFree(buffer);
-            throw DMExceptionWithErrorCode(hr);
-        }
-        ReadXmlStructData(dataStream.Get(), handler);
-
-        // GlobalFree() is not needed since 'delete on release' is enabled.
-        // GlobalFree(buffer);
-    }
-
-    void ReadXmlValue(const wstring& resultSyncML, const wstring& targetXmlPath, wstring& value)
-    {
-        DWORD bufferSize = static_cast<DWORD>(resultSyncML.size() * sizeof(resultSyncML[0]));
-        char* buffer = (char*)GlobalAlloc(GMEM_FIXED, bufferSize);
-        memcpy(buffer, resultSyncML.c_str(), bufferSize);
+            vector<wstring> uriTokens;
+            SplitString(item.locUri.str(), L'/', uriTokens);
 
-        ComPtr<IStream> dataStream;
-        HRESULT hr = ::CreateStreamOnHGlobal(buffer, TRUE /*delete on release*/, dataStream.GetAddressOf());
-        if (FAILED(hr))
-        {
-            GlobalFree(buffer);
-            throw DMExceptionWithErrorCode(hr);
+            wstring value = item.data.str();
+            handler(uriTokens, value);
         }
-        ReadXmlValue(dataStream.Get(), targetXmlPath, value);
-
-        // GlobalFree() is not needed since 'delete on release' is enabled.
-        // GlobalFree(buffer);
     }
 
     void WriteRegistryValue(const wstring& subKey, const wstring& propName, const wstring& propValue)
@@ -760,108 +455,36 @@ namespace Utils
         return jsonPropertyName;
     }
 
-    void LaunchProcess(const wstring& commandString, unsigned long& returnCode, string& output)
+    ProcessRunner::Result LaunchProcess(const wstring& commandString, const ProcessRunner::OutputHandler& onOutput, unsigned int timeoutMs, const ProcessCancellation* cancellation)
     {
         TRACEP(L"Launching: ", commandString.c_str());
 
-        SECURITY_ATTRIBUTES securityAttributes;
-        securityAttributes.nLength = sizeof(SECURITY_ATTRIBUTES);
-        securityAttributes.bInheritHandle = TRUE;
-        securityAttributes.lpSecurityDescriptor = NULL;
-
-        AutoCloseHandle stdOutReadHandle;
-        AutoCloseHandle stdOutWriteHandle;
-        DWORD pipeBufferSize = 4096;
-
-        if (!CreatePipe(stdOutReadHandle.GetAddress(), stdOutWriteHandle.GetAddress(), &securityAttributes, pipeBufferSize))
-        {
-            throw DMExceptionWithErrorCode(GetLastError());
-        }
+        unique_ptr<IChildProcess> child = StartChildProcess(commandString, cancellation);
+        TRACE("Child process has been launched.");
 
-        if (!SetHandleInformation(stdOutReadHandle.Get(), HANDLE_FLAG_INHERIT, 0 /*flags*/))
+        ProcessRunner::Result result = ProcessRunner::Run(*child, onOutput, timeoutMs);
+        if (result.status == ProcessRunner::TimedOut)
         {
-            throw DMExceptionWithErrorCode(GetLastError());
+            TRACEP("Warning: Child process timed out after (ms): ", timeoutMs);
         }
-
-        PROCESS_INFORMATION piProcInfo;
-        ZeroMemory(&piProcInfo, sizeof(PROCESS_INFORMATION));
-
-        STARTUPINFO siStartInfo;
-        ZeroMemory(&siStartInfo, sizeof(STARTUPINFO));
-        siStartInfo.cb = sizeof(STARTUPINFO);
-        siStartInfo.hStdError = stdOutWriteHandle.Get();
-        siStartInfo.hStdOutput = stdOutWriteHandle.Get();
-        siStartInfo.hStdInput = NULL;
-siStartInfo.dwFlags |= STARTF_USESTDHANDLES;
-
-if (!CreateProcess(NULL,
-    const_cast<wchar_t*>(commandString.c_str()), // command line 
-    NULL,         // process security attributes 
-    NULL,         // primary thread security attributes 
-    TRUE,         // handles are inherited 
-    0,            // creation flags 
-    NULL,         // use parent's environment 
-    NULL,         // use parent's current directory 
-    &siStartInfo, // STARTUPINFO pointer 
-    &piProcInfo)) // receives PROCESS_INFORMATION
-{
-    throw DMExceptionWithErrorCode(GetLastError());
-}
-TRACE("Child process has been launched.");
-
-bool doneWriting = false;
-while (!doneWriting)
-{
-    // Let the child process run for 1 second, and then check if there is anything to read...
-    DWORD waitStatus = WaitForSingleObject(piProcInfo.hProcess, 1000);
-    if (waitStatus == WAIT_OBJECT_0)
-    {
-        TRACE("Child process has exited.");
-        if (!GetExitCodeProcess(piProcInfo.hProcess, &returnCode))
+        else if (result.status == ProcessRunner::Cancelled)
         {
-            TRACEP("Warning: Failed to get process exist code. GetLastError() = ", GetLastError());
-            // ToDo: do we ignore?
+            TRACE("Warning: Child process was cancelled.");
         }
-        CloseHandle(piProcInfo.hProcess);
-        CloseHandle(piProcInfo.hThread);
 
-        // Child process has exited, no more writing will take place.
-        // Without closing the write channel, the ReadFile will keep waiting.
-        doneWriting = true;
-        stdOutWriteHandle.Close();
-    }
-    else
-    {
-        TRACE("Child process is still running...");
+        TRACEP("Command return Code: ", result.exitCode);
+        return result;
     }
 
-    DWORD bytesAvailable = 0;
-    if (PeekNamedPipe(stdOutReadHandle.Get(), NULL, 0, NULL, &bytesAvailable, NULL))
-    {
-        if (bytesAvailable > 0)
-        {
-            DWORD readByteCount = 0;
-            vector<char> readBuffer(bytesAvailable + 1);
-            if (ReadFile(stdOutReadHandle.Get(), readBuffer.data(), static_cast<unsigned int>(readBuffer.size()) - 1, &readByteCount, NULL) || readByteCount == 0)
-            {
-                readBuffer[readByteCount] = '\0';
-                output += readBuffer.data();
-            }
-        }
-    }
-    else
+    void LaunchProcess(const wstring& commandString, unsigned long& returnCode, string& output)
     {
-        DWORD retCode = GetLastError();
-        if (ERROR_PIPE_HAS_BEEN_ENDED != retCode)
+        ProcessRunner::Result result = LaunchProcess(commandString, [&output](const char* data, size_t size)
         {
-            printf("error code = %d\n", retCode);
-        }
-        break;
-    }
-}
+            output.append(data, size);
+        }, ProcessRunner::NoTimeout);
 
-TRACEP("Command return Code: ", returnCode);
-TRACEP("Command output : ", output.c_str());
+        returnCode = result.exitCode;
+        TRACEPV("Command output : ", output.c_str());
     }
 
     wstring GetProcessExePath(DWORD processID)
@@ -944,47 +567,54 @@ TRACEP("Command output : ", output.c_str());
     {
         TRACE(__FUNCTION__);
 
-        DWORD destinationSize = 0;
-        if (!CryptStringToBinary(encrypted.c_str(), static_cast<unsigned int>(encrypted.size()), CRYPT_STRING_BASE64, nullptr, &destinationSize, nullptr, nullptr))
-        {
-            throw DMException("Error: cannot obtain the required size to decode buffer from base64.");
-        }
-
-        decrypted.resize(destinationSize);
-        if (!CryptStringToBinary(encrypted.c_str(), static_cast<unsigned int>(encrypted.size()), CRYPT_STRING_BASE64, reinterpret_cast<unsigned char*>(decrypted.data()), &destinationSize, nullptr, nullptr))
-        {
-            throw DMException("Error: cannot obtain the required size to decode buffer from base64.");
-        }
+        decrypted.clear();
+        Base64Decoder::Decode(encrypted.data(), encrypted.size(), decrypted);
     }
 
     wstring ToBase64(vector<char>& buffer)
     {
         TRACE(__FUNCTION__);
 
-        DWORD destinationSize = 0;
-        if (!CryptBinaryToString(reinterpret_cast<unsigned char*>(buffer.data()), static_cast<unsigned int>(buffer.size()), CRYPT_STRING_BASE64, nullptr, &destinationSize))
-        {
-            throw DMException("Error: cannot obtain the required size to encode buffer into base64.");
-        }
+        // Unlike CryptBinaryToString, no line breaks are inserted.
+        wstring encoded;
+        Base64Encoder::Encode(buffer.data(), buffer.size(), encoded);
+        return encoded;
+    }
 
-        vector<wchar_t> destinationBuffer(destinationSize);
-        if (!CryptBinaryToString(reinterpret_cast<unsigned char*>(buffer.data()), static_cast<unsigned int>(buffer.size()), CRYPT_STRING_BASE64, destinationBuffer.data(), &destinationSize))
-        {
-            throw DMException("Error: cannot convert binary stream to base64.");
-        }
+    wstring FileToBase64(const wstring& fileName)
+    {
+        TRACE(__FUNCTION__);
+        TRACEP(L"fileName = ", fileName.c_str());
 
-        // Note that the size returned includes the null terminating character.
-        return wstring(destinationBuffer.data(), destinationBuffer.size() - 1);
+        wstring encoded;
+        AppendFileAsBase64(fileName, encoded);
+        return encoded;
     }
 
-    wstring FileToBase64(const wstring& fileName)
+    void AppendFileAsBase64(const wstring& fileName, wstring& out, size_t trailingCapacity)
     {
         TRACE(__FUNCTION__);
         TRACEP(L"fileName = ", fileName.c_str());
 
-        vector<char> buffer;
-        LoadFile(fileName, buffer);
-        return ToBase64(buffer);
+        ifstream file(fileName, ios::in | ios::binary | ios::ate);
+        if (!file.is_open())
+        {
+            throw DMException("Error: failed to open binary file!");
+        }
+
+        size_t fileSize = static_cast<size_t>(file.tellg());
+        file.seekg(0, ios::beg);
+        out.reserve(out.size() + Base64Encoder::EncodedSize(fileSize) + trailingCapacity);
+
+        Base64Encoder::EncodeStream([&file](void* buffer, size_t size)
+        {
+            file.read(static_cast<char*>(buffer), size);
+            if (file.bad())
+            {
+                throw DMException("Error: failed to read file!");
+            }
+            return static_cast<size_t>(file.gcount());
+        }, out);
     }
 
 }
@@ -25,6 +25,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "StringUtils.h"
 #include "AutoCloseHandle.h"
 #include "Constants.h"
+#include "ProcessRunner.h"
 
 #define IoTDMSihostExe L"sihost.exe"
 
@@ -55,7 +56,6 @@ namespace Utils
     std::wstring GetProgramDataFolder();
 
     // Xml helpers
-    void ReadXmlValue(const std::wstring& resultSyncML, const std::wstring& targetXmlPath, std::wstring& value);
     void ReadXmlStructData(const std::wstring& resultSyncML, ELEMENT_HANDLER handler);
 
     // Registry helpers
@@ -74,6 +74,9 @@ namespace Utils
 
     // Process helpers
     void LaunchProcess(const std::wstring& commandString, unsigned long& returnCode, std::string& output);
+    // Passes output to 'onOutput' as the child writes it. The child is
+    // terminated after 'timeoutMs' or when 'cancellation' fires.
+    ProcessRunner::Result LaunchProcess(const std::wstring& commandString, const ProcessRunner::OutputHandler& onOutput, unsigned int timeoutMs, const ProcessCancellation* cancellation = nullptr);
     std::wstring GetProcessExePath(DWORD processID);
     bool IsProcessRunning(const std::wstring& processName);
 
@@ -155,4 +158,8 @@ namespace Utils
     void Base64ToBinary(const std::wstring& encrypted, std::vector<char>& decrypted);
     std::wstring ToBase64(std::vector<char>& buffer);
     std::wstring FileToBase64(const std::wstring& fileName);
+
+    // Appends the base64 encoding of a file to 'out', reading it in fixed-size chunks.
+    // 'out' is grown once, with room for 'trailingCapacity' more characters after it.
+    void AppendFileAsBase64(const std::wstring& fileName, std::wstring& out, size_t trailingCapacity = 0);
 }
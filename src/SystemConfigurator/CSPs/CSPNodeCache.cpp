@@ -0,0 +1,229 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include "..\SharedUtilities\Logger.h"
+#include "CSPNodeCache.h"
+
+using namespace std;
+
+CSPNodeCache::CSPNodeCache() :
+    CSPNodeCache(PolicyMap())
+{
+}
+
+CSPNodeCache::CSPNodeCache(const PolicyMap& policies, TimeSource now) :
+    _now(now),
+    _policies(policies),
+    _size(0),
+    _generation(0),
+    _hitCount(0),
+    _missCount(0),
+    _invalidationCount(0)
+{
+}
+
+void CSPNodeCache::SetPolicy(const wstring& subtree, chrono::milliseconds ttl)
+{
+    lock_guard<mutex> lock(_mutex);
+    _policies[subtree] = ttl;
+}
+
+chrono::milliseconds CSPNodeCache::GetTimeToLive(const wstring& path) const
+{
+    // Must be called with _mutex held.
+    // Walk up from the node itself to find the longest subtree with a policy.
+    wstring subtree = path;
+    while (!subtree.empty())
+    {
+        auto policy = _policies.find(subtree);
+        if (policy != _policies.end())
+        {
+            return policy->second;
+        }
+
+        size_t separator = subtree.rfind(L'/');
+        if (separator == wstring::npos)
+        {
+            break;
+        }
+        subtree.resize(separator);
+    }
+    return chrono::milliseconds(0);
+}
+
+bool CSPNodeCache::IsCacheable(const wstring& path) const
+{
+    lock_guard<mutex> lock(_mutex);
+    return GetTimeToLive(path).count() > 0;
+}
+
+wstring CSPNodeCache::VariantKey(const wstring& sid, const wstring& format)
+{
+    return sid + L"|" + format;
+}
+
+bool CSPNodeCache::TryGet(const wstring& sid, const wstring& path, const wstring& format, wstring& value)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    if (GetTimeToLive(path).count() <= 0)
+    {
+        return false;
+    }
+
+    auto node = _entries.find(path);
+    if (node != _entries.end())
+    {
+        auto entry = node->second.find(VariantKey(sid, format));
+        if (entry != node->second.end())
+        {
+            if (entry->second.expiry > _now())
+            {
+                ++_hitCount;
+                value = entry->second.value;
+                return true;
+            }
+
+            node->second.erase(entry);
+            --_size;
+            if (node->second.empty())
+            {
+                _entries.erase(node);
+            }
+        }
+    }
+
+    ++_missCount;
+    return false;
+}
+
+void CSPNodeCache::Put(const wstring& sid, const wstring& path, const wstring& format, const wstring& value, unsigned long long generation)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    if (generation != _generation)
+    {
+        TRACEP(L"CSPNodeCache: value read before an invalidation is not cached: ", path.c_str());
+        return;
+    }
+
+    chrono::milliseconds ttl = GetTimeToLive(path);
+    if (ttl.count() <= 0)
+    {
+        return;
+    }
+
+    auto inserted = _entries[path].insert(make_pair(VariantKey(sid, format), Entry()));
+    if (inserted.second)
+    {
+        ++_size;
+    }
+    inserted.first->second.value = value;
+    inserted.first->second.expiry = _now() + ttl;
+}
+
+unsigned long long CSPNodeCache::Generation() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _generation;
+}
+
+void CSPNodeCache::Erase(EntryMap::iterator it)
+{
+    // Must be called with _mutex held.
+    _size -= it->second.size();
+    _invalidationCount += it->second.size();
+    _entries.erase(it);
+}
+
+void CSPNodeCache::Invalidate(const wstring& path)
+{
+    lock_guard<mutex> lock(_mutex);
+
+    ++_generation;
+    if (_entries.empty())
+    {
+        return;
+    }
+
+    // The node and its descendants...
+    auto node = _entries.find(path);
+    if (node != _entries.end())
+    {
+        Erase(node);
+    }
+
+    wstring prefix = path + L"/";
+    auto descendant = _entries.lower_bound(prefix);
+    while (descendant != _entries.end() && descendant->first.compare(0, prefix.size(), prefix) == 0)
+    {
+        Erase(descendant++);
+    }
+
+    // ...and its ancestors.
+    wstring ancestor = path;
+    size_t separator = ancestor.rfind(L'/');
+    while (separator != wstring::npos)
+    {
+        ancestor.resize(separator);
+        auto it = _entries.find(ancestor);
+        if (it != _entries.end())
+        {
+            Erase(it);
+        }
+        separator = ancestor.rfind(L'/');
+    }
+}
+
+void CSPNodeCache::Clear()
+{
+    lock_guard<mutex> lock(_mutex);
+
+    ++_generation;
+    _entries.clear();
+    _size = 0;
+}
+
+unsigned long long CSPNodeCache::HitCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _hitCount;
+}
+
+unsigned long long CSPNodeCache::MissCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _missCount;
+}
+
+unsigned long long CSPNodeCache::InvalidationCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _invalidationCount;
+}
+
+size_t CSPNodeCache::Size() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _size;
+}
+
+void CSPNodeCache::ResetStatistics()
+{
+    lock_guard<mutex> lock(_mutex);
+    _hitCount = 0;
+    _missCount = 0;
+    _invalidationCount = 0;
+}
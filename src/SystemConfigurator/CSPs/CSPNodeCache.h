@@ -0,0 +1,90 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <functional>
+
+// Read-through cache for CSP node values, keyed by node path.
+//
+// Only nodes under a subtree with a policy are cached. The policy of the
+// longest matching subtree applies, so a broad subtree can be cached while
+// some of its children are excluded with a zero time-to-live.
+//
+// Writing a node invalidates its cached value, the values of its descendants
+// and the values of its ancestors (an interior node caches its child list).
+// Each invalidation advances Generation(). Put() ignores a value that was read
+// before an invalidation so that a read racing with a write cannot put a
+// stale value back.
+class CSPNodeCache
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<Clock::time_point()> TimeSource;
+    typedef std::map<std::wstring, std::chrono::milliseconds> PolicyMap;
+
+    CSPNodeCache();
+    CSPNodeCache(const PolicyMap& policies, TimeSource now = Clock::now);
+
+    // A zero ttl excludes the subtree from caching.
+    void SetPolicy(const std::wstring& subtree, std::chrono::milliseconds ttl);
+    bool IsCacheable(const std::wstring& path) const;
+
+    // 'sid' and 'format' identify how the value was read; the same node read
+    // for another user or in another format is cached separately.
+    bool TryGet(const std::wstring& sid, const std::wstring& path, const std::wstring& format, std::wstring& value);
+    void Put(const std::wstring& sid, const std::wstring& path, const std::wstring& format, const std::wstring& value, unsigned long long generation);
+
+    unsigned long long Generation() const;
+    void Invalidate(const std::wstring& path);
+    void Clear();
+
+    // Statistics
+    unsigned long long HitCount() const;
+    unsigned long long MissCount() const;
+    unsigned long long InvalidationCount() const;
+    size_t Size() const;
+    void ResetStatistics();
+
+private:
+    struct Entry
+    {
+        std::wstring value;
+        Clock::time_point expiry;
+    };
+
+    // Path -> (sid + format) -> entry
+    typedef std::map<std::wstring, std::map<std::wstring, Entry>> EntryMap;
+
+    std::chrono::milliseconds GetTimeToLive(const std::wstring& path) const;
+    void Erase(EntryMap::iterator it);
+
+    static std::wstring VariantKey(const std::wstring& sid, const std::wstring& format);
+
+    TimeSource _now;
+    PolicyMap _policies;
+
+    mutable std::mutex _mutex;
+    EntryMap _entries;
+    size_t _size;
+    unsigned long long _generation;
+
+    unsigned long long _hitCount;
+    unsigned long long _missCount;
+    unsigned long long _invalidationCount;
+};
@@ -189,6 +189,20 @@ void CertificateInfo::AddCertificate(const std::wstring& path, const std::wstrin
     MdmProvision::RunAddDataBase64(fullPath, certificateInBase64);
 }
 
+void CertificateInfo::AddCertificateFromFile(const std::wstring& path, const std::wstring& hash, const std::wstring& fileName)
+{
+    TRACE(__FUNCTION__);
+
+    wstring fullPath = path;
+    fullPath += L"/";
+    fullPath += hash;
+    fullPath += L"/EncodedCertificate";
+
+    TRACEP(L"Adding : ", fullPath.c_str());
+
+    MdmProvision::RunAddDataBase64FromFile(fullPath, fileName);
+}
+
 void CertificateInfo::DeleteCertificate(const wstring& path, const wstring& hash)
 {
     TRACE(__FUNCTION__);
@@ -256,7 +270,6 @@ std::wstring CertificateFile::ThumbPrint() const
 
 void CertificateFile::Install(const std::wstring& certStorePath)
 {
-    wstring certificateBase64 = Utils::FileToBase64(_fullFileName);
-    CertificateInfo::AddCertificate(certStorePath, ThumbPrint(), certificateBase64);
+    CertificateInfo::AddCertificateFromFile(certStorePath, ThumbPrint(), _fullFileName);
 }
 
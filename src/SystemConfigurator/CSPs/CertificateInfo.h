@@ -50,6 +50,7 @@ public:
     static void AddTemplateName(const std::wstring& certPath, const std::wstring& value);
 
     static void AddCertificate(const std::wstring& path, const std::wstring& hash, const std::wstring& certificateInBase64);
+    static void AddCertificateFromFile(const std::wstring& path, const std::wstring& hash, const std::wstring& fileName);
     static void DeleteCertificate(const std::wstring& path, const std::wstring& hash);
 
 private:
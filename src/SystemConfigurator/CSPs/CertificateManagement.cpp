@@ -16,6 +16,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CertificateManagement.h"
 #include "MdmProvision.h"
 #include "CertificateInfo.h"
+#include "CertificateReconciler.h"
 #include "..\SharedUtilities\Logger.h"
 
 using namespace std;
@@ -30,21 +31,22 @@ const wchar_t* JsonStateUnknown = L"unknown";
 const wchar_t* JsonStateInstalled = L"installed";
 const wchar_t* JsonStateUninstalled = L"uninstalled";
 
-bool icompare_pred(wchar_t a, wchar_t b)
+static bool GetFileStamp(const wstring& fileName, CertificateReconciler::FileStamp& stamp)
 {
-    return ::towlower(a) == ::towlower(b);
-}
-
-bool icompare(std::wstring const& a, std::wstring const& b)
-{
-    if (a.length() == b.length())
-    {
-        return std::equal(b.begin(), b.end(), a.begin(), icompare_pred);
-    }
-    else
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(fileName.c_str(), GetFileExInfoStandard, &attributes))
     {
         return false;
     }
+
+    stamp.size = (static_cast<unsigned long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    stamp.lastWriteTime = (static_cast<unsigned long long>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+static wstring GetFileThumbPrint(const wstring& fileName)
+{
+    return CertificateFile(fileName).ThumbPrint();
 }
 
 void CertificateManagement::SyncCertificates(const std::wstring& path, const std::wstring& desiredStatesString)
@@ -62,7 +64,7 @@ void CertificateManagement::SyncCertificates(const std::wstring& path, const std
 
     // Loading desired certificates info...
     TRACE(L"Loading desired certificates info...");
-    vector<CertificateFile> desiredInstalls;
+    vector<wstring> desiredInstalls;
     vector<wstring> desiredUninstalls;
     for (const wstring& certificateEntry : certificateEntries)
     {
@@ -86,8 +88,7 @@ void CertificateManagement::SyncCertificates(const std::wstring& path, const std
             TRACEP(L"Certificate File Name: ", fileName.c_str());
 
             wstring fullFileName = Utils::GetDmUserFolder() + L"\\" + fileName;
-            TRACEP(L"Reading: ", fullFileName.c_str());
-            desiredInstalls.push_back(CertificateFile(fullFileName));
+            desiredInstalls.push_back(fullFileName);
         }
         else
         {
@@ -96,67 +97,23 @@ void CertificateManagement::SyncCertificates(const std::wstring& path, const std
         }
     }
 
-    // If in desired but not in current, add it.
-    TRACE(L"Deciding what to add...");
-    vector<CertificateFile> certificatesToAdd;
-    for (const CertificateFile& certificateFileInfo : desiredInstalls)
-    {
-        wstring desiredHash = certificateFileInfo.ThumbPrint();
-        bool found = false;
-        for (const wstring& currentHash : currentHashesVector)
-        {
-            if (icompare(currentHash, desiredHash))
-            {
-                found = true;
-                break;
-            }
-        }
-        if (!found)
-        {
-            TRACEP(L"-- Will be adding: ", certificateFileInfo.FullFileName().c_str());
-            certificatesToAdd.push_back(certificateFileInfo);
-        }
-        else
-        {
-            TRACEP(L"-- Already installed: ", certificateFileInfo.FullFileName().c_str());
-        }
-    }
+    // Kept across syncs so unchanged files are not read and hashed again.
+    static CertificateReconciler reconciler(GetFileStamp, GetFileThumbPrint);
 
-    // If in current but not in desired, remove it.
-    TRACE(L"Deciding what to delete...");
-    vector<wstring> hashesToDelete;
-    for (const wstring& desiredUninstall : desiredUninstalls)
-    {
-        TRACEP(L"Looking for: ", desiredUninstall.c_str());
-        bool found = false;
-        for (const wstring& currentHash : currentHashesVector)
-        {
-            if (icompare(currentHash, desiredUninstall))
-            {
-                TRACEP(L"-- Found: ", currentHash.c_str());
-                found = true;
-                break;
-            }
-        }
-        if (found)
-        {
-            TRACEP(L"-- Will be deleting: ", desiredUninstall.c_str());
-            hashesToDelete.push_back(desiredUninstall);
-        }
-    }
+    TRACE(L"Deciding what to add and delete...");
+    CertificateReconciler::Plan plan = reconciler.Reconcile(currentHashesVector, desiredInstalls, desiredUninstalls);
 
     // Delete certificates
-    for (const wstring& hashToDelete : hashesToDelete)
+    for (const wstring& hashToDelete : plan.toDelete)
     {
         TRACEP(L"Deleting ", hashToDelete.c_str());
         CertificateInfo::DeleteCertificate(path, hashToDelete);
     }
 
     // Add certificates
-    for (const CertificateFile& certificateToAdd : certificatesToAdd)
+    for (const CertificateReconciler::Addition& certificateToAdd : plan.toAdd)
     {
-        TRACEP(L"Adding: ", certificateToAdd.FullFileName().c_str());
-        wstring certificateInBase64 = Utils::FileToBase64(certificateToAdd.FullFileName());
-        CertificateInfo::AddCertificate(path, certificateToAdd.ThumbPrint(), certificateInBase64);
+        TRACEP(L"Adding: ", certificateToAdd.fileName.c_str());
+        CertificateInfo::AddCertificateFromFile(path, certificateToAdd.thumbPrint, certificateToAdd.fileName);
     }
 }
@@ -0,0 +1,179 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <algorithm>
+#include <cwctype>
+#include <future>
+#include <unordered_set>
+#include "CertificateReconciler.h"
+
+using namespace std;
+
+const size_t CertificateReconciler::MaxCachedFiles;
+
+CertificateReconciler::CertificateReconciler(StampFunction stamp, HashFunction hash, unsigned int workerCount) :
+    _stamp(stamp),
+    _hash(hash),
+    _workerCount((max)(workerCount, 1u)),
+    _filesHashed(0)
+{
+}
+
+wstring CertificateReconciler::Normalize(const wstring& thumbPrint)
+{
+    wstring normalized(thumbPrint);
+    for (wchar_t& c : normalized)
+    {
+        c = static_cast<wchar_t>(towlower(c));
+    }
+    return normalized;
+}
+
+CertificateReconciler::Plan CertificateReconciler::Reconcile(
+    const vector<wstring>& currentThumbPrints,
+    const vector<wstring>& installFiles,
+    const vector<wstring>& uninstallThumbPrints)
+{
+    unordered_set<wstring> current;
+    current.reserve(currentThumbPrints.size());
+    for (const wstring& thumbPrint : currentThumbPrints)
+    {
+        current.insert(Normalize(thumbPrint));
+    }
+
+    Plan plan;
+
+    vector<wstring> installThumbPrints = GetThumbPrints(installFiles);
+    unordered_set<wstring> adding;
+    for (size_t i = 0; i < installFiles.size(); ++i)
+    {
+        wstring thumbPrint = Normalize(installThumbPrints[i]);
+        if (current.count(thumbPrint) == 0 && adding.insert(thumbPrint).second)
+        {
+            Addition addition;
+            addition.fileName = installFiles[i];
+            addition.thumbPrint = installThumbPrints[i];
+            plan.toAdd.push_back(addition);
+        }
+    }
+
+    unordered_set<wstring> deleting;
+    for (const wstring& thumbPrint : uninstallThumbPrints)
+    {
+        wstring normalized = Normalize(thumbPrint);
+        if (current.count(normalized) != 0 && deleting.insert(normalized).second)
+        {
+            plan.toDelete.push_back(thumbPrint);
+        }
+    }
+
+    return plan;
+}
+
+vector<wstring> CertificateReconciler::GetThumbPrints(const vector<wstring>& installFiles)
+{
+    vector<wstring> thumbPrints(installFiles.size());
+    vector<FileStamp> stamps(installFiles.size());
+    vector<bool> stamped(installFiles.size());
+
+    // Files that are cached and unchanged are not read.
+    vector<size_t> misses;
+    for (size_t i = 0; i < installFiles.size(); ++i)
+    {
+        stamped[i] = _stamp(installFiles[i], stamps[i]);
+
+        lock_guard<mutex> lock(_mutex);
+        auto it = _cache.find(installFiles[i]);
+        if (stamped[i] && it != _cache.end() &&
+            it->second.stamp.size == stamps[i].size &&
+            it->second.stamp.lastWriteTime == stamps[i].lastWriteTime)
+        {
+            thumbPrints[i] = it->second.thumbPrint;
+        }
+        else
+        {
+            misses.push_back(i);
+        }
+    }
+
+    if (misses.empty())
+    {
+        return thumbPrints;
+    }
+
+    // The workers are started for this sync only and stopped when it returns.
+    DomainExecutor workers(static_cast<unsigned int>((min)(static_cast<size_t>(_workerCount), misses.size())));
+    vector<future<wstring>> hashes;
+    hashes.reserve(misses.size());
+    for (size_t i : misses)
+    {
+        HashFunction hash = _hash;
+        wstring fileName = installFiles[i];
+        hashes.push_back(workers.Enqueue(vector<wstring>(), [hash, fileName]()
+        {
+            return hash(fileName);
+        }));
+    }
+
+    // Every hash is waited for, so none is still running when this returns.
+    exception_ptr error;
+    for (size_t j = 0; j < misses.size(); ++j)
+    {
+        size_t i = misses[j];
+        try
+        {
+            thumbPrints[i] = hashes[j].get();
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = current_exception();
+            }
+            continue;
+        }
+
+        lock_guard<mutex> lock(_mutex);
+        ++_filesHashed;
+        if (stamped[i])
+        {
+            if (_cache.size() >= MaxCachedFiles)
+            {
+                _cache.clear();
+            }
+            CacheEntry& entry = _cache[installFiles[i]];
+            entry.stamp = stamps[i];
+            entry.thumbPrint = thumbPrints[i];
+        }
+    }
+
+    if (error)
+    {
+        rethrow_exception(error);
+    }
+    return thumbPrints;
+}
+
+size_t CertificateReconciler::CachedFiles() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _cache.size();
+}
+
+unsigned long long CertificateReconciler::FilesHashed() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _filesHashed;
+}
@@ -0,0 +1,102 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "..\DomainExecutor.h"
+
+// Works out which certificates a store needs added and removed.
+//
+// Thumbprints are compared case-insensitively through a hash set, so the
+// diff is linear in the number of certificates. Certificate files are hashed
+// in parallel, and each file's thumbprint is remembered until the file's
+// size or last write time changes, so syncing the same desired list again
+// does not read the files at all. The hashing threads only exist while a
+// sync has files to hash.
+//
+// Reading and hashing files is injected so the engine can be tested without
+// a certificate store.
+class CertificateReconciler
+{
+public:
+    // Identifies one version of a file's contents.
+    struct FileStamp
+    {
+        unsigned long long size;
+        unsigned long long lastWriteTime;
+    };
+
+    // Returns false if the file cannot be examined; it is then hashed, and
+    // the hash reports the error.
+    typedef std::function<bool(const std::wstring& fileName, FileStamp& stamp)> StampFunction;
+
+    // Returns the thumbprint of the certificate in the file. Throws on error.
+    typedef std::function<std::wstring(const std::wstring& fileName)> HashFunction;
+
+    struct Addition
+    {
+        std::wstring fileName;
+        std::wstring thumbPrint;
+    };
+
+    struct Plan
+    {
+        std::vector<Addition> toAdd;
+        std::vector<std::wstring> toDelete;
+    };
+
+    // The cache is dropped once it holds this many files.
+    static const size_t MaxCachedFiles = 4096;
+
+    CertificateReconciler(StampFunction stamp, HashFunction hash, unsigned int workerCount = DomainExecutor::DefaultWorkerCount);
+
+    static std::wstring Normalize(const std::wstring& thumbPrint);
+
+    // Files whose certificate is not in the store are added, once each.
+    // Thumbprints to uninstall are deleted if the store has them, and are
+    // returned as given. If a file cannot be hashed, the exception propagates
+    // and nothing is returned.
+    Plan Reconcile(const std::vector<std::wstring>& currentThumbPrints,
+                   const std::vector<std::wstring>& installFiles,
+                   const std::vector<std::wstring>& uninstallThumbPrints);
+
+    size_t CachedFiles() const;
+    unsigned long long FilesHashed() const;
+
+private:
+    struct CacheEntry
+    {
+        FileStamp stamp;
+        std::wstring thumbPrint;
+    };
+
+    CertificateReconciler(const CertificateReconciler&);
+    CertificateReconciler& operator=(const CertificateReconciler&);
+
+    // Returns the thumbprints of installFiles, in the same order.
+    std::vector<std::wstring> GetThumbPrints(const std::vector<std::wstring>& installFiles);
+
+    StampFunction _stamp;
+    HashFunction _hash;
+    unsigned int _workerCount;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<std::wstring, CacheEntry> _cache;
+    unsigned long long _filesHashed;
+};
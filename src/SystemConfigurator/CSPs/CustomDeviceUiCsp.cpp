@@ -13,6 +13,7 @@ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "stdafx.h"
+#include <algorithm>
 #include "CustomDeviceUiCSP.h"
 #include "RebootCSP.h"
 #include "MdmProvision.h"
@@ -58,12 +59,12 @@ wstring CustomDeviceUiCSP::GetStartupAppId()
     return appId;
 }
 
-wstring CustomDeviceUiCSP::GetBackgroundTasksToLaunch()
+vector<wstring> CustomDeviceUiCSP::GetBackgroundAppIds()
 {
     TRACE(__FUNCTION__);
 #ifdef IOT_ENTERPRISE
     // TODO: need Enterprise solution
-    auto data = ref new Windows::Data::Json::JsonArray();
+    vector<wstring> appIds;
 #else
     // REQUEST
     //    ./Vendor/MSFT/CustomDeviceUI/BackgroundTaskstoLaunch?list=Struct
@@ -89,26 +90,42 @@ wstring CustomDeviceUiCSP::GetBackgroundTasksToLaunch()
     //    </Results>
 
     
-    auto data = ref new Windows::Data::Json::JsonArray();
+    vector<wstring> appIds;
     // use std::function to pass lambda that captures something
     std::function<void(std::vector<std::wstring>&, std::wstring&)> valueHandler =
-        [data](vector<wstring>& uriTokens, wstring& /*value*/) {
+        [&appIds](vector<wstring>& uriTokens, wstring& /*value*/) {
         if (uriTokens.size() == 6)
         {
             // 0/__1___/__2__/____3________/___________4___________/___5_
             // ./Vendor/MSFT/CustomDeviceUI/BackgroundTaskstoLaunch/Aumid
-            wstring pkgFamilyName = Utils::TrimString(uriTokens[5], L"!App");
-            auto aumid = ref new Platform::String(pkgFamilyName.c_str());
-            data->Append(JsonValue::CreateStringValue(aumid));
+            appIds.push_back(Utils::TrimString(uriTokens[5], L"!App"));
         }
     };
     MdmProvision::RunGetStructData(
         L"./Vendor/MSFT/CustomDeviceUI/BackgroundTaskstoLaunch?list=Struct",
         valueHandler);
 #endif // IOT_ENTERPRISE
+    return appIds;
+}
+
+wstring CustomDeviceUiCSP::GetBackgroundTasksToLaunch()
+{
+    TRACE(__FUNCTION__);
+
+    auto data = ref new Windows::Data::Json::JsonArray();
+    for (const wstring& appId : GetBackgroundAppIds())
+    {
+        data->Append(JsonValue::CreateStringValue(ref new Platform::String(appId.c_str())));
+    }
     return data->Stringify()->Data();
 }
 
+StartupAppIndex CustomDeviceUiCSP::GetStartupApps()
+{
+    TRACE(__FUNCTION__);
+    return StartupAppIndex(GetStartupAppId, GetBackgroundAppIds);
+}
+
 void HandleStartupApp(const wstring& appId, bool backgroundApplication, bool add)
 {
     TRACE(__FUNCTION__);
@@ -210,7 +227,7 @@ bool CustomDeviceUiCSP::IsBackground(const std::wstring& pkgFamilyName)
     // TODO: need Enterprise solution
     return false;
 #else
-    wstring backgroundTasks = CustomDeviceUiCSP::GetBackgroundTasksToLaunch();
-    return wstring::npos != backgroundTasks.find(pkgFamilyName);
+    vector<wstring> appIds = CustomDeviceUiCSP::GetBackgroundAppIds();
+    return appIds.end() != find(appIds.begin(), appIds.end(), pkgFamilyName);
 #endif // IOT_ENTERPRISE
 }
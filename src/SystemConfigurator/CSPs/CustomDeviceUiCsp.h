@@ -16,12 +16,18 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <string>
 #include <vector>
+#include "StartupAppIndex.h"
 
 class CustomDeviceUiCSP
 {
 public:
     static std::wstring GetStartupAppId();
     static std::wstring GetBackgroundTasksToLaunch();
+    static std::vector<std::wstring> GetBackgroundAppIds();
+
+    // Reads the foreground and background startup apps with one query each.
+    static StartupAppIndex GetStartupApps();
+
     static bool IsForeground(const std::wstring& appId);
     static bool IsBackground(const std::wstring& appId);
     static void AddAsStartupApp(const std::wstring& appId, bool backgroundApplication);
@@ -20,6 +20,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "..\SharedUtilities\Logger.h"
 #include "..\SharedUtilities\Utils.h"
 #include "MdmProvision.h"
+#include "EtlExporter.h"
 #include "DiagnosticLogCSP.h"
 
 using namespace std;
@@ -296,22 +297,6 @@ void DiagnosticLogCSP::CreateEtlFile(CollectorDesiredConfiguration^ collector)
     collectorFileCSPPath += L"/";
     collectorFileCSPPath += collector->Name->Data();
 
-    // Read data from CSP into our buffers...
-    vector<vector<char>> decryptedEtlBuffer;
-    int blockCount = 0;
-    if (MdmProvision::TryGetNumber(collectorFileCSPPath + L"/" + CSPBlockCount, blockCount))
-    {
-        for (int i = 0; i < blockCount; ++i)
-        {
-            MdmProvision::RunSet(collectorFileCSPPath + L"/" + CSPBlockIndexToRead, i);
-            wstring blockData = MdmProvision::RunGetBase64(collectorFileCSPPath + L"/BlockData");
-
-            vector<char> decryptedBlock;
-            Utils::Base64ToBinary(blockData, decryptedBlock);
-            decryptedEtlBuffer.push_back(decryptedBlock);
-        }
-    }
-
     // Make sure the target folder exists...
     wstring etlFolderName;
     etlFolderName += Utils::GetDmUserFolder();
@@ -336,11 +321,44 @@ void DiagnosticLogCSP::CreateEtlFile(CollectorDesiredConfiguration^ collector)
     wstring etlFullFileName = etlFolderName + L"\\" + etlFileName;
     TRACEP(L"ETL Full File Name: ", etlFullFileName.c_str());
 
-    // Write the buffers to disk...
+    int blockCount = 0;
+    MdmProvision::TryGetNumber(collectorFileCSPPath + L"/" + CSPBlockCount, blockCount);
+
+    // Stream the blocks from the CSP to disk; only a few are in memory at a time.
+    EtlExporter exporter([&collectorFileCSPPath](int blockIndex)
+    {
+        MdmProvision::RunSet(collectorFileCSPPath + L"/" + CSPBlockIndexToRead, blockIndex);
+        return MdmProvision::RunGetBase64(collectorFileCSPPath + L"/" + CSPBlockData);
+    }, Utils::Base64ToBinary);
+
     ofstream etlFile(etlFullFileName, ios::out | ios::binary);
-    for (auto it = decryptedEtlBuffer.begin(); it != decryptedEtlBuffer.end(); it++)
+    try
+    {
+        EtlExporter::Progress progress = exporter.Export(blockCount, [&etlFile](const vector<char>& block)
+        {
+            etlFile.write(block.data(), block.size());
+            if (!etlFile)
+            {
+                throw DMException("Error: failed to write the etl file.");
+            }
+        },
+        [](const EtlExporter::Progress& progress)
+        {
+            if (progress.blocksWritten % 16 == 0)
+            {
+                TRACEP(L"ETL blocks written: ", progress.blocksWritten);
+            }
+        });
+
+        TRACEP(L"ETL bytes written: ", progress.bytesWritten);
+        TRACEP(L"ETL export throughput (bytes/s): ", static_cast<unsigned long long>(progress.BytesPerSecond()));
+    }
+    catch (...)
     {
-        etlFile.write(it->data(), it->size());
+        // Do not leave a truncated file behind.
+        etlFile.close();
+        DeleteFile(etlFullFileName.c_str());
+        throw;
     }
     etlFile.close();
 }
@@ -0,0 +1,138 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include "..\SharedUtilities\Logger.h"
+#include "EtlExporter.h"
+
+using namespace std;
+
+const size_t EtlExporter::DefaultReadAhead;
+
+double EtlExporter::Progress::BytesPerSecond() const
+{
+    double seconds = chrono::duration<double>(elapsed).count();
+    return seconds > 0 ? bytesWritten / seconds : 0;
+}
+
+EtlExporter::EtlExporter(ReadBlock read, DecodeBlock decode, size_t readAhead) :
+    _read(read),
+    _decode(decode),
+    _readAhead(readAhead == 0 ? 1 : readAhead)
+{
+}
+
+EtlExporter::Progress EtlExporter::Export(int blockCount, const WriteBlock& write, const ProgressHandler& onProgress) const
+{
+    TRACEP(L"Exporting blocks: ", blockCount);
+
+    Progress progress;
+    progress.blocksWritten = 0;
+    progress.blockCount = blockCount;
+    progress.bytesWritten = 0;
+    progress.elapsed = Clock::duration::zero();
+
+    Clock::time_point start = Clock::now();
+
+    mutex m;
+    condition_variable cv;
+    deque<wstring> ready;
+    bool stopping = false;
+    exception_ptr readError;
+
+    thread reader([&]()
+    {
+        for (int i = 0; i < blockCount; ++i)
+        {
+            wstring block;
+            try
+            {
+                block = _read(i);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> l(m);
+                readError = current_exception();
+                cv.notify_all();
+                return;
+            }
+
+            unique_lock<mutex> l(m);
+            cv.wait(l, [&]() { return stopping || ready.size() < _readAhead; });
+            if (stopping)
+            {
+                return;
+            }
+            ready.push_back(move(block));
+            cv.notify_all();
+        }
+    });
+
+    auto stopReader = [&]()
+    {
+        {
+            lock_guard<mutex> l(m);
+            stopping = true;
+        }
+        cv.notify_all();
+        reader.join();
+    };
+
+    try
+    {
+        vector<char> decoded;
+        for (int i = 0; i < blockCount; ++i)
+        {
+            wstring encoded;
+            {
+                unique_lock<mutex> l(m);
+                cv.wait(l, [&]() { return !ready.empty() || readError; });
+                if (ready.empty())
+                {
+                    rethrow_exception(readError);
+                }
+                encoded = move(ready.front());
+                ready.pop_front();
+            }
+            cv.notify_all();
+
+            decoded.clear();
+            _decode(encoded, decoded);
+            write(decoded);
+
+            ++progress.blocksWritten;
+            progress.bytesWritten += decoded.size();
+            progress.elapsed = Clock::now() - start;
+            if (onProgress)
+            {
+                onProgress(progress);
+            }
+        }
+    }
+    catch (...)
+    {
+        TRACEP(L"Export failed after blocks: ", progress.blocksWritten);
+        stopReader();
+        throw;
+    }
+    stopReader();
+
+    TRACEP(L"Exported bytes: ", progress.bytesWritten);
+    return progress;
+}
@@ -0,0 +1,64 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Copies a file out of a block-based CSP channel (DiagnosticLog/FileDownload)
+// without holding the whole file in memory.
+//
+// One thread reads blocks from the CSP in order and queues them, staying at
+// most a few blocks ahead. The calling thread decodes each queued block and
+// writes it out as soon as it is its turn, so reading block N+1 overlaps
+// decoding and writing block N, and memory stays bounded by the read-ahead.
+class EtlExporter
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Reads one block. Calls are made in index order from a single thread.
+    typedef std::function<std::wstring(int blockIndex)> ReadBlock;
+    typedef std::function<void(const std::wstring& encoded, std::vector<char>& decoded)> DecodeBlock;
+    typedef std::function<void(const std::vector<char>& block)> WriteBlock;
+
+    struct Progress
+    {
+        int blocksWritten;
+        int blockCount;
+        unsigned long long bytesWritten;
+        Clock::duration elapsed;
+
+        double BytesPerSecond() const;
+    };
+
+    typedef std::function<void(const Progress& progress)> ProgressHandler;
+
+    static const size_t DefaultReadAhead = 2;
+
+    EtlExporter(ReadBlock read, DecodeBlock decode, size_t readAhead = DefaultReadAhead);
+
+    // Writes blocks 0..blockCount-1 in order, calling onProgress after each.
+    // If reading, decoding or writing throws, the other side is stopped and
+    // the exception propagates; blocks already written stay written.
+    Progress Export(int blockCount, const WriteBlock& write, const ProgressHandler& onProgress = nullptr) const;
+
+private:
+    ReadBlock _read;
+    DecodeBlock _decode;
+    size_t _readAhead;
+};
@@ -0,0 +1,32 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+
+// Applies a SyncML request and returns the SyncML response.
+//
+// MdmProvision routes every CSP call through an ISyncMLExecutor. By default
+// this is the local management stack (ApplyLocalManagementSyncML), but another
+// implementation - like an in-memory CSP simulator - can be injected using
+// MdmProvision::SetExecutor() to run the CSP logic off-device.
+class ISyncMLExecutor
+{
+public:
+    virtual ~ISyncMLExecutor() {}
+
+    // Implementations must be safe to call from multiple threads.
+    virtual void Execute(const std::wstring& requestSyncML, std::wstring& responseSyncML) = 0;
+};
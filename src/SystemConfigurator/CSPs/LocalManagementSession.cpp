@@ -0,0 +1,150 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include "..\SharedUtilities\Logger.h"
+#include "..\SharedUtilities\DMException.h"
+#include "PrivateAPIs\WinSDKRS2.h"
+#include "LocalManagementSession.h"
+
+using namespace std;
+
+static HRESULT RegisterWithLocalManagement()
+{
+    return RegisterDeviceWithLocalManagement(NULL);
+}
+
+static HRESULT ApplyWithLocalManagement(const wstring& requestSyncML, wstring& outputSyncML)
+{
+    PWSTR output = nullptr;
+    HRESULT hr = ApplyLocalManagementSyncML(requestSyncML.c_str(), &output);
+
+    // Kept on failure too: statuses show which commands the stack ran.
+    if (output)
+    {
+        outputSyncML = output;
+    }
+    LocalFree(output);
+    return hr;
+}
+
+LocalManagementSession::LocalManagementSession() :
+    LocalManagementSession(RegisterWithLocalManagement, ApplyWithLocalManagement)
+{
+}
+
+LocalManagementSession::LocalManagementSession(RegisterFunction registerFunction, ApplyFunction applyFunction) :
+    _registerFunction(registerFunction),
+    _applyFunction(applyFunction),
+    _registered(false),
+    _registrationCount(0),
+    _applyCount(0)
+{
+}
+
+void LocalManagementSession::EnsureRegistered()
+{
+    // Must be called with _mutex held.
+    if (_registered)
+    {
+        return;
+    }
+
+    TRACE("Registering with local management...");
+
+    ++_registrationCount;
+    HRESULT hr = _registerFunction();
+    if (FAILED(hr))
+    {
+        throw DMExceptionWithErrorCode("RegisterDeviceWithLocalManagement", hr);
+    }
+    _registered = true;
+}
+
+void LocalManagementSession::Apply(const wstring& requestSyncML, wstring& outputSyncML)
+{
+    TRACE(__FUNCTION__);
+
+    // The lock only covers the registration; requests are applied concurrently.
+    unsigned long long registration;
+    {
+        lock_guard<mutex> lock(_mutex);
+        EnsureRegistered();
+        registration = _registrationCount;
+        ++_applyCount;
+    }
+
+    outputSyncML.clear();
+    HRESULT hr = _applyFunction(requestSyncML, outputSyncML);
+
+    // A CSP that denies one command also fails with E_ACCESSDENIED, after the
+    // commands before it have run. Only a refusal with no response at all
+    // shows that nothing was applied.
+    if (FAILED(hr) && !(IsRegistrationLost(hr) && outputSyncML.empty()))
+    {
+        throw DMExceptionWithErrorCode("ApplyLocalManagementSyncML", hr);
+    }
+    if (FAILED(hr))
+    {
+        TRACEP("ApplyLocalManagementSyncML refused the request. Re-registering and retrying. Error: ", hr);
+
+        {
+            lock_guard<mutex> lock(_mutex);
+
+            // Requests that failed together re-register once.
+            if (_registrationCount == registration)
+            {
+                _registered = false;
+            }
+            EnsureRegistered();
+            ++_applyCount;
+        }
+
+        outputSyncML.clear();
+        hr = _applyFunction(requestSyncML, outputSyncML);
+        if (FAILED(hr))
+        {
+            throw DMExceptionWithErrorCode("ApplyLocalManagementSyncML", hr);
+        }
+    }
+}
+
+bool LocalManagementSession::IsRegistrationLost(HRESULT hr)
+{
+    return hr == E_ACCESSDENIED;
+}
+
+void LocalManagementSession::Invalidate()
+{
+    lock_guard<mutex> lock(_mutex);
+    _registered = false;
+}
+
+bool LocalManagementSession::IsRegistered() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _registered;
+}
+
+unsigned long long LocalManagementSession::RegistrationCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _registrationCount;
+}
+
+unsigned long long LocalManagementSession::ApplyCount() const
+{
+    lock_guard<mutex> lock(_mutex);
+    return _applyCount;
+}
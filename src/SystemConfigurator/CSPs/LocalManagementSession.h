@@ -0,0 +1,71 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <functional>
+#include <Windows.h>
+
+// Owns the registration of this process with the local management stack.
+//
+// RegisterDeviceWithLocalManagement() is expensive, so it is called once and
+// its result is cached. It is only called again after ApplyLocalManagementSyncML()
+// refuses a request with an error the lost registration produces (for example,
+// after the enrollment was reset) and returns no response. No response means no
+// command ran, so the session re-registers and retries the request once. Any
+// other failure is reported as is. That includes the same error with a response,
+// which a CSP denying one command of a request returns. The request may have run
+// in part, and commands such as Exec or Add must not run twice.
+//
+// Only the registration is serialized; requests are applied concurrently.
+//
+// The local management APIs are injected so the registration logic can be
+// exercised (and its savings measured) against a stub.
+class LocalManagementSession
+{
+public:
+    typedef std::function<HRESULT()> RegisterFunction;
+    typedef std::function<HRESULT(const std::wstring& requestSyncML, std::wstring& outputSyncML)> ApplyFunction;
+
+    // Uses RegisterDeviceWithLocalManagement() and ApplyLocalManagementSyncML().
+    LocalManagementSession();
+    LocalManagementSession(RegisterFunction registerFunction, ApplyFunction applyFunction);
+
+    void Apply(const std::wstring& requestSyncML, std::wstring& outputSyncML);
+
+    // True for the errors ApplyLocalManagementSyncML() returns when this
+    // process is not registered. A CSP may return them as well; Apply() also
+    // requires an empty response before it retries.
+    static bool IsRegistrationLost(HRESULT hr);
+
+    // Forces the next Apply() to register again.
+    void Invalidate();
+
+    bool IsRegistered() const;
+    unsigned long long RegistrationCount() const;
+    unsigned long long ApplyCount() const;
+
+private:
+    void EnsureRegistered();
+
+    RegisterFunction _registerFunction;
+    ApplyFunction _applyFunction;
+
+    mutable std::mutex _mutex;
+    bool _registered;
+    unsigned long long _registrationCount;
+    unsigned long long _applyCount;
+};
@@ -13,125 +13,163 @@ WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
 THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 #include "stdafx.h"
-#include <thread>
-#include <queue>
+#include <algorithm>
+#include <atomic>
 #include "..\SharedUtilities\Logger.h"
 #include "..\SharedUtilities\DMException.h"
-#include "..\TaskQueue.h"
-#include "PrivateAPIs\WinSDKRS2.h"
+#include "..\SharedUtilities\Constants.h"
+#include "..\SharedUtilities\SyncMLReader.h"
+#include "..\SharedUtilities\SyncMLResponse.h"
+#include "LocalManagementSession.h"
+#include "ParallelSyncMLExecutor.h"
 #include "..\resource.h"
 #include "MdmProvision.h"
 
-#define ROOT_XML L"SyncML\\SyncBody"
-#define ROOT_START_TAG L"<" ROOT_XML L">"
-#define ROOT_END_TAG L"</" ROOT_XML L">"
-#define STATUS_XML_PATH ROOT_XML L"\\Status\\Data\\"
-#define RESULTS_XML_PATH ROOT_XML L"\\Results\\Item\\Data\\"
-
 using namespace std;
 
+// Nodes that do not change while the service is running. Children of
+// ./DevDetail/Ext are excluded unless listed (e.g. the device name and the
+// display resolution can change).
+static const CSPNodeCache::PolicyMap DefaultCachePolicies =
+{
+    { L"./DevInfo", chrono::hours(1) },
+    { L"./DevDetail", chrono::hours(1) },
+    { L"./DevDetail/Ext", chrono::milliseconds(0) },
+    { L"./DevDetail/Ext/Microsoft/OSPlatform", chrono::hours(1) },
+    { L"./DevDetail/Ext/Microsoft/ProcessorType", chrono::hours(1) },
+    { L"./DevDetail/Ext/Microsoft/ProcessorArchitecture", chrono::hours(1) },
+    { L"./DevDetail/Ext/Microsoft/RadioSwV", chrono::hours(1) },
+    { L"./DevDetail/Ext/Microsoft/CommercializationOperator", chrono::hours(1) },
+    { L"./DevDetail/Ext/Microsoft/TotalRAM", chrono::hours(1) },
+};
+
 bool MdmProvision::s_errorVerbosity = false;
+mutex MdmProvision::s_executorMutex;
+shared_ptr<ISyncMLExecutor> MdmProvision::s_executor;
+CSPNodeCache MdmProvision::s_cache(DefaultCachePolicies);
 
-class SyncMLServer
+// The number of SyncML workers can be set in the registry. It defaults to
+// one because ApplyLocalManagementSyncML() is not documented as safe to call
+// from several threads at once.
+static unsigned int SyncMLWorkerCount()
 {
-public:
-    SyncMLServer()
-    {
-        TRACE(__FUNCTION__);
-        _workerThread = thread(ServiceWorkerThread, this);
-    }
+    unsigned long workerCount = 1;
+    Utils::TryReadRegistryValue(IoTDMRegistryRoot, RegSyncMLWorkerCount, workerCount);
+    return static_cast<unsigned int>((max)(1ul, (min)(workerCount, 16ul)));
+}
 
-    void Process(const wstring& requestSyncML, wstring& outputSyncML)
+static ParallelSyncMLExecutor::ApplyFunction LocalManagementApply()
+{
+    shared_ptr<LocalManagementSession> session = make_shared<LocalManagementSession>();
+    return [session](const wstring& requestSyncML, wstring& outputSyncML)
     {
-        TRACE(__FUNCTION__);
-        TaskQueue::Task task([&]()
-        {
-            return ProcessInternal(requestSyncML);
-        });
+        session->Apply(requestSyncML, outputSyncML);
+    };
+}
 
-        future<wstring> futureResult = _queue.Enqueue(move(task));
+void MdmProvision::SetErrorVerbosity(bool verbosity) noexcept
+{
+    s_errorVerbosity = verbosity;
+}
 
-        // This will block until the result is available...
-        outputSyncML = futureResult.get();
-    }
+void MdmProvision::SetExecutor(shared_ptr<ISyncMLExecutor> executor)
+{
+    TRACE(__FUNCTION__);
 
-private:
+    lock_guard<mutex> lock(s_executorMutex);
+    s_executor = executor;
 
-    static void ServiceWorkerThread(void* context)
-    {
-        TRACE(__FUNCTION__);
+    // Values read from the previous executor do not describe the new one.
+    s_cache.Clear();
+}
 
-        SyncMLServer* syncMLServer = static_cast<SyncMLServer*>(context);
-        syncMLServer->Listen();
-    }
+CSPNodeCache& MdmProvision::Cache()
+{
+    return s_cache;
+}
 
-    void Listen()
+void MdmProvision::InvalidateCachedTargets(const vector<ParallelSyncMLExecutor::Target>& targets)
+{
+    // Callers of RunSyncML() may send any command. Every node targeted by
+    // something other than a Get is dropped from the cache.
+    for (const auto& target : targets)
     {
-        TRACE(__FUNCTION__);
-
-        while (true)
+        if (target.verb != L"Get")
         {
-            TRACE("Worker thread waiting for a task to be queued...");
-            TaskQueue::Task task = _queue.Dequeue();
-
-            TRACE("A task has been dequeued...");
-            task();
-
-            TRACE("Task has completed.");
+            s_cache.Invalidate(target.locUri);
         }
     }
+}
 
-    wstring ProcessInternal(const wstring& requestSyncML)
-    {
-        TRACE(__FUNCTION__);
-
-        TRACEP(L"SyncMLServer - Request : ", requestSyncML.c_str());
+void MdmProvision::ApplySyncML(const wstring&, const wstring& requestSyncML, const vector<ParallelSyncMLExecutor::Target>& targets, wstring& outputSyncML)
+{
+    TRACEPV(L"Request : ", requestSyncML);
 
-        HRESULT hr = RegisterDeviceWithLocalManagement(NULL);
-        if (FAILED(hr))
-        {
-            throw DMExceptionWithErrorCode("RegisterDeviceWithLocalManagement", hr);
-        }
+    shared_ptr<ISyncMLExecutor> executor;
+    {
+        lock_guard<mutex> lock(s_executorMutex);
+        executor = s_executor;
+    }
 
-        PWSTR output = nullptr;
-        hr = ApplyLocalManagementSyncML(requestSyncML.c_str(), &output);
-        if (FAILED(hr))
-        {
-            throw DMExceptionWithErrorCode("ApplyLocalManagementSyncML", hr);
-        }
+    if (executor)
+    {
+        executor->Execute(requestSyncML, outputSyncML);
+    }
+    else
+    {
+        static ParallelSyncMLExecutor syncMLServer(LocalManagementApply(), SyncMLWorkerCount());
+        syncMLServer.Execute(requestSyncML, targets, outputSyncML);
 
-        wstring outputSyncML;
-        if (output)
+        // The executor's metrics are traced after every hundred requests.
+        static atomic<unsigned int> requestCount(0);
+        if (++requestCount % 100 == 0)
         {
-            outputSyncML = output;
+            TRACEP(L"SyncML executor metrics: ", DomainExecutor::MetricsToString(syncMLServer.GetMetrics()));
         }
-        LocalFree(output);
-
-        return outputSyncML;
     }
 
-    thread _workerThread;
-    TaskQueue _queue;
-};
+    TRACEPV(L"Response: ", outputSyncML);
+}
 
-void MdmProvision::SetErrorVerbosity(bool verbosity) noexcept
+static wstring GetResultValue(const Utils::SyncMLResponse& response)
 {
-    s_errorVerbosity = verbosity;
+    if (response.Items().empty() || !response.Items()[0].data.present())
+    {
+        throw DMException("MdmProvision: the response has no result data.");
+    }
+    return response.Items()[0].data.str();
 }
 
-void MdmProvision::RunSyncML(const wstring&, const wstring& requestSyncML, wstring& outputSyncML)
+void MdmProvision::RunSyncML(const wstring& sid, const wstring& requestSyncML, wstring& outputSyncML)
 {
-    TRACEP(L"Request : ", requestSyncML.c_str());
-
-    static SyncMLServer syncMLServer;
-    syncMLServer.Process(requestSyncML, outputSyncML);
+    Utils::SyncMLResponse response;
+    RunSyncML(sid, requestSyncML, outputSyncML, response);
+}
 
-    TRACEP(L"Response: ", outputSyncML.c_str());
+void MdmProvision::RunSyncML(const wstring& sid, const wstring& requestSyncML, wstring& outputSyncML, Utils::SyncMLResponse& response)
+{
+    // The targets are read once, for both scheduling and cache invalidation.
+    vector<ParallelSyncMLExecutor::Target> targets = ParallelSyncMLExecutor::GetTargets(requestSyncML);
+    try
+    {
+        ApplySyncML(sid, requestSyncML, targets, outputSyncML);
+    }
+    catch (...)
+    {
+        InvalidateCachedTargets(targets);
+        throw;
+    }
+    InvalidateCachedTargets(targets);
 
-    wstring returnCodeString;
-    Utils::ReadXmlValue(outputSyncML, STATUS_XML_PATH, returnCodeString);
+    // The response is parsed once; callers read their results from it.
+    response.Parse(outputSyncML);
+    if (response.Statuses().empty() || response.Statuses()[0].code == 0)
+    {
+        ReportError(requestSyncML, outputSyncML);
+        throw DMException("MdmProvision: the response has no status.");
+    }
 
-    unsigned int returnCode = stoi(returnCodeString);
+    unsigned int returnCode = response.Statuses()[0].code;
     if (returnCode >= 300)
     {
         ReportError(requestSyncML, outputSyncML, returnCode);
@@ -139,6 +177,57 @@ void MdmProvision::RunSyncML(const wstring&, const wstring& requestSyncML, wstri
     }
 }
 
+void MdmProvision::RunBatch(const wstring& sid, SyncMLBatch& batch)
+{
+    TRACEP(L"Running batch. Command count: ", batch.Size());
+
+    for (size_t i = 0; i < batch.Size(); ++i)
+    {
+        wstring value;
+        if (batch.GetVerb(i) == L"Get" && s_cache.TryGet(sid, batch.GetPath(i), batch.GetFormat(i), value))
+        {
+            batch.Resolve(i, value);
+        }
+    }
+
+    auto invalidateWrites = [&batch]()
+    {
+        for (size_t i = 0; i < batch.Size(); ++i)
+        {
+            if (batch.GetVerb(i) != L"Get")
+            {
+                s_cache.Invalidate(batch.GetPath(i));
+            }
+        }
+    };
+
+    // Unlike RunSyncML(), a failing command does not throw; its status is
+    // recorded in the batch so that the remaining commands can still be used.
+    unsigned long long generation = s_cache.Generation();
+    try
+    {
+        batch.Execute([&sid](const wstring& requestSyncML, wstring& outputSyncML)
+        {
+            ApplySyncML(sid, requestSyncML, ParallelSyncMLExecutor::GetTargets(requestSyncML), outputSyncML);
+        });
+    }
+    catch (...)
+    {
+        invalidateWrites();
+        throw;
+    }
+
+    // Values are cached before the writes of the same batch invalidate them.
+    for (size_t i = 0; i < batch.Size(); ++i)
+    {
+        if (batch.GetVerb(i) == L"Get" && !batch.IsResolved(i) && batch.Succeeded(i))
+        {
+            s_cache.Put(sid, batch.GetPath(i), batch.GetFormat(i), batch.GetResult(i).value, generation);
+        }
+    }
+    invalidateWrites();
+}
+
 void MdmProvision::RunAdd(const wstring& sid, const wstring& path, const wstring& value)
 {
     wstring requestSyncML = LR"(
@@ -162,9 +251,11 @@ void MdmProvision::RunAdd(const wstring& sid, const wstring& path, const wstring
     RunSyncML(sid, requestSyncML, resultSyncML);
 }
 
-void MdmProvision::RunAddData(const wstring& sid, const wstring& path, const wstring& value, const wstring& type)
+// An Add command is written in three parts so that the data can be appended
+// in place, however it is produced.
+static void BeginAddData(wstring& requestSyncML, const wstring& path, const wstring& type)
 {
-    wstring requestSyncML = LR"(
+    requestSyncML += LR"(
         <SyncBody>
             <Add>
                 <CmdID>1</CmdID>
@@ -180,13 +271,21 @@ void MdmProvision::RunAddData(const wstring& sid, const wstring& path, const wst
     requestSyncML += LR"(</Format>
                     </Meta>
                     <Data>)";
-    requestSyncML += value;
-    requestSyncML += LR"(</Data>
+}
+
+static const wchar_t EndAddData[] = LR"(</Data>
                 </Item>
             </Add>
         </SyncBody>
         )";
 
+void MdmProvision::RunAddData(const wstring& sid, const wstring& path, const wstring& value, const wstring& type)
+{
+    wstring requestSyncML;
+    BeginAddData(requestSyncML, path, type);
+    requestSyncML += value;
+    requestSyncML += EndAddData;
+
     wstring resultSyncML;
     RunSyncML(sid, requestSyncML, resultSyncML);
 }
@@ -222,6 +321,19 @@ void MdmProvision::RunAddDataBase64(const wstring& sid, const std::wstring& path
     RunAddData(sid, path, value, L"b64");
 }
 
+void MdmProvision::RunAddDataBase64FromFile(const wstring& sid, const wstring& path, const wstring& fileName)
+{
+    // The request is the only copy of the payload: the file is not loaded
+    // whole, and the encoding is not built separately and then pasted in.
+    wstring requestSyncML;
+    BeginAddData(requestSyncML, path, L"b64");
+    Utils::AppendFileAsBase64(fileName, requestSyncML, sizeof(EndAddData) / sizeof(EndAddData[0]));
+    requestSyncML += EndAddData;
+
+    wstring resultSyncML;
+    RunSyncML(sid, requestSyncML, resultSyncML);
+}
+
 void MdmProvision::RunDelete(const std::wstring& sid, const std::wstring& path)
 {
     wstring requestSyncML = LR"(
@@ -239,7 +351,7 @@ void MdmProvision::RunDelete(const std::wstring& sid, const std::wstring& path)
         </SyncBody>
         )";
 
-    TRACEP(L"RunDelete : ", requestSyncML.c_str());
+    TRACEPV(L"RunDelete : ", requestSyncML);
 
     wstring resultSyncML;
     RunSyncML(sid, requestSyncML, resultSyncML);
@@ -247,6 +359,13 @@ void MdmProvision::RunDelete(const std::wstring& sid, const std::wstring& path)
 
 wstring MdmProvision::RunGetString(const wstring& sid, const wstring& path)
 {
+    wstring value;
+    if (s_cache.TryGet(sid, path, L"text", value))
+    {
+        return value;
+    }
+    unsigned long long generation = s_cache.Generation();
+
     wstring requestSyncML = LR"(
         <SyncBody>
             <Get>
@@ -266,15 +385,23 @@ wstring MdmProvision::RunGetString(const wstring& sid, const wstring& path)
         )";
 
     wstring resultSyncML;
-    RunSyncML(sid, requestSyncML, resultSyncML);
+    Utils::SyncMLResponse response;
+    RunSyncML(sid, requestSyncML, resultSyncML, response);
 
-    wstring value;
-    Utils::ReadXmlValue(resultSyncML, RESULTS_XML_PATH, value);
+    value = GetResultValue(response);
+    s_cache.Put(sid, path, L"text", value, generation);
     return value;
 }
 
 std::wstring MdmProvision::RunGetBase64(const std::wstring& sid, const std::wstring& path)
 {
+    wstring value;
+    if (s_cache.TryGet(sid, path, L"b64", value))
+    {
+        return value;
+    }
+    unsigned long long generation = s_cache.Generation();
+
     // http://www.openmobilealliance.org/tech/affiliates/syncml/syncml_metinf_v101_20010615.pdf
     // Section 5.3.
 
@@ -297,10 +424,11 @@ std::wstring MdmProvision::RunGetBase64(const std::wstring& sid, const std::wstr
         )";
 
     wstring resultSyncML;
-    RunSyncML(sid, requestSyncML, resultSyncML);
+    Utils::SyncMLResponse response;
+    RunSyncML(sid, requestSyncML, resultSyncML, response);
 
-    wstring value;
-    Utils::ReadXmlValue(resultSyncML, RESULTS_XML_PATH, value);
+    value = GetResultValue(response);
+    s_cache.Put(sid, path, L"b64", value, generation);
     return value;
 }
 
@@ -333,6 +461,13 @@ void MdmProvision::RunGetStructData(const std::wstring& path, Utils::ELEMENT_HAN
 
 unsigned int MdmProvision::RunGetUInt(const wstring& sid, const wstring& path)
 {
+    wstring valueString;
+    if (s_cache.TryGet(sid, path, L"int", valueString))
+    {
+        return stoi(valueString);
+    }
+    unsigned long long generation = s_cache.Generation();
+
     wstring requestSyncML = LR"(
         <SyncBody>
             <Get>
@@ -352,12 +487,14 @@ unsigned int MdmProvision::RunGetUInt(const wstring& sid, const wstring& path)
         )";
 
     wstring resultSyncML;
-    RunSyncML(sid, requestSyncML, resultSyncML);
+    Utils::SyncMLResponse response;
+    RunSyncML(sid, requestSyncML, resultSyncML, response);
 
     // Extract the result data
-    wstring valueString;
-    Utils::ReadXmlValue(resultSyncML, RESULTS_XML_PATH, valueString);
-    return stoi(valueString);
+    valueString = GetResultValue(response);
+    unsigned int value = stoi(valueString);
+    s_cache.Put(sid, path, L"int", valueString, generation);
+    return value;
 }
 
 bool MdmProvision::RunGetBool(const wstring& sid, const wstring& path)
@@ -538,6 +675,12 @@ void MdmProvision::RunExecWithParameters(const wstring& sid, const wstring& path
     RunSyncML(sid, requestSyncML, resultSyncML);
 }
 
+void MdmProvision::RunBatch(SyncMLBatch& batch)
+{
+    // empty sid is okay for device-wide CSPs.
+    RunBatch(L"", batch);
+}
+
 void MdmProvision::RunAdd(const wstring& path, const wstring& value)
 {
     // empty sid is okay for device-wide CSPs.
@@ -573,6 +716,12 @@ void MdmProvision::RunAddDataBase64(const wstring& path, const wstring& value)
     RunAddDataBase64(L"", path, value);
 }
 
+void MdmProvision::RunAddDataBase64FromFile(const wstring& path, const wstring& fileName)
+{
+    // empty sid is okay for device-wide CSPs.
+    RunAddDataBase64FromFile(L"", path, fileName);
+}
+
 void MdmProvision::RunDelete(const std::wstring& path)
 {
     // empty sid is okay for device-wide CSPs.
@@ -15,21 +15,39 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #pragma once
 
 #include <string>
+#include <memory>
+#include <mutex>
 #include "..\SharedUtilities\DMException.h"
 #include "..\SharedUtilities\Utils.h"
+#include "..\SharedUtilities\SyncMLResponse.h"
+#include "SyncMLBatch.h"
+#include "ISyncMLExecutor.h"
+#include "ParallelSyncMLExecutor.h"
+#include "CSPNodeCache.h"
 
 class MdmProvision
 {
 public:
     static void SetErrorVerbosity(bool verbosity) noexcept;
 
+    // Replaces the local management stack with the given executor for all
+    // subsequent calls. Passing nullptr restores the local management stack.
+    static void SetExecutor(std::shared_ptr<ISyncMLExecutor> executor);
+
+    // Values of slow-changing nodes read through RunGet*() and RunBatch().
+    // Writes through MdmProvision invalidate the affected nodes.
+    static CSPNodeCache& Cache();
+
     // With sid
     static void RunSyncML(const std::wstring& sid, const std::wstring& inputSyncML, std::wstring& outputSyncML);
+    static void RunBatch(const std::wstring& sid, SyncMLBatch& batch);
 
     static void RunAdd(const std::wstring& sid, const std::wstring& path, const std::wstring& value);
     static void RunAddData(const std::wstring& sid, const std::wstring& path, const std::wstring& value, const std::wstring& type = L"chr");
     static void RunAddTyped(const std::wstring& sid, const std::wstring& path, const std::wstring& type);
     static void RunAddDataBase64(const std::wstring& sid, const std::wstring& path, const std::wstring& value);
+    // The file is encoded straight into the request, which is sized once.
+    static void RunAddDataBase64FromFile(const std::wstring& sid, const std::wstring& path, const std::wstring& fileName);
 
     static void RunDelete(const std::wstring& sid, const std::wstring& path);
 
@@ -48,10 +66,13 @@ public:
     static void RunExecWithParameters(const std::wstring& sid, const std::wstring& path, const std::wstring& params);
 
     // Without sid
+    static void RunBatch(SyncMLBatch& batch);
+
     static void RunAdd(const std::wstring& path, const std::wstring& value);
     static void RunAddData(const std::wstring& path, const std::wstring& value);
     static void RunAddTyped(const std::wstring& path, const std::wstring& type);
     static void RunAddDataBase64(const std::wstring& path, const std::wstring& value);
+    static void RunAddDataBase64FromFile(const std::wstring& path, const std::wstring& fileName);
     static void RunAddData(const std::wstring& path, int value);
     static void RunAddData(const std::wstring& path, bool value);
 
@@ -114,5 +135,12 @@ public:
     static void ReportError(const std::wstring& syncMLRequest, const std::wstring& syncMLResponse);
 
 private:
+    static void ApplySyncML(const std::wstring& sid, const std::wstring& inputSyncML, const std::vector<ParallelSyncMLExecutor::Target>& targets, std::wstring& outputSyncML);
+    static void RunSyncML(const std::wstring& sid, const std::wstring& inputSyncML, std::wstring& outputSyncML, Utils::SyncMLResponse& response);
+    static void InvalidateCachedTargets(const std::vector<ParallelSyncMLExecutor::Target>& targets);
+
     static bool s_errorVerbosity;
+    static std::mutex s_executorMutex;
+    static std::shared_ptr<ISyncMLExecutor> s_executor;
+    static CSPNodeCache s_cache;
 };
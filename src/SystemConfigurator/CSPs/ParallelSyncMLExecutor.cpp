@@ -0,0 +1,134 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <algorithm>
+#include "..\SharedUtilities\Logger.h"
+#include "..\SharedUtilities\StringUtils.h"
+#include "..\SharedUtilities\SyncMLReader.h"
+#include "ParallelSyncMLExecutor.h"
+
+using namespace std;
+
+ParallelSyncMLExecutor::ParallelSyncMLExecutor(ApplyFunction apply, unsigned int workerCount) :
+    _apply(apply),
+    _executor(workerCount)
+{
+}
+
+void ParallelSyncMLExecutor::Execute(const wstring& requestSyncML, wstring& outputSyncML)
+{
+    Execute(requestSyncML, GetTargets(requestSyncML), outputSyncML);
+}
+
+void ParallelSyncMLExecutor::Execute(const wstring& requestSyncML, const vector<Target>& targets, wstring& outputSyncML)
+{
+    TRACE(__FUNCTION__);
+
+    future<wstring> result = _executor.Enqueue(GetDomains(targets), [this, &requestSyncML]()
+    {
+        wstring output;
+        _apply(requestSyncML, output);
+        return output;
+    }, GetPriority(targets));
+
+    // Rethrows what the request threw on the worker.
+    outputSyncML = result.get();
+}
+
+DomainExecutor::Metrics ParallelSyncMLExecutor::GetMetrics() const
+{
+    return _executor.GetMetrics();
+}
+
+wstring ParallelSyncMLExecutor::GetDomain(const wstring& locUri)
+{
+    vector<wstring> segments;
+    Utils::SplitString(locUri.substr(0, locUri.find(L'?')), L'/', segments);
+
+    // ./Device/Vendor/MSFT/X and ./Vendor/MSFT/X are the same node.
+    if (segments.size() > 2 && segments[1] == L"Device")
+    {
+        segments.erase(segments.begin() + 1);
+    }
+
+    // "." and the root, then the user scope and the vendor segments if present.
+    size_t count = 2;
+    if (segments.size() > count && segments[1] == L"User")
+    {
+        ++count;
+    }
+    if (segments.size() > count && segments[count - 1] == L"Vendor")
+    {
+        count += 2;
+    }
+    count = (min)(count, segments.size());
+
+    wstring domain;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i != 0)
+        {
+            domain += L'/';
+        }
+        domain += segments[i];
+    }
+    return domain;
+}
+
+vector<ParallelSyncMLExecutor::Target> ParallelSyncMLExecutor::GetTargets(const wstring& requestSyncML)
+{
+    vector<Target> targets;
+    Utils::SyncMLReader::Read(requestSyncML, nullptr,
+        [&targets](const Utils::SyncMLReader::ElementStack& elementStack, const wstring& text)
+        {
+            // <Command><Item><Target><LocURI>
+            size_t depth = elementStack.size();
+            if (depth >= 2 && elementStack[depth - 1] == L"LocURI" && elementStack[depth - 2] == L"Target")
+            {
+                Target target;
+                target.verb = depth >= 4 ? elementStack[depth - 4] : L"";
+                target.locUri = text;
+                targets.push_back(target);
+            }
+        });
+    return targets;
+}
+
+vector<wstring> ParallelSyncMLExecutor::GetDomains(const vector<Target>& targets)
+{
+    vector<wstring> domains;
+    for (const auto& target : targets)
+    {
+        domains.push_back(GetDomain(target.locUri));
+    }
+
+    if (domains.empty())
+    {
+        domains.push_back(L".");
+    }
+    return domains;
+}
+
+TaskQueue::Priority ParallelSyncMLExecutor::GetPriority(const vector<Target>& targets)
+{
+    for (const auto& target : targets)
+    {
+        if (target.locUri.find(L"/DiagnosticLog/FileDownload") != wstring::npos)
+        {
+            return TaskQueue::Bulk;
+        }
+    }
+    return TaskQueue::Normal;
+}
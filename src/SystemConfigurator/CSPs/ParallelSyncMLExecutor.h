@@ -0,0 +1,66 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "..\DomainExecutor.h"
+#include "ISyncMLExecutor.h"
+
+// Applies SyncML requests on a DomainExecutor. A request's domains are the
+// CSPs it targets (for example ./Vendor/MSFT/DiagnosticLog), so requests to
+// one CSP keep their order while requests to other CSPs are not held up.
+class ParallelSyncMLExecutor : public ISyncMLExecutor
+{
+public:
+    typedef std::function<void(const std::wstring& requestSyncML, std::wstring& outputSyncML)> ApplyFunction;
+
+    // A node targeted by a request, and the command (Get, Replace, ...) that targets it.
+    struct Target
+    {
+        std::wstring verb;
+        std::wstring locUri;
+    };
+
+    ParallelSyncMLExecutor(ApplyFunction apply, unsigned int workerCount = DomainExecutor::DefaultWorkerCount);
+
+    // Blocks until the request has been applied.
+    void Execute(const std::wstring& requestSyncML, std::wstring& outputSyncML) override;
+
+    // As above, for callers that have already read the request's targets.
+    void Execute(const std::wstring& requestSyncML, const std::vector<Target>& targets, std::wstring& outputSyncML);
+
+    DomainExecutor::Metrics GetMetrics() const;
+
+    // The CSP root of a node: ./Vendor/MSFT/<CSP>, ./User/Vendor/MSFT/<CSP>, or
+    // the first segment for other roots (./DevDetail). The device scope is
+    // implied, so ./Device/Vendor/MSFT/<CSP> maps to ./Vendor/MSFT/<CSP>.
+    static std::wstring GetDomain(const std::wstring& locUri);
+
+    // Every target in the request, read in a single pass.
+    static std::vector<Target> GetTargets(const std::wstring& requestSyncML);
+
+    // The domains of the targets. A request without targets gets a domain of
+    // its own, shared with other such requests.
+    static std::vector<std::wstring> GetDomains(const std::vector<Target>& targets);
+
+    // Log file downloads are bulk work; other requests are normal.
+    static TaskQueue::Priority GetPriority(const std::vector<Target>& targets);
+
+private:
+    ApplyFunction _apply;
+    DomainExecutor _executor;
+};
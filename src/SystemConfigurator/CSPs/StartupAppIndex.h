@@ -0,0 +1,42 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// The device's startup app configuration, read once and kept in memory so
+// that many apps can be looked up without a CSP query each.
+//
+// The two queries are injected: CustomDeviceUiCSP in the product, fakes in
+// tests. App IDs are package family names, without the "!App" suffix.
+class StartupAppIndex
+{
+public:
+    typedef std::function<std::wstring()> GetForegroundApp;
+    typedef std::function<std::vector<std::wstring>()> GetBackgroundApps;
+
+    // Calls each query exactly once.
+    StartupAppIndex(const GetForegroundApp& getForegroundApp, const GetBackgroundApps& getBackgroundApps);
+
+    bool IsForeground(const std::wstring& pkgFamilyName) const;
+    bool IsBackground(const std::wstring& pkgFamilyName) const;
+
+private:
+    std::wstring _foregroundApp;
+    std::unordered_set<std::wstring> _backgroundApps;
+};
@@ -0,0 +1,371 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cwctype>
+#include "..\SharedUtilities\Logger.h"
+#include "..\SharedUtilities\DMException.h"
+#include "..\SharedUtilities\SyncMLResponse.h"
+#include "SyncMLBatch.h"
+
+#define META_TYPE_TEXT L"<Meta><Type xmlns=\"syncml:metinf\">text/plain</Type></Meta>"
+#define META_TYPE_B64 L"<Meta><Type xmlns=\"syncml:metinf\">b64</Type></Meta>"
+#define META_FORMAT_START L"<Meta><Format xmlns=\"syncml:metinf\">"
+#define META_FORMAT_END L"</Format></Meta>"
+
+using namespace std;
+
+namespace
+{
+    // Maps a CmdRef back to the command index. Returns SIZE_MAX if it is not a CmdID.
+    size_t CommandIndex(const Utils::SyncMLResponse::View& cmdRef)
+    {
+        if (cmdRef.size == 0 || cmdRef.size > 9)
+        {
+            return SIZE_MAX;
+        }
+
+        size_t cmdId = 0;
+        for (size_t i = 0; i < cmdRef.size; ++i)
+        {
+            if (cmdRef.data[i] < L'0' || cmdRef.data[i] > L'9')
+            {
+                return SIZE_MAX;
+            }
+            cmdId = cmdId * 10 + (cmdRef.data[i] - L'0');
+        }
+        return cmdId == 0 ? SIZE_MAX : cmdId - 1;
+    }
+
+    wstring FormatMeta(const wstring& format)
+    {
+        return META_FORMAT_START + format + META_FORMAT_END;
+    }
+}
+
+SyncMLBatch::SyncMLBatch()
+{
+}
+
+size_t SyncMLBatch::Queue(const wchar_t* verb, const wstring& path, const wstring& meta)
+{
+    Command command;
+    command.verb = verb;
+    command.path = path;
+    command.meta = meta;
+    command.hasData = false;
+    command.resolved = false;
+    _commands.emplace_back(move(command));
+    return _commands.size() - 1;
+}
+
+size_t SyncMLBatch::Queue(const wchar_t* verb, const wstring& path, const wstring& meta, const wstring& data)
+{
+    size_t index = Queue(verb, path, meta);
+    _commands[index].data = data;
+    _commands[index].hasData = true;
+    return index;
+}
+
+size_t SyncMLBatch::QueueGet(const wstring& path, const wstring& meta, const wstring& format)
+{
+    size_t index = Queue(L"Get", path, meta);
+    _commands[index].format = format;
+    return index;
+}
+
+size_t SyncMLBatch::QueueGetString(const wstring& path)
+{
+    return QueueGet(path, META_TYPE_TEXT, L"text");
+}
+
+size_t SyncMLBatch::QueueGetBase64(const wstring& path)
+{
+    // http://www.openmobilealliance.org/tech/affiliates/syncml/syncml_metinf_v101_20010615.pdf
+    // Section 5.3.
+    return QueueGet(path, META_TYPE_B64, L"b64");
+}
+
+size_t SyncMLBatch::QueueGetUInt(const wstring& path)
+{
+    return QueueGet(path, FormatMeta(L"int"), L"int");
+}
+
+size_t SyncMLBatch::QueueSet(const wstring& path, const wstring& value)
+{
+    return Queue(L"Replace", path, META_TYPE_TEXT, value);
+}
+
+size_t SyncMLBatch::QueueSet(const wstring& path, int value)
+{
+    return Queue(L"Replace", path, FormatMeta(L"int"), to_wstring(value));
+}
+
+size_t SyncMLBatch::QueueSet(const wstring& path, bool value)
+{
+    return Queue(L"Replace", path, FormatMeta(L"bool"), value ? L"True" : L"False");
+}
+
+size_t SyncMLBatch::QueueSetBase64(const wstring& path, const wstring& value)
+{
+    return Queue(L"Replace", path, META_TYPE_B64, value);
+}
+
+size_t SyncMLBatch::QueueAdd(const wstring& path, const wstring& value)
+{
+    return Queue(L"Add", path + L"/" + value, L"");
+}
+
+size_t SyncMLBatch::QueueAddData(const wstring& path, const wstring& value, const wstring& type)
+{
+    return Queue(L"Add", path, FormatMeta(type), value);
+}
+
+size_t SyncMLBatch::QueueAddData(const wstring& path, int value)
+{
+    return QueueAddData(path, to_wstring(value), L"int");
+}
+
+size_t SyncMLBatch::QueueAddData(const wstring& path, bool value)
+{
+    // Matches MdmProvision::RunAddData(path, bool) which sends 0/1.
+    return QueueAddData(path, to_wstring(value ? 1 : 0), L"bool");
+}
+
+size_t SyncMLBatch::QueueAddDataBase64(const wstring& path, const wstring& value)
+{
+    return QueueAddData(path, value, L"b64");
+}
+
+size_t SyncMLBatch::QueueDelete(const wstring& path)
+{
+    return Queue(L"Delete", path, L"");
+}
+
+size_t SyncMLBatch::QueueExec(const wstring& path)
+{
+    return Queue(L"Exec", path, L"");
+}
+
+size_t SyncMLBatch::QueueExecWithParameters(const wstring& path, const wstring& params)
+{
+    return Queue(L"Exec", path, FormatMeta(L"chr"), params);
+}
+
+size_t SyncMLBatch::Size() const
+{
+    return _commands.size();
+}
+
+const wstring& SyncMLBatch::GetVerb(size_t index) const
+{
+    return _commands.at(index).verb;
+}
+
+const wstring& SyncMLBatch::GetPath(size_t index) const
+{
+    return _commands.at(index).path;
+}
+
+const wstring& SyncMLBatch::GetFormat(size_t index) const
+{
+    return _commands.at(index).format;
+}
+
+void SyncMLBatch::Resolve(size_t index, const wstring& value)
+{
+    Command& command = _commands.at(index);
+    if (command.verb != L"Get")
+    {
+        throw DMException("SyncMLBatch: only Get commands can be resolved locally.");
+    }
+    command.resolved = true;
+
+    _results.resize(_commands.size());
+    _results[index].status = 200;
+    _results[index].value = value;
+}
+
+bool SyncMLBatch::IsResolved(size_t index) const
+{
+    return _commands.at(index).resolved;
+}
+
+wstring SyncMLBatch::ToSyncML() const
+{
+    wstring requestSyncML = L"<SyncBody>";
+    for (size_t i = 0; i < _commands.size(); ++i)
+    {
+        const Command& command = _commands[i];
+        if (command.resolved)
+        {
+            continue;
+        }
+
+        // CmdIDs stay aligned with the command indices (even with resolved
+        // commands skipped) so that the response maps back by CmdRef.
+        requestSyncML += L"<" + command.verb + L">";
+        requestSyncML += L"<CmdID>" + to_wstring(i + 1) + L"</CmdID>";
+        requestSyncML += L"<Item><Target><LocURI>" + command.path + L"</LocURI></Target>";
+        requestSyncML += command.meta;
+        if (command.hasData)
+        {
+            requestSyncML += L"<Data>" + command.data + L"</Data>";
+        }
+        requestSyncML += L"</Item>";
+        requestSyncML += L"</" + command.verb + L">";
+    }
+    requestSyncML += L"</SyncBody>";
+    return requestSyncML;
+}
+
+void SyncMLBatch::ParseResponse(const wstring& responseSyncML)
+{
+    TRACE(__FUNCTION__);
+
+    _results.resize(_commands.size());
+    for (size_t i = 0; i < _commands.size(); ++i)
+    {
+        if (!_commands[i].resolved)
+        {
+            _results[i] = Result();
+        }
+    }
+
+    // The response looks like:
+    //   <SyncML><SyncBody>
+    //     <Status>...<CmdRef>n</CmdRef>...<Data>200</Data></Status>
+    //     <Results>...<CmdRef>n</CmdRef>...<Item>...<Data>value</Data></Item></Results>
+    //   </SyncBody></SyncML>
+    // Only elements directly under <Status> and <Results>/<Item> are of interest.
+
+    Utils::SyncMLResponse response(responseSyncML);
+
+    for (const Utils::SyncMLResponse::Status& status : response.Statuses())
+    {
+        size_t index = CommandIndex(status.cmdRef);
+        if (index < _results.size())
+        {
+            _results[index].status = status.code;
+        }
+    }
+
+    // Only the first item of a Get is reported.
+    vector<bool> valueSet(_results.size(), false);
+    for (const Utils::SyncMLResponse::Item& item : response.Items())
+    {
+        size_t index = CommandIndex(item.cmdRef);
+        if (index < _results.size() && !valueSet[index])
+        {
+            _results[index].value = item.data.str();
+            valueSet[index] = true;
+        }
+    }
+}
+
+void SyncMLBatch::Execute(Executor executor)
+{
+    TRACE(__FUNCTION__);
+
+    if (_commands.empty())
+    {
+        _results.clear();
+        return;
+    }
+
+    bool allResolved = all_of(_commands.begin(), _commands.end(), [](const Command& command) { return command.resolved; });
+    if (allResolved)
+    {
+        TRACE("All commands resolved locally. Nothing to send.");
+        return;
+    }
+
+    wstring responseSyncML;
+    executor(ToSyncML(), responseSyncML);
+    ParseResponse(responseSyncML);
+}
+
+const SyncMLBatch::Result& SyncMLBatch::GetResult(size_t index) const
+{
+    if (index >= _results.size())
+    {
+        throw DMException("SyncMLBatch: no result for the requested command index.");
+    }
+    return _results[index];
+}
+
+bool SyncMLBatch::Succeeded(size_t index) const
+{
+    unsigned int status = GetResult(index).status;
+    return status >= 200 && status < 300;
+}
+
+wstring SyncMLBatch::GetString(size_t index) const
+{
+    const Result& result = GetResult(index);
+    if (!Succeeded(index))
+    {
+        TRACEP(L"SyncMLBatch command failed: ", _commands[index].path.c_str());
+        throw DMExceptionWithErrorCode(result.status);
+    }
+    return result.value;
+}
+
+unsigned int SyncMLBatch::GetUInt(size_t index) const
+{
+    return stoi(GetString(index));
+}
+
+bool SyncMLBatch::GetBool(size_t index) const
+{
+    wstring value = GetString(index);
+    transform(value.begin(), value.end(), value.begin(), ::towlower);
+    return value == L"true";
+}
+
+bool SyncMLBatch::TryGetString(size_t index, wstring& value) const
+{
+    bool success = true;
+    try
+    {
+        value = GetString(index);
+    }
+    catch (DMException& e)
+    {
+        success = false;
+        TRACEP(L"Error: TryGetString() - path     : ", _commands[index].path.c_str());
+        TRACEP("Error: TryGetString() - exception: ", e.what());
+    }
+    return success;
+}
+
+bool SyncMLBatch::TryGetBool(size_t index, bool& value) const
+{
+    bool success = true;
+    try
+    {
+        value = GetBool(index);
+    }
+    catch (DMException& e)
+    {
+        success = false;
+        TRACEP(L"Error: TryGetBool() - path     : ", _commands[index].path.c_str());
+        TRACEP("Error: TryGetBool() - exception: ", e.what());
+    }
+    return success;
+}
@@ -0,0 +1,157 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "..\SharedUtilities\DMException.h"
+
+// SyncMLBatch collects several Get/Replace/Add/Delete/Exec commands into a
+// single <SyncBody> so that they are applied with one round-trip to the local
+// management stack instead of one round-trip per node.
+//
+// Each Queue* call returns the index of the command in the batch. After
+// Execute(), the per-command status and value can be retrieved using that
+// index. A failing command does not fail the whole batch; callers decide per
+// item (the same way the TryGet* helpers of MdmProvision do).
+//
+// The batch does not know how to talk to the local management stack - that is
+// supplied by the caller as an Executor (see MdmProvision::RunBatch()). This
+// keeps the request building and the response de-multiplexing testable with a
+// fake executor.
+class SyncMLBatch
+{
+public:
+    typedef std::function<void(const std::wstring& requestSyncML, std::wstring& responseSyncML)> Executor;
+
+    struct Result
+    {
+        Result() :
+            status(0)
+        {}
+
+        // OMA-DM status code of the command (200, 404, 500, ...).
+        // 0 means no status was returned for this command.
+        unsigned int status;
+
+        // <Results> data for Get commands. Empty for other commands.
+        std::wstring value;
+    };
+
+    SyncMLBatch();
+
+    size_t QueueGetString(const std::wstring& path);
+    size_t QueueGetBase64(const std::wstring& path);
+    size_t QueueGetUInt(const std::wstring& path);
+
+    size_t QueueSet(const std::wstring& path, const std::wstring& value);
+    size_t QueueSet(const std::wstring& path, int value);
+    size_t QueueSet(const std::wstring& path, bool value);
+    size_t QueueSetBase64(const std::wstring& path, const std::wstring& value);
+
+    size_t QueueAdd(const std::wstring& path, const std::wstring& value);
+    size_t QueueAddData(const std::wstring& path, const std::wstring& value, const std::wstring& type = L"chr");
+    size_t QueueAddData(const std::wstring& path, int value);
+    size_t QueueAddData(const std::wstring& path, bool value);
+    size_t QueueAddDataBase64(const std::wstring& path, const std::wstring& value);
+
+    size_t QueueDelete(const std::wstring& path);
+
+    size_t QueueExec(const std::wstring& path);
+    size_t QueueExecWithParameters(const std::wstring& path, const std::wstring& params);
+
+    size_t Size() const;
+
+    // Command details, so that callers (like MdmProvision's node cache) can
+    // answer some of the commands without sending them.
+    const std::wstring& GetVerb(size_t index) const;
+    const std::wstring& GetPath(size_t index) const;
+    // The format requested by a Get command ("text", "b64" or "int").
+    const std::wstring& GetFormat(size_t index) const;
+
+    // Completes a Get command with a known value. Resolved commands are not
+    // sent by Execute() and report status 200 with that value.
+    void Resolve(size_t index, const std::wstring& value);
+    bool IsResolved(size_t index) const;
+
+    // Builds the request, runs it through the executor, and de-multiplexes
+    // the response into the per-command results.
+    void Execute(Executor executor);
+
+    // Exposed separately so that they can be exercised independently.
+    std::wstring ToSyncML() const;
+    void ParseResponse(const std::wstring& responseSyncML);
+
+    const Result& GetResult(size_t index) const;
+    bool Succeeded(size_t index) const;
+
+    // These throw DMExceptionWithErrorCode(status) if the command failed.
+    std::wstring GetString(size_t index) const;
+    unsigned int GetUInt(size_t index) const;
+    bool GetBool(size_t index) const;
+
+    // These leave 'value' untouched and return false if the command failed.
+    bool TryGetString(size_t index, std::wstring& value) const;
+    bool TryGetBool(size_t index, bool& value) const;
+
+    template<class T>
+    bool TryGetNumber(size_t index, std::wstring& value) const
+    {
+        T number;
+        if (!TryGetNumber<T>(index, number))
+        {
+            return false;
+        }
+        value = std::to_wstring(number);
+        return true;
+    }
+
+    template<class T>
+    bool TryGetNumber(size_t index, T& value) const
+    {
+        bool success = true;
+        try
+        {
+            value = static_cast<T>(GetUInt(index));
+        }
+        catch (std::exception& e)
+        {
+            success = false;
+            TRACEP(L"Error: TryGetNumber() - path     : ", _commands[index].path.c_str());
+            TRACEP("Error: TryGetNumber() - exception: ", e.what());
+        }
+        return success;
+    }
+
+private:
+    struct Command
+    {
+        std::wstring verb;      // Get, Replace, Add, Delete, Exec
+        std::wstring path;
+        std::wstring meta;      // Complete <Meta> element or empty.
+        std::wstring format;    // Get commands only.
+        std::wstring data;
+        bool hasData;
+        bool resolved;
+    };
+
+    size_t QueueGet(const std::wstring& path, const std::wstring& meta, const std::wstring& format);
+    size_t Queue(const wchar_t* verb, const std::wstring& path, const std::wstring& meta);
+    size_t Queue(const wchar_t* verb, const std::wstring& path, const std::wstring& meta, const std::wstring& data);
+
+    std::vector<Command> _commands;
+    std::vector<Result> _results;
+};
@@ -78,7 +78,7 @@ wstring WifiCSP::GetProfile(const wstring& profileName)
     path += L"/WlanXml";
 
     wstring profileXml = MdmProvision::RunGetString(path);
-    TRACEP(L" profile xml = ", profileXml.c_str());
+    TRACEPV(L" profile xml = ", profileXml);
     return profileXml;
 }
 
@@ -56,20 +56,44 @@ IResponse^ WindowsUpdatePolicyCSP::Get(IRequest^ request)
 
     wstring ring = L"<error reading ring>";
 
-    // Read the values...
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/ActiveHoursStart", activeHoursStart);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/ActiveHoursEnd", activeHoursEnd);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/AllowAutoUpdate", allowAutoUpdate);
-
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/AllowUpdateService", allowUpdateService);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/BranchReadinessLevel", branchReadinessLevel);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/DeferFeatureUpdatesPeriodInDays", deferFeatureUpdatesPeriod);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/DeferQualityUpdatesPeriodInDays", deferQualityUpdatesPeriod);
-
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/PauseFeatureUpdates", pauseFeatureUpdates);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/PauseQualityUpdates", pauseQualityUpdates);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/ScheduledInstallDay", scheduledInstallDay);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Device/Vendor/MSFT/Policy/Result/Update/ScheduledInstallTime", scheduledInstallTime);
+    // Read the values in a single round-trip...
+    SyncMLBatch batch;
+    size_t activeHoursStartIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/ActiveHoursStart");
+    size_t activeHoursEndIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/ActiveHoursEnd");
+    size_t allowAutoUpdateIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/AllowAutoUpdate");
+
+    size_t allowUpdateServiceIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/AllowUpdateService");
+    size_t branchReadinessLevelIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/BranchReadinessLevel");
+    size_t deferFeatureUpdatesPeriodIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/DeferFeatureUpdatesPeriodInDays");
+    size_t deferQualityUpdatesPeriodIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/DeferQualityUpdatesPeriodInDays");
+
+    size_t pauseFeatureUpdatesIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/PauseFeatureUpdates");
+    size_t pauseQualityUpdatesIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/PauseQualityUpdates");
+    size_t scheduledInstallDayIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/ScheduledInstallDay");
+    size_t scheduledInstallTimeIndex = batch.QueueGetUInt(L"./Device/Vendor/MSFT/Policy/Result/Update/ScheduledInstallTime");
+
+    try
+    {
+        MdmProvision::RunBatch(batch);
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: failed to read Windows Update policies: ", e.what());
+    }
+
+    batch.TryGetNumber<unsigned int>(activeHoursStartIndex, activeHoursStart);
+    batch.TryGetNumber<unsigned int>(activeHoursEndIndex, activeHoursEnd);
+    batch.TryGetNumber<unsigned int>(allowAutoUpdateIndex, allowAutoUpdate);
+
+    batch.TryGetNumber<unsigned int>(allowUpdateServiceIndex, allowUpdateService);
+    batch.TryGetNumber<unsigned int>(branchReadinessLevelIndex, branchReadinessLevel);
+    batch.TryGetNumber<unsigned int>(deferFeatureUpdatesPeriodIndex, deferFeatureUpdatesPeriod);
+    batch.TryGetNumber<unsigned int>(deferQualityUpdatesPeriodIndex, deferQualityUpdatesPeriod);
+
+    batch.TryGetNumber<unsigned int>(pauseFeatureUpdatesIndex, pauseFeatureUpdates);
+    batch.TryGetNumber<unsigned int>(pauseQualityUpdatesIndex, pauseQualityUpdates);
+    batch.TryGetNumber<unsigned int>(scheduledInstallDayIndex, scheduledInstallDay);
+    batch.TryGetNumber<unsigned int>(scheduledInstallTimeIndex, scheduledInstallTime);
 
     Utils::TryReadRegistryValue(WURingRegistrySubKey, WURingPropertyName, ring);
 
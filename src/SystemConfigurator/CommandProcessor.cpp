@@ -149,26 +149,73 @@ IResponse^ HandleGetDeviceInfo(IRequest^ request)
     wstring batteryRemaining = L"<error>";
     wstring batteryRuntime = L"<error>";
 
-    MdmProvision::TryGetString(L"./DevInfo/DevId", id);
-    MdmProvision::TryGetString(L"./DevInfo/Man", manufacturer);
-    MdmProvision::TryGetString(L"./DevInfo/Mod", model);
-    MdmProvision::TryGetString(L"./DevInfo/DmV", dmVer);
-    MdmProvision::TryGetString(L"./DevInfo/Lang", lang);
-
-    MdmProvision::TryGetString(L"./DevDetail/DevTyp", type);
-    MdmProvision::TryGetString(L"./DevDetail/OEM", oem);
-    MdmProvision::TryGetString(L"./DevDetail/HwV", hwVer);
-    MdmProvision::TryGetString(L"./DevDetail/FwV", fwVer);
-    MdmProvision::TryGetString(L"./DevDetail/SwV", osVer);
-
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/OSPlatform", platform);
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/ProcessorType", processorType);
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/RadioSwV", radioSwVer);
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/Resolution", displayResolution);
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/CommercializationOperator", commercializationOperator);
-
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/ProcessorArchitecture", processorArchitecture);
-    MdmProvision::TryGetString(L"./DevDetail/Ext/Microsoft/DeviceName", name);
+    // Read all the nodes in a single round-trip...
+    SyncMLBatch batch;
+    size_t idIndex = batch.QueueGetString(L"./DevInfo/DevId");
+    size_t manufacturerIndex = batch.QueueGetString(L"./DevInfo/Man");
+    size_t modelIndex = batch.QueueGetString(L"./DevInfo/Mod");
+    size_t dmVerIndex = batch.QueueGetString(L"./DevInfo/DmV");
+    size_t langIndex = batch.QueueGetString(L"./DevInfo/Lang");
+
+    size_t typeIndex = batch.QueueGetString(L"./DevDetail/DevTyp");
+    size_t oemIndex = batch.QueueGetString(L"./DevDetail/OEM");
+    size_t hwVerIndex = batch.QueueGetString(L"./DevDetail/HwV");
+    size_t fwVerIndex = batch.QueueGetString(L"./DevDetail/FwV");
+    size_t osVerIndex = batch.QueueGetString(L"./DevDetail/SwV");
+
+    size_t platformIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/OSPlatform");
+    size_t processorTypeIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/ProcessorType");
+    size_t radioSwVerIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/RadioSwV");
+    size_t displayResolutionIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/Resolution");
+    size_t commercializationOperatorIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/CommercializationOperator");
+
+    size_t processorArchitectureIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/ProcessorArchitecture");
+    size_t nameIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/DeviceName");
+
+    size_t totalMemoryIndex = batch.QueueGetUInt(L"./DevDetail/Ext/Microsoft/TotalRAM");
+    size_t secureBootStateIndex = batch.QueueGetUInt(L"./Vendor/MSFT/DeviceStatus/SecureBootState");
+    size_t osEditionIndex = batch.QueueGetString(L"./Vendor/MSFT/DeviceStatus/OS/Edition");
+    size_t batteryStatusIndex = batch.QueueGetUInt(L"./Vendor/MSFT/DeviceStatus/Battery/Status");
+    size_t batteryRemainingIndex = batch.QueueGetUInt(L"./Vendor/MSFT/DeviceStatus/Battery/EstimatedChargeRemaining");
+    size_t batteryRuntimeIndex = batch.QueueGetUInt(L"./Vendor/MSFT/DeviceStatus/Battery/EstimatedRuntime");
+
+    try
+    {
+        MdmProvision::RunBatch(batch);
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: failed to read device info: ", e.what());
+    }
+
+    // A failed batch leaves every value at its '<error>' default.
+    batch.TryGetString(idIndex, id);
+    batch.TryGetString(manufacturerIndex, manufacturer);
+    batch.TryGetString(modelIndex, model);
+    batch.TryGetString(dmVerIndex, dmVer);
+    batch.TryGetString(langIndex, lang);
+
+    batch.TryGetString(typeIndex, type);
+    batch.TryGetString(oemIndex, oem);
+    batch.TryGetString(hwVerIndex, hwVer);
+    batch.TryGetString(fwVerIndex, fwVer);
+    batch.TryGetString(osVerIndex, osVer);
+
+    batch.TryGetString(platformIndex, platform);
+    batch.TryGetString(processorTypeIndex, processorType);
+    batch.TryGetString(radioSwVerIndex, radioSwVer);
+    batch.TryGetString(displayResolutionIndex, displayResolution);
+    batch.TryGetString(commercializationOperatorIndex, commercializationOperator);
+
+    batch.TryGetString(processorArchitectureIndex, processorArchitecture);
+    batch.TryGetString(nameIndex, name);
+
+    batch.TryGetNumber<unsigned int>(totalMemoryIndex, totalMemory);
+    batch.TryGetNumber<unsigned int>(secureBootStateIndex, secureBootState);
+    batch.TryGetString(osEditionIndex, osEdition);
+    batch.TryGetNumber<unsigned int>(batteryStatusIndex, batteryStatus);
+    batch.TryGetNumber<char>(batteryRemainingIndex, batteryRemaining);
+    batch.TryGetNumber<int>(batteryRuntimeIndex, batteryRuntime);
 
     ULARGE_INTEGER sizeInBytes;
     if (GetDiskFreeSpaceEx(L"c:\\", NULL, &sizeInBytes, NULL))
@@ -182,13 +229,6 @@ IResponse^ HandleGetDeviceInfo(IRequest^ request)
         false;
     }
 
-    MdmProvision::TryGetNumber<unsigned int>(L"./DevDetail/Ext/Microsoft/TotalRAM", totalMemory);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Vendor/MSFT/DeviceStatus/SecureBootState", secureBootState);
-    MdmProvision::TryGetString(L"./Vendor/MSFT/DeviceStatus/OS/Edition", osEdition);
-    MdmProvision::TryGetNumber<unsigned int>(L"./Vendor/MSFT/DeviceStatus/Battery/Status", batteryStatus);
-    MdmProvision::TryGetNumber<char>(L"./Vendor/MSFT/DeviceStatus/Battery/EstimatedChargeRemaining", batteryRemaining);
-    MdmProvision::TryGetNumber<int>(L"./Vendor/MSFT/DeviceStatus/Battery/EstimatedRuntime", batteryRuntime);
-
     GetDeviceInfoResponse^ getDeviceInfoResponse = ref new GetDeviceInfoResponse(ResponseStatus::Success);
 
     getDeviceInfoResponse->id = ref new String(id.c_str());
@@ -461,21 +501,26 @@ void SetAppStartUpType(const wstring& pkgFamilyName, StartUpType startUpType)
     }
 }
 
-StartUpType GetAppStartUpType(const wstring& pkgFamilyName)
+StartUpType GetAppStartUpType(const StartupAppIndex& startupApps, const wstring& pkgFamilyName)
 {
-    TRACE(__FUNCTION__);
-
-    if (CustomDeviceUiCSP::IsBackground(pkgFamilyName))
+    if (startupApps.IsBackground(pkgFamilyName))
     {
         return StartUpType::Background;
     }
-    else if (CustomDeviceUiCSP::IsForeground(pkgFamilyName))
+    else if (startupApps.IsForeground(pkgFamilyName))
     {
         return StartUpType::Foreground;
     }
     return StartUpType::None;
 }
 
+StartUpType GetAppStartUpType(const wstring& pkgFamilyName)
+{
+    TRACE(__FUNCTION__);
+
+    return GetAppStartUpType(CustomDeviceUiCSP::GetStartupApps(), pkgFamilyName);
+}
+
 IResponse^ HandleInstallApp(IRequest^ request)
 {
     TRACE(__FUNCTION__);
@@ -639,13 +684,16 @@ IResponse^ HandleListApps(IRequest^ request)
     auto json = EnterpriseModernAppManagementCSP::GetInstalledApps();
     JsonObject^ jsonMap = JsonObject::Parse(ref new Platform::String(json.c_str()));
 
+    // Read the startup configuration once rather than once per app.
+    StartupAppIndex startupApps = CustomDeviceUiCSP::GetStartupApps();
+
     // Inject the StartUp property.
     for each (auto pair in jsonMap)
     {
         auto pfn = pair->Key;
         auto properties = jsonMap->GetNamedObject(pfn);
         wstring packageFamilyName = properties->GetNamedString("PackageFamilyName")->Data();
-        properties->Insert(L"StartUp", JsonValue::CreateNumberValue(static_cast<double>(GetAppStartUpType(packageFamilyName))));
+        properties->Insert(L"StartUp", JsonValue::CreateNumberValue(static_cast<double>(GetAppStartUpType(startupApps, packageFamilyName))));
     }
 
     return ref new ListAppsResponse(ResponseStatus::Success, jsonMap);
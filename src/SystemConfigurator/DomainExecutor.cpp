@@ -0,0 +1,196 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <algorithm>
+#include <exception>
+#include <sstream>
+#include "..\SharedUtilities\Logger.h"
+#include "DomainExecutor.h"
+
+using namespace std;
+
+const unsigned int DomainExecutor::DefaultWorkerCount;
+
+DomainExecutor::DomainExecutor(unsigned int workerCount) :
+    _waiting(0),
+    _running(0),
+    _peakWaiting(0),
+    _completed(0)
+{
+    TRACEP(L"DomainExecutor worker count: ", workerCount);
+
+    for (unsigned int i = 0; i < (max)(workerCount, 1u); ++i)
+    {
+        _workers.emplace_back([this]() { RunWorker(); });
+    }
+}
+
+DomainExecutor::~DomainExecutor()
+{
+    _ready.Shutdown(true /*dropPending*/);
+    for (auto& worker : _workers)
+    {
+        worker.join();
+    }
+}
+
+future<wstring> DomainExecutor::Enqueue(const vector<wstring>& domains, Work work, TaskQueue::Priority priority)
+{
+    shared_ptr<Entry> entry = make_shared<Entry>();
+    entry->work = move(work);
+    entry->priority = priority;
+    entry->domains = domains;
+    entry->scheduled = false;
+    sort(entry->domains.begin(), entry->domains.end());
+    entry->domains.erase(unique(entry->domains.begin(), entry->domains.end()), entry->domains.end());
+
+    future<wstring> result = entry->result.get_future();
+
+    lock_guard<mutex> lock(_mutex);
+    for (const auto& domain : entry->domains)
+    {
+        _domains[domain].push_back(entry);
+    }
+    ++_waiting;
+    _peakWaiting = (max)(_peakWaiting, _waiting);
+
+    ScheduleIfReady(entry);
+    return result;
+}
+
+unsigned int DomainExecutor::WorkerCount() const
+{
+    return static_cast<unsigned int>(_workers.size());
+}
+
+DomainExecutor::Metrics DomainExecutor::GetMetrics() const
+{
+    lock_guard<mutex> lock(_mutex);
+
+    Metrics metrics;
+    metrics.waiting = _waiting;
+    metrics.running = _running;
+    metrics.peakWaiting = _peakWaiting;
+    metrics.completed = _completed;
+    for (const auto& domain : _domains)
+    {
+        metrics.domainDepths[domain.first] = domain.second.size();
+    }
+    metrics.ready = _ready.GetMetrics();
+    return metrics;
+}
+
+wstring DomainExecutor::MetricsToString(const Metrics& metrics)
+{
+    size_t deepest = 0;
+    for (const auto& domain : metrics.domainDepths)
+    {
+        deepest = (max)(deepest, domain.second);
+    }
+
+    wostringstream text;
+    text << L"completed=" << metrics.completed
+        << L" running=" << metrics.running
+        << L" waiting=" << metrics.waiting
+        << L" peakWaiting=" << metrics.peakWaiting
+        << L" ready=" << metrics.ready.depth
+        << L" busyDomains=" << metrics.domainDepths.size()
+        << L" deepestDomain=" << deepest;
+    return text.str();
+}
+
+void DomainExecutor::RunWorker()
+{
+    while (_ready.RunOne())
+    {
+    }
+}
+
+void DomainExecutor::ScheduleIfReady(const shared_ptr<Entry>& entry)
+{
+    if (entry->scheduled)
+    {
+        return;
+    }
+    for (const auto& domain : entry->domains)
+    {
+        if (_domains[domain].front() != entry)
+        {
+            return;
+        }
+    }
+    entry->scheduled = true;
+
+    _ready.Enqueue(TaskQueue::Task([this, entry]()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            --_waiting;
+            ++_running;
+        }
+
+        wstring output;
+        exception_ptr error;
+        try
+        {
+            output = entry->work();
+        }
+        catch (...)
+        {
+            error = current_exception();
+        }
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            Complete(entry);
+        }
+
+        if (error)
+        {
+            entry->result.set_exception(error);
+        }
+        else
+        {
+            entry->result.set_value(move(output));
+        }
+        return wstring();
+    }), entry->priority);
+}
+
+void DomainExecutor::Complete(const shared_ptr<Entry>& entry)
+{
+    --_running;
+    ++_completed;
+
+    vector<shared_ptr<Entry>> next;
+    for (const auto& domain : entry->domains)
+    {
+        auto it = _domains.find(domain);
+        it->second.pop_front();
+        if (it->second.empty())
+        {
+            _domains.erase(it);
+        }
+        else
+        {
+            next.push_back(it->second.front());
+        }
+    }
+
+    for (const auto& nextEntry : next)
+    {
+        ScheduleIfReady(nextEntry);
+    }
+}
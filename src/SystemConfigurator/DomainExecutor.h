@@ -0,0 +1,102 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+and associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so,
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TaskQueue.h"
+
+// Runs tasks on a fixed pool of workers. Each task names the domains it
+// touches. Tasks that share a domain run one at a time, in the order they
+// were enqueued; tasks in unrelated domains run in parallel.
+//
+// A task waits here until it is first in line in every one of its domains.
+// Only then is it put on the TaskQueue that the workers take from.
+class DomainExecutor
+{
+public:
+    typedef std::function<std::wstring()> Work;
+
+    struct Metrics
+    {
+        size_t waiting;         // enqueued and not started
+        size_t running;
+        size_t peakWaiting;
+        unsigned long long completed;
+
+        // Tasks enqueued and not finished, per domain.
+        std::map<std::wstring, size_t> domainDepths;
+
+        // Tasks that are ready and waiting for a worker.
+        TaskQueue::Metrics ready;
+    };
+
+    static const unsigned int DefaultWorkerCount = 4;
+
+    explicit DomainExecutor(unsigned int workerCount = DefaultWorkerCount);
+
+    // Lets running tasks finish. Tasks that have not started are dropped;
+    // their futures report a broken promise.
+    ~DomainExecutor();
+
+    // A task with no domains runs as soon as a worker is free. The future is
+    // set after the task has left its domains and been counted as completed.
+    //
+    // The priority orders tasks that are ready at the same time; it does not
+    // let a task overtake an earlier one in the same domain.
+    std::future<std::wstring> Enqueue(const std::vector<std::wstring>& domains, Work work, TaskQueue::Priority priority = TaskQueue::Normal);
+
+    unsigned int WorkerCount() const;
+    Metrics GetMetrics() const;
+
+    // A single line, for the trace.
+    static std::wstring MetricsToString(const Metrics& metrics);
+
+private:
+    struct Entry
+    {
+        Work work;
+        std::promise<std::wstring> result;
+        TaskQueue::Priority priority;
+        std::vector<std::wstring> domains;
+        bool scheduled;
+    };
+
+    DomainExecutor(const DomainExecutor&);
+    DomainExecutor& operator=(const DomainExecutor&);
+
+    void RunWorker();
+
+    // Both must be called with _mutex held.
+    void ScheduleIfReady(const std::shared_ptr<Entry>& entry);
+    void Complete(const std::shared_ptr<Entry>& entry);
+
+    TaskQueue _ready;
+    std::vector<std::thread> _workers;
+
+    mutable std::mutex _mutex;
+    std::map<std::wstring, std::deque<std::shared_ptr<Entry>>> _domains;
+    size_t _waiting;
+    size_t _running;
+    size_t _peakWaiting;
+    unsigned long long _completed;
+};
@@ -0,0 +1,190 @@
+#include "stdafx.h"
+#include <algorithm>
+#include <sstream>
+#include <vector>
+#include "RequestScheduler.h"
+#include "../SharedUtilities/Logger.h"
+
+using namespace std;
+
+RequestScheduler::RequestScheduler() :
+    _running(0),
+    _exclusiveRunning(false)
+{
+}
+
+bool RequestScheduler::Conflicts(const RequestClass& a, const RequestClass& b)
+{
+    if (a.access == Exclusive || b.access == Exclusive)
+    {
+        return true;
+    }
+    if (a.resource != b.resource)
+    {
+        return false;
+    }
+    return a.access == Mutating || b.access == Mutating;
+}
+
+void RequestScheduler::Run(uint32_t kind, const RequestClass& requestClass, const function<void()>& handler)
+{
+    Waiter waiter;
+    waiter.requestClass = &requestClass;
+    waiter.admitted = false;
+
+    Clock::time_point queued = Clock::now();
+    {
+        unique_lock<mutex> l(_mutex);
+
+        KindMetrics& metrics = _metrics[kind];
+        ++metrics.waiting;
+        metrics.peakWaiting = (max)(metrics.peakWaiting, metrics.waiting);
+
+        _waiting.push_back(&waiter);
+        Admit();
+        _cv.wait(l, [&waiter]() { return waiter.admitted; });
+
+        Clock::duration wait = Clock::now() - queued;
+        --metrics.waiting;
+        ++metrics.running;
+        metrics.totalWait += wait;
+        metrics.maxWait = (max)(metrics.maxWait, wait);
+    }
+
+    Clock::time_point start = Clock::now();
+    auto finish = [&]()
+    {
+        lock_guard<mutex> l(_mutex);
+        KindMetrics& metrics = _metrics[kind];
+        --metrics.running;
+        ++metrics.completed;
+        metrics.totalRun += Clock::now() - start;
+        Release(requestClass);
+    };
+
+    try
+    {
+        handler();
+    }
+    catch (...)
+    {
+        finish();
+        throw;
+    }
+    finish();
+}
+
+map<uint32_t, RequestScheduler::KindMetrics> RequestScheduler::GetMetrics() const
+{
+    lock_guard<mutex> l(_mutex);
+    return _metrics;
+}
+
+wstring RequestScheduler::MetricsToString(const map<uint32_t, KindMetrics>& metrics)
+{
+    typedef chrono::milliseconds ms;
+
+    wostringstream text;
+    for (const auto& kind : metrics)
+    {
+        const KindMetrics& m = kind.second;
+        unsigned long long started = m.completed + m.running;
+        text << L"\n  kind " << kind.first
+            << L": completed=" << m.completed
+            << L" running=" << m.running
+            << L" waiting=" << m.waiting
+            << L" peakWaiting=" << m.peakWaiting
+            << L" avgWaitMs=" << (started == 0 ? 0 : chrono::duration_cast<ms>(m.totalWait).count() / started)
+            << L" maxWaitMs=" << chrono::duration_cast<ms>(m.maxWait).count()
+            << L" avgRunMs=" << (m.completed == 0 ? 0 : chrono::duration_cast<ms>(m.totalRun).count() / m.completed);
+    }
+    return text.str();
+}
+
+bool RequestScheduler::ConflictsWithRunning(const RequestClass& requestClass) const
+{
+    if (_exclusiveRunning)
+    {
+        return true;
+    }
+
+    switch (requestClass.access)
+    {
+    case Exclusive:
+        return _running != 0;
+    case Mutating:
+        return _writers.count(requestClass.resource) != 0 || _readers.count(requestClass.resource) != 0;
+    default:
+        return _writers.count(requestClass.resource) != 0;
+    }
+}
+
+void RequestScheduler::Admit()
+{
+    // A waiter starts if it conflicts neither with what is running nor with
+    // an earlier waiter, so conflicting requests keep their arrival order.
+    vector<const RequestClass*> blocked;
+    bool admitted = false;
+    for (auto it = _waiting.begin(); it != _waiting.end();)
+    {
+        const RequestClass& requestClass = *(*it)->requestClass;
+
+        bool conflicts = ConflictsWithRunning(requestClass);
+        for (size_t i = 0; !conflicts && i < blocked.size(); ++i)
+        {
+            conflicts = Conflicts(*blocked[i], requestClass);
+        }
+
+        if (conflicts)
+        {
+            blocked.push_back(&requestClass);
+            ++it;
+            continue;
+        }
+
+        ++_running;
+        switch (requestClass.access)
+        {
+        case Exclusive:
+            _exclusiveRunning = true;
+            break;
+        case Mutating:
+            _writers.insert(requestClass.resource);
+            break;
+        default:
+            ++_readers[requestClass.resource];
+            break;
+        }
+
+        (*it)->admitted = true;
+        it = _waiting.erase(it);
+        admitted = true;
+    }
+
+    if (admitted)
+    {
+        _cv.notify_all();
+    }
+}
+
+void RequestScheduler::Release(const RequestClass& requestClass)
+{
+    --_running;
+    switch (requestClass.access)
+    {
+    case Exclusive:
+        _exclusiveRunning = false;
+        break;
+    case Mutating:
+        _writers.erase(requestClass.resource);
+        break;
+    default:
+        if (--_readers[requestClass.resource] == 0)
+        {
+            _readers.erase(requestClass.resource);
+        }
+        break;
+    }
+
+    Admit();
+}
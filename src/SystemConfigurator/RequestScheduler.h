@@ -0,0 +1,85 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+// Decides when a request may run, on the thread that received it.
+//
+// Each request touches one resource (for example L"Wifi") and either only
+// reads it, mutates it, or needs the whole device to itself:
+//  - read-only requests run alongside each other,
+//  - a mutating request runs alone on its resource,
+//  - an exclusive request runs alone.
+// Requests start in arrival order except that a request may start ahead of
+// earlier ones it does not conflict with.
+class RequestScheduler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Access
+    {
+        ReadOnly,
+        Mutating,
+        Exclusive
+    };
+
+    struct RequestClass
+    {
+        Access access;
+        std::wstring resource;  // ignored for Exclusive
+    };
+
+    struct KindMetrics
+    {
+        size_t waiting;
+        size_t running;
+        size_t peakWaiting;
+        unsigned long long completed;
+        Clock::duration totalWait;
+        Clock::duration maxWait;
+        Clock::duration totalRun;
+    };
+
+    RequestScheduler();
+
+    static bool Conflicts(const RequestClass& a, const RequestClass& b);
+
+    // Blocks until the request may run, then runs handler. Exceptions from
+    // handler propagate after the request has been released.
+    void Run(uint32_t kind, const RequestClass& requestClass, const std::function<void()>& handler);
+
+    std::map<uint32_t, KindMetrics> GetMetrics() const;
+
+    // One line per request kind, for the trace.
+    static std::wstring MetricsToString(const std::map<uint32_t, KindMetrics>& metrics);
+
+private:
+    struct Waiter
+    {
+        const RequestClass* requestClass;
+        bool admitted;
+    };
+
+    // All must be called with _mutex held.
+    bool ConflictsWithRunning(const RequestClass& requestClass) const;
+    void Admit();
+    void Release(const RequestClass& requestClass);
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+
+    std::list<Waiter*> _waiting;
+    size_t _running;
+    bool _exclusiveRunning;
+    std::map<std::wstring, size_t> _readers;
+    std::set<std::wstring> _writers;
+
+    std::map<uint32_t, KindMetrics> _metrics;
+};
\ No newline at end of file
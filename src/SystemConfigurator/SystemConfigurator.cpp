@@ -16,10 +16,16 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "CommandProcessor.h"
 #include "DMService.h"
 #include "..\SharedUtilities\Logger.h"
+#include "..\SharedUtilities\BinaryLogWriter.h"
+#include "..\SharedUtilities\Constants.h"
+#include "..\SharedUtilities\DMException.h"
+#include "..\SharedUtilities\Utils.h"
 #ifdef _DEBUG
 #include "..\SharedUtilities\Impersonator.h"
 #endif // _DEBUG
 
+using namespace std;
+
 #define SERVICE_NAME             L"SystemConfigurator"
 #define SERVICE_DISPLAY_NAME     L"System Configurator"
 #define SERVICE_START_TYPE       SERVICE_DEMAND_START
@@ -27,6 +33,30 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define SERVICE_ACCOUNT          L"NT AUTHORITY\\SYSTEM"
 #define SERVICE_PASSWORD         L""
 
+#define BINARY_LOG_FILE_SIZE     (1024 * 1024)
+#define BINARY_LOG_FILE_COUNT    4
+
+static void EnableBinaryLog()
+{
+    try
+    {
+        wstring folder;
+        if (ERROR_SUCCESS != Utils::TryReadRegistryValue(RegBinaryLog, RegBinaryLogFolder, folder) || folder.empty())
+        {
+            folder = Utils::GetProgramDataFolder() + L"\\IoTDM\\Logs";
+        }
+        Utils::EnsureFolderExists(folder);
+
+        unique_ptr<Utils::ILogSink> binaryLog(new Utils::BinaryLogWriter(folder, SERVICE_NAME, BINARY_LOG_FILE_SIZE, BINARY_LOG_FILE_COUNT));
+        gLogger.EnableBinaryLog(move(binaryLog), Utils::ETWLogger::LoggingLevel::Information);
+        TRACEP(L"Binary log folder: ", folder.c_str());
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: failed to enable the binary log: ", e.what());
+    }
+}
+
 [Platform::MTAThread]
 int wmain(int argc, wchar_t *argv[])
 {
@@ -49,6 +79,18 @@ int wmain(int argc, wchar_t *argv[])
         {
             DMService::Uninstall(SERVICE_NAME);
         }
+        else if (_wcsicmp(L"decodelog", argv[1] + 1) == 0)
+        {
+            vector<wstring> paths(argv + 2, argv + argc);
+            try
+            {
+                Utils::DecodeBinaryLogFiles(paths, wcout);
+            }
+            catch (DMException& e)
+            {
+                TRACEP("Error: failed to decode the log files: ", e.what());
+            }
+        }
 #ifdef _DEBUG
         else if (_wcsicmp(L"debug", argv[1] + 1) == 0)
         {
@@ -77,14 +119,18 @@ int wmain(int argc, wchar_t *argv[])
         TRACE(L"Parameters:");
         TRACE(L" -install  to install the service.");
         TRACE(L" -remove   to remove the service.");
+        TRACE(L" -decodelog <file.dmlog>...  to print binary log files as text.");
         TRACE(L"");
         TRACE(L"Running service...");
 
+        EnableBinaryLog();
+
         DMService service(SERVICE_NAME);
         DMService::Run(service);
     }
 
     TRACE("Exiting wmain.");
+    gLogger.Flush();
 
     return 0;
 }
@@ -17,6 +17,7 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <stdlib.h>
 #include <stdio.h>
 #include <iostream>
+#include <atomic>
 #include "SystemConfiguratorProxy_h.h"
 #include <windows.h>
 
@@ -30,6 +31,9 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include "Logger.h"
 #include "Utils.h"
 #include "Blob.h"
+#include "RequestPipeline.h"
+#include "..\RequestScheduler.h"
+#include "..\DomainExecutor.h"
 
 using namespace Microsoft::Devices::Management::Message;
 using namespace std;
@@ -247,27 +251,179 @@ void SystemConfiguratorProxyDisconnect()
 }
 
 //
-// Rpc method to send request to DM service
+// Which requests may run at the same time. Read-only requests share their
+// resource, mutating ones hold it alone, and exclusive ones hold the device.
 //
-HRESULT SendRequest(
-    _In_ handle_t /*phContext*/,
-    _In_ UINT32 requestType,
-    _In_ BSTR requestJson,
-    __RPC__deref_out_opt UINT32* responseType,
-    __RPC__deref_out_opt BSTR* responseJson
-    )
+static RequestScheduler::RequestClass ClassifyRequest(DMMessageKind kind)
+{
+    RequestScheduler::Access access;
+    const wchar_t* resource = L"";
+
+    switch (kind)
+    {
+    case DMMessageKind::ExitDM:
+    case DMMessageKind::FactoryReset:
+    case DMMessageKind::InstallApp:
+    case DMMessageKind::ImmediateReboot:
+        access = RequestScheduler::Exclusive;
+        break;
+
+    case DMMessageKind::ListApps:
+    case DMMessageKind::GetStartupForegroundApp:
+    case DMMessageKind::ListStartupBackgroundApps:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Apps";
+        break;
+    case DMMessageKind::UninstallApp:
+    case DMMessageKind::AddStartupApp:
+    case DMMessageKind::RemoveStartupApp:
+    case DMMessageKind::StartApp:
+    case DMMessageKind::StopApp:
+        access = RequestScheduler::Mutating;
+        resource = L"Apps";
+        break;
+
+    case DMMessageKind::GetRebootInfo:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Reboot";
+        break;
+    case DMMessageKind::SetRebootInfo:
+        access = RequestScheduler::Mutating;
+        resource = L"Reboot";
+        break;
+
+    case DMMessageKind::GetTimeInfo:
+    case DMMessageKind::GetTimeService:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Time";
+        break;
+    case DMMessageKind::SetTimeInfo:
+    case DMMessageKind::SetTimeService:
+        access = RequestScheduler::Mutating;
+        resource = L"Time";
+        break;
+
+    case DMMessageKind::GetDeviceInfo:
+        access = RequestScheduler::ReadOnly;
+        resource = L"DeviceInfo";
+        break;
+
+    // The token cache serializes fetches per slot.
+    case DMMessageKind::TpmGetServiceUrl:
+    case DMMessageKind::TpmGetSASToken:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Tpm";
+        break;
+
+    case DMMessageKind::GetCertificateConfiguration:
+    case DMMessageKind::GetCertificateDetails:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Certificates";
+        break;
+    case DMMessageKind::SetCertificateConfiguration:
+        access = RequestScheduler::Mutating;
+        resource = L"Certificates";
+        break;
+
+    case DMMessageKind::GetWindowsUpdatePolicy:
+    case DMMessageKind::GetWindowsUpdateRebootPolicy:
+    case DMMessageKind::GetWindowsUpdates:
+        access = RequestScheduler::ReadOnly;
+        resource = L"WindowsUpdate";
+        break;
+    case DMMessageKind::CheckUpdates:
+    case DMMessageKind::SetWindowsUpdatePolicy:
+    case DMMessageKind::SetWindowsUpdateRebootPolicy:
+    case DMMessageKind::SetWindowsUpdates:
+        access = RequestScheduler::Mutating;
+        resource = L"WindowsUpdate";
+        break;
+
+    case DMMessageKind::DeviceHealthAttestationGetReport:
+        access = RequestScheduler::ReadOnly;
+        resource = L"HealthAttestation";
+        break;
+    case DMMessageKind::DeviceHealthAttestationVerifyHealth:
+        access = RequestScheduler::Mutating;
+        resource = L"HealthAttestation";
+        break;
+
+    case DMMessageKind::GetWifiConfiguration:
+    case DMMessageKind::GetWifiDetails:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Wifi";
+        break;
+    case DMMessageKind::SetWifiConfiguration:
+        access = RequestScheduler::Mutating;
+        resource = L"Wifi";
+        break;
+
+    case DMMessageKind::GetEventTracingConfiguration:
+        access = RequestScheduler::ReadOnly;
+        resource = L"EventTracing";
+        break;
+    case DMMessageKind::SetEventTracingConfiguration:
+        access = RequestScheduler::Mutating;
+        resource = L"EventTracing";
+        break;
+
+    case DMMessageKind::GetDMFolders:
+    case DMMessageKind::GetDMFiles:
+        access = RequestScheduler::ReadOnly;
+        resource = L"DMFiles";
+        break;
+    case DMMessageKind::DeleteDMFile:
+    case DMMessageKind::TransferFile:
+        access = RequestScheduler::Mutating;
+        resource = L"DMFiles";
+        break;
+
+    case DMMessageKind::GetWindowsTelemetry:
+        access = RequestScheduler::ReadOnly;
+        resource = L"Telemetry";
+        break;
+    case DMMessageKind::SetWindowsTelemetry:
+        access = RequestScheduler::Mutating;
+        resource = L"Telemetry";
+        break;
+
+    default:
+        // Anything not listed above gets the device to itself.
+        access = RequestScheduler::Exclusive;
+        break;
+    }
+
+    RequestScheduler::RequestClass requestClass;
+    requestClass.access = access;
+    requestClass.resource = resource;
+    return requestClass;
+}
+
+static RequestScheduler Scheduler;
+
+// The scheduler's metrics are traced after every MetricsTraceInterval requests.
+static const unsigned int MetricsTraceInterval = 100;
+static atomic<unsigned int> RequestCount(0);
+
+//
+// Deserializes and runs a request, turning any failure into an ErrorResponse
+//
+template<typename MakeBlob>
+static IResponse^ ProcessRequest(MakeBlob makeBlob)
 {
     IResponse^ response = nullptr;
     try
     {
-        TRACE("Request received...");
-        TRACEP(L"    ", Utils::ConcatString(L"request tag:", (uint32_t)requestType));
-        TRACEP(L"    ", Utils::ConcatString(L"request json:", requestJson));
-        auto requestJsonString = ref new String(requestJson);
-        auto requestBlob = Blob::CreateFromJson(requestType, requestJsonString);
-
-        IRequest^ request = requestBlob->MakeIRequest();
-        response = ProcessCommand(request);
+        IRequest^ request = makeBlob()->MakeIRequest();
+        Scheduler.Run(static_cast<uint32_t>(request->Tag), ClassifyRequest(request->Tag), [&]()
+        {
+            response = ProcessCommand(request);
+        });
+
+        if (++RequestCount % MetricsTraceInterval == 0)
+        {
+            TRACEP(L"Request scheduler metrics:", RequestScheduler::MetricsToString(Scheduler.GetMetrics()));
+        }
     }
     catch (const DMExceptionWithErrorCode& e)
     {
@@ -285,16 +441,212 @@ HRESULT SendRequest(
     {
         response = ref new ErrorResponse(ErrorSubSystem::DeviceManagement, static_cast<int>(DeviceManagementErrors::GenericError), L"Unknown exception!");
     }
+    return response;
+}
+
+//
+// Rpc method to send request to DM service
+//
+HRESULT SendRequest(
+    _In_ handle_t /*phContext*/,
+    _In_ UINT32 requestType,
+    _In_ BSTR requestJson,
+    __RPC__deref_out_opt UINT32* responseType,
+    __RPC__deref_out_opt BSTR* responseJson
+    )
+{
+    TRACE("Request received...");
+    TRACEP(L"    request tag:", (uint32_t)requestType);
+    TRACEPV(L"    request json:", static_cast<const wchar_t*>(requestJson));
+
+    IResponse^ response = ProcessRequest([&]()
+    {
+        return Blob::CreateFromJson(requestType, ref new String(requestJson));
+    });
 
     *responseType = (UINT32)response->Tag;
     auto responseJsonString = response->Serialize()->PayloadAsString;
     *responseJson = SysAllocString(responseJsonString->Data());
     TRACE("Response generated...");
     TRACEP(L"response tag :", *responseType);
-    TRACEP(L"response json: ", responseJsonString->Data());
+    TRACEPV(L"response json: ", responseJsonString->Data());
     return S_OK;
 }
 
+//
+// Runs a serialized request blob and returns the serialized response. The payload stays in
+// the encoding the client wrote (UTF-8 for current clients) and is only decoded by the model.
+//
+static Blob^ ProcessBlob(const byte* request, UINT32 requestSize)
+{
+    bool acceptsBinary = false;
+    IResponse^ response = ProcessRequest([&]()
+    {
+        if (request == nullptr)
+        {
+            throw ref new Platform::Exception(E_INVALIDARG, "Request blob is missing.");
+        }
+
+        // Parse straight from the caller's buffer; it outlives the request, which is fully
+        // processed before this returns.
+        auto requestBlob = Blob::CreateView(request, requestSize, nullptr);
+        requestBlob->ValidateVersion();
+        TRACEP(L"    request tag:", (uint32_t)requestBlob->Tag);
+        acceptsBinary = requestBlob->AcceptsBinaryPayload;
+        return requestBlob;
+    });
+    TRACEP(L"response tag :", (uint32_t)response->Tag);
+
+    // Large responses skip the JSON DOM entirely when the client can read the binary encoding.
+    auto binaryResponse = dynamic_cast<IBinaryDataPayload^>(response);
+    return (acceptsBinary && binaryResponse != nullptr) ? binaryResponse->SerializeBinary() : response->Serialize();
+}
+
+//
+// Rpc method to send a serialized blob to DM service.
+//
+HRESULT SendBlob(
+    _In_ handle_t /*phContext*/,
+    _In_ UINT32 requestSize,
+    _In_reads_bytes_(requestSize) byte* request,
+    __RPC__out UINT32* responseSize,
+    __RPC__deref_out_ecount_full_opt(*responseSize) byte** responseBytes
+    )
+{
+    TRACE("Blob request received...");
+    TRACEP(L"    request size:", requestSize);
+
+    *responseSize = 0;
+    *responseBytes = nullptr;
+
+    // The request is parsed straight from the RPC receive buffer.
+    auto bytes = ProcessBlob(request, requestSize)->GetByteArrayForSerialization();
+    *responseBytes = static_cast<byte*>(midl_user_allocate(bytes->Length));
+    if (*responseBytes == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+    memcpy_s(*responseBytes, bytes->Length, bytes->Data, bytes->Length);
+    *responseSize = bytes->Length;
+
+    TRACE("Response generated...");
+    TRACEP(L"response size: ", *responseSize);
+    return S_OK;
+}
+
+//
+// Pipelined requests. A client opens a session, submits any number of requests tagged with
+// its own IDs, and long-polls for responses, which come back in batches in completion order.
+// Each request runs on the pipeline workers and then through the same scheduler as SendBlob.
+//
+
+static const UINT32 MaxReceiveTimeoutMs = 5000;
+
+// Created by the first pipelined request, so that runs that never serve RPC (-decodelog,
+// install) start no workers, and nothing is traced before the logger is set up.
+static DomainExecutor& PipelineWorkers()
+{
+    static DomainExecutor workers;
+    return workers;
+}
+
+static Utils::PipelineServer Pipeline(
+    [](const uint8_t* request, uint32_t requestSize)
+    {
+        auto bytes = ProcessBlob(request, requestSize)->GetByteArrayForSerialization();
+        return Utils::PipelineBatch::Bytes(bytes->Data, bytes->Data + bytes->Length);
+    },
+    [](function<void()> work)
+    {
+        PipelineWorkers().Enqueue(vector<wstring>(), [work]()
+        {
+            work();
+            return wstring();
+        });
+    });
+
+// The context handle carries the session ID. RPC only accepts it on the connection that
+// opened it, and runs PIPELINE_SESSION_rundown when that connection goes away.
+static uint32_t SessionId(PIPELINE_SESSION session)
+{
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(session));
+}
+
+HRESULT OpenPipeline(
+    _In_ handle_t /*phContext*/,
+    __RPC__deref_out_opt PIPELINE_SESSION* session
+    )
+{
+    uint32_t sessionId = Pipeline.Open();
+    *session = reinterpret_cast<PIPELINE_SESSION>(static_cast<uintptr_t>(sessionId));
+    TRACEP(L"Pipeline session opened: ", sessionId);
+    return S_OK;
+}
+
+HRESULT SubmitPipelined(
+    _In_ PIPELINE_SESSION session,
+    _In_ UINT32 requestId,
+    _In_ UINT32 requestSize,
+    _In_reads_bytes_(requestSize) byte* request
+    )
+{
+    if (request == nullptr && requestSize != 0)
+    {
+        return E_INVALIDARG;
+    }
+    return Pipeline.Submit(SessionId(session), requestId, request, requestSize) ? S_OK : E_INVALIDARG;
+}
+
+HRESULT ReceivePipelined(
+    _In_ PIPELINE_SESSION session,
+    _In_ UINT32 timeoutMs,
+    __RPC__out UINT32* responseSize,
+    __RPC__deref_out_ecount_full_opt(*responseSize) byte** responses
+    )
+{
+    *responseSize = 0;
+    *responses = nullptr;
+
+    // Bounded so that an RPC thread is never parked for long.
+    Utils::PipelineBatch::Bytes batch;
+    if (!Pipeline.Receive(SessionId(session), (min)(timeoutMs, MaxReceiveTimeoutMs), batch))
+    {
+        return E_INVALIDARG;
+    }
+    if (batch.empty())
+    {
+        return S_OK;
+    }
+
+    *responses = static_cast<byte*>(midl_user_allocate(batch.size()));
+    if (*responses == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+    memcpy_s(*responses, batch.size(), batch.data(), batch.size());
+    *responseSize = static_cast<UINT32>(batch.size());
+    return S_OK;
+}
+
+HRESULT ClosePipeline(
+    __RPC__deref_inout_opt PIPELINE_SESSION* session
+    )
+{
+    uint32_t sessionId = SessionId(*session);
+    Pipeline.Close(sessionId);
+    *session = nullptr;
+    TRACEP(L"Pipeline session closed: ", sessionId);
+    return S_OK;
+}
+
+// The client went away without closing its session.
+void __RPC_USER PIPELINE_SESSION_rundown(PIPELINE_SESSION session)
+{
+    uint32_t sessionId = SessionId(session);
+    Pipeline.Close(sessionId);
+    TRACEP(L"Pipeline session run down: ", sessionId);
+}
+
 /******************************************************/
 /*         MIDL allocate and free                     */
 /******************************************************/
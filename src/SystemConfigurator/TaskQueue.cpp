@@ -1,38 +1,151 @@
 #include "stdafx.h"
+#include <algorithm>
 #include "TaskQueue.h"
 #include "../SharedUtilities/Logger.h"
 #include "../SharedUtilities/DMException.h"
 
 using namespace std;
 
-TaskQueue::TaskQueue()
+TaskQueue::TaskQueue() :
+    _shutdown(false),
+    _peakDepth(0),
+    _completed(0),
+    _expired(0),
+    _rejected(0),
+    _totalWait(Clock::duration::zero()),
+    _totalRun(Clock::duration::zero())
 {
 }
 
-future<wstring> TaskQueue::Enqueue(Task task)
+future<wstring> TaskQueue::Enqueue(Task task, Priority priority, Clock::time_point deadline)
 {
     TRACE(__FUNCTION__);
 
     future<wstring> response = task.get_future();
 
     unique_lock<mutex> l(_mutex);
-    _queue.push(move(task));
+    if (_shutdown)
+    {
+        // The task is destroyed unrun; its future reports a broken promise.
+        TRACE("Task queue is shut down. Dropping task.");
+        ++_rejected;
+        return response;
+    }
+
+    Item item;
+    item.task = move(task);
+    item.enqueued = Clock::now();
+    item.deadline = deadline;
+    _queues[priority].push_back(move(item));
+    _peakDepth = (max)(_peakDepth, Depth());
     l.unlock();
 
     _cv.notify_one();
-
     return response;
 }
 
-TaskQueue::Task TaskQueue::Dequeue()
+bool TaskQueue::Dequeue(Task& task)
 {
     TRACE(__FUNCTION__);
 
     unique_lock<mutex> l(_mutex);
-    _cv.wait(l, [&] { return !_queue.empty(); });
+    for (;;)
+    {
+        _cv.wait(l, [&] { return _shutdown || Depth() != 0; });
+
+        Clock::time_point now = Clock::now();
+        for (auto& queue : _queues)
+        {
+            while (!queue.empty())
+            {
+                Item item = move(queue.front());
+                queue.pop_front();
 
-    Task taskItem = move(_queue.front());
-    _queue.pop();
+                if (item.deadline < now)
+                {
+                    TRACE("Task expired before it could run. Dropping it.");
+                    ++_expired;
+                    continue;
+                }
+
+                _totalWait += now - item.enqueued;
+                task = move(item.task);
+                return true;
+            }
+        }
+
+        // Everything queued had expired.
+        if (_shutdown)
+        {
+            return false;
+        }
+    }
+}
+
+bool TaskQueue::RunOne()
+{
+    Task task;
+    if (!Dequeue(task))
+    {
+        return false;
+    }
+
+    Clock::time_point start = Clock::now();
+    task();
+    Clock::duration elapsed = Clock::now() - start;
+
+    lock_guard<mutex> l(_mutex);
+    ++_completed;
+    _totalRun += elapsed;
+    return true;
+}
 
-    return taskItem;
+void TaskQueue::Shutdown(bool dropPending)
+{
+    TRACE(__FUNCTION__);
+
+    // Destroy dropped tasks outside the lock; their futures wake waiters.
+    deque<Item> dropped[PriorityCount];
+    {
+        lock_guard<mutex> l(_mutex);
+        _shutdown = true;
+        if (dropPending)
+        {
+            for (int i = 0; i < PriorityCount; ++i)
+            {
+                _rejected += _queues[i].size();
+                dropped[i].swap(_queues[i]);
+            }
+        }
+    }
+    _cv.notify_all();
+}
+
+TaskQueue::Metrics TaskQueue::GetMetrics() const
+{
+    lock_guard<mutex> l(_mutex);
+
+    Metrics metrics;
+    metrics.depth = Depth();
+    metrics.peakDepth = _peakDepth;
+    for (int i = 0; i < PriorityCount; ++i)
+    {
+        metrics.depthByPriority[i] = _queues[i].size();
+    }
+    metrics.completed = _completed;
+    metrics.expired = _expired;
+    metrics.rejected = _rejected;
+    metrics.totalWait = _totalWait;
+    metrics.totalRun = _totalRun;
+    return metrics;
+}
+
+size_t TaskQueue::Depth() const
+{
+    size_t depth = 0;
+    for (const auto& queue : _queues)
+    {
+        depth += queue.size();
+    }
+    return depth;
 }
@@ -2,24 +2,89 @@
 #include <thread>
 #include <string>
 #include <queue>
+#include <deque>
 #include <mutex>
+#include <chrono>
 #include <future>
 #include <functional>
 #include <condition_variable>
 
+// A queue of tasks for a pool of worker threads.
+//
+// Tasks are taken highest priority first and, within a priority, in the order
+// they were enqueued. A task whose deadline passes while it is queued is
+// dropped without running. A dropped task's future reports
+// std::future_errc::broken_promise.
 class TaskQueue
 {
 public:
     typedef std::packaged_task<std::wstring()> Task;
+    typedef std::chrono::steady_clock Clock;
+
+    enum Priority
+    {
+        Interactive,    // direct methods a user is waiting on
+        Normal,
+        Bulk,           // log and file transfers
+        PriorityCount
+    };
+
+    struct Metrics
+    {
+        size_t depth;
+        size_t peakDepth;
+        size_t depthByPriority[PriorityCount];
+        unsigned long long completed;
+        unsigned long long expired;
+        unsigned long long rejected;    // dropped by or enqueued after Shutdown
+        Clock::duration totalWait;      // from Enqueue to Dequeue
+        Clock::duration totalRun;       // measured by RunOne
+    };
+
+    static Clock::time_point NoDeadline() { return Clock::time_point::max(); }
 
     TaskQueue();
 
-    std::future<std::wstring> Enqueue(Task task);
-    Task Dequeue();
+    std::future<std::wstring> Enqueue(Task task, Priority priority = Normal, Clock::time_point deadline = NoDeadline());
+
+    // Blocks until a task is available. Returns false once the queue has been
+    // shut down and there is nothing left to take.
+    bool Dequeue(Task& task);
+
+    // Dequeues a task and runs it on the calling thread. Returns false once
+    // the queue has been shut down and there is nothing left to run.
+    bool RunOne();
+
+    // Stops accepting tasks and wakes every waiting worker. Tasks already
+    // queued are still handed out unless dropPending is set.
+    void Shutdown(bool dropPending = false);
+
+    Metrics GetMetrics() const;
 
 private:
-    std::queue<Task> _queue;
+    struct Item
+    {
+        Task task;
+        Clock::time_point enqueued;
+        Clock::time_point deadline;
+    };
+
+    TaskQueue(const TaskQueue&);
+    TaskQueue& operator=(const TaskQueue&);
+
+    // Must be called with _mutex held.
+    size_t Depth() const;
+
+    std::deque<Item> _queues[PriorityCount];
+    bool _shutdown;
+
+    size_t _peakDepth;
+    unsigned long long _completed;
+    unsigned long long _expired;
+    unsigned long long _rejected;
+    Clock::duration _totalWait;
+    Clock::duration _totalRun;
 
-    std::mutex _mutex;
+    mutable std::mutex _mutex;
     std::condition_variable _cv;
 };
\ No newline at end of file
@@ -24,16 +24,75 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include <ppltasks.h>
 #include <atlbase.h>
+#include <utility>
 
 using namespace concurrency;
+using namespace std;
 using namespace SystemConfiguratorProxyClient;
 
+// Carries a failed RPC status through the pipeline's completions.
+struct PipelineRpcFailure
+{
+    DWORD status;
+};
+
+typedef pair<exception_ptr, Utils::PipelineBatch::Bytes> PipelineResult;
+
+static IResponse^ ParsePipelinedResponse(PipelineResult& result)
+{
+    if (result.first)
+    {
+        try
+        {
+            rethrow_exception(result.first);
+        }
+        catch (const PipelineRpcFailure& e)
+        {
+            return ref new ErrorResponse(ErrorSubSystem::DeviceManagement, e.status, L"Failure in SystemConfigurator pipelined RPC");
+        }
+        catch (...)
+        {
+            return ref new ErrorResponse(ErrorSubSystem::DeviceManagement, E_ABORT, L"SystemConfigurator pipeline was closed");
+        }
+    }
+
+    auto& bytes = result.second;
+    if (bytes.size() < 2 * sizeof(uint32_t))
+    {
+        return ref new ErrorResponse(ErrorSubSystem::DeviceManagement, E_UNEXPECTED, L"SystemConfigurator returned a truncated response blob");
+    }
+    return Blob::ParseResponse(Platform::ArrayReference<uint8_t>(bytes.data(), static_cast<unsigned int>(bytes.size())));
+}
+
 Windows::Foundation::IAsyncOperation<IResponse^>^ SCProxyClient::SendCommandAsync(IRequest^ command)
 {
-    return create_async([this, command]() -> IResponse^ {
+    // Without a pipeline, for instance while a restarted service is not yet listening, each
+    // request holds a pool thread in a blocking call.
+    shared_ptr<Utils::PipelineClient> client = GetPipeline();
+    if (!client)
+    {
+        return create_async([this, command]() -> IResponse^ {
+
+            return SendCommand(command);
 
-        return SendCommand(command);
+        });
+    }
 
+    // The request is submitted right away; the pipeline's receiver completes it whenever the
+    // service finishes it, and the response is parsed on a pool thread, not the receiver.
+    auto requestBytes = command->Serialize()->GetByteArrayForSerialization();
+    task_completion_event<PipelineResult> completed;
+    client->Send(requestBytes->Data, requestBytes->Length, [completed](exception_ptr error, Utils::PipelineBatch::Bytes response)
+    {
+        completed.set(PipelineResult(error, move(response)));
+    });
+
+    return create_async([completed]()
+    {
+        return create_task(completed).then([](PipelineResult result) -> IResponse^
+        {
+            return ParsePipelinedResponse(result);
+        });
     });
 }
 
@@ -62,9 +121,204 @@ DWORD DoSendCommand(handle_t binding, BSTR request, UINT requestType, BSTR *pRes
     RpcEndExcept
 }
 
+DWORD DoSendBlob(handle_t binding, UINT32 requestSize, byte* request, UINT32* pResponseSize, byte** pResponse)
+{
+    if (binding == NULL)
+    {
+        return RPC_S_INVALID_BINDING;
+    }
+
+    RpcTryExcept
+    {
+        return ::SendBlob(
+                /* [in] */ binding,
+                /* [in] */ requestSize,
+                /* [in] */ request,
+                /* [out] */ pResponseSize,
+                /* [out] */ pResponse);
+    }
+    RpcExcept(1)
+    {
+        return RpcExceptionCode();
+    }
+    RpcEndExcept
+}
+
+DWORD DoOpenPipeline(handle_t binding, PIPELINE_SESSION* pSession)
+{
+    if (binding == NULL)
+    {
+        return RPC_S_INVALID_BINDING;
+    }
+
+    RpcTryExcept
+    {
+        return ::OpenPipeline(binding, pSession);
+    }
+    RpcExcept(1)
+    {
+        return RpcExceptionCode();
+    }
+    RpcEndExcept
+}
+
+DWORD DoSubmitPipelined(PIPELINE_SESSION session, UINT32 requestId, UINT32 requestSize, byte* request)
+{
+    RpcTryExcept
+    {
+        return ::SubmitPipelined(session, requestId, requestSize, request);
+    }
+    RpcExcept(1)
+    {
+        return RpcExceptionCode();
+    }
+    RpcEndExcept
+}
+
+DWORD DoReceivePipelined(PIPELINE_SESSION session, UINT32 timeoutMs, UINT32* pResponseSize, byte** pResponses)
+{
+    RpcTryExcept
+    {
+        return ::ReceivePipelined(session, timeoutMs, pResponseSize, pResponses);
+    }
+    RpcExcept(1)
+    {
+        return RpcExceptionCode();
+    }
+    RpcEndExcept
+}
+
+DWORD DoClosePipeline(PIPELINE_SESSION* pSession)
+{
+    DWORD status;
+    RpcTryExcept
+    {
+        status = ::ClosePipeline(pSession);
+    }
+    RpcExcept(1)
+    {
+        status = RpcExceptionCode();
+    }
+    RpcEndExcept
+
+    // The service is gone; only the client's side of the handle is left to free.
+    if (*pSession != nullptr)
+    {
+        RpcSsDestroyClientContext(pSession);
+    }
+    return status;
+}
+
+// Opens a session and a pipeline client on it, or returns null if the service did not open one.
+static shared_ptr<Utils::PipelineClient> OpenPipelineClient(handle_t binding)
+{
+    PIPELINE_SESSION session = nullptr;
+    if (DoOpenPipeline(binding, &session) != RPC_S_OK)
+    {
+        return nullptr;
+    }
+
+    Utils::PipelineClient* client = new Utils::PipelineClient(
+        [session](uint32_t requestId, const uint8_t* data, uint32_t size)
+        {
+            auto status = DoSubmitPipelined(session, requestId, size, const_cast<byte*>(data));
+            if (status != RPC_S_OK)
+            {
+                throw PipelineRpcFailure { status };
+            }
+        },
+        [session](uint32_t timeoutMs)
+        {
+            UINT32 responseSize = 0;
+            byte* responses = nullptr;
+            auto status = DoReceivePipelined(session, timeoutMs, &responseSize, &responses);
+            if (status != RPC_S_OK)
+            {
+                throw PipelineRpcFailure { status };
+            }
+
+            Utils::PipelineBatch::Bytes batch(responses, responses + responseSize);
+            midl_user_free(responses);
+            return batch;
+        });
+
+    // Stops the receiver before the session it uses is closed.
+    return shared_ptr<Utils::PipelineClient>(client, [session](Utils::PipelineClient* client)
+    {
+        delete client;
+
+        PIPELINE_SESSION closing = session;
+        DoClosePipeline(&closing);
+    });
+}
+
+shared_ptr<Utils::PipelineClient> SCProxyClient::GetPipeline()
+{
+    lock_guard<mutex> lock(pipelineMutex);
+    if (!usePipeline)
+    {
+        return nullptr;
+    }
+
+    // A pipeline breaks for good when a call on it fails, as it does when SystemConfigurator
+    // restarts. Requests still on it have already failed; later ones go to a new session.
+    if (!pipeline || pipeline->IsBroken())
+    {
+        pipeline = OpenPipelineClient(hRpcBinding);
+    }
+    return pipeline;
+}
+
 IResponse^ SCProxyClient::SendCommand(IRequest^ command)
 {
     auto blob = command->Serialize();
+    if (!useBlobTransport)
+    {
+        return SendCommandAsJson(command, blob);
+    }
+
+    // Send the serialized blob as is, so the UTF-8 payload crosses the process boundary
+    // without being widened into a BSTR and narrowed again on the other side.
+    auto requestBytes = blob->GetByteArrayForSerialization();
+    UINT32 responseSize = 0;
+    byte* responseBytes = nullptr;
+
+    auto status = DoSendBlob(this->hRpcBinding, requestBytes->Length, requestBytes->Data, &responseSize, &responseBytes);
+    if (status == RPC_S_PROCNUM_OUT_OF_RANGE)
+    {
+        // An older SystemConfigurator only understands the JSON string transport.
+        useBlobTransport = false;
+        return SendCommandAsJson(command, blob);
+    }
+
+    if (RPC_S_OK != status)
+    {
+        return ref new ErrorResponse(ErrorSubSystem::DeviceManagement, status, L"Failure in SystemConfigurator SendBlob RPC");
+    }
+
+    if (responseBytes == nullptr || responseSize < 2 * sizeof(uint32_t))
+    {
+        midl_user_free(responseBytes);
+        return ref new ErrorResponse(ErrorSubSystem::DeviceManagement, E_UNEXPECTED, L"SystemConfigurator returned a truncated response blob");
+    }
+
+    // Parse straight from the RPC buffer, then release it.
+    IResponse^ response = nullptr;
+    try
+    {
+        response = Blob::ParseResponse(Platform::ArrayReference<uint8_t>(responseBytes, responseSize));
+    }
+    catch (...)
+    {
+        midl_user_free(responseBytes);
+        throw;
+    }
+    midl_user_free(responseBytes);
+    return response;
+}
+
+IResponse^ SCProxyClient::SendCommandAsJson(IRequest^ command, Blob^ blob)
+{
     auto json = blob->PayloadAsString;
 
     auto requestType = (UINT32)command->Tag;
@@ -118,6 +372,11 @@ __int64 SCProxyClient::Initialize()
         goto error_status;
     }
 
+    // An older SystemConfigurator does not implement pipelining; SendCommandAsync then falls
+    // back to one blocking call per request.
+    pipeline = OpenPipelineClient(hRpcBinding);
+    usePipeline = pipeline != nullptr;
+
 error_status:
 
     if (pszStringBinding != nullptr)
@@ -134,6 +393,9 @@ SCProxyClient::~SCProxyClient()
 {
     RPC_STATUS status;
 
+    // Fails the requests still in flight and closes the session.
+    pipeline.reset();
+
     if (hRpcBinding != NULL) 
     {
         status = RpcBindingFree(&hRpcBinding);
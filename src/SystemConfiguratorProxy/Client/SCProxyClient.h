@@ -22,7 +22,11 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define RPC_STATIC_ENDPOINT L"IotDmRpcEndpoint"
 #define RPC_PROTOCOL L"ncalrpc"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include "SystemConfiguratorProxy_h.h"
+#include "..\..\SharedUtilities\RequestPipeline.h"
 
 using namespace Microsoft::Devices::Management::Message;
 
@@ -42,6 +46,20 @@ namespace SystemConfiguratorProxyClient
         __int64 Initialize();
 
     private:
+        IResponse^ SendCommandAsJson(IRequest^ command, Blob^ blob);
+
+        // The current pipeline. A broken one is replaced by a new session; null if none could be opened.
+        std::shared_ptr<Utils::PipelineClient> GetPipeline();
+
         handle_t hRpcBinding;
+
+        // Cleared the first time the service turns out not to implement SendBlob.
+        std::atomic<bool> useBlobTransport { true };
+
+        // Set by Initialize() when the service implements pipelined requests. SendCommandAsync
+        // then keeps any number of requests in flight instead of holding a thread on each.
+        bool usePipeline = false;
+        std::mutex pipelineMutex;
+        std::shared_ptr<Utils::PipelineClient> pipeline;
     };
 }
@@ -0,0 +1,391 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\Base64.h"
+#include "Base64Test.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+static wstring Encode(const string& data)
+{
+    wstring text;
+    Base64Encoder::Encode(data.data(), data.size(), text);
+    return text;
+}
+
+static wstring Decode(const wstring& text)
+{
+    vector<char> data;
+    Base64Decoder::Decode(text.data(), text.size(), data);
+    return wstring(data.begin(), data.end());
+}
+
+static vector<char> RandomBytes(mt19937& random, size_t size)
+{
+    vector<char> bytes(size);
+    for (auto& b : bytes)
+    {
+        b = static_cast<char>(random());
+    }
+    return bytes;
+}
+
+void Base64Test::VectorTest()
+{
+    TRACE(__FUNCTION__);
+
+    // RFC 4648, section 10.
+    const char* plain[] = { "", "f", "fo", "foo", "foob", "fooba", "foobar" };
+    const wchar_t* encoded[] = { L"", L"Zg==", L"Zm8=", L"Zm9v", L"Zm9vYg==", L"Zm9vYmE=", L"Zm9vYmFy" };
+    for (size_t i = 0; i < sizeof(plain) / sizeof(plain[0]); ++i)
+    {
+        Test::Utils::EnsureEqual(Encode(plain[i]), encoded[i], L"Encode");
+        string p(plain[i]);
+        Test::Utils::EnsureEqual(Decode(encoded[i]), wstring(p.begin(), p.end()), L"Decode");
+    }
+
+    // Narrow output matches wide output.
+    string narrow;
+    Base64Encoder::Encode("foobar", 6, narrow);
+    Test::Utils::EnsureEqual(wstring(narrow.begin(), narrow.end()), L"Zm9vYmFy", L"Narrow encode");
+}
+
+void Base64Test::RoundTripTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Every length up to a few SIMD blocks, so each tail size is covered.
+    mt19937 random(1);
+    for (size_t size = 0; size < 200; ++size)
+    {
+        vector<char> data = RandomBytes(random, size);
+
+        wstring wide;
+        Base64Encoder::Encode(data.data(), data.size(), wide);
+        string narrow;
+        Base64Encoder::Encode(data.data(), data.size(), narrow);
+        Test::Utils::EnsureEqual(to_wstring(wide.size()), to_wstring(Base64Encoder::EncodedSize(size)), L"Encoded size");
+        Test::Utils::EnsureEqual(wstring(narrow.begin(), narrow.end()), wide, L"Narrow and wide");
+
+        vector<char> fromWide;
+        Base64Decoder::Decode(wide.data(), wide.size(), fromWide);
+        vector<char> fromNarrow;
+        Base64Decoder::Decode(narrow.data(), narrow.size(), fromNarrow);
+        Test::Utils::EnsureEqual(fromWide == data ? L"true" : L"false", L"true", L"Wide round trip");
+        Test::Utils::EnsureEqual(fromNarrow == data ? L"true" : L"false", L"true", L"Narrow round trip");
+    }
+
+    // Line-wrapped text, as CryptBinaryToString wrote it, still decodes.
+    vector<char> data = RandomBytes(random, 1000);
+    wstring text;
+    Base64Encoder::Encode(data.data(), data.size(), text);
+    wstring wrapped;
+    for (size_t i = 0; i < text.size(); i += 64)
+    {
+        wrapped += text.substr(i, 64) + L"\r\n";
+    }
+    vector<char> decoded;
+    Base64Decoder::Decode(wrapped.data(), wrapped.size(), decoded);
+    Test::Utils::EnsureEqual(decoded == data ? L"true" : L"false", L"true", L"Wrapped round trip");
+}
+
+void Base64Test::AlphabetTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Each byte value at a position the vectorized decoder looks at, and at
+    // one only the scalar decoder sees.
+    const string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const string base(48, 'Q');
+    for (size_t position : { static_cast<size_t>(5), static_cast<size_t>(46) })
+    {
+        for (int c = 0; c < 256; ++c)
+        {
+            string text = base;
+            text[position] = static_cast<char>(c);
+
+            bool inAlphabet = alphabet.find(static_cast<char>(c)) != string::npos;
+            bool whitespace = c == ' ' || c == '\t' || c == '\r' || c == '\n';
+            bool accepted = true;
+            vector<char> decoded;
+            try
+            {
+                Base64Decoder::Decode(text.data(), text.size(), decoded);
+            }
+            catch (DMException&)
+            {
+                accepted = false;
+            }
+
+            Test::Utils::EnsureEqual(accepted ? L"true" : L"false", inAlphabet || whitespace ? L"true" : L"false", L"Character " + to_wstring(c));
+            if (inAlphabet)
+            {
+                // The character decodes to its index.
+                size_t index = alphabet.find(static_cast<char>(c));
+                size_t bit = position * 6;
+                uint32_t sextet = 0;
+                for (int k = 0; k < 6; ++k, ++bit)
+                {
+                    uint8_t byte = static_cast<uint8_t>(decoded[bit / 8]);
+                    sextet = (sextet << 1) | ((byte >> (7 - bit % 8)) & 1);
+                }
+                Test::Utils::EnsureEqual(to_wstring(sextet), to_wstring(index), L"Sextet");
+            }
+        }
+    }
+}
+
+void Base64Test::StreamingTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Splitting the input anywhere gives the same result as one call.
+    mt19937 random(2);
+    vector<char> data = RandomBytes(random, 5000);
+    wstring expected;
+    Base64Encoder::Encode(data.data(), data.size(), expected);
+
+    for (int run = 0; run < 20; ++run)
+    {
+        Base64Encoder encoder;
+        wstring text;
+        size_t offset = 0;
+        while (offset < data.size())
+        {
+            size_t size = (min)(data.size() - offset, static_cast<size_t>(random() % 40));
+            encoder.Append(data.data() + offset, size, text);
+            offset += size;
+        }
+        encoder.Finish(text);
+        Test::Utils::EnsureEqual(text, expected, L"Streamed encode");
+
+        Base64Decoder decoder;
+        vector<char> decoded;
+        offset = 0;
+        while (offset < text.size())
+        {
+            size_t size = (min)(text.size() - offset, static_cast<size_t>(random() % 40));
+            decoder.Append(text.data() + offset, size, decoded);
+            offset += size;
+        }
+        decoder.Finish(decoded);
+        Test::Utils::EnsureEqual(decoded == data ? L"true" : L"false", L"true", L"Streamed decode");
+    }
+}
+
+void Base64Test::EncodeStreamTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Reads arrive in uneven pieces, as from a file or pipe, and the encoder
+    // never asks for more than one chunk at a time.
+    mt19937 random(4);
+    vector<char> data = RandomBytes(random, 3 * Base64Encoder::StreamChunkSize + 1234);
+    wstring expected;
+    Base64Encoder::Encode(data.data(), data.size(), expected);
+
+    size_t offset = 0;
+    size_t largestRequest = 0;
+    wstring text = L"<Data>";
+    Base64Encoder::EncodeStream([&](void* buffer, size_t size) -> size_t
+    {
+        largestRequest = (max)(largestRequest, size);
+        size_t count = (min)((min)(size, data.size() - offset), static_cast<size_t>(1 + random() % 70000));
+        memcpy(buffer, data.data() + offset, count);
+        offset += count;
+        return count;
+    }, text);
+
+    Test::Utils::EnsureEqual(text, L"<Data>" + expected, L"Streamed file");
+    Test::Utils::EnsureEqual(to_wstring(largestRequest), to_wstring(Base64Encoder::StreamChunkSize), L"Read size");
+}
+
+void Base64Test::MalformedTest()
+{
+    TRACE(__FUNCTION__);
+
+    Test::Utils::EnsureException<DMException>(L"Decode", []() { Decode(L"Zm9v\x263AYmFy"); });
+    Test::Utils::EnsureException<DMException>(L"Decode", []() { Decode(L"Zg==Zg=="); });
+    Test::Utils::EnsureException<DMException>(L"Decode", []() { Decode(L"Z==="); });
+    Test::Utils::EnsureException<DMException>(L"Decode", []() { Decode(L"Zm9vY"); });
+
+    // Unpadded final groups and trailing whitespace are accepted.
+    Test::Utils::EnsureEqual(Decode(L"Zm9vYg"), L"foob", L"Unpadded");
+    Test::Utils::EnsureEqual(Decode(L"Zm9vYg==\r\n"), L"foob", L"Trailing whitespace");
+}
+
+// The shape of the code this replaced: size the output in one pass, convert
+// in a second, then copy the result out of a temporary buffer.
+static void ReferenceEncode(const vector<char>& data, wstring& text)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t size = 0;
+    for (size_t i = 0; i < data.size(); i += 3)
+    {
+        size += 4;
+    }
+
+    vector<wchar_t> buffer(size);
+    size_t o = 0;
+    for (size_t i = 0; i < data.size(); i += 3)
+    {
+        uint32_t bits = static_cast<uint8_t>(data[i]) << 16;
+        if (i + 1 < data.size()) bits |= static_cast<uint8_t>(data[i + 1]) << 8;
+        if (i + 2 < data.size()) bits |= static_cast<uint8_t>(data[i + 2]);
+        buffer[o++] = table[bits >> 18];
+        buffer[o++] = table[(bits >> 12) & 0x3f];
+        buffer[o++] = i + 1 < data.size() ? table[(bits >> 6) & 0x3f] : L'=';
+        buffer[o++] = i + 2 < data.size() ? table[bits & 0x3f] : L'=';
+    }
+    text = wstring(buffer.data(), buffer.size());
+}
+
+static void ReferenceDecode(const wstring& text, vector<char>& data)
+{
+    auto sextet = [](wchar_t c) -> int
+    {
+        if (c >= L'A' && c <= L'Z') return c - L'A';
+        if (c >= L'a' && c <= L'z') return c - L'a' + 26;
+        if (c >= L'0' && c <= L'9') return c - L'0' + 52;
+        if (c == L'+') return 62;
+        if (c == L'/') return 63;
+        return -1;
+    };
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        size_t size = 0;
+        uint32_t bits = 0;
+        int count = 0;
+        for (wchar_t c : text)
+        {
+            int value = sextet(c);
+            if (value < 0)
+            {
+                continue;
+            }
+            bits = (bits << 6) | value;
+            if (++count == 4)
+            {
+                if (pass == 1)
+                {
+                    data[size] = static_cast<char>(bits >> 16);
+                    data[size + 1] = static_cast<char>(bits >> 8);
+                    data[size + 2] = static_cast<char>(bits);
+                }
+                size += 3;
+                count = 0;
+                bits = 0;
+            }
+        }
+        if (pass == 0)
+        {
+            data.resize(size);
+        }
+    }
+}
+
+void Base64Test::Benchmark()
+{
+    TRACE(__FUNCTION__);
+
+    const size_t size = 8 * 1024 * 1024;
+    const int rounds = 5;
+    mt19937 random(3);
+    vector<char> data = RandomBytes(random, size);
+
+    auto megabytesPerSecond = [size, rounds](chrono::steady_clock::duration elapsed)
+    {
+        return static_cast<long long>(size * rounds / (1024.0 * 1024.0) / chrono::duration<double>(elapsed).count());
+    };
+
+    wstring text;
+    vector<char> decoded;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        ReferenceEncode(data, text);
+    }
+    long long referenceEncode = megabytesPerSecond(chrono::steady_clock::now() - start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        decoded.clear();
+        ReferenceDecode(text, decoded);
+    }
+    long long referenceDecode = megabytesPerSecond(chrono::steady_clock::now() - start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        text.clear();
+        Base64Encoder::Encode(data.data(), data.size(), text);
+    }
+    long long encode = megabytesPerSecond(chrono::steady_clock::now() - start);
+
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        decoded.clear();
+        Base64Decoder::Decode(text.data(), text.size(), decoded);
+    }
+    long long decode = megabytesPerSecond(chrono::steady_clock::now() - start);
+    Test::Utils::EnsureEqual(decoded == data ? L"true" : L"false", L"true", L"Benchmark round trip");
+
+    cout << "Base64 encode MB/s: reference " << referenceEncode << ", codec " << encode << endl;
+    cout << "Base64 decode MB/s: reference " << referenceDecode << ", codec " << decode << endl;
+}
+
+bool Base64Test::RunTest()
+{
+    bool result = true;
+    try
+    {
+        VectorTest();
+        RoundTripTest();
+        AlphabetTest();
+        StreamingTest();
+        EncodeStreamTest();
+        MalformedTest();
+        Benchmark();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
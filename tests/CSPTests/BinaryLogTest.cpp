@@ -0,0 +1,208 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\BinaryLog.h"
+#include "BinaryLogTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+static LogEntry MakeEntry(uint64_t time, const wstring& format, LogArgType argType, uint64_t argValue, const wstring& stringArg)
+{
+    LogEntry entry;
+    entry.time = time;
+    entry.threadId = 42;
+    entry.level = ETWLogger::LoggingLevel::Warning;
+    entry.text = format + stringArg;
+    entry.formatLength = format.size();
+    entry.argType = argType;
+    entry.argValue = argValue;
+    return entry;
+}
+
+static wstring Format(const LogEntry& entry)
+{
+    wstring text;
+    entry.AppendText(text);
+    return text;
+}
+
+static vector<LogEntry> Decode(const vector<uint8_t>& buffer, size_t size)
+{
+    vector<LogEntry> entries;
+    BinaryLogDecoder::Decode(buffer.data(), size, [&entries](const LogEntry& entry)
+    {
+        entries.push_back(entry);
+    });
+    return entries;
+}
+
+void BinaryLogTest::RoundTripTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Non-ASCII text and a surrogate pair make sure the UTF-8 conversion is lossless.
+    wstring unicode = L"café 中文 \xd83d\xde00";
+    vector<LogEntry> expected;
+    expected.push_back(MakeEntry(1000, L"Starting...", LogArgType::None, 0, L""));
+    expected.push_back(MakeEntry(1005, L"Count: ", LogArgType::Int, static_cast<uint64_t>(-17), L""));
+    expected.push_back(MakeEntry(990, L"Size: ", LogArgType::UInt, UINT64_MAX, L""));
+    expected.push_back(MakeEntry(2000, L"Name: ", LogArgType::String, 0, unicode));
+    expected.push_back(MakeEntry(2000, L"", LogArgType::String, 0, L""));
+
+    vector<uint8_t> buffer(4096);
+    BinaryLogEncoder encoder;
+    Test::Utils::EnsureEqual(encoder.Begin(buffer.data(), buffer.size(), 900) ? L"true" : L"false", L"true", L"Header written");
+    for (const auto& entry : expected)
+    {
+        Test::Utils::EnsureEqual(encoder.Append(entry) ? L"true" : L"false", L"true", L"Entry appended");
+    }
+
+    Test::Utils::EnsureEqual(to_wstring(BinaryLogDecoder::StartTime(buffer.data(), buffer.size())), L"900", L"Start time");
+
+    vector<LogEntry> actual = Decode(buffer, buffer.size());
+    Test::Utils::EnsureEqual(to_wstring(actual.size()), to_wstring(expected.size()), L"Entry count");
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        Test::Utils::EnsureEqual(to_wstring(actual[i].time), to_wstring(expected[i].time), L"Time");
+        Test::Utils::EnsureEqual(to_wstring(actual[i].threadId), L"42", L"Thread id");
+        Test::Utils::EnsureEqual(to_wstring(actual[i].level), to_wstring(expected[i].level), L"Level");
+        Test::Utils::EnsureEqual(Format(actual[i]), Format(expected[i]), L"Text");
+    }
+
+    Test::Utils::EnsureException<DMException>(L"Bad header", [&buffer]()
+    {
+        vector<uint8_t> corrupt(buffer);
+        corrupt[0] ^= 0xFF;
+        BinaryLogDecoder::StartTime(corrupt.data(), corrupt.size());
+    });
+}
+
+void BinaryLogTest::InterningTest()
+{
+    TRACE(__FUNCTION__);
+
+    const int count = 100;
+    wstring longFormat(BinaryLogEncoder::MaxInternedLength + 1, L'z');
+    vector<uint8_t> buffer(64 * 1024);
+
+    // A repeated format costs its text once; an overlong one is written every time.
+    BinaryLogEncoder interned;
+    interned.Begin(buffer.data(), buffer.size(), 0);
+    for (int i = 0; i < count; ++i)
+    {
+        interned.Append(MakeEntry(i, L"A format string that repeats: ", LogArgType::Int, i, L""));
+    }
+    size_t internedSize = interned.Size() - BinaryLogEncoder::HeaderSize;
+
+    vector<LogEntry> entries = Decode(buffer, interned.Size());
+    Test::Utils::EnsureEqual(to_wstring(entries.size()), to_wstring(count), L"Interned entry count");
+    Test::Utils::EnsureEqual(Format(entries.back()), L"A format string that repeats: 99", L"Interned entry text");
+    Test::Utils::EnsureEqual(internedSize < count * 8 ? L"true" : L"false", L"true", L"Interned formats are not repeated");
+
+    BinaryLogEncoder inlined;
+    inlined.Begin(buffer.data(), buffer.size(), 0);
+    for (int i = 0; i < 3; ++i)
+    {
+        inlined.Append(MakeEntry(i, longFormat, LogArgType::None, 0, L""));
+    }
+    Test::Utils::EnsureEqual(inlined.Size() > BinaryLogEncoder::HeaderSize + 3 * longFormat.size() ? L"true" : L"false", L"true", L"Long formats are inline");
+
+    entries = Decode(buffer, inlined.Size());
+    Test::Utils::EnsureEqual(to_wstring(entries.size()), L"3", L"Inline entry count");
+    Test::Utils::EnsureEqual(Format(entries.back()), longFormat, L"Inline entry text");
+}
+
+void BinaryLogTest::FullBufferTest()
+{
+    TRACE(__FUNCTION__);
+
+    vector<uint8_t> buffer(256, 0);
+    BinaryLogEncoder encoder;
+    encoder.Begin(buffer.data(), buffer.size(), 0);
+
+    int appended = 0;
+    while (encoder.Append(MakeEntry(appended, L"Filling the buffer: ", LogArgType::UInt, appended, L"")))
+    {
+        ++appended;
+    }
+
+    // The entry that did not fit must leave the buffer exactly as it was.
+    size_t size = encoder.Size();
+    vector<uint8_t> before(buffer);
+    Test::Utils::EnsureEqual(encoder.Append(MakeEntry(0, L"Filling the buffer: ", LogArgType::UInt, 0, L"")) ? L"true" : L"false", L"false", L"Full buffer rejects entries");
+    Test::Utils::EnsureEqual(to_wstring(encoder.Size()), to_wstring(size), L"Size unchanged");
+    Test::Utils::EnsureEqual(buffer == before ? L"true" : L"false", L"true", L"Buffer unchanged");
+
+    vector<LogEntry> entries = Decode(buffer, buffer.size());
+    Test::Utils::EnsureEqual(to_wstring(entries.size()), to_wstring(appended), L"Entries before the buffer filled up");
+}
+
+void BinaryLogTest::TruncationTest()
+{
+    TRACE(__FUNCTION__);
+
+    vector<uint8_t> buffer(1024, 0);
+    BinaryLogEncoder encoder;
+    encoder.Begin(buffer.data(), buffer.size(), 0);
+    encoder.Append(MakeEntry(1, L"first", LogArgType::None, 0, L""));
+    size_t firstSize = encoder.Size();
+    encoder.Append(MakeEntry(2, L"second ", LogArgType::String, 0, L"record"));
+    size_t secondSize = encoder.Size();
+
+    // A record cut short, as when the system stops mid-write, ends decoding.
+    for (size_t size = firstSize; size < secondSize; ++size)
+    {
+        vector<LogEntry> entries = Decode(buffer, size);
+        Test::Utils::EnsureEqual(to_wstring(entries.size()), L"1", L"Truncated record skipped");
+    }
+
+    vector<LogEntry> entries = Decode(buffer, secondSize);
+    Test::Utils::EnsureEqual(to_wstring(entries.size()), L"2", L"Complete records");
+    Test::Utils::EnsureEqual(Format(entries.back()), L"second record", L"Last record text");
+}
+
+bool BinaryLogTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        RoundTripTest();
+        InterningTest();
+        FullBufferTest();
+        TruncationTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
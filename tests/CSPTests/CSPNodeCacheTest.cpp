@@ -0,0 +1,209 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <memory>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\CSPNodeCache.h"
+#include "..\..\src\SystemConfigurator\CSPs\MdmProvision.h"
+#include "..\..\src\SystemConfigurator\CSPs\SyncMLBatch.h"
+#include "CSPSimulator.h"
+#include "CSPNodeCacheTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+static void EnsureCount(unsigned long long actual, unsigned long long expected, const wchar_t* message)
+{
+    Test::Utils::EnsureEqual(to_wstring(actual), to_wstring(expected), message);
+}
+
+void CSPNodeCacheTest::PolicyTest()
+{
+    TRACE(__FUNCTION__);
+
+    CSPNodeCache cache;
+    cache.SetPolicy(L"./DevDetail", chrono::hours(1));
+    cache.SetPolicy(L"./DevDetail/Ext", chrono::milliseconds(0));
+    cache.SetPolicy(L"./DevDetail/Ext/Microsoft/TotalRAM", chrono::hours(1));
+
+    if (!cache.IsCacheable(L"./DevDetail/HwV") ||
+        !cache.IsCacheable(L"./DevDetail/Ext/Microsoft/TotalRAM") ||
+        cache.IsCacheable(L"./DevDetail/Ext/Microsoft/DeviceName") ||
+        cache.IsCacheable(L"./DevDetailX") ||
+        cache.IsCacheable(L"./DevInfo/Man"))
+    {
+        throw Test::Utils::TestFailureException("Unexpected cache policy match.");
+    }
+
+    // Values of nodes without a policy are never stored.
+    cache.Put(L"", L"./DevInfo/Man", L"text", L"Contoso", cache.Generation());
+    cache.Put(L"", L"./DevDetail/HwV", L"text", L"1.0", cache.Generation());
+    EnsureCount(cache.Size(), 1, L"Cache size");
+
+    // The sid and the format are part of the key.
+    wstring value;
+    if (!cache.TryGet(L"", L"./DevDetail/HwV", L"text", value) ||
+        cache.TryGet(L"S-1-5-18", L"./DevDetail/HwV", L"text", value) ||
+        cache.TryGet(L"", L"./DevDetail/HwV", L"b64", value))
+    {
+        throw Test::Utils::TestFailureException("Unexpected cache lookup result.");
+    }
+    Test::Utils::EnsureEqual(value, L"1.0", L"Cached value");
+    EnsureCount(cache.HitCount(), 1, L"Hit count");
+    EnsureCount(cache.MissCount(), 2, L"Miss count");
+}
+
+void CSPNodeCacheTest::ExpiryTest()
+{
+    TRACE(__FUNCTION__);
+
+    CSPNodeCache::Clock::time_point now = CSPNodeCache::Clock::now();
+    CSPNodeCache::PolicyMap policies;
+    policies[L"./DevInfo"] = chrono::seconds(10);
+    CSPNodeCache cache(policies, [&now]() { return now; });
+
+    cache.Put(L"", L"./DevInfo/Man", L"text", L"Contoso", cache.Generation());
+
+    wstring value;
+    now += chrono::seconds(9);
+    if (!cache.TryGet(L"", L"./DevInfo/Man", L"text", value))
+    {
+        throw Test::Utils::TestFailureException("Value expired too early.");
+    }
+
+    now += chrono::seconds(1);
+    if (cache.TryGet(L"", L"./DevInfo/Man", L"text", value))
+    {
+        throw Test::Utils::TestFailureException("Value did not expire.");
+    }
+    EnsureCount(cache.Size(), 0, L"Cache size after expiry");
+}
+
+void CSPNodeCacheTest::InvalidationTest()
+{
+    TRACE(__FUNCTION__);
+
+    CSPNodeCache cache;
+    cache.SetPolicy(L"./Vendor/MSFT/Store", chrono::hours(1));
+
+    unsigned long long generation = cache.Generation();
+    cache.Put(L"", L"./Vendor/MSFT/Store", L"text", L"hash1/hash2", generation);
+    cache.Put(L"", L"./Vendor/MSFT/Store/hash1/Value", L"text", L"1", generation);
+    cache.Put(L"", L"./Vendor/MSFT/Store/hash2/Value", L"text", L"2", generation);
+    cache.Put(L"", L"./Vendor/MSFT/Store/hash2/Value", L"int", L"2", generation);
+    EnsureCount(cache.Size(), 4, L"Cache size");
+
+    // Writing a node drops its ancestors and descendants only.
+    cache.Invalidate(L"./Vendor/MSFT/Store/hash1");
+    EnsureCount(cache.Size(), 2, L"Cache size after invalidating a subtree");
+    EnsureCount(cache.InvalidationCount(), 2, L"Invalidation count");
+
+    // A write to a parent drops every descendant.
+    cache.Invalidate(L"./Vendor/MSFT");
+    EnsureCount(cache.Size(), 0, L"Cache size after invalidating a parent");
+
+    // A value read before an invalidation is not stored.
+    cache.Put(L"", L"./Vendor/MSFT/Store/hash1/Value", L"text", L"stale", generation);
+    EnsureCount(cache.Size(), 0, L"Cache size after a stale put");
+}
+
+void CSPNodeCacheTest::RoundTripTest()
+{
+    TRACE(__FUNCTION__);
+
+    shared_ptr<CSPSimulator> simulator = make_shared<CSPSimulator>();
+    simulator->SetNode(L"./DevInfo/Man", L"Contoso");
+    simulator->SetNode(L"./DevInfo/Mod", L"Model");
+    simulator->SetNode(L"./DevDetail/HwV", L"1.0");
+    simulator->SetNode(L"./DevDetail/Ext/Microsoft/TotalRAM", L"2048");
+    simulator->SetNode(L"./DevDetail/Ext/Microsoft/DeviceName", L"device");
+
+    MdmProvision::SetExecutor(simulator);
+    try
+    {
+        auto readDeviceInfo = []()
+        {
+            SyncMLBatch batch;
+            size_t manufacturerIndex = batch.QueueGetString(L"./DevInfo/Man");
+            batch.QueueGetString(L"./DevInfo/Mod");
+            batch.QueueGetString(L"./DevDetail/HwV");
+            size_t totalMemoryIndex = batch.QueueGetUInt(L"./DevDetail/Ext/Microsoft/TotalRAM");
+            size_t nameIndex = batch.QueueGetString(L"./DevDetail/Ext/Microsoft/DeviceName");
+            MdmProvision::RunBatch(batch);
+
+            Test::Utils::EnsureEqual(batch.GetString(manufacturerIndex), L"Contoso", L"Manufacturer");
+            Test::Utils::EnsureEqual(batch.GetString(totalMemoryIndex), L"2048", L"Total memory");
+            Test::Utils::EnsureEqual(batch.GetString(nameIndex), L"device", L"Device name");
+        };
+
+        // Only the device name is excluded from caching, so every report
+        // after the first one reads a single node.
+        const unsigned int reportCount = 10;
+        for (unsigned int i = 0; i < reportCount; ++i)
+        {
+            readDeviceInfo();
+        }
+        EnsureCount(simulator->RoundTripCount(), reportCount, L"Round trips for device info");
+        EnsureCount(simulator->CommandCount(L"Get"), 5 + (reportCount - 1), L"Get commands for device info");
+
+        simulator->ResetCounters();
+        Test::Utils::EnsureEqual(MdmProvision::RunGetString(L"./DevInfo/Man"), L"Contoso", L"Cached RunGetString");
+        EnsureCount(simulator->RoundTripCount(), 0, L"Round trips for a cached node");
+
+        // A write through MdmProvision invalidates the node.
+        MdmProvision::RunSet(L"./DevInfo/Man", wstring(L"Fabrikam"));
+        Test::Utils::EnsureEqual(MdmProvision::RunGetString(L"./DevInfo/Man"), L"Fabrikam", L"RunGetString after RunSet");
+
+        // So does a write to a parent.
+        MdmProvision::RunDelete(L"./DevInfo");
+        Test::Utils::EnsureException<DMException>("MdmProvision::RunGetString()", []() { MdmProvision::RunGetString(L"./DevInfo/Man"); });
+    }
+    catch (...)
+    {
+        MdmProvision::SetExecutor(nullptr);
+        throw;
+    }
+    MdmProvision::SetExecutor(nullptr);
+}
+
+bool CSPNodeCacheTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        PolicyTest();
+        ExpiryTest();
+        InvalidationTest();
+        RoundTripTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
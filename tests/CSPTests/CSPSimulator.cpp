@@ -0,0 +1,379 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\SyncMLReader.h"
+#include "CSPSimulator.h"
+
+using namespace std;
+
+// OMA-DM status codes
+const unsigned int StatusOk = 200;
+const unsigned int StatusNotFound = 404;
+const unsigned int StatusCommandNotAllowed = 405;
+const unsigned int StatusAlreadyExists = 418;
+
+static bool IsCommandVerb(const wstring& name)
+{
+    return name == L"Get" || name == L"Add" || name == L"Replace" || name == L"Delete" || name == L"Exec";
+}
+
+static wstring NormalizePath(const wstring& locUri, bool& structData)
+{
+    wstring path = locUri;
+    structData = false;
+
+    size_t query = path.find(L'?');
+    if (query != wstring::npos)
+    {
+        structData = path.find(L"list=Struct", query) != wstring::npos;
+        path.resize(query);
+    }
+    while (path.size() > 1 && path.back() == L'/')
+    {
+        path.pop_back();
+    }
+    return path;
+}
+
+CSPSimulator::CSPSimulator() :
+    _roundTripLatency(0),
+    _commandLatency(0),
+    _roundTripCount(0)
+{
+}
+
+void CSPSimulator::Execute(const wstring& requestSyncML, wstring& responseSyncML)
+{
+    vector<Command> commands;
+    Command current;
+
+    Utils::SyncMLReader::Read(requestSyncML,
+        [&](const Utils::SyncMLReader::ElementStack& elementStack)
+        {
+            size_t depth = elementStack.size();
+            if (depth >= 2 && elementStack[depth - 2] == L"SyncBody" && IsCommandVerb(elementStack.back()))
+            {
+                current = Command();
+                current.verb = elementStack.back();
+                current.hasData = false;
+            }
+        },
+        [&](const Utils::SyncMLReader::ElementStack& elementStack, const wstring& text)
+        {
+            size_t depth = elementStack.size();
+            const wstring& name = elementStack.back();
+            const wstring& parent = depth >= 2 ? elementStack[depth - 2] : name;
+
+            if (name == L"CmdID" && IsCommandVerb(parent))
+            {
+                current.cmdId = text;
+            }
+            else if (name == L"LocURI" && parent == L"Target")
+            {
+                current.path = text;
+            }
+            else if (name == L"Data" && parent == L"Item")
+            {
+                current.data = text;
+                current.hasData = true;
+            }
+            else if (depth >= 2 && elementStack[depth - 2] == L"SyncBody" && IsCommandVerb(name))
+            {
+                commands.push_back(current);
+            }
+        });
+
+    chrono::microseconds latency;
+    {
+        lock_guard<recursive_mutex> lock(_mutex);
+        latency = _roundTripLatency + _commandLatency * static_cast<int>(commands.size());
+    }
+    if (latency.count() > 0)
+    {
+        this_thread::sleep_for(latency);
+    }
+
+    wstring statuses;
+    wstring results;
+    unsigned int responseCmdId = 1;
+    {
+        lock_guard<recursive_mutex> lock(_mutex);
+
+        ++_roundTripCount;
+        for (const Command& command : commands)
+        {
+            ++_commandCounts[command.verb];
+
+            wstring items;
+            unsigned int status = ApplyCommand(command, items);
+
+            statuses += L"<Status><CmdID>" + to_wstring(responseCmdId++) + L"</CmdID><MsgRef>1</MsgRef>";
+            statuses += L"<CmdRef>" + command.cmdId + L"</CmdRef><Cmd>" + command.verb + L"</Cmd>";
+            statuses += L"<Data>" + to_wstring(status) + L"</Data></Status>";
+
+            if (!items.empty())
+            {
+                results += L"<Results><CmdID>" + to_wstring(responseCmdId++) + L"</CmdID><MsgRef>1</MsgRef>";
+                results += L"<CmdRef>" + command.cmdId + L"</CmdRef>" + items + L"</Results>";
+            }
+        }
+    }
+
+    responseSyncML = L"<SyncML xmlns=\"SYNCML:SYNCML1.2\"><SyncBody>";
+    responseSyncML += statuses;
+    responseSyncML += results;
+    responseSyncML += L"<Final/></SyncBody></SyncML>";
+}
+
+unsigned int CSPSimulator::ApplyCommand(const Command& command, wstring& items)
+{
+    bool structData = false;
+    wstring path = NormalizePath(command.path, structData);
+
+    auto failure = _failures.find(path);
+    if (failure != _failures.end())
+    {
+        return failure->second;
+    }
+
+    auto node = _nodes.find(path);
+
+    if (command.verb == L"Get")
+    {
+        if (node == _nodes.end())
+        {
+            return StatusNotFound;
+        }
+
+        auto appendItem = [&items](const wstring& locUri, const wstring& value)
+        {
+            items += L"<Item><Source><LocURI>" + locUri + L"</LocURI></Source>";
+            items += L"<Data>" + Utils::SyncMLReader::Escape(value) + L"</Data></Item>";
+        };
+
+        if (structData && node->second.interior)
+        {
+            wstring prefix = path + L"/";
+            for (auto it = _nodes.lower_bound(prefix); it != _nodes.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+            {
+                appendItem(it->first, it->second.interior ? L"" : it->second.value);
+            }
+        }
+        else if (node->second.interior)
+        {
+            set<wstring> children;
+            GetChildren(path, children);
+
+            wstring childList;
+            for (const wstring& child : children)
+            {
+                childList += (childList.empty() ? L"" : L"/") + child;
+            }
+            appendItem(path, childList);
+        }
+        else
+        {
+            appendItem(path, node->second.value);
+        }
+        return StatusOk;
+    }
+    else if (command.verb == L"Add")
+    {
+        if (node != _nodes.end())
+        {
+            return StatusAlreadyExists;
+        }
+        EnsureParents(path);
+        Node newNode;
+        newNode.interior = !command.hasData;
+        newNode.value = command.data;
+        _nodes[path] = newNode;
+        return StatusOk;
+    }
+    else if (command.verb == L"Replace")
+    {
+        if (node == _nodes.end())
+        {
+            return StatusNotFound;
+        }
+        if (node->second.interior)
+        {
+            return StatusCommandNotAllowed;
+        }
+        node->second.value = command.data;
+        return StatusOk;
+    }
+    else if (command.verb == L"Delete")
+    {
+        if (node == _nodes.end())
+        {
+            return StatusNotFound;
+        }
+        _nodes.erase(node);
+
+        // Siblings such as "<path>-x" sort between the node and its
+        // descendants, so only the descendants' range is erased.
+        wstring prefix = path + L"/";
+        auto first = _nodes.lower_bound(prefix);
+        auto last = first;
+        while (last != _nodes.end() && last->first.compare(0, prefix.size(), prefix) == 0)
+        {
+            ++last;
+        }
+        _nodes.erase(first, last);
+        return StatusOk;
+    }
+    else // Exec
+    {
+        auto handler = _execHandlers.find(path);
+        if (handler == _execHandlers.end())
+        {
+            return StatusNotFound;
+        }
+        return handler->second(command.data);
+    }
+}
+
+void CSPSimulator::EnsureParents(const wstring& path)
+{
+    // Skip the leading '.' (or './') - it is the root of the tree.
+    size_t separator = path.find(L'/', path.compare(0, 2, L"./") == 0 ? 2 : 0);
+    while (separator != wstring::npos)
+    {
+        wstring parent = path.substr(0, separator);
+        if (_nodes.find(parent) == _nodes.end())
+        {
+            Node interiorNode;
+            interiorNode.interior = true;
+            _nodes[parent] = interiorNode;
+        }
+        separator = path.find(L'/', separator + 1);
+    }
+}
+
+void CSPSimulator::GetChildren(const wstring& path, set<wstring>& children) const
+{
+    wstring prefix = path + L"/";
+    for (auto it = _nodes.lower_bound(prefix); it != _nodes.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it)
+    {
+        wstring child = it->first.substr(prefix.size());
+        if (child.find(L'/') == wstring::npos)
+        {
+            children.insert(child);
+        }
+    }
+}
+
+void CSPSimulator::SetNode(const wstring& path, const wstring& value)
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+
+    EnsureParents(path);
+    Node node;
+    node.interior = false;
+    node.value = value;
+    _nodes[path] = node;
+}
+
+void CSPSimulator::SetInteriorNode(const wstring& path)
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+
+    EnsureParents(path);
+    Node node;
+    node.interior = true;
+    _nodes[path] = node;
+}
+
+bool CSPSimulator::TryGetNode(const wstring& path, wstring& value) const
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+
+    auto node = _nodes.find(path);
+    if (node == _nodes.end() || node->second.interior)
+    {
+        return false;
+    }
+    value = node->second.value;
+    return true;
+}
+
+bool CSPSimulator::NodeExists(const wstring& path) const
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    return _nodes.find(path) != _nodes.end();
+}
+
+void CSPSimulator::SetExecHandler(const wstring& path, ExecHandler handler)
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    _execHandlers[path] = handler;
+}
+
+void CSPSimulator::FailCommands(const wstring& path, unsigned int status)
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    _failures[path] = status;
+}
+
+void CSPSimulator::ClearFailures()
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    _failures.clear();
+}
+
+void CSPSimulator::SetLatency(chrono::microseconds perRoundTrip, chrono::microseconds perCommand)
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    _roundTripLatency = perRoundTrip;
+    _commandLatency = perCommand;
+}
+
+unsigned long long CSPSimulator::RoundTripCount() const
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    return _roundTripCount;
+}
+
+unsigned long long CSPSimulator::CommandCount() const
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+
+    unsigned long long count = 0;
+    for (const auto& it : _commandCounts)
+    {
+        count += it.second;
+    }
+    return count;
+}
+
+unsigned long long CSPSimulator::CommandCount(const wstring& verb) const
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+
+    auto it = _commandCounts.find(verb);
+    return it == _commandCounts.end() ? 0 : it->second;
+}
+
+void CSPSimulator::ResetCounters()
+{
+    lock_guard<recursive_mutex> lock(_mutex);
+    _roundTripCount = 0;
+    _commandCounts.clear();
+}
@@ -0,0 +1,96 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include "..\..\src\SystemConfigurator\CSPs\ISyncMLExecutor.h"
+
+// In-memory OMA-DM tree that understands the SyncML sent by MdmProvision and
+// SyncMLBatch. Inject it with MdmProvision::SetExecutor() to run CSP logic
+// without the local management stack.
+//
+// Semantics follow the OMA-DM protocol as implemented by the Windows CSPs:
+// - Add creates the node (and any missing interior parents). 418 if it exists.
+// - Get on a leaf returns its value. Get on an interior node returns the names
+//   of its children separated by '/'. '?list=StructData' returns one item per
+//   descendant. 404 if the node does not exist.
+// - Replace updates an existing leaf. 404 if it does not exist.
+// - Delete removes the node and its descendants. 404 if it does not exist.
+// - Exec invokes the handler registered for the node. 404 if there is none.
+class CSPSimulator : public ISyncMLExecutor
+{
+public:
+    typedef std::function<unsigned int(const std::wstring& data)> ExecHandler;
+
+    CSPSimulator();
+
+    void Execute(const std::wstring& requestSyncML, std::wstring& responseSyncML) override;
+
+    // Tree setup
+    void SetNode(const std::wstring& path, const std::wstring& value);
+    void SetInteriorNode(const std::wstring& path);
+    bool TryGetNode(const std::wstring& path, std::wstring& value) const;
+    bool NodeExists(const std::wstring& path) const;
+    void SetExecHandler(const std::wstring& path, ExecHandler handler);
+
+    // Makes every command targeting 'path' fail with 'status'.
+    void FailCommands(const std::wstring& path, unsigned int status);
+    void ClearFailures();
+
+    // Latency added to each round-trip and to each command in it.
+    void SetLatency(std::chrono::microseconds perRoundTrip, std::chrono::microseconds perCommand);
+
+    // Counters
+    unsigned long long RoundTripCount() const;
+    unsigned long long CommandCount() const;
+    unsigned long long CommandCount(const std::wstring& verb) const;
+    void ResetCounters();
+
+private:
+    struct Node
+    {
+        bool interior;
+        std::wstring value;
+    };
+
+    struct Command
+    {
+        std::wstring verb;
+        std::wstring cmdId;
+        std::wstring path;
+        std::wstring data;
+        bool hasData;
+    };
+
+    void EnsureParents(const std::wstring& path);
+    void GetChildren(const std::wstring& path, std::set<std::wstring>& children) const;
+    unsigned int ApplyCommand(const Command& command, std::wstring& results);
+
+    mutable std::recursive_mutex _mutex;
+    std::map<std::wstring, Node> _nodes;
+    std::map<std::wstring, ExecHandler> _execHandlers;
+    std::map<std::wstring, unsigned int> _failures;
+
+    std::chrono::microseconds _roundTripLatency;
+    std::chrono::microseconds _commandLatency;
+
+    unsigned long long _roundTripCount;
+    std::map<std::wstring, unsigned long long> _commandCounts;
+};
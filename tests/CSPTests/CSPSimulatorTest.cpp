@@ -0,0 +1,185 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\MdmProvision.h"
+#include "..\..\src\SystemConfigurator\CSPs\SyncMLBatch.h"
+#include "CSPSimulator.h"
+#include "CSPSimulatorTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+static void EnsureStatus(const SyncMLBatch& batch, size_t index, unsigned int expected, const wchar_t* message)
+{
+    Test::Utils::EnsureEqual(to_wstring(batch.GetResult(index).status), to_wstring(expected), message);
+}
+
+void CSPSimulatorTest::NodeLifetimeTest()
+{
+    TRACE(__FUNCTION__);
+
+    CSPSimulator simulator;
+    const wstring path = L"./Vendor/MSFT/Test/Node";
+
+    SyncMLBatch batch;
+    size_t getMissing = batch.QueueGetString(path);
+    size_t add = batch.QueueAddData(path, wstring(L"one"));
+    size_t addAgain = batch.QueueAddData(path, wstring(L"two"));
+    size_t get = batch.QueueGetString(path);
+    size_t replace = batch.QueueSet(path, wstring(L"three &amp; four"));
+    size_t getReplaced = batch.QueueGetString(path);
+    size_t remove = batch.QueueDelete(path);
+    size_t removeAgain = batch.QueueDelete(path);
+    batch.Execute([&simulator](const wstring& request, wstring& response) { simulator.Execute(request, response); });
+
+    EnsureStatus(batch, getMissing, 404, L"Get of a missing node");
+    EnsureStatus(batch, add, 200, L"Add");
+    EnsureStatus(batch, addAgain, 418, L"Add of an existing node");
+    Test::Utils::EnsureEqual(batch.GetString(get), L"one", L"Get after Add");
+    EnsureStatus(batch, replace, 200, L"Replace");
+    Test::Utils::EnsureEqual(batch.GetString(getReplaced), L"three & four", L"Get after Replace");
+    EnsureStatus(batch, remove, 200, L"Delete");
+    EnsureStatus(batch, removeAgain, 404, L"Delete of a missing node");
+
+    if (simulator.RoundTripCount() != 1 || simulator.CommandCount() != batch.Size())
+    {
+        throw Test::Utils::TestFailureException("Unexpected simulator counters.");
+    }
+}
+
+void CSPSimulatorTest::InteriorNodeTest()
+{
+    TRACE(__FUNCTION__);
+
+    CSPSimulator simulator;
+    simulator.SetNode(L"./Vendor/MSFT/Store/hash1/Value", L"1");
+    simulator.SetNode(L"./Vendor/MSFT/Store/hash2/Value", L"2");
+
+    unsigned int execCount = 0;
+    simulator.SetExecHandler(L"./Vendor/MSFT/Reboot/RebootNow", [&execCount](const wstring&) { ++execCount; return 200u; });
+    simulator.FailCommands(L"./Vendor/MSFT/Broken", 500);
+
+    SyncMLBatch batch;
+    size_t list = batch.QueueGetString(L"./Vendor/MSFT/Store");
+    size_t exec = batch.QueueExec(L"./Vendor/MSFT/Reboot/RebootNow");
+    size_t execMissing = batch.QueueExec(L"./Vendor/MSFT/Reboot/Missing");
+    size_t broken = batch.QueueGetString(L"./Vendor/MSFT/Broken");
+    batch.Execute([&simulator](const wstring& request, wstring& response) { simulator.Execute(request, response); });
+
+    Test::Utils::EnsureEqual(batch.GetString(list), L"hash1/hash2", L"Children of an interior node");
+    EnsureStatus(batch, exec, 200, L"Exec");
+    EnsureStatus(batch, execMissing, 404, L"Exec without a handler");
+    EnsureStatus(batch, broken, 500, L"Injected failure");
+    if (execCount != 1)
+    {
+        throw Test::Utils::TestFailureException("Exec handler was not invoked exactly once.");
+    }
+}
+
+void CSPSimulatorTest::DeleteSubtreeTest()
+{
+    TRACE(__FUNCTION__);
+
+    // '-' and '.' sort before '/', so these siblings sit between ./A/Foo and
+    // its children in the tree.
+    CSPSimulator simulator;
+    simulator.SetNode(L"./A/Foo/Child", L"1");
+    simulator.SetNode(L"./A/Foo-Bar", L"2");
+    simulator.SetNode(L"./A/Foo.x", L"3");
+    simulator.SetNode(L"./A/Fooz", L"4");
+
+    SyncMLBatch batch;
+    size_t remove = batch.QueueDelete(L"./A/Foo");
+    batch.Execute([&simulator](const wstring& request, wstring& response) { simulator.Execute(request, response); });
+
+    EnsureStatus(batch, remove, 200, L"Delete of an interior node");
+    Test::Utils::EnsureEqual(simulator.NodeExists(L"./A/Foo") ? L"true" : L"false", L"false", L"Deleted node");
+    Test::Utils::EnsureEqual(simulator.NodeExists(L"./A/Foo/Child") ? L"true" : L"false", L"false", L"Deleted child");
+    Test::Utils::EnsureEqual(simulator.NodeExists(L"./A/Foo-Bar") ? L"true" : L"false", L"true", L"Sibling with '-'");
+    Test::Utils::EnsureEqual(simulator.NodeExists(L"./A/Foo.x") ? L"true" : L"false", L"true", L"Sibling with '.'");
+    Test::Utils::EnsureEqual(simulator.NodeExists(L"./A/Fooz") ? L"true" : L"false", L"true", L"Sibling after the subtree");
+}
+
+void CSPSimulatorTest::ExecutorInjectionTest()
+{
+    TRACE(__FUNCTION__);
+
+    shared_ptr<CSPSimulator> simulator = make_shared<CSPSimulator>();
+    simulator->SetNode(L"./DevInfo/Man", L"Contoso");
+    simulator->SetNode(L"./Vendor/MSFT/WiFi/Profile/home/WlanXml", L"<xml/>");
+    simulator->SetNode(L"./Vendor/MSFT/WiFi/Profile/work/WlanXml", L"<xml/>");
+
+    MdmProvision::SetExecutor(simulator);
+    try
+    {
+        Test::Utils::EnsureEqual(MdmProvision::RunGetString(L"./DevInfo/Man"), L"Contoso", L"RunGetString through the simulator");
+
+        MdmProvision::RunSet(L"./DevInfo/Man", wstring(L"Fabrikam"));
+        Test::Utils::EnsureEqual(MdmProvision::RunGetString(L"./DevInfo/Man"), L"Fabrikam", L"RunSet through the simulator");
+
+        vector<wstring> profiles;
+        std::function<void(vector<wstring>&, wstring&)> handler = [&profiles](vector<wstring>& uriTokens, wstring&)
+        {
+            if (uriTokens.size() == 6)
+            {
+                profiles.push_back(uriTokens[5]);
+            }
+        };
+        MdmProvision::RunGetStructData(L"./Vendor/MSFT/WiFi/Profile?list=StructData", handler);
+        Test::Utils::EnsureEqual(to_wstring(profiles.size()), L"2", L"RunGetStructData through the simulator");
+
+        MdmProvision::RunDelete(L"./DevInfo/Man");
+        Test::Utils::EnsureException<DMException>("MdmProvision::RunGetString()", []() { MdmProvision::RunGetString(L"./DevInfo/Man"); });
+    }
+    catch (...)
+    {
+        MdmProvision::SetExecutor(nullptr);
+        throw;
+    }
+    MdmProvision::SetExecutor(nullptr);
+}
+
+bool CSPSimulatorTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        NodeLifetimeTest();
+        InteriorNodeTest();
+        DeleteSubtreeTest();
+        ExecutorInjectionTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
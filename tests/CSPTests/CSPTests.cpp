@@ -16,8 +16,27 @@ THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
 #include "stdafx.h"
+#include "Base64Test.h"
+#include "BinaryLogTest.h"
 #include "CertificateManagementTest.h"
+#include "CertificateReconcilerTest.h"
+#include "CSPNodeCacheTest.h"
+#include "CSPSimulatorTest.h"
 #include "DeviceHealthAttestationTest.h"
+#include "EtlExporterTest.h"
+#include "LocalManagementSessionTest.h"
+#include "LogRingTest.h"
+#include "MessageFramingTest.h"
+#include "MpscTaskQueueTest.h"
+#include "ParallelSyncMLExecutorTest.h"
+#include "ProcessRunnerTest.h"
+#include "RequestPipelineTest.h"
+#include "RequestSchedulerTest.h"
+#include "StartupAppIndexTest.h"
+#include "SyncMLBatchTest.h"
+#include "SyncMLResponseTest.h"
+#include "TaskQueueTest.h"
+#include "TpmTokenCacheTest.h"
 #include "WifiManagementTest.h"
 #include "..\..\src\SharedUtilities\Logger.h"
 
@@ -34,18 +53,46 @@ void ShowUsage()
     TRACE("");
     TRACE("On success, the return value is 0.");
     TRACE("");
+    TRACE("CSPTests.exe -benchmark compares TaskQueue and MpscTaskQueue instead of running the tests.");
+    TRACE("");
 }
 
 [Platform::MTAThread]
-int wmain(int, wchar_t *[])
+int wmain(int argc, wchar_t *argv[])
 {
     ShowUsage();
 
     bool result = true;
 
+    if (argc > 1 && _wcsicmp(argv[1], L"-benchmark") == 0)
+    {
+        result = MpscTaskQueueTest::RunBenchmark();
+        gLogger.Flush();
+        return result ? 0 : 1;
+    }
+
     result &= CertificateManagementTest::RunTest();
+    result &= CertificateReconcilerTest::RunTest();
     result &= DeviceHealthAttestationTest::RunTest();
+    result &= EtlExporterTest::RunTest();
     result &= WifiManagementTest::RunTest();
+    result &= SyncMLBatchTest::RunTest();
+    result &= SyncMLResponseTest::RunTest();
+    result &= TaskQueueTest::RunTest();
+    result &= TpmTokenCacheTest::RunTest();
+    result &= CSPSimulatorTest::RunTest();
+    result &= LocalManagementSessionTest::RunTest();
+    result &= CSPNodeCacheTest::RunTest();
+    result &= MessageFramingTest::RunTest();
+    result &= MpscTaskQueueTest::RunTest();
+    result &= ParallelSyncMLExecutorTest::RunTest();
+    result &= ProcessRunnerTest::RunTest();
+    result &= RequestPipelineTest::RunTest();
+    result &= RequestSchedulerTest::RunTest();
+    result &= StartupAppIndexTest::RunTest();
+    result &= LogRingTest::RunTest();
+    result &= BinaryLogTest::RunTest();
+    result &= Base64Test::RunTest();
 
     // Add other tests here.
 
@@ -57,6 +104,7 @@ int wmain(int, wchar_t *[])
     {
         TRACE("Test Failed");
     }
+    gLogger.Flush();
     return result ? 0 : 1;
 }
 
@@ -0,0 +1,267 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\CertificateReconciler.h"
+#include "CertificateReconcilerTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+// A fake file system: each file holds one certificate, and the file named
+// "cert<n>.cer" has thumbprint "AB<n>", in upper case
+// where the store lists thumbprints in lower case.
+class FakeFiles
+{
+public:
+    FakeFiles() : hashed(0), hashDelayMs(0) {}
+
+    static wstring FileName(int n) { return L"cert" + to_wstring(n) + L".cer"; }
+    static wstring ThumbPrint(int n) { return L"AB" + to_wstring(n); }
+
+    void Touch(const wstring& fileName)
+    {
+        lock_guard<mutex> lock(_mutex);
+        ++_writeTimes[fileName];
+    }
+
+    CertificateReconciler::StampFunction Stamp()
+    {
+        return [this](const wstring& fileName, CertificateReconciler::FileStamp& stamp)
+        {
+            if (fileName.find(L"unstamped") != wstring::npos)
+            {
+                return false;
+            }
+            lock_guard<mutex> lock(_mutex);
+            stamp.size = fileName.size();
+            stamp.lastWriteTime = _writeTimes[fileName];
+            return true;
+        };
+    }
+
+    CertificateReconciler::HashFunction Hash()
+    {
+        return [this](const wstring& fileName)
+        {
+            if (hashDelayMs != 0)
+            {
+                this_thread::sleep_for(chrono::milliseconds(hashDelayMs));
+            }
+            if (fileName.find(L"corrupt") != wstring::npos)
+            {
+                throw runtime_error("not a certificate");
+            }
+            ++hashed;
+
+            // "cert<n>.cer" and "unstamped<n>.cer" -> "AB<n>".
+            size_t digits = fileName.find_first_of(L"0123456789");
+            return L"AB" + fileName.substr(digits, fileName.find(L'.') - digits);
+        };
+    }
+
+    atomic<int> hashed;
+    int hashDelayMs;
+
+private:
+    mutex _mutex;
+    map<wstring, unsigned long long> _writeTimes;
+};
+
+static wstring Join(const vector<wstring>& values)
+{
+    wstring joined;
+    for (const wstring& value : values)
+    {
+        joined += value + L";";
+    }
+    return joined;
+}
+
+static wstring JoinAdditions(const vector<CertificateReconciler::Addition>& additions)
+{
+    wstring joined;
+    for (const CertificateReconciler::Addition& addition : additions)
+    {
+        joined += addition.fileName + L"=" + addition.thumbPrint + L";";
+    }
+    return joined;
+}
+
+void CertificateReconcilerTest::DiffTest()
+{
+    TRACE(__FUNCTION__);
+
+    FakeFiles files;
+    CertificateReconciler reconciler(files.Stamp(), files.Hash());
+
+    // The store lists thumbprints in lower case; the files hash to upper case.
+    vector<wstring> current = { L"ab1", L"ab2", L"ab3" };
+    vector<wstring> installs = { FakeFiles::FileName(1), FakeFiles::FileName(4), FakeFiles::FileName(5), FakeFiles::FileName(4) };
+    vector<wstring> uninstalls = { L"AB2", L"ab9", L"Ab2" };
+
+    CertificateReconciler::Plan plan = reconciler.Reconcile(current, installs, uninstalls);
+    Test::Utils::EnsureEqual(JoinAdditions(plan.toAdd), L"cert4.cer=AB4;cert5.cer=AB5;", L"To add");
+    Test::Utils::EnsureEqual(Join(plan.toDelete), L"AB2;", L"To delete");
+
+    // Nothing desired, nothing to do.
+    plan = reconciler.Reconcile(current, vector<wstring>(), vector<wstring>());
+    Test::Utils::EnsureEqual(to_wstring(plan.toAdd.size() + plan.toDelete.size()), L"0", L"Empty plan");
+}
+
+void CertificateReconcilerTest::CacheTest()
+{
+    TRACE(__FUNCTION__);
+
+    FakeFiles files;
+    CertificateReconciler reconciler(files.Stamp(), files.Hash());
+
+    vector<wstring> installs;
+    for (int i = 0; i < 10; ++i)
+    {
+        installs.push_back(FakeFiles::FileName(i));
+    }
+    installs.push_back(L"unstamped1.cer");
+
+    reconciler.Reconcile(vector<wstring>(), installs, vector<wstring>());
+    Test::Utils::EnsureEqual(to_wstring(files.hashed.load()), L"11", L"First sync hashes every file");
+    Test::Utils::EnsureEqual(to_wstring(reconciler.CachedFiles()), L"10", L"Files that can be stamped are cached");
+
+    // Only the file that cannot be stamped is hashed again.
+    CertificateReconciler::Plan plan = reconciler.Reconcile(vector<wstring>(), installs, vector<wstring>());
+    Test::Utils::EnsureEqual(to_wstring(files.hashed.load()), L"12", L"Second sync uses the cache");
+    Test::Utils::EnsureEqual(plan.toAdd[3].thumbPrint, L"AB3", L"Cached thumbprint");
+
+    // A rewritten file is hashed again.
+    files.Touch(FakeFiles::FileName(3));
+    reconciler.Reconcile(vector<wstring>(), installs, vector<wstring>());
+    Test::Utils::EnsureEqual(to_wstring(files.hashed.load()), L"14", L"Changed file hashed again");
+    Test::Utils::EnsureEqual(to_wstring(reconciler.FilesHashed()), L"14", L"Files hashed");
+}
+
+void CertificateReconcilerTest::ParallelTest()
+{
+    TRACE(__FUNCTION__);
+
+    // 16 files taking 20 ms each to hash: about 80 ms on 4 workers, 320 serially.
+    FakeFiles files;
+    files.hashDelayMs = 20;
+    CertificateReconciler reconciler(files.Stamp(), files.Hash(), 4);
+
+    vector<wstring> installs;
+    for (int i = 0; i < 16; ++i)
+    {
+        installs.push_back(FakeFiles::FileName(i));
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CertificateReconciler::Plan plan = reconciler.Reconcile(vector<wstring>(), installs, vector<wstring>());
+    long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    TRACEP(L"Hashed 16 files (ms): ", elapsedMs);
+    Test::Utils::EnsureEqual(elapsedMs < 240 ? L"true" : L"false", L"true", L"Files hashed in parallel");
+
+    // Results come back in the order the files were given.
+    for (int i = 0; i < 16; ++i)
+    {
+        Test::Utils::EnsureEqual(plan.toAdd[i].thumbPrint, FakeFiles::ThumbPrint(i), L"Thumbprint order");
+    }
+}
+
+void CertificateReconcilerTest::FailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    FakeFiles files;
+    CertificateReconciler reconciler(files.Stamp(), files.Hash());
+
+    vector<wstring> installs = { FakeFiles::FileName(1), L"corrupt.cer", FakeFiles::FileName(2) };
+    Test::Utils::EnsureException<runtime_error>(L"Reconcile", [&]()
+    {
+        reconciler.Reconcile(vector<wstring>(), installs, vector<wstring>());
+    });
+
+    // The files that did hash are still cached.
+    Test::Utils::EnsureEqual(to_wstring(reconciler.CachedFiles()), L"2", L"Cached after a failure");
+}
+
+void CertificateReconcilerTest::ScaleTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A store of 1000 certificates, half of them desired, synced repeatedly.
+    const int count = 1000;
+    FakeFiles files;
+    CertificateReconciler reconciler(files.Stamp(), files.Hash());
+
+    vector<wstring> current;
+    vector<wstring> installs;
+    vector<wstring> uninstalls;
+    for (int i = 0; i < count; ++i)
+    {
+        current.push_back(CertificateReconciler::Normalize(FakeFiles::ThumbPrint(i)));
+        installs.push_back(FakeFiles::FileName(i + count / 2));
+        uninstalls.push_back(FakeFiles::ThumbPrint(i * 2));
+    }
+
+    reconciler.Reconcile(current, installs, uninstalls);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    CertificateReconciler::Plan plan = reconciler.Reconcile(current, installs, uninstalls);
+    long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    TRACEP(L"Cached sync of 1000 certificates (ms): ", elapsedMs);
+    Test::Utils::EnsureEqual(to_wstring(files.hashed.load()), to_wstring(count), L"Hashed once");
+    Test::Utils::EnsureEqual(to_wstring(plan.toAdd.size()), to_wstring(count / 2), L"To add");
+    Test::Utils::EnsureEqual(to_wstring(plan.toDelete.size()), to_wstring(count / 2), L"To delete");
+}
+
+bool CertificateReconcilerTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        DiffTest();
+        CacheTest();
+        ParallelTest();
+        FailureTest();
+        ScaleTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,178 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\EtlExporter.h"
+#include "EtlExporterTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+// A fake block channel: block i is "<i>:" followed by filler, and "decoding"
+// narrows it to chars, so the exported file is easy to predict.
+static wstring FakeBlock(int blockIndex)
+{
+    return to_wstring(blockIndex) + L":" + wstring(100, L'a' + blockIndex % 26);
+}
+
+static void FakeDecode(const wstring& encoded, vector<char>& decoded)
+{
+    decoded.assign(encoded.begin(), encoded.end());
+}
+
+void EtlExporterTest::ContentTest()
+{
+    TRACE(__FUNCTION__);
+
+    const int blockCount = 50;
+    EtlExporter exporter(FakeBlock, FakeDecode);
+
+    string file;
+    int progressCalls = 0;
+    EtlExporter::Progress progress = exporter.Export(blockCount,
+        [&file](const vector<char>& block) { file.append(block.begin(), block.end()); },
+        [&progressCalls](const EtlExporter::Progress& p) { Test::Utils::EnsureEqual(to_wstring(p.blocksWritten), to_wstring(++progressCalls), L"Progress"); });
+
+    wstring expected;
+    for (int i = 0; i < blockCount; ++i)
+    {
+        expected += FakeBlock(i);
+    }
+    Test::Utils::EnsureEqual(wstring(file.begin(), file.end()), expected, L"Exported file");
+    Test::Utils::EnsureEqual(to_wstring(progressCalls), to_wstring(blockCount), L"Progress calls");
+    Test::Utils::EnsureEqual(to_wstring(progress.bytesWritten), to_wstring(expected.size()), L"Bytes written");
+
+    // An empty channel exports nothing.
+    progress = exporter.Export(0, [](const vector<char>&) { throw runtime_error("unexpected write"); });
+    Test::Utils::EnsureEqual(to_wstring(progress.bytesWritten), L"0", L"Empty export");
+}
+
+void EtlExporterTest::BoundedTest()
+{
+    TRACE(__FUNCTION__);
+
+    // With a slow writer, reading stays a bounded distance ahead of writing.
+    const size_t readAhead = 2;
+    atomic<int> read(0);
+    int maxAhead = 0;
+    EtlExporter exporter([&read](int blockIndex) { ++read; return FakeBlock(blockIndex); }, FakeDecode, readAhead);
+
+    int written = 0;
+    exporter.Export(30, [&](const vector<char>&)
+    {
+        this_thread::sleep_for(chrono::milliseconds(5));
+        ++written;
+        maxAhead = (max)(maxAhead, read.load() - written);
+    });
+
+    // Queued blocks, plus the one the reader holds while it waits for room.
+    TRACEP(L"Most blocks read ahead of the writer: ", maxAhead);
+    Test::Utils::EnsureEqual(maxAhead <= static_cast<int>(readAhead) + 1 ? L"true" : L"false", L"true", L"Read-ahead bounded");
+}
+
+void EtlExporterTest::OverlapTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Reading and writing take 20 ms a block each; overlapped, 10 blocks take
+    // about 220 ms rather than 400.
+    EtlExporter exporter([](int blockIndex)
+    {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        return FakeBlock(blockIndex);
+    }, FakeDecode);
+
+    EtlExporter::Progress progress = exporter.Export(10, [](const vector<char>&)
+    {
+        this_thread::sleep_for(chrono::milliseconds(20));
+    });
+
+    long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(progress.elapsed).count();
+    TRACEP(L"Overlapped export (ms): ", elapsedMs);
+    TRACEP(L"Throughput (bytes/s): ", progress.BytesPerSecond());
+    Test::Utils::EnsureEqual(elapsedMs < 340 ? L"true" : L"false", L"true", L"Reads overlap writes");
+}
+
+void EtlExporterTest::FailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A failed read stops the export after the blocks before it are written.
+    {
+        EtlExporter exporter([](int blockIndex) -> wstring
+        {
+            if (blockIndex == 5)
+            {
+                throw runtime_error("read failed");
+            }
+            return FakeBlock(blockIndex);
+        }, FakeDecode);
+
+        int written = 0;
+        Test::Utils::EnsureException<runtime_error>(L"Export", [&]()
+        {
+            exporter.Export(20, [&written](const vector<char>&) { ++written; });
+        });
+        Test::Utils::EnsureEqual(to_wstring(written), L"5", L"Blocks before the failed read");
+    }
+
+    // A failed write stops the reader.
+    {
+        atomic<int> read(0);
+        EtlExporter exporter([&read](int blockIndex) { ++read; return FakeBlock(blockIndex); }, FakeDecode, 2);
+
+        Test::Utils::EnsureException<runtime_error>(L"Export", [&]()
+        {
+            exporter.Export(1000, [](const vector<char>&) { throw runtime_error("disk full"); });
+        });
+        Test::Utils::EnsureEqual(read.load() <= 4 ? L"true" : L"false", L"true", L"Reader stopped");
+    }
+}
+
+bool EtlExporterTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        ContentTest();
+        BoundedTest();
+        OverlapTest();
+        FailureTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
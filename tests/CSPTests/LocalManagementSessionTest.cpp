@@ -0,0 +1,224 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\LocalManagementSession.h"
+#include "LocalManagementSessionTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+// Stands in for RegisterDeviceWithLocalManagement()/ApplyLocalManagementSyncML().
+// Applying fails while the stub is not registered, like the real stack does
+// after the registration is lost.
+class LocalManagementStub
+{
+public:
+    LocalManagementStub() :
+        registered(false),
+        registerResult(S_OK),
+        applyResult(S_OK),
+        partial(false),
+        registerCalls(0),
+        applyCalls(0)
+    {}
+
+    LocalManagementSession::RegisterFunction Register()
+    {
+        return [this]()
+        {
+            ++registerCalls;
+            registered = SUCCEEDED(registerResult);
+            return registerResult;
+        };
+    }
+
+    LocalManagementSession::ApplyFunction Apply()
+    {
+        return [this](const wstring& requestSyncML, wstring& outputSyncML)
+        {
+            ++applyCalls;
+            if (!registered)
+            {
+                return E_ACCESSDENIED;
+            }
+            // A failed request only produces a response if part of it ran.
+            if (SUCCEEDED(applyResult) || partial)
+            {
+                outputSyncML = requestSyncML;
+            }
+            return applyResult;
+        };
+    }
+
+    bool registered;
+    HRESULT registerResult;
+    HRESULT applyResult;
+    bool partial;
+    unsigned int registerCalls;
+    unsigned int applyCalls;
+};
+
+void LocalManagementSessionTest::RegisterOnceTest()
+{
+    TRACE(__FUNCTION__);
+
+    LocalManagementStub stub;
+    LocalManagementSession session(stub.Register(), stub.Apply());
+
+    const unsigned int requestCount = 100;
+    for (unsigned int i = 0; i < requestCount; ++i)
+    {
+        wstring output;
+        session.Apply(L"<SyncBody/>", output);
+        Test::Utils::EnsureEqual(output, L"<SyncBody/>", L"Unexpected output");
+    }
+
+    Test::Utils::EnsureEqual(to_wstring(session.RegistrationCount()), L"1", L"Registration count");
+    Test::Utils::EnsureEqual(to_wstring(session.ApplyCount()), to_wstring(requestCount), L"Apply count");
+    Test::Utils::EnsureEqual(to_wstring(stub.registerCalls), L"1", L"Calls to the register stub");
+}
+
+void LocalManagementSessionTest::RegistrationFailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    LocalManagementStub stub;
+    LocalManagementSession session(stub.Register(), stub.Apply());
+
+    // A failed registration is not cached...
+    stub.registerResult = E_FAIL;
+    Test::Utils::EnsureException<DMExceptionWithErrorCode>("LocalManagementSession::Apply()", [&session]()
+    {
+        wstring output;
+        session.Apply(L"<SyncBody/>", output);
+    });
+    if (session.IsRegistered() || stub.applyCalls != 0)
+    {
+        throw Test::Utils::TestFailureException("Apply must not be attempted without a registration.");
+    }
+
+    // ...so the next request tries again.
+    stub.registerResult = S_OK;
+    wstring output;
+    session.Apply(L"<SyncBody/>", output);
+    Test::Utils::EnsureEqual(to_wstring(session.RegistrationCount()), L"2", L"Registration count after a failed registration");
+}
+
+void LocalManagementSessionTest::LostRegistrationTest()
+{
+    TRACE(__FUNCTION__);
+
+    LocalManagementStub stub;
+    LocalManagementSession session(stub.Register(), stub.Apply());
+
+    wstring output;
+    session.Apply(L"<SyncBody/>", output);
+
+    // The stack drops the registration; the session re-registers and retries.
+    stub.registered = false;
+    session.Apply(L"<SyncBody/>", output);
+    Test::Utils::EnsureEqual(output, L"<SyncBody/>", L"Unexpected output after re-registration");
+    Test::Utils::EnsureEqual(to_wstring(session.RegistrationCount()), L"2", L"Registration count after a lost registration");
+    Test::Utils::EnsureEqual(to_wstring(session.ApplyCount()), L"3", L"Apply count after a lost registration");
+
+    // If the retry is refused too, the error is reported.
+    stub.applyResult = E_ACCESSDENIED;
+    unsigned int applyCalls = stub.applyCalls;
+    Test::Utils::EnsureException<DMExceptionWithErrorCode>("LocalManagementSession::Apply()", [&session]()
+    {
+        wstring output;
+        session.Apply(L"<SyncBody/>", output);
+    });
+    Test::Utils::EnsureEqual(to_wstring(stub.applyCalls - applyCalls), L"2", L"Applies of a refused request");
+}
+
+void LocalManagementSessionTest::GenericFailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    LocalManagementStub stub;
+    LocalManagementSession session(stub.Register(), stub.Apply());
+
+    wstring output;
+    session.Apply(L"<SyncBody/>", output);
+
+    // A failure that does not mean the registration was lost may come from a
+    // request that ran in part; it is reported without applying it again.
+    stub.applyResult = E_FAIL;
+    Test::Utils::EnsureException<DMExceptionWithErrorCode>("LocalManagementSession::Apply()", [&session]()
+    {
+        wstring output;
+        session.Apply(L"<Exec>RebootNow</Exec>", output);
+    });
+    Test::Utils::EnsureEqual(to_wstring(stub.applyCalls), L"2", L"Calls to the apply stub");
+    Test::Utils::EnsureEqual(to_wstring(stub.registerCalls), L"1", L"Calls to the register stub");
+    Test::Utils::EnsureEqual(session.IsRegistered() ? L"true" : L"false", L"true", L"Registration kept");
+}
+
+void LocalManagementSessionTest::PartialApplyTest()
+{
+    TRACE(__FUNCTION__);
+
+    LocalManagementStub stub;
+    LocalManagementSession session(stub.Register(), stub.Apply());
+
+    wstring output;
+    session.Apply(L"<SyncBody/>", output);
+
+    // A CSP denies a command after the ones before it have run. The error is
+    // the one a lost registration produces, but the request is not retried.
+    stub.applyResult = E_ACCESSDENIED;
+    stub.partial = true;
+    Test::Utils::EnsureException<DMExceptionWithErrorCode>("LocalManagementSession::Apply()", [&session]()
+    {
+        wstring output;
+        session.Apply(L"<Exec>RebootNow</Exec><Replace>Denied</Replace>", output);
+    });
+    Test::Utils::EnsureEqual(to_wstring(stub.applyCalls), L"2", L"Calls to the apply stub");
+    Test::Utils::EnsureEqual(to_wstring(stub.registerCalls), L"1", L"Calls to the register stub");
+    Test::Utils::EnsureEqual(session.IsRegistered() ? L"true" : L"false", L"true", L"Registration kept");
+}
+
+bool LocalManagementSessionTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        RegisterOnceTest();
+        RegistrationFailureTest();
+        LostRegistrationTest();
+        GenericFailureTest();
+        PartialApplyTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
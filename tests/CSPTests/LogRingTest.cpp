@@ -0,0 +1,169 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <thread>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\LogRing.h"
+#include "LogRingTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+static void Push(LogRing& ring, const wstring& text, uint64_t time)
+{
+    ring.Push(ETWLogger::LoggingLevel::Information, text.c_str(), text.size(), time, 7);
+}
+
+void LogRingTest::OrderTest()
+{
+    TRACE(__FUNCTION__);
+
+    LogRing ring;
+    wstring longText(LogRing::InlineChars * 3, L'x');
+
+    Push(ring, L"first", 1);
+    Push(ring, L"", 2);
+    Push(ring, longText, 3);
+
+    // A string parameter is appended when the record is copied, inline or
+    // on the heap; an integer is kept as a value.
+    wstring param(L"param");
+    LogArg stringArg = { LogArgType::String, 0, param.c_str(), param.size() };
+    LogArg longArg = { LogArgType::String, 0, longText.c_str(), longText.size() };
+    LogArg intArg = { LogArgType::Int, static_cast<uint64_t>(-42), nullptr, 0 };
+    ring.Push(ETWLogger::LoggingLevel::Verbose, L"message ", 8, stringArg, 4, 7);
+    ring.Push(ETWLogger::LoggingLevel::Verbose, L"message ", 8, longArg, 5, 7);
+    ring.Push(ETWLogger::LoggingLevel::Verbose, L"number ", 7, intArg, 6, 7);
+
+    LogEntry entry;
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? entry.text : L"<empty>", L"first", L"First record");
+    Test::Utils::EnsureEqual(to_wstring(entry.time), L"1", L"First record time");
+    Test::Utils::EnsureEqual(to_wstring(entry.threadId), L"7", L"First record thread");
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? entry.text : L"<empty>", L"", L"Empty record");
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? entry.text : L"<empty>", longText, L"Long record");
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? entry.text : L"<empty>", L"message param", L"Record with parameter");
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? entry.text : L"<empty>", L"message " + longText, L"Long record with parameter");
+    Test::Utils::EnsureEqual(to_wstring(entry.formatLength), L"8", L"Format length");
+    wstring formatted;
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? entry.text : L"<empty>", L"number ", L"Record with integer");
+    entry.AppendText(formatted);
+    Test::Utils::EnsureEqual(formatted, L"number -42", L"Formatted integer");
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? L"true" : L"false", L"false", L"Ring drained");
+    Test::Utils::EnsureEqual(to_wstring(ring.DroppedCount()), L"0", L"Dropped count");
+}
+
+void LogRingTest::DropOldestTest()
+{
+    TRACE(__FUNCTION__);
+
+    LogRing ring;
+    const size_t extra = 10;
+    wstring longText(LogRing::InlineChars, L'y');
+
+    // Mix in heap-allocated records so dropping them is covered too.
+    for (size_t i = 0; i < LogRing::Capacity + extra; ++i)
+    {
+        Push(ring, i % 2 ? longText + to_wstring(i) : to_wstring(i), i);
+    }
+    Test::Utils::EnsureEqual(to_wstring(ring.DroppedCount()), to_wstring(extra), L"Dropped count");
+
+    // The oldest records are gone; the newest are all there, in order.
+    LogEntry entry;
+    for (size_t i = extra; i < LogRing::Capacity + extra; ++i)
+    {
+        Test::Utils::EnsureEqual(ring.Pop(entry) ? to_wstring(entry.time) : L"<empty>", to_wstring(i), L"Record after overflow");
+    }
+    Test::Utils::EnsureEqual(ring.Pop(entry) ? L"true" : L"false", L"false", L"Ring drained");
+
+    // Records left in the ring are released with it.
+    Push(ring, longText, 0);
+}
+
+void LogRingTest::ConcurrentTest()
+{
+    TRACE(__FUNCTION__);
+
+    LogRing ring;
+    const uint64_t count = 200000;
+
+    thread writer([&ring, count]()
+    {
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            wstring text = to_wstring(i);
+            ring.Push(ETWLogger::LoggingLevel::Verbose, text.c_str(), text.size(), i, 1);
+        }
+    });
+
+    // Every record is either read intact and in order, or counted as dropped.
+    uint64_t read = 0;
+    uint64_t last = 0;
+    bool writerDone = false;
+    LogEntry entry;
+    for (;;)
+    {
+        if (ring.Pop(entry))
+        {
+            if (read != 0 && entry.time <= last)
+            {
+                throw Test::Utils::TestFailureException(L"Records read out of order");
+            }
+            Test::Utils::EnsureEqual(entry.text, to_wstring(entry.time), L"Record text");
+            last = entry.time;
+            ++read;
+        }
+        else if (writerDone)
+        {
+            break;
+        }
+        else if (read + ring.DroppedCount() == count)
+        {
+            writer.join();
+            writerDone = true;
+        }
+    }
+
+    Test::Utils::EnsureEqual(to_wstring(read + ring.DroppedCount()), to_wstring(count), L"Records read or dropped");
+}
+
+bool LogRingTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        OrderTest();
+        DropOldestTest();
+        ConcurrentTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,243 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstring>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\BufferPool.h"
+#include "..\..\src\SharedUtilities\MessageFraming.h"
+#include "MessageFramingTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+// Stands in for a pipe: bytes written come back out in order, and reads can
+// be capped to simulate a transport that returns less than was asked for.
+class PipeStub
+{
+public:
+    PipeStub() :
+        maxRead(0),
+        writeCalls(0),
+        flushCalls(0)
+    {}
+
+    MessageFraming::ReadFunction Read()
+    {
+        return [this](void* buffer, size_t size) -> size_t
+        {
+            size_t count = (min)(size, bytes.size());
+            if (maxRead != 0)
+            {
+                count = (min)(count, maxRead);
+            }
+            copy(bytes.begin(), bytes.begin() + count, static_cast<uint8_t*>(buffer));
+            bytes.erase(bytes.begin(), bytes.begin() + count);
+            return count;
+        };
+    }
+
+    MessageFraming::WriteFunction Write()
+    {
+        return [this](const MessageFraming::Chunk* chunks, size_t count)
+        {
+            ++writeCalls;
+            for (size_t i = 0; i < count; ++i)
+            {
+                const uint8_t* data = static_cast<const uint8_t*>(chunks[i].data);
+                bytes.insert(bytes.end(), data, data + chunks[i].size);
+            }
+        };
+    }
+
+    MessageFraming::FlushFunction Flush()
+    {
+        return [this]() { ++flushCalls; };
+    }
+
+    deque<uint8_t> bytes;
+    size_t maxRead;
+    unsigned int writeCalls;
+    unsigned int flushCalls;
+};
+
+static vector<uint8_t> MakePayload(size_t size, uint8_t seed)
+{
+    vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; ++i)
+    {
+        payload[i] = static_cast<uint8_t>(seed + i * 7);
+    }
+    return payload;
+}
+
+static void EnsureFrame(const BufferPool::Lease& frame, const vector<uint8_t>& expected, const wchar_t* message)
+{
+    Test::Utils::EnsureEqual(to_wstring(frame->size), to_wstring(expected.size()), message);
+    if (!expected.empty() && memcmp(frame->data, expected.data(), expected.size()) != 0)
+    {
+        throw Test::Utils::TestFailureException(message);
+    }
+}
+
+void MessageFramingTest::RoundTripTest()
+{
+    TRACE(__FUNCTION__);
+
+    PipeStub pipe;
+    MessageFraming framing(pipe.Read(), pipe.Write(), BufferPool::Create(), pipe.Flush());
+
+    vector<vector<uint8_t>> payloads = { MakePayload(0, 1), MakePayload(10, 2), MakePayload(5000, 3), MakePayload(300000, 4), MakePayload(1, 5) };
+    for (const auto& payload : payloads)
+    {
+        framing.WriteFrame(payload.data(), payload.size());
+    }
+
+    // One gathered write per frame, and no flush unless asked for.
+    Test::Utils::EnsureEqual(to_wstring(pipe.writeCalls), to_wstring(payloads.size()), L"Write calls");
+    Test::Utils::EnsureEqual(to_wstring(pipe.flushCalls), L"0", L"Implicit flushes");
+
+    // Short reads must not matter.
+    pipe.maxRead = 1000;
+    for (const auto& payload : payloads)
+    {
+        EnsureFrame(framing.ReadFrame(), payload, L"Round-tripped frame");
+    }
+    Test::Utils::EnsureEqual(to_wstring(pipe.bytes.size()), L"0", L"Bytes left in the pipe");
+
+    framing.Flush();
+    Test::Utils::EnsureEqual(to_wstring(pipe.flushCalls), L"1", L"Explicit flushes");
+}
+
+void MessageFramingTest::ReadAheadTest()
+{
+    TRACE(__FUNCTION__);
+
+    PipeStub pipe;
+    MessageFraming framing(pipe.Read(), pipe.Write(), BufferPool::Create());
+
+    auto small = MakePayload(100, 7);
+    for (int i = 0; i < 10; ++i)
+    {
+        framing.WriteFrame(small.data(), small.size());
+    }
+
+    // Ten 104-byte frames fit in the read-ahead buffer: one read call for all of them.
+    for (int i = 0; i < 10; ++i)
+    {
+        EnsureFrame(framing.ReadFrame(), small, L"Small frame");
+    }
+    Test::Utils::EnsureEqual(to_wstring(framing.ReadCallCount()), L"1", L"Read calls for small frames");
+
+    // A large payload is read straight into its buffer after the buffered part.
+    auto large = MakePayload(200000, 9);
+    framing.WriteFrame(large.data(), large.size());
+    EnsureFrame(framing.ReadFrame(), large, L"Large frame");
+    Test::Utils::EnsureEqual(to_wstring(framing.ReadCallCount()), L"3", L"Read calls for a large frame");
+}
+
+void MessageFramingTest::PoolReuseTest()
+{
+    TRACE(__FUNCTION__);
+
+    auto pool = BufferPool::Create(2);
+
+    {
+        auto a = pool->Acquire(300);
+        auto b = pool->Acquire(500);
+        Test::Utils::EnsureEqual(to_wstring(a->capacity), L"512", L"Size class");
+        Test::Utils::EnsureEqual(to_wstring(b->capacity), L"512", L"Size class");
+    }
+    Test::Utils::EnsureEqual(to_wstring(pool->FreeCount()), L"2", L"Buffers returned to the pool");
+
+    PipeStub pipe;
+    MessageFraming framing(pipe.Read(), pipe.Write(), pool);
+    auto payload = MakePayload(400, 3);
+    for (int i = 0; i < 100; ++i)
+    {
+        framing.WriteFrame(payload.data(), payload.size());
+        EnsureFrame(framing.ReadFrame(), payload, L"Pooled frame");
+    }
+
+    // Two 512-byte buffers from above plus the read-ahead buffer; every frame reused one.
+    Test::Utils::EnsureEqual(to_wstring(pool->AllocationCount()), L"3", L"Allocations");
+    Test::Utils::EnsureEqual(to_wstring(pool->ReuseCount()), L"100", L"Reuses");
+
+    // Oversized buffers are not pooled, and leases can outlive the pool.
+    BufferPool::Lease orphan = pool->Acquire(BufferPool::MaxClassSize + 1);
+    pool.reset();
+    orphan.reset();
+}
+
+void MessageFramingTest::MalformedStreamTest()
+{
+    TRACE(__FUNCTION__);
+
+    {
+        PipeStub pipe;
+        MessageFraming framing(pipe.Read(), pipe.Write(), BufferPool::Create());
+        auto payload = MakePayload(50, 1);
+        framing.WriteFrame(payload.data(), payload.size());
+        pipe.bytes.resize(pipe.bytes.size() - 1);
+        Test::Utils::EnsureException<DMException>(L"ReadFrame", [&]() { framing.ReadFrame(); });
+    }
+
+    {
+        PipeStub pipe;
+        MessageFraming framing(pipe.Read(), pipe.Write(), BufferPool::Create());
+        uint32_t bogus = MessageFraming::MaxFrameSize + 1;
+        MessageFraming::Chunk chunk = { &bogus, sizeof(bogus) };
+        pipe.Write()(&chunk, 1);
+        Test::Utils::EnsureException<DMException>(L"ReadFrame", [&]() { framing.ReadFrame(); });
+    }
+
+    {
+        PipeStub pipe;
+        MessageFraming framing(pipe.Read(), pipe.Write(), BufferPool::Create());
+        Test::Utils::EnsureException<DMException>(L"ReadFrame", [&]() { framing.ReadFrame(); });
+    }
+}
+
+bool MessageFramingTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        RoundTripTest();
+        ReadAheadTest();
+        PoolReuseTest();
+        MalformedStreamTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
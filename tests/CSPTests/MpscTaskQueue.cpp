@@ -0,0 +1,299 @@
+#include "stdafx.h"
+#include "..\..\src\SharedUtilities\Logger.h"
+#include "MpscTaskQueue.h"
+
+using namespace std;
+
+const uint32_t MpscTaskQueue::DefaultPoolSize;
+const uint32_t MpscTaskQueue::NotPooled;
+
+// The free stack packs a tag (high 32 bits) and the top slot's index + 1
+// (low 32 bits, 0 when empty). The tag changes on every update, so a pop
+// that raced with a pop and a push of the same slot fails its exchange.
+static uint32_t FreeTop(uint64_t free) { return static_cast<uint32_t>(free); }
+static uint64_t FreeWithTop(uint64_t free, uint32_t top) { return (((free >> 32) + 1) << 32) | top; }
+
+MpscTaskQueue::MpscTaskQueue(uint32_t poolSize) :
+    _pool(new Node[poolSize]),
+    _poolSize(poolSize),
+    _free(poolSize == 0 ? 0 : 1),
+    _depth(0),
+    _parked(false),
+    _shutdown(false),
+    _dropPending(false),
+    _peakDepth(0),
+    _completed(0),
+    _expired(0),
+    _rejected(0),
+    _totalWait(0),
+    _totalRun(0)
+{
+    for (uint32_t i = 0; i < poolSize; ++i)
+    {
+        _pool[i].index = i;
+        _pool[i].nextFree.store(i + 1 < poolSize ? i + 2 : 0, memory_order_relaxed);
+    }
+
+    for (auto& list : _lists)
+    {
+        list.stub.next.store(nullptr, memory_order_relaxed);
+        list.stub.index = NotPooled;
+        list.head.store(&list.stub, memory_order_relaxed);
+        list.tail = &list.stub;
+    }
+    for (auto& depth : _depthByPriority)
+    {
+        depth.store(0, memory_order_relaxed);
+    }
+}
+
+MpscTaskQueue::~MpscTaskQueue()
+{
+    DropAll();
+}
+
+future<wstring> MpscTaskQueue::Enqueue(Task task, Priority priority, Clock::time_point deadline)
+{
+    future<wstring> response = task.get_future();
+
+    if (_shutdown.load())
+    {
+        // The task is destroyed unrun; its future reports a broken promise.
+        ++_rejected;
+        return response;
+    }
+
+    Node* node = Allocate();
+    node->task = move(task);
+    node->enqueued = Clock::now();
+    node->deadline = deadline;
+
+    // Counted before the push: a consumer that sees a non-zero depth waits
+    // for the node rather than parking.
+    size_t depth = ++_depth;
+    ++_depthByPriority[priority];
+    Push(_lists[priority], node);
+
+    size_t peak = _peakDepth.load(memory_order_relaxed);
+    while (depth > peak && !_peakDepth.compare_exchange_weak(peak, depth, memory_order_relaxed))
+    {
+    }
+
+    if (_parked.load() && _parked.exchange(false))
+    {
+        lock_guard<mutex> l(_parkMutex);
+        _parkCv.notify_one();
+    }
+    return response;
+}
+
+bool MpscTaskQueue::Dequeue(Task& task)
+{
+    for (;;)
+    {
+        if (_dropPending.load())
+        {
+            DropAll();
+            return false;
+        }
+
+        Node* node = TakeNext();
+        if (node != nullptr)
+        {
+            Clock::time_point now = Clock::now();
+            if (node->deadline < now)
+            {
+                TRACE("Task expired before it could run. Dropping it.");
+                ++_expired;
+                Release(node);
+                continue;
+            }
+
+            _totalWait += (now - node->enqueued).count();
+            task = move(node->task);
+            Release(node);
+            return true;
+        }
+
+        if (_depth.load() != 0)
+        {
+            // A producer has counted its task but not linked it in yet.
+            this_thread::yield();
+            continue;
+        }
+
+        unique_lock<mutex> l(_parkMutex);
+        if (_shutdown.load())
+        {
+            if (_depth.load() == 0)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        _parked.store(true);
+        if (_depth.load() == 0)
+        {
+            _parkCv.wait(l, [this]() { return !_parked.load() || _shutdown.load(); });
+        }
+        _parked.store(false);
+    }
+}
+
+bool MpscTaskQueue::RunOne()
+{
+    Task task;
+    if (!Dequeue(task))
+    {
+        return false;
+    }
+
+    Clock::time_point start = Clock::now();
+    task();
+    _totalRun += (Clock::now() - start).count();
+    ++_completed;
+    return true;
+}
+
+void MpscTaskQueue::Shutdown(bool dropPending)
+{
+    TRACE(__FUNCTION__);
+
+    if (dropPending)
+    {
+        _dropPending.store(true);
+    }
+    _shutdown.store(true);
+
+    lock_guard<mutex> l(_parkMutex);
+    _parkCv.notify_all();
+}
+
+MpscTaskQueue::Metrics MpscTaskQueue::GetMetrics() const
+{
+    Metrics metrics;
+    metrics.depth = _depth.load();
+    metrics.peakDepth = _peakDepth.load();
+    for (int i = 0; i < TaskQueue::PriorityCount; ++i)
+    {
+        metrics.depthByPriority[i] = _depthByPriority[i].load();
+    }
+    metrics.completed = _completed.load();
+    metrics.expired = _expired.load();
+    metrics.rejected = _rejected.load();
+    metrics.totalWait = Clock::duration(_totalWait.load());
+    metrics.totalRun = Clock::duration(_totalRun.load());
+    return metrics;
+}
+
+MpscTaskQueue::Node* MpscTaskQueue::Allocate()
+{
+    uint64_t free = _free.load(memory_order_acquire);
+    for (;;)
+    {
+        uint32_t top = FreeTop(free);
+        if (top == 0)
+        {
+            // The pool is exhausted; fall back to the heap.
+            Node* node = new Node();
+            node->index = NotPooled;
+            return node;
+        }
+
+        Node* node = &_pool[top - 1];
+        uint32_t next = node->nextFree.load(memory_order_relaxed);
+        if (_free.compare_exchange_weak(free, FreeWithTop(free, next), memory_order_acquire, memory_order_acquire))
+        {
+            return node;
+        }
+    }
+}
+
+void MpscTaskQueue::Release(Node* node)
+{
+    // Drops the shared state of a task that did not run.
+    node->task = Task();
+
+    if (node->index == NotPooled)
+    {
+        delete node;
+        return;
+    }
+
+    uint64_t free = _free.load(memory_order_relaxed);
+    do
+    {
+        node->nextFree.store(FreeTop(free), memory_order_relaxed);
+    } while (!_free.compare_exchange_weak(free, FreeWithTop(free, node->index + 1), memory_order_release, memory_order_relaxed));
+}
+
+void MpscTaskQueue::Push(List& list, Node* node)
+{
+    node->next.store(nullptr, memory_order_relaxed);
+    Node* previous = list.head.exchange(node, memory_order_acq_rel);
+    previous->next.store(node, memory_order_release);
+}
+
+MpscTaskQueue::Node* MpscTaskQueue::Pop(List& list)
+{
+    Node* tail = list.tail;
+    Node* next = tail->next.load(memory_order_acquire);
+    if (tail == &list.stub)
+    {
+        if (next == nullptr)
+        {
+            return nullptr;
+        }
+        list.tail = next;
+        tail = next;
+        next = next->next.load(memory_order_acquire);
+    }
+
+    if (next != nullptr)
+    {
+        list.tail = next;
+        return tail;
+    }
+
+    // tail is the last node. Unless a producer is mid-push, put the stub
+    // behind it so tail can be handed out.
+    if (tail != list.head.load(memory_order_acquire))
+    {
+        return nullptr;
+    }
+    Push(list, &list.stub);
+
+    next = tail->next.load(memory_order_acquire);
+    if (next != nullptr)
+    {
+        list.tail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+MpscTaskQueue::Node* MpscTaskQueue::TakeNext()
+{
+    for (int i = 0; i < TaskQueue::PriorityCount; ++i)
+    {
+        Node* node = Pop(_lists[i]);
+        if (node != nullptr)
+        {
+            --_depthByPriority[i];
+            --_depth;
+            return node;
+        }
+    }
+    return nullptr;
+}
+
+void MpscTaskQueue::DropAll()
+{
+    Node* node;
+    while ((node = TakeNext()) != nullptr)
+    {
+        ++_rejected;
+        Release(node);
+    }
+}
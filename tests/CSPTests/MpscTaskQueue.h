@@ -0,0 +1,104 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <condition_variable>
+#include "..\..\src\SystemConfigurator\TaskQueue.h"
+
+// A TaskQueue for any number of producers and exactly one consumer.
+//
+// Enqueue does not lock: each priority class is an intrusive linked list
+// that producers append to with a single atomic exchange, and queue nodes
+// come from a preallocated pool. The consumer takes a lock only to park
+// when there is nothing to run, and producers take it only to wake a
+// parked consumer.
+//
+// Only one thread may call Dequeue or RunOne. The other members are safe to
+// call from any thread. A task enqueued while Shutdown runs may be dropped
+// instead of rejected; either way its future reports a broken promise.
+//
+// The service uses TaskQueue. This queue is kept with the tests so that
+// MpscTaskQueueTest can measure it against TaskQueue.
+class MpscTaskQueue
+{
+public:
+    typedef TaskQueue::Task Task;
+    typedef TaskQueue::Clock Clock;
+    typedef TaskQueue::Priority Priority;
+    typedef TaskQueue::Metrics Metrics;
+
+    static const uint32_t DefaultPoolSize = 1024;
+
+    explicit MpscTaskQueue(uint32_t poolSize = DefaultPoolSize);
+    ~MpscTaskQueue();
+
+    std::future<std::wstring> Enqueue(Task task, Priority priority = TaskQueue::Normal, Clock::time_point deadline = TaskQueue::NoDeadline());
+
+    // Same contract as TaskQueue; consumer thread only.
+    bool Dequeue(Task& task);
+    bool RunOne();
+
+    // Pending tasks are dropped by the consumer's next Dequeue, or by the
+    // destructor if there is none.
+    void Shutdown(bool dropPending = false);
+
+    Metrics GetMetrics() const;
+
+private:
+    static const uint32_t NotPooled = UINT32_MAX;
+
+    struct Node
+    {
+        std::atomic<Node*> next;
+        Task task;
+        Clock::time_point enqueued;
+        Clock::time_point deadline;
+        uint32_t index;                     // in _pool, or NotPooled
+        std::atomic<uint32_t> nextFree;     // index + 1 of the next free slot
+    };
+
+    // Dmitry Vyukov's intrusive MPSC queue. The stub keeps the list non-empty.
+    struct List
+    {
+        std::atomic<Node*> head;    // producers
+        Node* tail;                 // consumer
+        Node stub;
+    };
+
+    MpscTaskQueue(const MpscTaskQueue&);
+    MpscTaskQueue& operator=(const MpscTaskQueue&);
+
+    Node* Allocate();
+    void Release(Node* node);
+
+    static void Push(List& list, Node* node);
+    static Node* Pop(List& list);
+
+    // Takes the next task, or returns nullptr if every list is empty.
+    Node* TakeNext();
+    void DropAll();
+
+    // Free pool slots: a stack of indices tagged against ABA.
+    std::unique_ptr<Node[]> _pool;
+    uint32_t _poolSize;
+    std::atomic<uint64_t> _free;
+
+    List _lists[TaskQueue::PriorityCount];
+
+    std::atomic<size_t> _depth;
+    std::atomic<bool> _parked;
+    std::atomic<bool> _shutdown;
+    std::atomic<bool> _dropPending;
+    std::mutex _parkMutex;
+    std::condition_variable _parkCv;
+
+    std::atomic<size_t> _peakDepth;
+    std::atomic<size_t> _depthByPriority[TaskQueue::PriorityCount];
+    std::atomic<unsigned long long> _completed;
+    std::atomic<unsigned long long> _expired;
+    std::atomic<unsigned long long> _rejected;
+    std::atomic<Clock::rep> _totalWait;
+    std::atomic<Clock::rep> _totalRun;
+};
\ No newline at end of file
@@ -0,0 +1,292 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\TaskQueue.h"
+#include "MpscTaskQueue.h"
+#include "MpscTaskQueueTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+typedef TaskQueue::Clock Clock;
+
+// Runs producerCount threads that each enqueue tasksPerProducer tasks as fast
+// as they can, and one consumer that runs them. Returns tasks per second.
+template<class Queue>
+static double Throughput(unsigned int producerCount, unsigned int tasksPerProducer)
+{
+    Queue queue;
+    thread consumer([&queue]()
+    {
+        while (queue.RunOne())
+        {
+        }
+    });
+
+    Clock::time_point start = Clock::now();
+    vector<thread> producers;
+    for (unsigned int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&queue, tasksPerProducer]()
+        {
+            for (unsigned int i = 0; i < tasksPerProducer; ++i)
+            {
+                queue.Enqueue(TaskQueue::Task([]() { return wstring(); }));
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    queue.Shutdown();
+    consumer.join();
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    unsigned long long taskCount = static_cast<unsigned long long>(producerCount) * tasksPerProducer;
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().completed), to_wstring(taskCount), L"Benchmark tasks run");
+    return taskCount / seconds;
+}
+
+// Like Throughput, but each producer waits for its task to run before
+// enqueuing the next one. Returns the mean enqueue-to-run time in microseconds.
+template<class Queue>
+static double Latency(unsigned int producerCount, unsigned int tasksPerProducer)
+{
+    Queue queue;
+    atomic<long long> totalLatencyNs(0);
+    thread consumer([&queue]()
+    {
+        while (queue.RunOne())
+        {
+        }
+    });
+
+    vector<thread> producers;
+    for (unsigned int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&queue, &totalLatencyNs, tasksPerProducer]()
+        {
+            for (unsigned int i = 0; i < tasksPerProducer; ++i)
+            {
+                Clock::time_point enqueued = Clock::now();
+                queue.Enqueue(TaskQueue::Task([&totalLatencyNs, enqueued]()
+                {
+                    totalLatencyNs += chrono::duration_cast<chrono::nanoseconds>(Clock::now() - enqueued).count();
+                    return wstring();
+                })).get();
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    queue.Shutdown();
+    consumer.join();
+
+    return totalLatencyNs / 1000.0 / (static_cast<double>(producerCount) * tasksPerProducer);
+}
+
+void MpscTaskQueueTest::OrderTest()
+{
+    TRACE(__FUNCTION__);
+
+    MpscTaskQueue queue(2);
+    wstring log;
+    const wchar_t* names[] = { L"b1", L"n1", L"i1", L"b2", L"n2", L"i2" };
+    TaskQueue::Priority priorities[] = { TaskQueue::Bulk, TaskQueue::Normal, TaskQueue::Interactive, TaskQueue::Bulk, TaskQueue::Normal, TaskQueue::Interactive };
+    for (int i = 0; i < 6; ++i)
+    {
+        wstring name = names[i];
+        queue.Enqueue(TaskQueue::Task([&log, name]() { log += name; return name; }), priorities[i]);
+    }
+
+    future<wstring> expired = queue.Enqueue(TaskQueue::Task([&log]() { log += L"x"; return wstring(); }), TaskQueue::Interactive, Clock::now() - chrono::milliseconds(1));
+
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().depthByPriority[TaskQueue::Interactive]), L"3", L"Interactive depth");
+    for (int i = 0; i < 6; ++i)
+    {
+        queue.RunOne();
+    }
+
+    Test::Utils::EnsureEqual(log, L"i1i2n1n2b1b2", L"Priority order");
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().expired), L"1", L"Expired count");
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().depth), L"0", L"Depth");
+}
+
+void MpscTaskQueueTest::ProducersTest()
+{
+    TRACE(__FUNCTION__);
+
+    const unsigned int producerCount = 8;
+    const unsigned int tasksPerProducer = 5000;
+
+    // A small pool, so that the heap fallback is exercised too.
+    MpscTaskQueue queue(64);
+    vector<unsigned int> next(producerCount, 0);
+    bool ordered = true;
+
+    thread consumer([&queue]()
+    {
+        while (queue.RunOne())
+        {
+        }
+    });
+
+    vector<thread> producers;
+    for (unsigned int p = 0; p < producerCount; ++p)
+    {
+        producers.emplace_back([&queue, &next, &ordered, p, tasksPerProducer]()
+        {
+            for (unsigned int i = 0; i < tasksPerProducer; ++i)
+            {
+                queue.Enqueue(TaskQueue::Task([&next, &ordered, p, i]()
+                {
+                    ordered = ordered && next[p] == i;
+                    next[p] = i + 1;
+                    return wstring();
+                }));
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    queue.Shutdown();
+    consumer.join();
+
+    Test::Utils::EnsureEqual(ordered ? L"true" : L"false", L"true", L"Per-producer order");
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().completed), to_wstring(producerCount * tasksPerProducer), L"Tasks run");
+}
+
+void MpscTaskQueueTest::ShutdownTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A parked consumer wakes up and exits.
+    {
+        MpscTaskQueue queue;
+        thread consumer([&queue]()
+        {
+            while (queue.RunOne())
+            {
+            }
+        });
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.Shutdown();
+        consumer.join();
+    }
+
+    // Pending tasks are dropped when asked to, and later tasks are rejected.
+    {
+        MpscTaskQueue queue;
+        future<wstring> pending = queue.Enqueue(TaskQueue::Task([]() { return wstring(L"ran"); }));
+        queue.Shutdown(true /*dropPending*/);
+        future<wstring> late = queue.Enqueue(TaskQueue::Task([]() { return wstring(L"ran"); }));
+
+        Test::Utils::EnsureEqual(queue.RunOne() ? L"true" : L"false", L"false", L"Nothing to run");
+        Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().rejected), L"2", L"Rejected count");
+        Test::Utils::EnsureException<future_error>(L"Dropped task", [&pending]() { pending.get(); });
+        Test::Utils::EnsureException<future_error>(L"Late task", [&late]() { late.get(); });
+    }
+}
+
+void MpscTaskQueueTest::BenchmarkTest()
+{
+    TRACE(__FUNCTION__);
+
+    // Numbers depend on the machine; only their completion is checked.
+    const unsigned int taskCount = 64000;
+    const unsigned int latencyTaskCount = 8000;
+    cout << "TaskQueue vs MpscTaskQueue, one consumer" << endl;
+    cout << "producers  mutex tasks/s  mpsc tasks/s  mutex latency us  mpsc latency us" << endl;
+
+    unsigned int producerCounts[] = { 1, 2, 4, 8, 16 };
+    for (unsigned int producerCount : producerCounts)
+    {
+        double lockedThroughput = Throughput<TaskQueue>(producerCount, taskCount / producerCount);
+        double lockFreeThroughput = Throughput<MpscTaskQueue>(producerCount, taskCount / producerCount);
+        double lockedLatency = Latency<TaskQueue>(producerCount, latencyTaskCount / producerCount);
+        double lockFreeLatency = Latency<MpscTaskQueue>(producerCount, latencyTaskCount / producerCount);
+
+        cout << setw(9) << producerCount
+            << setw(15) << static_cast<long long>(lockedThroughput)
+            << setw(14) << static_cast<long long>(lockFreeThroughput)
+            << setw(18) << fixed << setprecision(1) << lockedLatency
+            << setw(17) << lockFreeLatency << endl;
+    }
+}
+
+bool MpscTaskQueueTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        OrderTest();
+        ProducersTest();
+        ShutdownTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
+
+bool MpscTaskQueueTest::RunBenchmark()
+{
+    bool result = true;
+    try
+    {
+        BenchmarkTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
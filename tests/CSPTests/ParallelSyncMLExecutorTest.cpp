@@ -0,0 +1,270 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\DomainExecutor.h"
+#include "..\..\src\SystemConfigurator\CSPs\ParallelSyncMLExecutor.h"
+#include "..\..\src\SystemConfigurator\CSPs\SyncMLBatch.h"
+#include "CSPSimulator.h"
+#include "ParallelSyncMLExecutorTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static long long ElapsedMs(Clock::time_point start)
+{
+    return chrono::duration_cast<chrono::milliseconds>(Clock::now() - start).count();
+}
+
+// Reads 'path' from a separate thread for each path, all at once.
+static void GetConcurrently(ParallelSyncMLExecutor& executor, const vector<wstring>& paths)
+{
+    vector<thread> threads;
+    for (const auto& path : paths)
+    {
+        threads.emplace_back([&executor, path]()
+        {
+            SyncMLBatch batch;
+            batch.QueueGetString(path);
+            batch.Execute([&executor](const wstring& request, wstring& response) { executor.Execute(request, response); });
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+void ParallelSyncMLExecutorTest::DomainTest()
+{
+    TRACE(__FUNCTION__);
+
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./Vendor/MSFT/DiagnosticLog/EtwLog/Collectors/c1"), L"./Vendor/MSFT/DiagnosticLog", L"Vendor CSP");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./Device/Vendor/MSFT/Policy/Config/Update/ActiveHoursStart"), L"./Vendor/MSFT/Policy", L"Device scope");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./Device/Vendor/MSFT/Reboot/RebootNow"), ParallelSyncMLExecutor::GetDomain(L"./Vendor/MSFT/Reboot/RebootNow"), L"Implied device scope");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./Device"), L"./Device", L"Device root alone");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./User/Vendor/MSFT/EnterpriseModernAppManagement/AppManagement"), L"./User/Vendor/MSFT/EnterpriseModernAppManagement", L"User scope");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./DevDetail/Ext/Microsoft/DeviceName"), L"./DevDetail", L"Standard root");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./Vendor/MSFT/WiFi/Profile?list=StructData"), L"./Vendor/MSFT/WiFi", L"Query");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomain(L"./Vendor/MSFT"), L"./Vendor/MSFT", L"Short path");
+
+    SyncMLBatch batch;
+    batch.QueueGetString(L"./DevInfo/Man");
+    batch.QueueGetString(L"./Vendor/MSFT/WiFi/Profile");
+    batch.QueueGetString(L"./DevInfo/Mod");
+    vector<wstring> domains;
+    batch.Execute([&domains](const wstring& request, wstring& response)
+    {
+        domains = ParallelSyncMLExecutor::GetDomains(ParallelSyncMLExecutor::GetTargets(request));
+        CSPSimulator().Execute(request, response);
+    });
+    Test::Utils::EnsureEqual(to_wstring(domains.size()), L"3", L"Domain per target");
+    Test::Utils::EnsureEqual(domains[1], L"./Vendor/MSFT/WiFi", L"Second target's domain");
+    Test::Utils::EnsureEqual(ParallelSyncMLExecutor::GetDomains(vector<ParallelSyncMLExecutor::Target>())[0], L".", L"Request without targets");
+
+    SyncMLBatch writes;
+    writes.QueueGetString(L"./DevInfo/Man");
+    writes.QueueSet(L"./Vendor/MSFT/Reboot/Schedule/Single", L"2030-01-01T00:00:00");
+    writes.QueueDelete(L"./Vendor/MSFT/WiFi/Profile/home");
+    vector<ParallelSyncMLExecutor::Target> commands;
+    writes.Execute([&commands](const wstring& request, wstring& response)
+    {
+        commands = ParallelSyncMLExecutor::GetTargets(request);
+        CSPSimulator().Execute(request, response);
+    });
+    Test::Utils::EnsureEqual(to_wstring(commands.size()), L"3", L"Target per command");
+    Test::Utils::EnsureEqual(commands[0].verb, L"Get", L"Get verb");
+    Test::Utils::EnsureEqual(commands[1].verb, L"Replace", L"Replace verb");
+    Test::Utils::EnsureEqual(commands[2].verb, L"Delete", L"Delete verb");
+    Test::Utils::EnsureEqual(commands[2].locUri, L"./Vendor/MSFT/WiFi/Profile/home", L"Delete target");
+
+    vector<ParallelSyncMLExecutor::Target> targets(1);
+    targets[0].locUri = L"./Vendor/MSFT/DiagnosticLog/EtwLog/Collectors/c1/TraceStatus";
+    Test::Utils::EnsureEqual(to_wstring(ParallelSyncMLExecutor::GetPriority(targets)), to_wstring(TaskQueue::Normal), L"Collector priority");
+    targets.resize(2);
+    targets[1].locUri = L"./Vendor/MSFT/DiagnosticLog/FileDownload/DMChannel/c1/BlockData";
+    Test::Utils::EnsureEqual(to_wstring(ParallelSyncMLExecutor::GetPriority(targets)), to_wstring(TaskQueue::Bulk), L"File download priority");
+}
+
+void ParallelSyncMLExecutorTest::OrderingTest()
+{
+    TRACE(__FUNCTION__);
+
+    const int taskCount = 200;
+    vector<int> orderA;
+    vector<int> orderB;
+    atomic<int> runningA(0);
+    atomic<int> runningB(0);
+    atomic<bool> overlapped(false);
+
+    {
+        DomainExecutor executor(4);
+        vector<future<wstring>> results;
+        for (int i = 0; i < taskCount; ++i)
+        {
+            // Every third task touches both domains and must wait for both.
+            bool inA = i % 3 != 1;
+            bool inB = i % 3 != 0;
+            vector<wstring> domains;
+            if (inA)
+            {
+                domains.push_back(L"A");
+            }
+            if (inB)
+            {
+                domains.push_back(L"B");
+            }
+
+            results.push_back(executor.Enqueue(domains, [&, i, inA, inB]()
+            {
+                if ((inA && ++runningA > 1) || (inB && ++runningB > 1))
+                {
+                    overlapped = true;
+                }
+                this_thread::yield();
+                if (inA)
+                {
+                    orderA.push_back(i);
+                    --runningA;
+                }
+                if (inB)
+                {
+                    orderB.push_back(i);
+                    --runningB;
+                }
+                return wstring();
+            }));
+        }
+        for (auto& result : results)
+        {
+            result.get();
+        }
+
+        DomainExecutor::Metrics metrics = executor.GetMetrics();
+        Test::Utils::EnsureEqual(to_wstring(metrics.completed), to_wstring(taskCount), L"Completed count");
+        Test::Utils::EnsureEqual(to_wstring(metrics.waiting + metrics.running), L"0", L"Nothing left");
+        Test::Utils::EnsureEqual(to_wstring(metrics.domainDepths.size()), L"0", L"Domains drained");
+        Test::Utils::EnsureEqual(DomainExecutor::MetricsToString(metrics).find(L"completed=200 running=0 waiting=0 ") == 0 ? L"true" : L"false", L"true", L"Metrics text");
+    }
+
+    Test::Utils::EnsureEqual(overlapped ? L"true" : L"false", L"false", L"Tasks in a domain never overlap");
+    Test::Utils::EnsureEqual(is_sorted(orderA.begin(), orderA.end()) ? L"true" : L"false", L"true", L"Order within domain A");
+    Test::Utils::EnsureEqual(is_sorted(orderB.begin(), orderB.end()) ? L"true" : L"false", L"true", L"Order within domain B");
+    Test::Utils::EnsureEqual(to_wstring(orderA.size() + orderB.size()), to_wstring(taskCount + taskCount / 3), L"Every task ran");
+}
+
+void ParallelSyncMLExecutorTest::ParallelismTest()
+{
+    TRACE(__FUNCTION__);
+
+    const long long latencyMs = 200;
+    CSPSimulator simulator;
+    simulator.SetLatency(chrono::milliseconds(latencyMs), chrono::microseconds(0));
+    simulator.SetNode(L"./Vendor/MSFT/DiagnosticLog/EtwLog/Collectors/c1/TraceStatus", L"1");
+    simulator.SetNode(L"./Vendor/MSFT/WiFi/Profile/home/WlanXml", L"<xml/>");
+    simulator.SetNode(L"./DevDetail/Ext/Microsoft/DeviceName", L"device");
+    simulator.SetNode(L"./Vendor/MSFT/Reboot/Schedule/Single", L"");
+
+    ParallelSyncMLExecutor executor([&simulator](const wstring& request, wstring& response)
+    {
+        simulator.Execute(request, response);
+    }, 4);
+
+    // A slow request to one CSP does not hold up the others...
+    vector<wstring> paths;
+    paths.push_back(L"./Vendor/MSFT/DiagnosticLog/EtwLog/Collectors/c1/TraceStatus");
+    paths.push_back(L"./Vendor/MSFT/WiFi/Profile/home/WlanXml");
+    paths.push_back(L"./DevDetail/Ext/Microsoft/DeviceName");
+    paths.push_back(L"./Vendor/MSFT/Reboot/Schedule/Single");
+    Clock::time_point start = Clock::now();
+    GetConcurrently(executor, paths);
+    long long independentMs = ElapsedMs(start);
+    TRACEP(L"Four CSPs (ms): ", independentMs);
+
+    // ...while requests to the same CSP still run one at a time.
+    vector<wstring> samePaths(4, paths[0]);
+    start = Clock::now();
+    GetConcurrently(executor, samePaths);
+    long long sameMs = ElapsedMs(start);
+    TRACEP(L"One CSP (ms): ", sameMs);
+
+    Test::Utils::EnsureEqual(independentMs < 2 * latencyMs ? L"true" : L"false", L"true", L"Independent CSPs run in parallel");
+    Test::Utils::EnsureEqual(sameMs >= 4 * latencyMs - 20 ? L"true" : L"false", L"true", L"One CSP is serialized");
+
+    DomainExecutor::Metrics metrics = executor.GetMetrics();
+    Test::Utils::EnsureEqual(to_wstring(metrics.completed), L"8", L"Completed requests");
+    Test::Utils::EnsureEqual(metrics.peakWaiting >= 3 ? L"true" : L"false", L"true", L"Peak queue depth");
+}
+
+void ParallelSyncMLExecutorTest::FailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    ParallelSyncMLExecutor executor([](const wstring&, wstring&)
+    {
+        throw DMException("apply failed");
+    }, 2);
+
+    Test::Utils::EnsureException<DMException>(L"Execute", [&executor]()
+    {
+        wstring response;
+        executor.Execute(L"<SyncBody/>", response);
+    });
+
+    // The domain is released after a failure.
+    Test::Utils::EnsureException<DMException>(L"Execute", [&executor]()
+    {
+        wstring response;
+        executor.Execute(L"<SyncBody/>", response);
+    });
+    Test::Utils::EnsureEqual(to_wstring(executor.GetMetrics().completed), L"2", L"Completed after failures");
+}
+
+bool ParallelSyncMLExecutorTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        DomainTest();
+        OrderingTest();
+        ParallelismTest();
+        FailureTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,260 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\ProcessRunner.h"
+#include "ProcessRunnerTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+// The same commands for cmd.exe and for /bin/sh.
+#ifdef _WIN32
+static const wchar_t* const EchoCommand = L"cmd.exe /c echo hello";
+static const wchar_t* const ExitCommand = L"cmd.exe /c exit 3";
+static const wchar_t* const ManyLinesCommand = L"cmd.exe /c for /L %i in (1,1,2000) do @echo line %i";
+static const wchar_t* const DelayedCommand = L"cmd.exe /c echo first & ping -n 3 127.0.0.1 > nul & echo second";
+static const wchar_t* const LongCommand = L"ping -n 30 127.0.0.1";
+#else
+static const wchar_t* const EchoCommand = L"echo hello";
+static const wchar_t* const ExitCommand = L"exit 3";
+static const wchar_t* const ManyLinesCommand = L"i=1; while [ $i -le 2000 ]; do echo line $i; i=$((i+1)); done";
+static const wchar_t* const DelayedCommand = L"echo first; sleep 2; echo second";
+static const wchar_t* const LongCommand = L"sleep 30";
+#endif
+
+typedef chrono::steady_clock Clock;
+
+static long long ElapsedMs(Clock::time_point start)
+{
+    return chrono::duration_cast<chrono::milliseconds>(Clock::now() - start).count();
+}
+
+static wstring ToWide(const string& text)
+{
+    return wstring(text.begin(), text.end());
+}
+
+// Replays a fixed sequence of waits, to check how the runner reacts to them.
+class ScriptedChild : public IChildProcess
+{
+public:
+    struct Step
+    {
+        unsigned int events;
+        const char* output;
+    };
+
+    ScriptedChild(const deque<Step>& steps) :
+        steps(steps),
+        terminated(false)
+    {}
+
+    unsigned int Wait(unsigned int timeoutMs) override
+    {
+        waits.push_back(timeoutMs);
+        if (steps.empty())
+        {
+            return 0;
+        }
+        current = steps.front();
+        steps.pop_front();
+        return current.events;
+    }
+
+    size_t Read(char* buffer, size_t size) override
+    {
+        size_t count = (min)(size, strlen(current.output));
+        memcpy(buffer, current.output, count);
+        return count;
+    }
+
+    unsigned long ExitCode() override
+    {
+        return 7;
+    }
+
+    void Terminate() override
+    {
+        terminated = true;
+    }
+
+    deque<Step> steps;
+    Step current;
+    vector<unsigned int> waits;
+    bool terminated;
+};
+
+void ProcessRunnerTest::DrainAfterExitTest()
+{
+    TRACE(__FUNCTION__);
+
+    // The child exits while a grandchild still holds the pipe: what was
+    // already written is read, then the runner stops without waiting for
+    // the end of the stream.
+    deque<ScriptedChild::Step> steps;
+    steps.push_back({ IChildProcess::OutputReady, "one " });
+    steps.push_back({ IChildProcess::OutputReady | IChildProcess::Exited, "two " });
+    steps.push_back({ IChildProcess::OutputReady, "three" });
+    ScriptedChild child(steps);
+
+    string output;
+    ProcessRunner::Result result = ProcessRunner::Run(child, [&output](const char* data, size_t size)
+    {
+        output.append(data, size);
+    });
+
+    Test::Utils::EnsureEqual(ToWide(output), L"one two three", L"Output");
+    Test::Utils::EnsureEqual(to_wstring(result.status), to_wstring(ProcessRunner::Completed), L"Status");
+    Test::Utils::EnsureEqual(to_wstring(result.exitCode), L"7", L"Exit code");
+    Test::Utils::EnsureEqual(to_wstring(child.waits.size()), L"4", L"Wait count");
+    Test::Utils::EnsureEqual(to_wstring(child.waits[0]), to_wstring(ProcessRunner::NoTimeout), L"Wait before exit");
+    Test::Utils::EnsureEqual(to_wstring(child.waits[2]), L"0", L"Wait after exit");
+    Test::Utils::EnsureEqual(child.terminated ? L"true" : L"false", L"false", L"Not terminated");
+}
+
+void ProcessRunnerTest::OutputTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A short command must not cost a polling interval.
+    Clock::time_point start = Clock::now();
+    string output;
+    for (int i = 0; i < 5; ++i)
+    {
+        output.clear();
+        unique_ptr<IChildProcess> child = StartChildProcess(EchoCommand, nullptr);
+        ProcessRunner::Result result = ProcessRunner::Run(*child, [&output](const char* data, size_t size)
+        {
+            output.append(data, size);
+        });
+        Test::Utils::EnsureEqual(to_wstring(result.status), to_wstring(ProcessRunner::Completed), L"Echo status");
+        Test::Utils::EnsureEqual(to_wstring(result.exitCode), L"0", L"Echo exit code");
+    }
+    long long elapsed = ElapsedMs(start);
+    TRACEP(L"Five short commands (ms): ", elapsed);
+
+    Test::Utils::EnsureEqual(ToWide(output.substr(0, 5)), L"hello", L"Echo output");
+    Test::Utils::EnsureEqual(elapsed < 2500 ? L"true" : L"false", L"true", L"Short commands return as soon as they exit");
+
+    unique_ptr<IChildProcess> exitChild = StartChildProcess(ExitCommand, nullptr);
+    Test::Utils::EnsureEqual(to_wstring(ProcessRunner::Run(*exitChild, nullptr).exitCode), L"3", L"Exit code");
+
+    output.clear();
+    unique_ptr<IChildProcess> manyLinesChild = StartChildProcess(ManyLinesCommand, nullptr);
+    ProcessRunner::Run(*manyLinesChild, [&output](const char* data, size_t size)
+    {
+        output.append(data, size);
+    });
+    Test::Utils::EnsureEqual(to_wstring(count(output.begin(), output.end(), '\n')), L"2000", L"Line count");
+    Test::Utils::EnsureEqual(output.find("line 2000") != string::npos ? L"true" : L"false", L"true", L"Last line");
+}
+
+void ProcessRunnerTest::StreamingTest()
+{
+    TRACE(__FUNCTION__);
+
+    // The first line is handed over while the child is still running.
+    Clock::time_point start = Clock::now();
+    long long firstOutputMs = -1;
+    string output;
+    unique_ptr<IChildProcess> child = StartChildProcess(DelayedCommand, nullptr);
+    ProcessRunner::Run(*child, [&](const char* data, size_t size)
+    {
+        if (firstOutputMs < 0)
+        {
+            firstOutputMs = ElapsedMs(start);
+        }
+        output.append(data, size);
+    });
+    long long totalMs = ElapsedMs(start);
+
+    Test::Utils::EnsureEqual(output.find("first") == 0 && output.find("second") != string::npos ? L"true" : L"false", L"true", L"Both lines");
+    Test::Utils::EnsureEqual(firstOutputMs >= 0 && firstOutputMs + 1000 < totalMs ? L"true" : L"false", L"true", L"First line streamed before exit");
+}
+
+void ProcessRunnerTest::TimeoutTest()
+{
+    TRACE(__FUNCTION__);
+
+    Clock::time_point start = Clock::now();
+    unique_ptr<IChildProcess> child = StartChildProcess(LongCommand, nullptr);
+    ProcessRunner::Result result = ProcessRunner::Run(*child, nullptr, 200);
+    long long elapsed = ElapsedMs(start);
+
+    Test::Utils::EnsureEqual(to_wstring(result.status), to_wstring(ProcessRunner::TimedOut), L"Timeout status");
+    Test::Utils::EnsureEqual(elapsed >= 200 && elapsed < 5000 ? L"true" : L"false", L"true", L"Timeout elapsed");
+}
+
+void ProcessRunnerTest::CancellationTest()
+{
+    TRACE(__FUNCTION__);
+
+    ProcessCancellation cancellation;
+    Test::Utils::EnsureEqual(cancellation.IsCancelled() ? L"true" : L"false", L"false", L"Not cancelled yet");
+
+    Clock::time_point start = Clock::now();
+    unique_ptr<IChildProcess> child = StartChildProcess(LongCommand, &cancellation);
+    thread canceller([&cancellation]()
+    {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        cancellation.Cancel();
+    });
+    ProcessRunner::Result result = ProcessRunner::Run(*child, nullptr);
+    canceller.join();
+    long long elapsed = ElapsedMs(start);
+
+    Test::Utils::EnsureEqual(to_wstring(result.status), to_wstring(ProcessRunner::Cancelled), L"Cancelled status");
+    Test::Utils::EnsureEqual(cancellation.IsCancelled() ? L"true" : L"false", L"true", L"Cancelled");
+    Test::Utils::EnsureEqual(elapsed < 5000 ? L"true" : L"false", L"true", L"Cancellation elapsed");
+}
+
+bool ProcessRunnerTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        DrainAfterExitTest();
+        OutputTest();
+        StreamingTest();
+        TimeoutTest();
+        CancellationTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,288 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\RequestPipeline.h"
+#include "RequestPipelineTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+typedef PipelineBatch::Bytes Bytes;
+
+static Bytes ToBytes(const string& s)
+{
+    return Bytes(s.begin(), s.end());
+}
+
+static wstring ToWide(const Bytes& bytes)
+{
+    return wstring(bytes.begin(), bytes.end());
+}
+
+// Runs dispatched work on threads of its own and joins them when destroyed.
+class TestDispatcher
+{
+public:
+    ~TestDispatcher()
+    {
+        for (auto& t : _threads)
+        {
+            t.join();
+        }
+    }
+
+    PipelineServer::Dispatch Dispatch()
+    {
+        return [this](function<void()> work)
+        {
+            lock_guard<mutex> lock(_mutex);
+            _threads.emplace_back(work);
+        };
+    }
+
+private:
+    mutex _mutex;
+    vector<thread> _threads;
+};
+
+// A request is "<delay in ms>:<text>"; the response is "<text>!" after the delay.
+static Bytes DelayedEcho(const uint8_t* data, uint32_t size)
+{
+    string request(data, data + size);
+    size_t colon = request.find(':');
+    this_thread::sleep_for(chrono::milliseconds(stoi(request.substr(0, colon))));
+    return ToBytes(request.substr(colon + 1) + "!");
+}
+
+// A client talking straight to a server session.
+static unique_ptr<PipelineClient> Connect(PipelineServer& server, uint32_t sessionId)
+{
+    return unique_ptr<PipelineClient>(new PipelineClient(
+        [&server, sessionId](uint32_t requestId, const uint8_t* data, uint32_t size)
+        {
+            if (!server.Submit(sessionId, requestId, data, size))
+            {
+                throw runtime_error("no session");
+            }
+        },
+        [&server, sessionId](uint32_t timeoutMs)
+        {
+            Bytes batch;
+            if (!server.Receive(sessionId, timeoutMs, batch))
+            {
+                throw runtime_error("no session");
+            }
+            return batch;
+        }));
+}
+
+static future<Bytes> Send(PipelineClient& client, const string& request)
+{
+    shared_ptr<promise<Bytes>> result = make_shared<promise<Bytes>>();
+    Bytes bytes = ToBytes(request);
+    client.Send(bytes.data(), static_cast<uint32_t>(bytes.size()), [result](exception_ptr error, Bytes response)
+    {
+        if (error)
+        {
+            result->set_exception(error);
+        }
+        else
+        {
+            result->set_value(move(response));
+        }
+    });
+    return result->get_future();
+}
+
+void RequestPipelineTest::BatchTest()
+{
+    TRACE(__FUNCTION__);
+
+    Bytes batch;
+    Bytes first = ToBytes("first");
+    PipelineBatch::Append(batch, 7, first.data(), static_cast<uint32_t>(first.size()));
+    PipelineBatch::Append(batch, 3, nullptr, 0);
+
+    wstring parsed;
+    PipelineBatch::Parse(batch.data(), batch.size(), [&parsed](uint32_t requestId, const uint8_t* data, uint32_t size)
+    {
+        parsed += to_wstring(requestId) + L"=" + ToWide(Bytes(data, data + size)) + L";";
+    });
+    Test::Utils::EnsureEqual(parsed, L"7=first;3=;", L"Parsed batch");
+
+    Test::Utils::EnsureException<runtime_error>(L"Parse", [&batch]()
+    {
+        PipelineBatch::Parse(batch.data(), batch.size() - 3, [](uint32_t, const uint8_t*, uint32_t) {});
+    });
+}
+
+void RequestPipelineTest::OutOfOrderTest()
+{
+    TRACE(__FUNCTION__);
+
+    TestDispatcher dispatcher;
+    PipelineServer server(DelayedEcho, dispatcher.Dispatch());
+    unique_ptr<PipelineClient> client = Connect(server, server.Open());
+
+    // Later requests are quicker, so responses come back in reverse.
+    wstring order;
+    mutex orderMutex;
+    vector<future<Bytes>> results;
+    const char* requests[] = { "150:a", "100:b", "50:c", "0:d" };
+    for (const char* request : requests)
+    {
+        shared_ptr<promise<Bytes>> result = make_shared<promise<Bytes>>();
+        results.push_back(result->get_future());
+        Bytes bytes = ToBytes(request);
+        client->Send(bytes.data(), static_cast<uint32_t>(bytes.size()), [result, &order, &orderMutex](exception_ptr, Bytes response)
+        {
+            {
+                lock_guard<mutex> lock(orderMutex);
+                order += ToWide(response);
+            }
+            result->set_value(response);
+        });
+    }
+
+    Test::Utils::EnsureEqual(ToWide(results[0].get()), L"a!", L"Response a");
+    Test::Utils::EnsureEqual(ToWide(results[1].get()), L"b!", L"Response b");
+    Test::Utils::EnsureEqual(ToWide(results[2].get()), L"c!", L"Response c");
+    Test::Utils::EnsureEqual(ToWide(results[3].get()), L"d!", L"Response d");
+    Test::Utils::EnsureEqual(order, L"d!c!b!a!", L"Completion order");
+    Test::Utils::EnsureEqual(to_wstring(client->InFlight()), L"0", L"Nothing in flight");
+}
+
+void RequestPipelineTest::ConcurrencyTest()
+{
+    TRACE(__FUNCTION__);
+
+    TestDispatcher dispatcher;
+    PipelineServer server(DelayedEcho, dispatcher.Dispatch());
+    unique_ptr<PipelineClient> client = Connect(server, server.Open());
+
+    // Eight 100 ms requests on one connection take about 100 ms, not 800.
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<future<Bytes>> results;
+    for (int i = 0; i < 8; ++i)
+    {
+        results.push_back(Send(*client, "100:" + to_string(i)));
+    }
+    for (int i = 0; i < 8; ++i)
+    {
+        Test::Utils::EnsureEqual(ToWide(results[i].get()), to_wstring(i) + L"!", L"Response");
+    }
+    long long elapsedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+    TRACEP(L"Eight pipelined requests (ms): ", elapsedMs);
+
+    Test::Utils::EnsureEqual(elapsedMs < 400 ? L"true" : L"false", L"true", L"Requests overlap");
+}
+
+void RequestPipelineTest::FailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A handler that throws produces an empty response.
+    {
+        TestDispatcher dispatcher;
+        PipelineServer server([](const uint8_t*, uint32_t) -> Bytes { throw runtime_error("handler failed"); }, dispatcher.Dispatch());
+        unique_ptr<PipelineClient> client = Connect(server, server.Open());
+        Test::Utils::EnsureEqual(to_wstring(Send(*client, "x").get().size()), L"0", L"Empty response");
+    }
+
+    // A broken connection fails what is in flight and everything after it.
+    {
+        TestDispatcher dispatcher;
+        PipelineServer server(DelayedEcho, dispatcher.Dispatch());
+        uint32_t sessionId = server.Open();
+        unique_ptr<PipelineClient> client = Connect(server, sessionId);
+        Test::Utils::EnsureEqual(client->IsBroken() ? L"true" : L"false", L"false", L"Healthy connection");
+
+        future<Bytes> inFlight = Send(*client, "200:slow");
+        this_thread::sleep_for(chrono::milliseconds(20));
+        server.Close(sessionId);
+
+        Test::Utils::EnsureException<runtime_error>(L"In flight", [&inFlight]() { inFlight.get(); });
+        future<Bytes> later = Send(*client, "0:later");
+        Test::Utils::EnsureException<runtime_error>(L"Later", [&later]() { later.get(); });
+        Test::Utils::EnsureEqual(client->IsBroken() ? L"true" : L"false", L"true", L"Broken connection");
+
+        // A new session recovers.
+        client = Connect(server, server.Open());
+        Test::Utils::EnsureEqual(ToWide(Send(*client, "0:again").get()), L"again!", L"After reopening");
+    }
+}
+
+void RequestPipelineTest::SessionTest()
+{
+    TRACE(__FUNCTION__);
+
+    TestDispatcher dispatcher;
+    PipelineServer server(DelayedEcho, dispatcher.Dispatch());
+    uint32_t first = server.Open();
+    uint32_t second = server.Open();
+    Test::Utils::EnsureEqual(to_wstring(server.SessionCount()), L"2", L"Open sessions");
+
+    // Responses go to the session that asked.
+    Bytes request = ToBytes("0:one");
+    server.Submit(first, 1, request.data(), static_cast<uint32_t>(request.size()));
+    Bytes batch;
+    server.Receive(second, 50, batch);
+    Test::Utils::EnsureEqual(to_wstring(batch.size()), L"0", L"Other session");
+    server.Receive(first, 1000, batch);
+    Test::Utils::EnsureEqual(to_wstring(batch.size()), to_wstring(2 * sizeof(uint32_t) + 4), L"Own session");
+
+    server.Close(first);
+    Test::Utils::EnsureEqual(server.Submit(first, 2, request.data(), static_cast<uint32_t>(request.size())) ? L"true" : L"false", L"false", L"Closed session");
+    Test::Utils::EnsureEqual(server.Receive(first, 0, batch) ? L"true" : L"false", L"false", L"Closed session receive");
+    Test::Utils::EnsureEqual(to_wstring(server.SessionCount()), L"1", L"Open sessions after close");
+}
+
+bool RequestPipelineTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        BatchTest();
+        OutOfOrderTest();
+        ConcurrencyTest();
+        FailureTest();
+        SessionTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
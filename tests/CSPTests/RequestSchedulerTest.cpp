@@ -0,0 +1,299 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\RequestScheduler.h"
+#include "RequestSchedulerTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+static RequestScheduler::RequestClass Class(RequestScheduler::Access access, const wstring& resource)
+{
+    RequestScheduler::RequestClass requestClass;
+    requestClass.access = access;
+    requestClass.resource = resource;
+    return requestClass;
+}
+
+// Counts how many fake handlers run at once.
+class Concurrency
+{
+public:
+    Concurrency() : _current(0), _peak(0) {}
+
+    void Run(chrono::milliseconds duration)
+    {
+        int current = ++_current;
+        int peak = _peak.load();
+        while (current > peak && !_peak.compare_exchange_weak(peak, current))
+        {
+        }
+        this_thread::sleep_for(duration);
+        --_current;
+    }
+
+    int Peak() const { return _peak.load(); }
+
+private:
+    atomic<int> _current;
+    atomic<int> _peak;
+};
+
+// Runs one request per class, each on its own thread, all at once.
+static void RunConcurrently(RequestScheduler& scheduler, const vector<RequestScheduler::RequestClass>& classes, Concurrency& concurrency)
+{
+    vector<thread> threads;
+    for (size_t i = 0; i < classes.size(); ++i)
+    {
+        threads.emplace_back([&scheduler, &classes, &concurrency, i]()
+        {
+            scheduler.Run(static_cast<uint32_t>(i), classes[i], [&concurrency]() { concurrency.Run(chrono::milliseconds(30)); });
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+static void WaitForWaiting(RequestScheduler& scheduler, uint32_t kind)
+{
+    for (;;)
+    {
+        auto metrics = scheduler.GetMetrics();
+        auto it = metrics.find(kind);
+        if (it != metrics.end() && it->second.waiting != 0)
+        {
+            return;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+void RequestSchedulerTest::ConflictTest()
+{
+    TRACE(__FUNCTION__);
+
+    auto readWifi = Class(RequestScheduler::ReadOnly, L"Wifi");
+    auto writeWifi = Class(RequestScheduler::Mutating, L"Wifi");
+    auto writeTime = Class(RequestScheduler::Mutating, L"Time");
+    auto exclusive = Class(RequestScheduler::Exclusive, L"");
+
+    Test::Utils::EnsureEqual(RequestScheduler::Conflicts(readWifi, readWifi) ? L"true" : L"false", L"false", L"Readers");
+    Test::Utils::EnsureEqual(RequestScheduler::Conflicts(readWifi, writeWifi) ? L"true" : L"false", L"true", L"Reader and writer");
+    Test::Utils::EnsureEqual(RequestScheduler::Conflicts(writeWifi, writeTime) ? L"true" : L"false", L"false", L"Writers of different resources");
+    Test::Utils::EnsureEqual(RequestScheduler::Conflicts(readWifi, exclusive) ? L"true" : L"false", L"true", L"Exclusive");
+}
+
+void RequestSchedulerTest::ReadersTest()
+{
+    TRACE(__FUNCTION__);
+
+    RequestScheduler scheduler;
+    Concurrency concurrency;
+    vector<RequestScheduler::RequestClass> classes(4, Class(RequestScheduler::ReadOnly, L"Wifi"));
+    RunConcurrently(scheduler, classes, concurrency);
+
+    Test::Utils::EnsureEqual(to_wstring(concurrency.Peak()), L"4", L"Readers run together");
+}
+
+void RequestSchedulerTest::WritersTest()
+{
+    TRACE(__FUNCTION__);
+
+    {
+        RequestScheduler scheduler;
+        Concurrency concurrency;
+        vector<RequestScheduler::RequestClass> classes;
+        classes.push_back(Class(RequestScheduler::Mutating, L"Wifi"));
+        classes.push_back(Class(RequestScheduler::ReadOnly, L"Wifi"));
+        classes.push_back(Class(RequestScheduler::Mutating, L"Wifi"));
+        RunConcurrently(scheduler, classes, concurrency);
+
+        Test::Utils::EnsureEqual(to_wstring(concurrency.Peak()), L"1", L"Conflicting requests run alone");
+    }
+
+    {
+        RequestScheduler scheduler;
+        Concurrency concurrency;
+        vector<RequestScheduler::RequestClass> classes;
+        classes.push_back(Class(RequestScheduler::Mutating, L"Wifi"));
+        classes.push_back(Class(RequestScheduler::Mutating, L"Time"));
+        classes.push_back(Class(RequestScheduler::ReadOnly, L"Apps"));
+        RunConcurrently(scheduler, classes, concurrency);
+
+        Test::Utils::EnsureEqual(to_wstring(concurrency.Peak()), L"3", L"Different resources run together");
+    }
+}
+
+void RequestSchedulerTest::ExclusiveTest()
+{
+    TRACE(__FUNCTION__);
+
+    RequestScheduler scheduler;
+    atomic<int> running(0);
+    atomic<bool> overlapped(false);
+
+    vector<thread> threads;
+    for (int i = 0; i < 6; ++i)
+    {
+        threads.emplace_back([&scheduler, &running, &overlapped, i]()
+        {
+            bool exclusive = i % 2 == 0;
+            auto requestClass = exclusive ? Class(RequestScheduler::Exclusive, L"") : Class(RequestScheduler::ReadOnly, L"Apps");
+            scheduler.Run(static_cast<uint32_t>(i), requestClass, [&running, &overlapped, exclusive]()
+            {
+                int current = ++running;
+                this_thread::sleep_for(chrono::milliseconds(10));
+                if (exclusive && (current != 1 || running.load() != 1))
+                {
+                    overlapped = true;
+                }
+                --running;
+            });
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    Test::Utils::EnsureEqual(overlapped ? L"true" : L"false", L"false", L"Exclusive requests run alone");
+}
+
+void RequestSchedulerTest::OrderTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A reader holds Wifi, a writer queues behind it, then another reader
+    // arrives. The second reader must not overtake the writer.
+    RequestScheduler scheduler;
+    wstring log;
+    mutex logMutex;
+    auto append = [&log, &logMutex](const wstring& entry)
+    {
+        lock_guard<mutex> lock(logMutex);
+        log += entry;
+    };
+
+    thread first([&]()
+    {
+        scheduler.Run(1, Class(RequestScheduler::ReadOnly, L"Wifi"), [&]()
+        {
+            append(L"r1 ");
+            WaitForWaiting(scheduler, 3);
+            this_thread::sleep_for(chrono::milliseconds(10));
+        });
+    });
+    this_thread::sleep_for(chrono::milliseconds(10));
+
+    thread writer([&]()
+    {
+        scheduler.Run(2, Class(RequestScheduler::Mutating, L"Wifi"), [&]() { append(L"w "); });
+    });
+    WaitForWaiting(scheduler, 2);
+
+    thread second([&]()
+    {
+        scheduler.Run(3, Class(RequestScheduler::ReadOnly, L"Wifi"), [&]() { append(L"r2 "); });
+    });
+
+    first.join();
+    writer.join();
+    second.join();
+
+    Test::Utils::EnsureEqual(log, L"r1 w r2 ", L"Arrival order kept for conflicting requests");
+
+    auto metrics = scheduler.GetMetrics();
+    Test::Utils::EnsureEqual(to_wstring(metrics[2].completed), L"1", L"Writer completed");
+    Test::Utils::EnsureEqual(to_wstring(metrics[2].peakWaiting), L"1", L"Writer waited");
+    Test::Utils::EnsureEqual(metrics[2].maxWait >= chrono::milliseconds(10) ? L"true" : L"false", L"true", L"Writer wait time");
+    Test::Utils::EnsureEqual(metrics[1].totalRun >= chrono::milliseconds(10) ? L"true" : L"false", L"true", L"Reader run time");
+}
+
+void RequestSchedulerTest::FailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    RequestScheduler scheduler;
+    Test::Utils::EnsureException<DMException>(L"Run", [&scheduler]()
+    {
+        scheduler.Run(1, Class(RequestScheduler::Exclusive, L""), []() { throw DMException("handler failed"); });
+    });
+
+    // The failed request released the device.
+    bool ran = false;
+    scheduler.Run(2, Class(RequestScheduler::Mutating, L"Wifi"), [&ran]() { ran = true; });
+    Test::Utils::EnsureEqual(ran ? L"true" : L"false", L"true", L"Request after a failure");
+    Test::Utils::EnsureEqual(to_wstring(scheduler.GetMetrics()[1].completed), L"1", L"Failed request counted");
+}
+
+void RequestSchedulerTest::MetricsTest()
+{
+    TRACE(__FUNCTION__);
+
+    map<uint32_t, RequestScheduler::KindMetrics> metrics;
+    RequestScheduler::KindMetrics& m = metrics[7];
+    m.waiting = 1;
+    m.running = 1;
+    m.peakWaiting = 3;
+    m.completed = 3;
+    m.totalWait = chrono::milliseconds(40);
+    m.maxWait = chrono::milliseconds(25);
+    m.totalRun = chrono::milliseconds(90);
+    Test::Utils::EnsureEqual(RequestScheduler::MetricsToString(metrics),
+        L"\n  kind 7: completed=3 running=1 waiting=1 peakWaiting=3 avgWaitMs=10 maxWaitMs=25 avgRunMs=30", L"Metrics text");
+
+    metrics[9] = RequestScheduler::KindMetrics();
+    Test::Utils::EnsureEqual(RequestScheduler::MetricsToString(metrics).find(L"kind 9: completed=0 running=0 waiting=0 peakWaiting=0 avgWaitMs=0 maxWaitMs=0 avgRunMs=0") != wstring::npos ? L"true" : L"false", L"true", L"Idle kind");
+}
+
+bool RequestSchedulerTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        ConflictTest();
+        ReadersTest();
+        WritersTest();
+        ExclusiveTest();
+        OrderTest();
+        FailureTest();
+        MetricsTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
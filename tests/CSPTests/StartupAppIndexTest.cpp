@@ -0,0 +1,207 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\StartupAppIndex.h"
+#include "StartupAppIndexTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+// A fake CustomDeviceUI CSP. Each query takes queryDelayMs, standing in for
+// a SyncML round trip, and is counted.
+class FakeCustomDeviceUi
+{
+public:
+    FakeCustomDeviceUi(const wstring& foregroundApp, const vector<wstring>& backgroundApps, int queryDelayMs) :
+        queries(0),
+        _foregroundApp(foregroundApp),
+        _backgroundApps(backgroundApps),
+        _queryDelayMs(queryDelayMs)
+    {
+    }
+
+    StartupAppIndex::GetForegroundApp ForegroundApp()
+    {
+        return [this]()
+        {
+            Query();
+            return _foregroundApp;
+        };
+    }
+
+    StartupAppIndex::GetBackgroundApps BackgroundApps()
+    {
+        return [this]()
+        {
+            Query();
+            return _backgroundApps;
+        };
+    }
+
+    int queries;
+
+private:
+    void Query()
+    {
+        ++queries;
+        if (_queryDelayMs != 0)
+        {
+            this_thread::sleep_for(chrono::milliseconds(_queryDelayMs));
+        }
+    }
+
+    wstring _foregroundApp;
+    vector<wstring> _backgroundApps;
+    int _queryDelayMs;
+};
+
+static wstring AppId(int n)
+{
+    return L"Contoso.App" + to_wstring(n) + L"_8wekyb3d8bbwe";
+}
+
+// 0 = none, 1 = foreground, 2 = background; the order ListApps checks them in.
+static int StartUpKind(const StartupAppIndex& startupApps, const wstring& pkgFamilyName)
+{
+    if (startupApps.IsBackground(pkgFamilyName))
+    {
+        return 2;
+    }
+    return startupApps.IsForeground(pkgFamilyName) ? 1 : 0;
+}
+
+void StartupAppIndexTest::LookupTest()
+{
+    TRACE(__FUNCTION__);
+
+    FakeCustomDeviceUi csp(AppId(1), { AppId(2), AppId(3) }, 0);
+    StartupAppIndex startupApps(csp.ForegroundApp(), csp.BackgroundApps());
+
+    Test::Utils::EnsureEqual(to_wstring(StartUpKind(startupApps, AppId(1))), L"1", L"Foreground app");
+    Test::Utils::EnsureEqual(to_wstring(StartUpKind(startupApps, AppId(2))), L"2", L"Background app");
+    Test::Utils::EnsureEqual(to_wstring(StartUpKind(startupApps, AppId(4))), L"0", L"Other app");
+
+    // Names are matched whole, not as substrings of one another.
+    Test::Utils::EnsureEqual(to_wstring(StartUpKind(startupApps, L"Contoso.App")), L"0", L"Prefix of a background app");
+    Test::Utils::EnsureEqual(to_wstring(StartUpKind(startupApps, L"App2")), L"0", L"Part of a background app");
+
+    // No foreground app is configured.
+    FakeCustomDeviceUi empty(L"", vector<wstring>(), 0);
+    StartupAppIndex noStartupApps(empty.ForegroundApp(), empty.BackgroundApps());
+    Test::Utils::EnsureEqual(to_wstring(StartUpKind(noStartupApps, L"")), L"0", L"Empty name");
+}
+
+void StartupAppIndexTest::QueryCountTest()
+{
+    TRACE(__FUNCTION__);
+
+    FakeCustomDeviceUi csp(AppId(1), { AppId(2) }, 0);
+    StartupAppIndex startupApps(csp.ForegroundApp(), csp.BackgroundApps());
+    for (int i = 0; i < 1000; ++i)
+    {
+        StartUpKind(startupApps, AppId(i));
+    }
+    Test::Utils::EnsureEqual(to_wstring(csp.queries), L"2", L"Queries for 1000 lookups");
+}
+
+void StartupAppIndexTest::BenchmarkTest()
+{
+    TRACE(__FUNCTION__);
+
+    // 200 installed apps; one foreground, every tenth in the background. Each
+    // CSP query takes 1 ms.
+    const int appCount = 200;
+    vector<wstring> inventory;
+    vector<wstring> backgroundApps;
+    for (int i = 0; i < appCount; ++i)
+    {
+        inventory.push_back(AppId(i));
+        if (i % 10 == 3)
+        {
+            backgroundApps.push_back(AppId(i));
+        }
+    }
+
+    // The old ListApps: both queries per app, through IsBackground/IsForeground.
+    FakeCustomDeviceUi perAppCsp(AppId(7), backgroundApps, 1);
+    vector<int> expected;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (const wstring& pkgFamilyName : inventory)
+    {
+        vector<wstring> background = perAppCsp.BackgroundApps()();
+        if (find(background.begin(), background.end(), pkgFamilyName) != background.end())
+        {
+            expected.push_back(2);
+        }
+        else
+        {
+            expected.push_back(perAppCsp.ForegroundApp()() == pkgFamilyName ? 1 : 0);
+        }
+    }
+    long long perAppMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    // ListApps now: the configuration once, then a lookup per app.
+    FakeCustomDeviceUi indexedCsp(AppId(7), backgroundApps, 1);
+    vector<int> actual;
+    start = chrono::steady_clock::now();
+    StartupAppIndex startupApps(indexedCsp.ForegroundApp(), indexedCsp.BackgroundApps());
+    for (const wstring& pkgFamilyName : inventory)
+    {
+        actual.push_back(StartUpKind(startupApps, pkgFamilyName));
+    }
+    long long indexedMs = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count();
+
+    TRACEP(L"Per-app queries: ", perAppCsp.queries);
+    TRACEP(L"Per-app lookup (ms): ", perAppMs);
+    TRACEP(L"Indexed lookup (ms): ", indexedMs);
+
+    Test::Utils::EnsureEqual(to_wstring(indexedCsp.queries), L"2", L"Indexed queries");
+    Test::Utils::EnsureEqual(actual == expected ? L"true" : L"false", L"true", L"Same startup types");
+    Test::Utils::EnsureEqual(indexedMs < perAppMs ? L"true" : L"false", L"true", L"Indexed lookup is faster");
+}
+
+bool StartupAppIndexTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        LookupTest();
+        QueryCountTest();
+        BenchmarkTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
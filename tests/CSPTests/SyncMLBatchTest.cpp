@@ -0,0 +1,136 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\CSPs\SyncMLBatch.h"
+#include "SyncMLBatchTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+// Canned response in the shape returned by ApplyLocalManagementSyncML().
+// Results come back out of order with respect to the statuses on purpose.
+const wchar_t* BatchResponseSyncML = LR"(<SyncML xmlns="SYNCML:SYNCML1.2"><SyncBody>
+    <Status><CmdID>1</CmdID><MsgRef>1</MsgRef><CmdRef>1</CmdRef><Cmd>Get</Cmd><Data>200</Data></Status>
+    <Status><CmdID>2</CmdID><MsgRef>1</MsgRef><CmdRef>2</CmdRef><Cmd>Get</Cmd><Data>404</Data></Status>
+    <Status><CmdID>3</CmdID><MsgRef>1</MsgRef><CmdRef>3</CmdRef><Cmd>Get</Cmd><Data>200</Data></Status>
+    <Status><CmdID>4</CmdID><MsgRef>1</MsgRef><CmdRef>4</CmdRef><Cmd>Replace</Cmd><Data>200</Data></Status>
+    <Results><CmdID>6</CmdID><MsgRef>1</MsgRef><CmdRef>3</CmdRef><Item><Source><LocURI>./DevDetail/Ext/Microsoft/TotalRAM</LocURI></Source><Meta><Format xmlns="syncml:metinf">int</Format></Meta><Data>2048</Data></Item></Results>
+    <Results><CmdID>5</CmdID><MsgRef>1</MsgRef><CmdRef>1</CmdRef><Item><Source><LocURI>./DevInfo/Man</LocURI></Source><Data>Contoso &amp; Co</Data></Item></Results>
+</SyncBody></SyncML>)";
+
+void SyncMLBatchTest::BuildRequestTest()
+{
+    TRACE(__FUNCTION__);
+
+    SyncMLBatch batch;
+    batch.QueueGetString(L"./DevInfo/Man");
+    batch.QueueSet(L"./Vendor/MSFT/Node", 5);
+
+    wstring expected =
+        L"<SyncBody>"
+        L"<Get><CmdID>1</CmdID><Item><Target><LocURI>./DevInfo/Man</LocURI></Target><Meta><Type xmlns=\"syncml:metinf\">text/plain</Type></Meta></Item></Get>"
+        L"<Replace><CmdID>2</CmdID><Item><Target><LocURI>./Vendor/MSFT/Node</LocURI></Target><Meta><Format xmlns=\"syncml:metinf\">int</Format></Meta><Data>5</Data></Item></Replace>"
+        L"</SyncBody>";
+    Test::Utils::EnsureEqual(batch.ToSyncML(), expected, L"Unexpected batch request");
+}
+
+void SyncMLBatchTest::ParseResponseTest()
+{
+    TRACE(__FUNCTION__);
+
+    SyncMLBatch batch;
+    size_t manufacturerIndex = batch.QueueGetString(L"./DevInfo/Man");
+    size_t missingIndex = batch.QueueGetString(L"./DevInfo/Missing");
+    size_t totalRamIndex = batch.QueueGetUInt(L"./DevDetail/Ext/Microsoft/TotalRAM");
+    size_t setIndex = batch.QueueSet(L"./Vendor/MSFT/Node", L"value");
+
+    unsigned int executorCalls = 0;
+    batch.Execute([&executorCalls](const wstring&, wstring& response)
+    {
+        ++executorCalls;
+        response = BatchResponseSyncML;
+    });
+
+    if (executorCalls != 1)
+    {
+        throw Test::Utils::TestFailureException("Expected a single round-trip for the whole batch.");
+    }
+
+    Test::Utils::EnsureEqual(batch.GetString(manufacturerIndex), L"Contoso & Co", L"Unexpected manufacturer");
+    Test::Utils::EnsureEqual(to_wstring(batch.GetUInt(totalRamIndex)), L"2048", L"Unexpected total RAM");
+    Test::Utils::EnsureEqual(to_wstring(batch.GetResult(missingIndex).status), L"404", L"Unexpected status for missing node");
+    if (!batch.Succeeded(setIndex))
+    {
+        throw Test::Utils::TestFailureException("Replace command should have succeeded.");
+    }
+}
+
+void SyncMLBatchTest::PartialFailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    SyncMLBatch batch;
+    batch.QueueGetString(L"./DevInfo/Man");
+    size_t missingIndex = batch.QueueGetString(L"./DevInfo/Missing");
+    batch.QueueGetUInt(L"./DevDetail/Ext/Microsoft/TotalRAM");
+    batch.QueueSet(L"./Vendor/MSFT/Node", L"value");
+    size_t noStatusIndex = batch.QueueExec(L"./Vendor/MSFT/Reboot/RebootNow");
+
+    batch.Execute([](const wstring&, wstring& response)
+    {
+        response = BatchResponseSyncML;
+    });
+
+    wstring value = L"<error>";
+    if (batch.TryGetString(missingIndex, value) || value != L"<error>")
+    {
+        throw Test::Utils::TestFailureException("A failed command must not produce a value.");
+    }
+    if (batch.Succeeded(noStatusIndex))
+    {
+        throw Test::Utils::TestFailureException("A command without a status must not be reported as successful.");
+    }
+    Test::Utils::EnsureException<DMException>("SyncMLBatch::GetString()", [&]() { batch.GetString(missingIndex); });
+}
+
+bool SyncMLBatchTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        BuildRequestTest();
+        ParseResponseTest();
+        PartialFailureTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
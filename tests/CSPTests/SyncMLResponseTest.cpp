@@ -0,0 +1,174 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SharedUtilities\SyncMLResponse.h"
+#include "..\..\src\SharedUtilities\Utils.h"
+#include "SyncMLResponseTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+using namespace Utils;
+
+void SyncMLResponseTest::StatusAndResultsTest()
+{
+    TRACE(__FUNCTION__);
+
+    wstring responseSyncML = LR"(<SyncML xmlns="SYNCML:SYNCML1.2"><SyncHdr><Status><CmdRef>0</CmdRef><Data>100</Data></Status></SyncHdr><SyncBody>
+        <Status><CmdID>1</CmdID><MsgRef>1</MsgRef><CmdRef>1</CmdRef><Cmd>Get</Cmd><Data>200</Data></Status>
+        <Status><CmdID>2</CmdID><MsgRef>1</MsgRef><CmdRef>2</CmdRef><Cmd>Get</Cmd><Data>404</Data></Status>
+        <Results><CmdID>3</CmdID><MsgRef>1</MsgRef><CmdRef>1</CmdRef>
+            <Item><Source><LocURI>./Vendor/MSFT/Store/hash1</LocURI></Source><Meta><Format xmlns="syncml:metinf">node</Format></Meta><Data/></Item>
+            <Item><Source><LocURI>./Vendor/MSFT/Store/hash1/Value</LocURI></Source><Data>1</Data></Item>
+        </Results>
+    </SyncBody></SyncML>)";
+
+    SyncMLResponse response(responseSyncML);
+
+    // The status in <SyncHdr> is not a command status.
+    Test::Utils::EnsureEqual(to_wstring(response.Statuses().size()), L"2", L"Status count");
+    Test::Utils::EnsureEqual(to_wstring(response.Statuses()[0].code), L"200", L"First status");
+    Test::Utils::EnsureEqual(response.Statuses()[1].cmd.str(), L"Get", L"Second status command");
+    Test::Utils::EnsureEqual(to_wstring(response.Statuses()[1].code), L"404", L"Second status");
+
+    Test::Utils::EnsureEqual(to_wstring(response.Items().size()), L"2", L"Item count");
+    if (response.Items()[0].data.present() || !response.Items()[1].data.present())
+    {
+        throw Test::Utils::TestFailureException("Unexpected data presence.");
+    }
+    Test::Utils::EnsureEqual(response.Items()[1].cmdRef.str(), L"1", L"Item CmdRef");
+    Test::Utils::EnsureEqual(response.Items()[1].locUri.str(), L"./Vendor/MSFT/Store/hash1/Value", L"Item LocURI");
+    Test::Utils::EnsureEqual(response.Items()[1].data.str(), L"1", L"Item data");
+
+    // Plain values are not copied.
+    const wchar_t* begin = responseSyncML.c_str();
+    const wchar_t* end = begin + responseSyncML.size();
+    if (response.Items()[1].locUri.data < begin || response.Items()[1].locUri.data >= end)
+    {
+        throw Test::Utils::TestFailureException("Plain values must point into the response.");
+    }
+}
+
+void SyncMLResponseTest::DecodingTest()
+{
+    TRACE(__FUNCTION__);
+
+    wstring responseSyncML = LR"(<syncml:SyncML xmlns:syncml="SYNCML:SYNCML1.2"><syncml:SyncBody>
+        <syncml:Status><syncml:CmdRef>1</syncml:CmdRef><syncml:Data> 200 </syncml:Data></syncml:Status>
+        <syncml:Results><syncml:CmdRef>1</syncml:CmdRef>
+            <syncml:Item><syncml:Data>&lt;xml a="1"/&gt; &amp; &#65;&#x42;</syncml:Data></syncml:Item>
+            <syncml:Item><syncml:Data><![CDATA[<raw & unescaped>]]> tail</syncml:Data></syncml:Item>
+            <!-- <syncml:Item><syncml:Data>commented out</syncml:Data></syncml:Item> -->
+        </syncml:Results>
+    </syncml:SyncBody></syncml:SyncML>)";
+
+    SyncMLResponse response(responseSyncML);
+    Test::Utils::EnsureEqual(to_wstring(response.Statuses()[0].code), L"200", L"Prefixed status");
+    Test::Utils::EnsureEqual(to_wstring(response.Items().size()), L"2", L"Prefixed item count");
+    Test::Utils::EnsureEqual(response.Items()[0].data.str(), L"<xml a=\"1\"/> & AB", L"Entities");
+    Test::Utils::EnsureEqual(response.Items()[1].data.str(), L"<raw & unescaped> tail", L"CDATA");
+}
+
+void SyncMLResponseTest::MalformedResponseTest()
+{
+    TRACE(__FUNCTION__);
+
+    const wchar_t* malformedResponses[] =
+    {
+        L"<SyncML><SyncBody><Status><Data>200</Data></Status>",
+        L"<SyncML><SyncBody></Status></SyncBody></SyncML>",
+        L"<SyncML><SyncBody><Status><Data>200</Data></Status></SyncBody></SyncML",
+        L"<SyncML><SyncBody><![CDATA[</SyncBody></SyncML>",
+    };
+
+    for (const wchar_t* malformedResponse : malformedResponses)
+    {
+        Test::Utils::EnsureException<DMException>("SyncMLResponse::Parse()", [malformedResponse]()
+        {
+            SyncMLResponse response;
+            response.Parse(malformedResponse, wcslen(malformedResponse));
+        });
+    }
+
+    // A status that is not a number is reported as 0.
+    wstring nonNumeric = L"<SyncML><SyncBody><Status><CmdRef>1</CmdRef><Data>abc</Data></Status></SyncBody></SyncML>";
+    SyncMLResponse response(nonNumeric);
+    Test::Utils::EnsureEqual(to_wstring(response.Statuses()[0].code), L"0", L"Non-numeric status");
+}
+
+void SyncMLResponseTest::LargeResponseTest()
+{
+    TRACE(__FUNCTION__);
+
+    // The shape of an EnterpriseModernAppManagement inventory.
+    const size_t appCount = 2000;
+    wstring responseSyncML = L"<SyncML xmlns=\"SYNCML:SYNCML1.2\"><SyncBody><Status><CmdID>1</CmdID><MsgRef>1</MsgRef><CmdRef>1</CmdRef><Cmd>Get</Cmd><Data>200</Data></Status>";
+    responseSyncML += L"<Results><CmdID>2</CmdID><MsgRef>1</MsgRef><CmdRef>1</CmdRef>";
+    for (size_t i = 0; i < appCount; ++i)
+    {
+        wstring app = L"./Device/Vendor/MSFT/EnterpriseModernAppManagement/AppManagement/AppStore/Contoso.App" + to_wstring(i) + L"_1.0.0.0_x86__8wekyb3d8bbwe";
+        responseSyncML += L"<Item><Source><LocURI>" + app + L"/Name</LocURI></Source><Data>Contoso App " + to_wstring(i) + L"</Data></Item>";
+        responseSyncML += L"<Item><Source><LocURI>" + app + L"/Version</LocURI></Source><Data>1.0.0.0</Data></Item>";
+    }
+    responseSyncML += L"</Results><Final/></SyncBody></SyncML>";
+
+    size_t itemCount = 0;
+    std::function<void(vector<wstring>&, wstring&)> handler = [&itemCount](vector<wstring>& uriTokens, wstring&)
+    {
+        if (uriTokens.size() == 9)
+        {
+            ++itemCount;
+        }
+    };
+
+    auto start = chrono::steady_clock::now();
+    Utils::ReadXmlStructData(responseSyncML, handler);
+    auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+    Test::Utils::EnsureEqual(to_wstring(itemCount), to_wstring(appCount * 2), L"Inventory item count");
+    TRACEP(L"ReadXmlStructData() on a large inventory (microseconds): ", duration.count());
+}
+
+bool SyncMLResponseTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        StatusAndResultsTest();
+        DecodingTest();
+        MalformedResponseTest();
+        LargeResponseTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,199 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <chrono>
+#include <thread>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\SystemConfigurator\TaskQueue.h"
+#include "TaskQueueTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+static TaskQueue::Task Append(wstring& log, const wstring& name)
+{
+    return TaskQueue::Task([&log, name]()
+    {
+        log += name;
+        return name;
+    });
+}
+
+static wstring FutureError(future<wstring>& result)
+{
+    try
+    {
+        result.get();
+    }
+    catch (future_error& e)
+    {
+        return e.code() == future_errc::broken_promise ? L"broken_promise" : L"future_error";
+    }
+    return L"none";
+}
+
+void TaskQueueTest::PriorityTest()
+{
+    TRACE(__FUNCTION__);
+
+    TaskQueue queue;
+    wstring log;
+    queue.Enqueue(Append(log, L"b1"), TaskQueue::Bulk);
+    queue.Enqueue(Append(log, L"n1"));
+    queue.Enqueue(Append(log, L"i1"), TaskQueue::Interactive);
+    queue.Enqueue(Append(log, L"b2"), TaskQueue::Bulk);
+    queue.Enqueue(Append(log, L"n2"), TaskQueue::Normal);
+    future<wstring> last = queue.Enqueue(Append(log, L"i2"), TaskQueue::Interactive);
+
+    TaskQueue::Metrics metrics = queue.GetMetrics();
+    Test::Utils::EnsureEqual(to_wstring(metrics.depthByPriority[TaskQueue::Interactive]), L"2", L"Interactive depth");
+    Test::Utils::EnsureEqual(to_wstring(metrics.depthByPriority[TaskQueue::Bulk]), L"2", L"Bulk depth");
+
+    for (int i = 0; i < 6; ++i)
+    {
+        queue.RunOne();
+    }
+
+    Test::Utils::EnsureEqual(log, L"i1i2n1n2b1b2", L"Priority order");
+    Test::Utils::EnsureEqual(last.get(), L"i2", L"Result");
+}
+
+void TaskQueueTest::DeadlineTest()
+{
+    TRACE(__FUNCTION__);
+
+    TaskQueue queue;
+    wstring log;
+    TaskQueue::Clock::time_point now = TaskQueue::Clock::now();
+    future<wstring> expired = queue.Enqueue(Append(log, L"expired"), TaskQueue::Interactive, now - chrono::milliseconds(1));
+    future<wstring> current = queue.Enqueue(Append(log, L"current"), TaskQueue::Normal, now + chrono::hours(1));
+
+    queue.RunOne();
+
+    Test::Utils::EnsureEqual(log, L"current", L"Expired task skipped");
+    Test::Utils::EnsureEqual(current.get(), L"current", L"Current task result");
+    Test::Utils::EnsureEqual(FutureError(expired), L"broken_promise", L"Expired task future");
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().expired), L"1", L"Expired count");
+}
+
+void TaskQueueTest::ShutdownTest()
+{
+    TRACE(__FUNCTION__);
+
+    // A worker waiting on an empty queue wakes up and exits.
+    {
+        TaskQueue queue;
+        bool exited = false;
+        thread worker([&queue, &exited]()
+        {
+            while (queue.RunOne())
+            {
+            }
+            exited = true;
+        });
+        this_thread::sleep_for(chrono::milliseconds(20));
+        queue.Shutdown();
+        worker.join();
+        Test::Utils::EnsureEqual(exited ? L"true" : L"false", L"true", L"Worker exited");
+    }
+
+    // Pending tasks are still handed out...
+    {
+        TaskQueue queue;
+        wstring log;
+        queue.Enqueue(Append(log, L"a"));
+        queue.Enqueue(Append(log, L"b"));
+        queue.Shutdown();
+        future<wstring> late = queue.Enqueue(Append(log, L"late"));
+
+        while (queue.RunOne())
+        {
+        }
+        Test::Utils::EnsureEqual(log, L"ab", L"Pending tasks drained");
+        Test::Utils::EnsureEqual(FutureError(late), L"broken_promise", L"Task enqueued after shutdown");
+        Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().rejected), L"1", L"Rejected count");
+    }
+
+    // ...unless they are dropped.
+    {
+        TaskQueue queue;
+        wstring log;
+        future<wstring> pending = queue.Enqueue(Append(log, L"a"));
+        queue.Shutdown(true /*dropPending*/);
+
+        Test::Utils::EnsureEqual(queue.RunOne() ? L"true" : L"false", L"false", L"Nothing to run");
+        Test::Utils::EnsureEqual(log, L"", L"Pending task dropped");
+        Test::Utils::EnsureEqual(FutureError(pending), L"broken_promise", L"Dropped task future");
+    }
+}
+
+void TaskQueueTest::MetricsTest()
+{
+    TRACE(__FUNCTION__);
+
+    TaskQueue queue;
+    for (int i = 0; i < 3; ++i)
+    {
+        queue.Enqueue(TaskQueue::Task([]()
+        {
+            this_thread::sleep_for(chrono::milliseconds(10));
+            return wstring();
+        }));
+    }
+    Test::Utils::EnsureEqual(to_wstring(queue.GetMetrics().peakDepth), L"3", L"Peak depth");
+
+    this_thread::sleep_for(chrono::milliseconds(10));
+    while (queue.GetMetrics().depth != 0)
+    {
+        queue.RunOne();
+    }
+
+    TaskQueue::Metrics metrics = queue.GetMetrics();
+    Test::Utils::EnsureEqual(to_wstring(metrics.completed), L"3", L"Completed count");
+    Test::Utils::EnsureEqual(metrics.totalRun >= chrono::milliseconds(30) ? L"true" : L"false", L"true", L"Run time");
+
+    // Each task waited at least 10 ms, the later ones also behind the earlier ones.
+    Test::Utils::EnsureEqual(metrics.totalWait >= chrono::milliseconds(60) ? L"true" : L"false", L"true", L"Wait time");
+}
+
+bool TaskQueueTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        PriorityTest();
+        DeadlineTest();
+        ShutdownTest();
+        MetricsTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
@@ -0,0 +1,255 @@
+/*
+Copyright 2017 Microsoft
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense, 
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT 
+LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, 
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH 
+THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <iostream>
+#include "..\..\src\SharedUtilities\DMException.h"
+#include "..\..\src\DMTpm\TpmTokenCache.h"
+#include "TpmTokenCacheTest.h"
+#include "TestUtils.h"
+
+using namespace std;
+
+typedef TpmTokenCache::Clock Clock;
+
+static wstring ToWide(const string& text)
+{
+    return wstring(text.begin(), text.end());
+}
+
+// Stands in for limpet: counts invocations and reads the time from a fake clock.
+class LimpetStub
+{
+public:
+    LimpetStub() :
+        now(Clock::from_time_t(1500000000)),
+        urlCalls(0),
+        tokenCalls(0),
+        withExpiry(true)
+    {}
+
+    TpmTokenCache::UrlSource Urls()
+    {
+        return [this](int logicalId)
+        {
+            ++urlCalls;
+            return "hub" + to_string(logicalId) + ".azure-devices.net/device" + to_string(urlCalls);
+        };
+    }
+
+    TpmTokenCache::TokenSource Tokens()
+    {
+        return [this](int logicalId, unsigned int durationInSeconds)
+        {
+            ++tokenCalls;
+            string token = "SharedAccessSignature sr=hub" + to_string(logicalId) + "&sig=" + to_string(tokenCalls);
+            if (withExpiry)
+            {
+                token += "&se=" + to_string(Clock::to_time_t(now) + durationInSeconds);
+            }
+            return token;
+        };
+    }
+
+    TpmTokenCache::TimeSource Time()
+    {
+        return [this]()
+        {
+            return now;
+        };
+    }
+
+    Clock::time_point now;
+    atomic<int> urlCalls;
+    atomic<int> tokenCalls;
+    bool withExpiry;
+};
+
+void TpmTokenCacheTest::ServiceUrlTest()
+{
+    TRACE(__FUNCTION__);
+
+    LimpetStub limpet;
+    TpmTokenCache cache(limpet.Urls(), limpet.Tokens(), limpet.Time());
+
+    string url = cache.GetServiceUrl(0);
+    limpet.now += chrono::hours(24 * 365);
+    Test::Utils::EnsureEqual(ToWide(cache.GetServiceUrl(0)), ToWide(url), L"Cached url");
+    Test::Utils::EnsureEqual(to_wstring(limpet.urlCalls), L"1", L"One limpet call per slot");
+
+    cache.GetServiceUrl(1);
+    Test::Utils::EnsureEqual(to_wstring(limpet.urlCalls), L"2", L"Slots are cached separately");
+
+    // Changing a slot drops what was cached for it, and only for it.
+    cache.Invalidate(0);
+    Test::Utils::EnsureEqual(cache.GetServiceUrl(0) != url ? L"true" : L"false", L"true", L"Url fetched again");
+    cache.GetServiceUrl(1);
+    Test::Utils::EnsureEqual(to_wstring(limpet.urlCalls), L"3", L"Other slot still cached");
+}
+
+void TpmTokenCacheTest::TokenExpiryTest()
+{
+    TRACE(__FUNCTION__);
+
+    LimpetStub limpet;
+    TpmTokenCache cache(limpet.Urls(), limpet.Tokens(), limpet.Time());
+
+    // An hour-long token is reused for a minute after it was issued...
+    string token = cache.GetSASToken(0, 3600);
+    limpet.now += chrono::seconds(TpmTokenCache::MaxReuseSeconds - 1);
+    Test::Utils::EnsureEqual(cache.GetSASToken(0, 3600) == token ? L"true" : L"false", L"true", L"Token cached");
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"1", L"One limpet call");
+
+    // ...so whoever gets it still has nearly the hour they asked for.
+    Clock::time_point expiry;
+    TpmTokenCache::TryGetTokenExpiry(token, expiry);
+    long long remaining = chrono::duration_cast<chrono::seconds>(expiry - limpet.now).count();
+    Test::Utils::EnsureEqual(remaining > 3600 - TpmTokenCache::MaxReuseSeconds ? L"true" : L"false", L"true", L"Lifetime left in a reused token");
+
+    limpet.now += chrono::seconds(1);
+    Test::Utils::EnsureEqual(cache.GetSASToken(0, 3600) != token ? L"true" : L"false", L"true", L"Token refreshed");
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"2", L"Second limpet call");
+
+    // A different duration is a different token.
+    cache.GetSASToken(0, 60);
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"3", L"Durations cached separately");
+
+    // A short token is reused for a tenth of its lifetime.
+    limpet.now += chrono::seconds(5);
+    cache.GetSASToken(0, 60);
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"3", L"Short token cached");
+    limpet.now += chrono::seconds(1);
+    cache.GetSASToken(0, 60);
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"4", L"Short token refreshed");
+
+    // A token shorter than ten seconds is never reused.
+    cache.GetSASToken(0, 5);
+    cache.GetSASToken(0, 5);
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"6", L"Very short token");
+
+    // Without se=, the token is reused for the same window.
+    limpet.withExpiry = false;
+    TpmTokenCache noExpiryCache(limpet.Urls(), limpet.Tokens(), limpet.Time());
+    noExpiryCache.GetSASToken(1, 3600);
+    limpet.now += chrono::seconds(TpmTokenCache::MaxReuseSeconds - 1);
+    noExpiryCache.GetSASToken(1, 3600);
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"7", L"Reused without se");
+    limpet.now += chrono::seconds(1);
+    noExpiryCache.GetSASToken(1, 3600);
+    Test::Utils::EnsureEqual(to_wstring(limpet.tokenCalls), L"8", L"Refreshed without se");
+
+    Test::Utils::EnsureEqual(TpmTokenCache::TryGetTokenExpiry("SharedAccessSignature sr=a&sig=b&se=1486606191", expiry) ? L"true" : L"false", L"true", L"se parsed");
+    Test::Utils::EnsureEqual(to_wstring(Clock::to_time_t(expiry)), L"1486606191", L"se value");
+    Test::Utils::EnsureEqual(TpmTokenCache::TryGetTokenExpiry("SharedAccessSignature sr=a&sig=b&se=", expiry) ? L"true" : L"false", L"false", L"Empty se");
+}
+
+void TpmTokenCacheTest::CoalescingTest()
+{
+    TRACE(__FUNCTION__);
+
+    // The first fetch is held until every thread has asked for the token.
+    const int threadCount = 8;
+    atomic<int> started(0);
+    atomic<int> fetches(0);
+    TpmTokenCache cache(
+        [](int) { return string(); },
+        [&](int, unsigned int)
+        {
+            ++fetches;
+            while (started < threadCount)
+            {
+                this_thread::yield();
+            }
+            this_thread::sleep_for(chrono::milliseconds(50));
+            return string("SharedAccessSignature sr=hub&sig=shared");
+        });
+
+    vector<string> tokens(threadCount);
+    vector<thread> threads;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back([&, i]()
+        {
+            ++started;
+            tokens[i] = cache.GetSASToken(0, 3600);
+        });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    Test::Utils::EnsureEqual(to_wstring(fetches), L"1", L"One fetch for concurrent requests");
+    for (const auto& token : tokens)
+    {
+        Test::Utils::EnsureEqual(ToWide(token), L"SharedAccessSignature sr=hub&sig=shared", L"Shared token");
+    }
+}
+
+void TpmTokenCacheTest::FailureTest()
+{
+    TRACE(__FUNCTION__);
+
+    int calls = 0;
+    TpmTokenCache cache(
+        [&calls](int) -> string
+        {
+            if (++calls == 1)
+            {
+                throw DMException("limpet failed");
+            }
+            return "hub.azure-devices.net/device0";
+        },
+        [](int, unsigned int) { return string(); });
+
+    // A failure is not cached.
+    Test::Utils::EnsureException<DMException>(L"GetServiceUrl", [&cache]()
+    {
+        cache.GetServiceUrl(0);
+    });
+    Test::Utils::EnsureEqual(ToWide(cache.GetServiceUrl(0)), L"hub.azure-devices.net/device0", L"Fetched after a failure");
+    Test::Utils::EnsureEqual(to_wstring(calls), L"2", L"Call count");
+}
+
+bool TpmTokenCacheTest::RunTest()
+{
+    bool result = true;
+    try
+    {
+        ServiceUrlTest();
+        TokenExpiryTest();
+        CoalescingTest();
+        FailureTest();
+    }
+    catch (DMException& e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+    catch (exception e)
+    {
+        TRACEP("Error: ", e.what());
+
+        cout << "Error: " << e.what() << endl;
+        result = false;
+    }
+
+    return result;
+}
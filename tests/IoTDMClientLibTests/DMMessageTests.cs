@@ -176,6 +176,151 @@ namespace IoTDMClientLibTests
             Assert.AreEqual(appInstallRequestRehydrated.data.Dependencies[1], "jkl");
         }
 
+        [TestMethod]
+        public void TestUtf8PayloadEncoding()
+        {
+            // New blobs carry UTF-8 and flag it in the version word
+            var appInstallRequest = new AppInstallRequest(new AppInstallRequestData() { AppxPath = "d\u00e9f\u00e9", PackageFamilyName = "\u65e5\u672c", Dependencies = new List<String>() });
+            var blob = appInstallRequest.Serialize();
+
+            Assert.IsTrue(blob.IsUtf8Payload);
+            Assert.AreEqual(blob.Version, 1U);
+            Assert.IsTrue(blob.GetByteArrayForSerialization().Length - 8 < blob.PayloadAsString.Length * 2);
+
+            var rehydrated = blob.MakeIRequest() as AppInstallRequest;
+            Assert.AreEqual(rehydrated.data.AppxPath, "d\u00e9f\u00e9");
+            Assert.AreEqual(rehydrated.data.PackageFamilyName, "\u65e5\u672c");
+
+            // Blobs from peers that predate the flag are UTF-16 and still readable
+            var legacyBytes = new List<byte>();
+            legacyBytes.AddRange(BitConverter.GetBytes(1U));
+            legacyBytes.AddRange(BitConverter.GetBytes((UInt32)DMMessageKind.SetTimeInfo));
+            legacyBytes.AddRange(System.Text.Encoding.Unicode.GetBytes("{\"status\":1}"));
+            var legacyBlob = Blob.CreateFromByteArray(legacyBytes.ToArray());
+
+            Assert.IsFalse(legacyBlob.IsUtf8Payload);
+            legacyBlob.ValidateVersion();
+            var response = legacyBlob.MakeIResponse() as StatusCodeResponse;
+            Assert.AreEqual(response.Status, ResponseStatus.Failure);
+            Assert.AreEqual(response.Tag, DMMessageKind.SetTimeInfo);
+
+            // Unknown payload flags are rejected rather than misread
+            legacyBytes[2] = 0x80;
+            var futureBlob = Blob.CreateFromByteArray(legacyBytes.ToArray());
+            bool threw = false;
+            try
+            {
+                futureBlob.ValidateVersion();
+            }
+            catch (Exception)
+            {
+                threw = true;
+            }
+            Assert.IsTrue(threw, "Unknown payload flags should fail version validation");
+        }
+
+        [TestMethod]
+        public void TestBinaryPayloadEncoding()
+        {
+            var apps = new Dictionary<string, AppInfo>();
+            for (int i = 0; i < 2000; ++i)
+            {
+                var pfn = "Contoso.App" + i + "_8wekyb3d8bbwe";
+                apps[pfn] = new AppInfo()
+                {
+                    AppSource = "AppStore", Architecture = "x64", InstallDate = "2017-06-01", InstallLocation = "C:\\Program Files\\WindowsApps\\" + pfn,
+                    IsBundle = "false", IsFramework = "false", IsProvisioned = "true", Name = "Contoso App \u00e9 " + i, PackageFamilyName = pfn,
+                    PackageStatus = "0", Publisher = "CN=Contoso", RequiresReinstall = "false", ResourceID = "", Users = "S-1-5-21", Version = "1.0." + i,
+                    StartUp = StartUpType.Background
+                };
+            }
+            var response = new ListAppsResponse(ResponseStatus.Success, apps);
+
+            var jsonBlob = response.Serialize();
+            var binaryBlob = response.SerializeBinary();
+            Assert.IsFalse(jsonBlob.IsBinaryPayload);
+            Assert.IsTrue(binaryBlob.IsBinaryPayload);
+            Assert.IsTrue(binaryBlob.AcceptsBinaryPayload);
+            binaryBlob.ValidateVersion();
+
+            var rehydrated = binaryBlob.MakeIResponse() as ListAppsResponse;
+            Assert.AreEqual(rehydrated.Status, ResponseStatus.Success);
+            Assert.AreEqual(rehydrated.Apps.Count, 2000);
+            var app = rehydrated.Apps["Contoso.App7_8wekyb3d8bbwe"];
+            Assert.AreEqual(app.Name, "Contoso App \u00e9 7");
+            Assert.AreEqual(app.Version, "1.0.7");
+            Assert.AreEqual(app.ResourceID, "");
+            Assert.AreEqual(app.StartUp, StartUpType.Background);
+
+            var stopwatch = System.Diagnostics.Stopwatch.StartNew();
+            for (int i = 0; i < 10; ++i)
+            {
+                response.Serialize().MakeIResponse();
+            }
+            var jsonTime = stopwatch.Elapsed;
+
+            stopwatch.Restart();
+            for (int i = 0; i < 10; ++i)
+            {
+                response.SerializeBinary().MakeIResponse();
+            }
+            var binaryTime = stopwatch.Elapsed;
+
+            System.Diagnostics.Debug.WriteLine("ListAppsResponse x2000 JSON:   " + jsonBlob.GetByteArrayForSerialization().Length + " bytes, " + (jsonTime.TotalMilliseconds / 10) + " ms/round trip");
+            System.Diagnostics.Debug.WriteLine("ListAppsResponse x2000 binary: " + binaryBlob.GetByteArrayForSerialization().Length + " bytes, " + (binaryTime.TotalMilliseconds / 10) + " ms/round trip");
+
+            // Smaller list and detail responses share the same path
+            var files = new StringListResponse(ResponseStatus.Success);
+            files.List.Add("a.etl");
+            files.List.Add("");
+            var filesRehydrated = files.SerializeBinary().MakeIResponse() as StringListResponse;
+            CollectionAssert.AreEqual(new List<string>(filesRehydrated.List), new List<string>() { "a.etl", "" });
+
+            var details = new GetCertificateDetailsResponse(ResponseStatus.Success) { base64Encoding = "TUlJ", issuedBy = "CA", issuedTo = "device", templateName = "", validFrom = "2017", validTo = "2018" };
+            var detailsRehydrated = details.SerializeBinary().MakeIResponse() as GetCertificateDetailsResponse;
+            Assert.AreEqual(detailsRehydrated.base64Encoding, "TUlJ");
+            Assert.AreEqual(detailsRehydrated.issuedTo, "device");
+            Assert.AreEqual(detailsRehydrated.validTo, "2018");
+        }
+
+#if DEBUG
+        // DMMessage only counts copies in debug builds.
+        [TestMethod]
+        public void TestBlobCopyStatistics()
+        {
+            const int iterations = 100;
+            var command = new AppInstallRequest(new AppInstallRequestData() { AppxPath = "abc", PackageFamilyName = "def", Dependencies = new List<String>() { "ghi", "jkl" } });
+
+            // String transport (SendRequest): the payload leaves as a string and the blob is rebuilt from it
+            BlobStatistics.Reset();
+            for (int i = 0; i < iterations; ++i)
+            {
+                var blob = command.Serialize();
+                var request = Blob.CreateFromJson((uint)blob.Tag, blob.PayloadAsString).MakeIRequest() as AppInstallRequest;
+                Assert.AreEqual(request.data.AppxPath, "abc");
+            }
+            var stringAllocations = BlobStatistics.AllocationCount / iterations;
+            var stringBytesCopied = BlobStatistics.BytesCopied / iterations;
+
+            // Blob transport (SendBlob): the serialized bytes are parsed in place on the receiving side
+            BlobStatistics.Reset();
+            for (int i = 0; i < iterations; ++i)
+            {
+                var bytes = command.Serialize().GetByteArrayForSerialization();
+                var request = Blob.ParseRequest(bytes) as AppInstallRequest;
+                Assert.AreEqual(request.data.AppxPath, "abc");
+            }
+            var viewAllocations = BlobStatistics.AllocationCount / iterations;
+            var viewBytesCopied = BlobStatistics.BytesCopied / iterations;
+
+            System.Diagnostics.Debug.WriteLine("String transport: " + stringAllocations + " allocations, " + stringBytesCopied + " bytes copied per message");
+            System.Diagnostics.Debug.WriteLine("Blob view:        " + viewAllocations + " allocations, " + viewBytesCopied + " bytes copied per message");
+
+            Assert.IsTrue(viewAllocations < stringAllocations);
+            Assert.IsTrue(viewBytesCopied < stringBytesCopied);
+        }
+#endif
+
         [TestMethod]
         public void TestReadFromIInputStream()
         {
@@ -259,6 +404,45 @@ namespace IoTDMClientLibTests
 
         }
 
+        [TestMethod]
+        public void TestMakeMessageThroughput()
+        {
+            // Every request and response crossing the proxy goes through MakeIRequest/MakeIResponse,
+            // so keep an eye on the per-message dispatch cost.
+            const int iterations = 100000;
+            var requestBlob = new GetTimeInfoRequest().Serialize();
+            var responseBlob = new StatusCodeResponse(ResponseStatus.Success, DMMessageKind.SetTimeInfo).Serialize();
+
+            var stopwatch = System.Diagnostics.Stopwatch.StartNew();
+            for (int i = 0; i < iterations; ++i)
+            {
+                Assert.IsNotNull(requestBlob.MakeIRequest() as GetTimeInfoRequest);
+            }
+            var requestTime = stopwatch.Elapsed;
+
+            stopwatch.Restart();
+            for (int i = 0; i < iterations; ++i)
+            {
+                Assert.IsNotNull(responseBlob.MakeIResponse() as StatusCodeResponse);
+            }
+            var responseTime = stopwatch.Elapsed;
+
+            System.Diagnostics.Debug.WriteLine("MakeIRequest:  " + (iterations / requestTime.TotalSeconds).ToString("F0") + " msg/s");
+            System.Diagnostics.Debug.WriteLine("MakeIResponse: " + (iterations / responseTime.TotalSeconds).ToString("F0") + " msg/s");
+
+            var unknown = Blob.CreateFromJson(12, "{}");
+            bool threw = false;
+            try
+            {
+                unknown.MakeIRequest();
+            }
+            catch (Exception)
+            {
+                threw = true;
+            }
+            Assert.IsTrue(threw, "Deserializing an unknown tag should throw");
+        }
+
         [TestMethod]
         public void TestRequestSendToProxy()
         {